@@ -0,0 +1,509 @@
+/// <summary>
+/// BatchMain is the entry point for the offline batch renderer, for
+/// thumbnails and turntables by the thousand. Renders a list of jobs
+/// with CpuVolumeRenderer, several at a time, and writes every frame
+/// to a TGA.
+///
+/// usage: VolumeBatch jobs.txt [--threads n] [--cache MB]
+///
+/// One job per line, blank lines and lines starting with # skipped:
+///   volume.raw [desc=WxHxD[:type][:sx,sy,sz]] [window=level,width]
+///       [transfer=v:r,g,b,a;...] [classification=identity|post-classified|pre-integrated]
+///       [step=scale] [shading=0|1] [size=WxH] [rotation=radians] [distance=d]
+///       [path=orbit|zoom|closeup] [frames=n] [out=name.tga]
+/// A job is one image from rotation and distance, or with a path
+/// frames images along that CameraPath. out may contain %d or %0Nd for
+/// the frame number; without one, jobs of more than one frame get
+/// _NNN inserted before the extension. out defaults to jobNNNN.tga
+/// after the job's line. Anything not given is as in
+/// VolumeRendererHeadless, at 256x256.
+///
+/// Jobs run on --threads renderers at once (one per core by default),
+/// each drawing its tiles on the cores left over, in the order of their
+/// volumes so jobs on the same volume follow each other. Every volume
+/// is loaded once, by the first job to ask for it while the others
+/// wait, and kept in a VolumeCache of --cache MB (2048 by default).
+/// </summary>
+#include "../VolumeRenderer/CameraPath.h"
+#include "../VolumeRenderer/CpuVolumeRenderer.h"
+#include "../VolumeRenderer/ImageWriter.h"
+#include "../VolumeRenderer/Parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	struct Job
+	{
+		int line;
+		std::string file;
+		VolumeDesc desc;
+		bool customWindow;
+		VoxelWindow window;
+		TransferFunction transfer;
+		Classification classification;
+		float stepScale;
+		bool shading;
+		int width;
+		int height;
+		float rotation;
+		float distance;
+		bool hasPath;
+		CameraPath path;
+		int frames;
+		std::string out;
+	};
+
+	struct JobResult
+	{
+		bool ok;
+		std::string error;
+		int images;
+		double renderMs;
+	};
+
+	// Volumes shared by every job, each loaded once: the first job to ask
+	// loads it, the ones asking meanwhile wait for that load.
+	class VolumeStore
+	{
+	public:
+		explicit VolumeStore(const size_t budget) : m_cache(budget), m_loads(0), m_loadMs(0.0) {}
+
+		std::shared_ptr<Volume> Get(const std::string& file, const VolumeDesc& desc, std::string& error)
+		{
+			const std::string key = GetVolumeKey(file, desc);
+			std::promise<Loaded> promise;
+			std::shared_future<Loaded> future;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				std::shared_ptr<Volume> volume = m_cache.Find(file, desc);
+				if (volume)
+				{
+					return volume;
+				}
+				auto pending = m_pending.find(key);
+				if (pending != m_pending.end())
+				{
+					future = pending->second;
+				}
+				else
+				{
+					m_pending[key] = promise.get_future().share();
+				}
+			}
+			if (future.valid())
+			{
+				const Loaded& loaded = future.get();
+				error = loaded.error;
+				return loaded.volume;
+			}
+
+			// this job loads it, like CpuVolumeRenderer::LoadVolume
+			auto start = std::chrono::high_resolution_clock::now();
+			Loaded loaded;
+			loaded.volume = std::make_shared<Volume>();
+			if (!loaded.volume->Load(file, desc) || !loaded.volume->CopyToMemory() || !loaded.volume->BuildMacrocells() || !loaded.volume->BuildMips())
+			{
+				loaded.error = loaded.volume->GetError();
+				loaded.volume = nullptr;
+			}
+			const double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (loaded.volume)
+				{
+					m_cache.Insert(file, desc, loaded.volume);
+				}
+				m_pending.erase(key);
+				++m_loads;
+				m_loadMs += ms;
+			}
+			promise.set_value(loaded);
+			error = loaded.error;
+			return loaded.volume;
+		}
+
+		int GetLoads() const { return m_loads; }
+		double GetLoadMs() const { return m_loadMs; }
+		VolumeCache::Stats GetCacheStats() const { return m_cache.GetStats(); }
+
+	private:
+		struct Loaded
+		{
+			std::shared_ptr<Volume> volume;
+			std::string error;
+		};
+
+		VolumeCache m_cache;
+		std::map<std::string, std::shared_future<Loaded>> m_pending;
+		int m_loads;
+		double m_loadMs;
+		std::mutex m_mutex;
+	};
+
+	bool ParseSize(const std::string& text, int& width, int& height)
+	{
+		char* end = nullptr;
+		long w = strtol(text.c_str(), &end, 10);
+		if (*end != 'x')
+		{
+			return false;
+		}
+		const char* p = end + 1;
+		long h = strtol(p, &end, 10);
+		if (end == p || *end != '\0' || w <= 0 || h <= 0 || w > 16384 || h > 16384)
+		{
+			return false;
+		}
+		width = static_cast<int>(w);
+		height = static_cast<int>(h);
+		return true;
+	}
+
+	bool ParseFloat(const std::string& text, float& value)
+	{
+		char* end = nullptr;
+		value = strtof(text.c_str(), &end);
+		return end != text.c_str() && *end == '\0';
+	}
+
+	// the output name of a frame: %d or %0Nd replaced by the number
+	bool FormatOutput(const std::string& pattern, const int frame, std::string& name)
+	{
+		size_t percent = pattern.find('%');
+		if (percent == std::string::npos)
+		{
+			name = pattern;
+			return true;
+		}
+		size_t p = percent + 1;
+		int width = 0;
+		while (p < pattern.size() && pattern[p] >= '0' && pattern[p] <= '9')
+		{
+			width = width * 10 + (pattern[p++] - '0');
+		}
+		if (p >= pattern.size() || pattern[p] != 'd' || width > 9 || pattern.find('%', p) != std::string::npos)
+		{
+			return false;
+		}
+		std::string number = std::to_string(frame);
+		number.insert(0, std::max(width - static_cast<int>(number.size()), 0), '0');
+		name = pattern.substr(0, percent) + number + pattern.substr(p + 1);
+		return true;
+	}
+
+	bool ParseJob(const std::string& text, const int line, Job& job, std::string& error)
+	{
+		std::istringstream stream(text);
+		stream >> job.file;
+
+		const VolumeCamera camera;
+		job.line = line;
+		job.desc = VolumeDesc(256, 256, 256);
+		job.customWindow = false;
+		job.classification = Classification::Identity;
+		job.stepScale = 1.f;
+		job.shading = false;
+		job.width = 256;
+		job.height = 256;
+		job.rotation = camera.GetRotation();
+		job.distance = camera.GetDistance();
+		job.hasPath = false;
+		job.frames = 1;
+		char name[32];
+		snprintf(name, sizeof(name), "job%04d.tga", line);
+		job.out = name;
+
+		std::string option;
+		while (stream >> option)
+		{
+			const size_t equals = option.find('=');
+			const std::string key = option.substr(0, equals);
+			const std::string value = equals != std::string::npos ? option.substr(equals + 1) : std::string();
+			bool valid = true;
+			if (equals == std::string::npos)
+			{
+				valid = false;
+			}
+			else if (key == "desc")
+			{
+				valid = ParseVolumeDesc(value, job.desc);
+			}
+			else if (key == "window")
+			{
+				float level = 0.f, width = 0.f;
+				const size_t comma = value.find(',');
+				valid = comma != std::string::npos && ParseFloat(value.substr(0, comma), level) && ParseFloat(value.substr(comma + 1), width) && width > 0.f;
+				job.window = VoxelWindow(level, width);
+				job.customWindow = true;
+			}
+			else if (key == "transfer")
+			{
+				valid = ParseTransferFunction(value, job.transfer);
+			}
+			else if (key == "classification")
+			{
+				valid = ParseClassification(value, job.classification);
+			}
+			else if (key == "step")
+			{
+				valid = ParseFloat(value, job.stepScale) && job.stepScale > 0.f;
+			}
+			else if (key == "shading")
+			{
+				valid = value == "0" || value == "1";
+				job.shading = value == "1";
+			}
+			else if (key == "size")
+			{
+				valid = ParseSize(value, job.width, job.height);
+			}
+			else if (key == "rotation")
+			{
+				valid = ParseFloat(value, job.rotation);
+			}
+			else if (key == "distance")
+			{
+				valid = ParseFloat(value, job.distance) && job.distance > 0.f;
+			}
+			else if (key == "path")
+			{
+				valid = CameraPath::FindStandardPath(value, job.path);
+				job.hasPath = true;
+			}
+			else if (key == "frames")
+			{
+				job.frames = atoi(value.c_str());
+				valid = job.frames > 0;
+			}
+			else if (key == "out")
+			{
+				std::string name;
+				job.out = value;
+				valid = !value.empty() && FormatOutput(value, 0, name);
+			}
+			else
+			{
+				valid = false;
+			}
+
+			if (!valid)
+			{
+				error = "invalid option " + option;
+				return false;
+			}
+		}
+
+		// several frames without a frame number in the name get one
+		if (job.frames > 1 && job.out.find('%') == std::string::npos)
+		{
+			const size_t dot = job.out.rfind('.');
+			job.out.insert(dot != std::string::npos ? dot : job.out.size(), "_%03d");
+		}
+		return true;
+	}
+
+	bool ReadJobs(const std::string& file, std::vector<Job>& jobs)
+	{
+		std::ifstream stream(file);
+		if (!stream)
+		{
+			fprintf(stderr, "Could not open %s\n", file.c_str());
+			return false;
+		}
+
+		std::string text;
+		for (int line = 1; std::getline(stream, text); ++line)
+		{
+			const size_t first = text.find_first_not_of(" \t\r");
+			if (first == std::string::npos || text[first] == '#')
+			{
+				continue;
+			}
+
+			Job job;
+			std::string error;
+			if (!ParseJob(text, line, job, error))
+			{
+				fprintf(stderr, "%s:%d: %s\n", file.c_str(), line, error.c_str());
+				return false;
+			}
+			jobs.push_back(job);
+		}
+		return true;
+	}
+
+	JobResult RunJob(CpuVolumeRenderer& renderer, const Job& job, VolumeStore& store)
+	{
+		JobResult result = { false, std::string(), 0, 0.0 };
+		std::shared_ptr<Volume> volume = store.Get(job.file, job.desc, result.error);
+		if (!volume)
+		{
+			return result;
+		}
+		if (renderer.GetWidth() != job.width || renderer.GetHeight() != job.height)
+		{
+			renderer.Initialize(job.width, job.height);
+		}
+		renderer.SetVolume(volume);
+
+		if (job.customWindow)
+		{
+			renderer.SetWindow(job.window);
+		}
+		else
+		{
+			renderer.ClearWindow();
+		}
+		renderer.SetTransferFunction(job.transfer);
+		renderer.SetClassification(job.classification);
+		renderer.SetStepScale(job.stepScale);
+		renderer.SetShading(job.shading);
+
+		VolumeCamera& camera = renderer.GetCamera();
+		for (int frame = 0; frame < job.frames; ++frame)
+		{
+			if (job.hasPath)
+			{
+				job.path.Apply(camera, frame, job.frames);
+			}
+			else
+			{
+				camera.SetRotation(job.rotation);
+				camera.SetDistance(job.distance);
+			}
+			renderer.Render();
+			result.renderMs += renderer.GetFrameStats().renderMs;
+
+			std::string name;
+			FormatOutput(job.out, frame, name);
+			if (!WriteTGA(name, renderer.GetFrame(), renderer.GetWidth(), renderer.GetHeight()))
+			{
+				result.error = "writing " + name + " failed";
+				return result;
+			}
+			++result.images;
+		}
+		result.ok = true;
+		return result;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		printf("usage: VolumeBatch jobs.txt [--threads n] [--cache MB]\n");
+		return 1;
+	}
+
+	int threads = GetWorkerCount();
+	size_t budget = static_cast<size_t>(2048) << 20;
+	for (int i = 2; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if (arg == "--threads" && i + 1 < argc)
+		{
+			threads = atoi(argv[++i]);
+		}
+		else if (arg == "--cache" && i + 1 < argc)
+		{
+			budget = static_cast<size_t>(atoi(argv[++i])) << 20;
+		}
+		else
+		{
+			fprintf(stderr, "Unknown option %s\n", arg.c_str());
+			return 1;
+		}
+	}
+	if (threads <= 0)
+	{
+		fprintf(stderr, "Invalid thread count\n");
+		return 1;
+	}
+
+	std::vector<Job> jobs;
+	if (!ReadJobs(argv[1], jobs))
+	{
+		return 1;
+	}
+
+	// jobs grouped by volume, in file order otherwise
+	std::vector<int> order(jobs.size());
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		order[i] = static_cast<int>(i);
+	}
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+		return GetVolumeKey(jobs[a].file, jobs[a].desc) < GetVolumeKey(jobs[b].file, jobs[b].desc);
+	});
+
+	threads = std::max(1, std::min(threads, static_cast<int>(jobs.size())));
+	const int tileWorkers = std::max(1, GetWorkerCount() / threads);
+	VolumeStore store(budget);
+	std::vector<JobResult> results(jobs.size());
+	std::atomic<int> next(0);
+	std::mutex printMutex;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	auto work = [&]() {
+		CpuVolumeRenderer renderer;
+		renderer.GetScheduler().SetWorkerCount(tileWorkers);
+		for (int i = next++; i < static_cast<int>(order.size()); i = next++)
+		{
+			const Job& job = jobs[order[i]];
+			JobResult& result = results[order[i]];
+			result = RunJob(renderer, job, store);
+			if (!result.ok)
+			{
+				std::lock_guard<std::mutex> lock(printMutex);
+				fprintf(stderr, "%s:%d: %s\n", argv[1], job.line, result.error.c_str());
+			}
+		}
+		renderer.Shutdown();
+	};
+	std::vector<std::thread> pool;
+	for (int i = 1; i < threads; ++i)
+	{
+		pool.emplace_back(work);
+	}
+	work();
+	for (std::thread& t : pool)
+	{
+		t.join();
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	int failed = 0;
+	int images = 0;
+	double megapixels = 0.0;
+	double renderMs = 0.0;
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		failed += results[i].ok ? 0 : 1;
+		images += results[i].images;
+		megapixels += results[i].images * static_cast<double>(jobs[i].width) * jobs[i].height * 1e-6;
+		renderMs += results[i].renderMs;
+	}
+
+	const VolumeCache::Stats cache = store.GetCacheStats();
+	printf("%d jobs (%d failed), %d images, %.1f megapixels in %.2f s on %d threads x %d tile workers\n", static_cast<int>(jobs.size()), failed,
+		images, megapixels, seconds, threads, tileWorkers);
+	printf("%.2f jobs/s, %.2f images/s, %.2f MP/s; %.2f ms rendering per image\n", jobs.size() / seconds, images / seconds, megapixels / seconds,
+		images > 0 ? renderMs / images : 0.0);
+	printf("%d volume loads, %.2f s; cache %llu hits, %llu misses, %llu evictions, %.1f MB resident\n", store.GetLoads(), store.GetLoadMs() * 1e-3,
+		static_cast<unsigned long long>(cache.hits), static_cast<unsigned long long>(cache.misses), static_cast<unsigned long long>(cache.evictions),
+		cache.bytes / (1024.0 * 1024.0));
+	return failed > 0 ? 1 : 0;
+}
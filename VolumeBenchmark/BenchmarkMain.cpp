@@ -0,0 +1,56 @@
+/// <summary>
+/// BenchmarkMain is the entry point for the benchmark tool.
+///
+/// usage: VolumeBenchmark <benchmark> [arguments]
+/// </summary>
+#include "Benchmarks.h"
+#include <cstdio>
+#include <cstring>
+
+struct Benchmark
+{
+	const char* name;
+	const char* usage;
+	int(*run)(int, char*[]);
+};
+
+static const Benchmark g_benchmarks[] =
+{
+	{ "raycast", "raycast [volume.raw] [width] [height] [frames]", RunRayCastBenchmark },
+	{ "macrocells", "macrocells [volume.raw] [width] [height] [frames]", RunMacrocellBenchmark },
+	{ "loader", "loader [volume.raw...]", RunLoaderBenchmark },
+	{ "cache", "cache [budget MB] [volume.raw...]", RunCacheBenchmark },
+	{ "lod", "lod [volume.raw] [width] [height] [frames]", RunLodBenchmark },
+	{ "compression", "compression [volume.raw] [width] [height] [frames] [WxHxD[:type]]", RunCompressionBenchmark },
+	{ "packed", "packed [WxHxD[:type]] [volume.raw...]", RunPackedBenchmark },
+	{ "transfer", "transfer [volume.raw] [width] [height] [frames]", RunTransferBenchmark },
+	{ "gradient", "gradient [volume.raw] [width] [height] [frames]", RunGradientBenchmark },
+	{ "proxy", "proxy [volume.raw]", RunProxyBenchmark },
+	{ "progressive", "progressive [volume.raw] [width] [height] [motion frames]", RunProgressiveBenchmark },
+	{ "temporal", "temporal [volume.raw] [width] [height] [frames]", RunTemporalBenchmark },
+	{ "scheduler", "scheduler [volume.raw] [width] [height] [frames] [workers]", RunSchedulerBenchmark },
+	{ "stats", "stats [WxHxD[:type]] [volume.raw...]", RunStatsBenchmark },
+	{ "suite", "suite [--out suite.json] [--frames n] [--sizes WxH,...] [--steps s,...] [--paths orbit,zoom,closeup]\n"
+		"        [--classification identity|post-classified|pre-integrated] [--layout WxHxD[:type]] [volume.raw...]", RunSuiteBenchmark },
+};
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1)
+	{
+		for (const Benchmark& benchmark : g_benchmarks)
+		{
+			if (strcmp(argv[1], benchmark.name) == 0)
+			{
+				return benchmark.run(argc - 2, argv + 2);
+			}
+		}
+	}
+
+	printf("usage: VolumeBenchmark <benchmark> [arguments]\n");
+	for (const Benchmark& benchmark : g_benchmarks)
+	{
+		printf("  %s\n", benchmark.usage);
+	}
+	return 1;
+}
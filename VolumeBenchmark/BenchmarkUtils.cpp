@@ -0,0 +1,89 @@
+// Helpers shared by the benchmarks: rendering a run of frames, copying the
+// frame out of the renderer and comparing it with a reference.
+#include "Benchmarks.h"
+#include "../VolumeRenderer/CompressedVolume.h"
+#include "../VolumeRenderer/CpuVolumeRenderer.h"
+#include <cmath>
+
+namespace
+{
+	template <typename RenderFn>
+	double RenderFramesWith(CpuVolumeRenderer& renderer, const int frames, std::vector<uint8_t>& image, uint64_t* samples,
+		uint64_t* decoded, RenderFn render)
+	{
+		renderer.GetCamera().SetRotation(1.f);
+
+		double totalMs = 0.0;
+		uint64_t totalSamples = 0;
+		uint64_t totalDecoded = 0;
+		for (int i = 0; i < frames; ++i)
+		{
+			renderer.Update(1.f / 60.f);
+			render();
+			totalMs += renderer.GetFrameStats().renderMs;
+			totalSamples += renderer.GetFrameStats().samples;
+			totalDecoded += renderer.GetFrameStats().bricksDecoded;
+		}
+		if (samples)
+		{
+			*samples = totalSamples;
+		}
+		if (decoded)
+		{
+			*decoded = totalDecoded;
+		}
+
+		CopyFrame(renderer, image);
+		return totalMs / frames;
+	}
+}
+
+double RenderFrames(CpuVolumeRenderer& renderer, const int frames, std::vector<uint8_t>& image, uint64_t* samples)
+{
+	return RenderFramesWith(renderer, frames, image, samples, nullptr, [&]() { renderer.Render(); });
+}
+
+double RenderFrames(CpuVolumeRenderer& renderer, const Volume& volume, const int frames, std::vector<uint8_t>& image,
+	uint64_t* samples, uint64_t* decoded)
+{
+	return RenderFramesWith(renderer, frames, image, samples, decoded, [&]() { renderer.Render(renderer.GetCamera(), volume); });
+}
+
+double RenderFrames(CpuVolumeRenderer& renderer, const CompressedVolume& volume, const int frames, std::vector<uint8_t>& image,
+	uint64_t* samples, uint64_t* decoded)
+{
+	return RenderFramesWith(renderer, frames, image, samples, decoded, [&]() { renderer.Render(renderer.GetCamera(), volume); });
+}
+
+void CopyFrame(const CpuVolumeRenderer& renderer, std::vector<uint8_t>& image)
+{
+	const uint8_t* frame = renderer.GetFrame();
+	image.assign(frame, frame + static_cast<size_t>(renderer.GetWidth()) * renderer.GetHeight() * 4);
+}
+
+void CompareImages(const uint8_t* image, const std::vector<uint8_t>& reference, double& meanDiff, double& psnr)
+{
+	double sum = 0.0;
+	double squared = 0.0;
+	size_t count = 0;
+	for (size_t i = 0; i < reference.size(); i += 4)
+	{
+		for (int c = 0; c < 3; ++c)
+		{
+			double diff = static_cast<double>(image[i + c]) - reference[i + c];
+			sum += std::fabs(diff);
+			squared += diff * diff;
+			++count;
+		}
+	}
+	meanDiff = count > 0 ? sum / count : 0.0;
+	psnr = squared > 0.0 ? 10.0 * std::log10(255.0 * 255.0 * count / squared) : INFINITY;
+}
+
+double GetMeanDiff(const uint8_t* image, const std::vector<uint8_t>& reference)
+{
+	double meanDiff = 0.0;
+	double psnr = 0.0;
+	CompareImages(image, reference, meanDiff, psnr);
+	return meanDiff;
+}
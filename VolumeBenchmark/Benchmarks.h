@@ -0,0 +1,72 @@
+/// <summary>
+/// Benchmarks.h
+///
+/// About:
+/// Entry points of the individual benchmarks. Each one takes
+/// the command line arguments following its name and returns
+/// the process exit code.
+/// </summary>
+#ifndef Benchmarks_h__
+#define Benchmarks_h__
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+class CompressedVolume;
+class CpuVolumeRenderer;
+class Volume;
+
+// scalar vs AVX2 vs AVX-512 ray packet kernels
+int RunRayCastBenchmark(int argc, char* argv[]);
+// macrocell grid build time and empty space skipping speedup
+int RunMacrocellBenchmark(int argc, char* argv[]);
+// background volume loading latency and request deduplication
+int RunLoaderBenchmark(int argc, char* argv[]);
+// dataset switching through the LRU volume cache
+int RunCacheBenchmark(int argc, char* argv[]);
+// mip chain build time and level of detail speedup with distance
+int RunLodBenchmark(int argc, char* argv[]);
+// block compression ratio, error and sampling speed at a few error bounds
+int RunCompressionBenchmark(int argc, char* argv[]);
+// packed volume file size per filter and load speed against RAW
+int RunPackedBenchmark(int argc, char* argv[]);
+// transfer function table updates, post-classified vs pre-integrated quality per step
+int RunTransferBenchmark(int argc, char* argv[]);
+// gradient volume build time and shading speedup over gradients on the fly
+int RunGradientBenchmark(int argc, char* argv[]);
+// proxy geometry tightness, face merging and incremental updates per opacity threshold
+int RunProxyBenchmark(int argc, char* argv[]);
+// progressive refinement, coarse frames in motion and the time to converge when still
+int RunProgressiveBenchmark(int argc, char* argv[]);
+// jittered ray starts and temporal accumulation against short steps, still and turning
+int RunTemporalBenchmark(int argc, char* argv[]);
+// static vs work stealing tile scheduling, frame time and idle time per worker
+int RunSchedulerBenchmark(int argc, char* argv[]);
+// volume histogram and statistics pass, scalar vs AVX2, against reading its sidecar
+int RunStatsBenchmark(int argc, char* argv[]);
+// regression suite, camera paths over datasets, sizes and steps, JSON report
+int RunSuiteBenchmark(int argc, char* argv[]);
+
+// milliseconds since start
+inline double ElapsedMs(const std::chrono::high_resolution_clock::time_point& start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// renders frames from the same start angle, returns ms/frame and copies the last
+// frame to image; samples and bricks decoded are summed over the frames if asked
+double RenderFrames(CpuVolumeRenderer& renderer, int frames, std::vector<uint8_t>& image, uint64_t* samples = nullptr);
+double RenderFrames(CpuVolumeRenderer& renderer, const Volume& volume, int frames, std::vector<uint8_t>& image,
+	uint64_t* samples = nullptr, uint64_t* decoded = nullptr);
+double RenderFrames(CpuVolumeRenderer& renderer, const CompressedVolume& volume, int frames, std::vector<uint8_t>& image,
+	uint64_t* samples = nullptr, uint64_t* decoded = nullptr);
+// copies the renderer's current RGBA frame to image
+void CopyFrame(const CpuVolumeRenderer& renderer, std::vector<uint8_t>& image);
+// mean absolute difference (0-255) and PSNR (dB) of the colour channels of an
+// RGBA image against a reference of the same size
+void CompareImages(const uint8_t* image, const std::vector<uint8_t>& reference, double& meanDiff, double& psnr);
+// the mean absolute difference alone
+double GetMeanDiff(const uint8_t* image, const std::vector<uint8_t>& reference);
+
+#endif // Benchmarks_h__
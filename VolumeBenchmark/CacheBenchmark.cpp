@@ -0,0 +1,74 @@
+// Dataset switching with and without a VolumeCache: cycles through the given
+// volumes a few times and reports the time per switch and the cache counters.
+#include "Benchmarks.h"
+#include "../VolumeRenderer/CpuVolumeRenderer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// ms per switch, -1 if a load failed
+	double SwitchVolumes(CpuVolumeRenderer& renderer, const std::vector<std::string>& files, const int rounds)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int round = 0; round < rounds; ++round)
+		{
+			for (const std::string& file : files)
+			{
+				if (!renderer.LoadVolume(file))
+				{
+					fprintf(stderr, "%s\n", renderer.GetLoadError().c_str());
+					return -1.0;
+				}
+			}
+		}
+		return ElapsedMs(start) / (rounds * files.size());
+	}
+}
+
+int RunCacheBenchmark(int argc, char* argv[])
+{
+	size_t budgetMB = argc > 0 ? static_cast<size_t>(atoi(argv[0])) : 64;
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; ++i)
+	{
+		files.push_back(argv[i]);
+	}
+	if (files.empty())
+	{
+		files.push_back("../VolumeRenderer/foot.raw");
+		files.push_back("../VolumeRenderer/bonsai.raw");
+	}
+	const int rounds = 5;
+
+	CpuVolumeRenderer renderer;
+	renderer.Initialize(16, 16);
+
+	double uncachedMs = SwitchVolumes(renderer, files, rounds);
+	if (uncachedMs < 0.0)
+	{
+		return 1;
+	}
+
+	VolumeCache cache(budgetMB << 20);
+	renderer.SetVolumeCache(&cache);
+	double cachedMs = SwitchVolumes(renderer, files, rounds);
+	if (cachedMs < 0.0)
+	{
+		return 1;
+	}
+
+	VolumeCache::Stats stats = cache.GetStats();
+	printf("%d volumes x %d rounds, %llu MB budget\n", static_cast<int>(files.size()), rounds, static_cast<unsigned long long>(budgetMB));
+	printf("%-10s %12s\n", "cache", "ms/switch");
+	printf("%-10s %12.3f\n", "off", uncachedMs);
+	printf("%-10s %12.3f\n", "on", cachedMs);
+	printf("%llu hits, %llu misses, %llu evictions, %d resident (%.1f MB)\n", static_cast<unsigned long long>(stats.hits),
+		static_cast<unsigned long long>(stats.misses), static_cast<unsigned long long>(stats.evictions), stats.entries,
+		stats.bytes / (1024.0 * 1024.0));
+
+	renderer.Shutdown();
+	return 0;
+}
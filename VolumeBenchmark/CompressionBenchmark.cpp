@@ -0,0 +1,148 @@
+// Block compression at a few error bounds: compression ratio, PSNR and maximum
+// error of the decoded voxels, and the CPU raycaster's speed sampling the
+// compressed volume through its decode caches against the plain LoadVolume
+// buffer (checked against the plain render).
+#include "Benchmarks.h"
+#include "../VolumeRenderer/CompressedVolume.h"
+#include "../VolumeRenderer/CpuVolumeRenderer.h"
+#include "../VolumeRenderer/Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// squared and largest error of the decoded voxels against volume
+	void MeasureError(const Volume& volume, const CompressedVolume& compressed, double& squared, double& maxError)
+	{
+		const int size = CompressedVolume::kBrickSize;
+		std::vector<float> voxels(CompressedVolume::kBrickVoxels);
+		squared = 0.0;
+		maxError = 0.0;
+		DispatchVoxelType(volume.GetDesc().type, [&](auto voxel) {
+			typedef decltype(voxel) T;
+			for (int bz = 0; bz < compressed.GetBricksZ(); ++bz)
+			{
+				for (int by = 0; by < compressed.GetBricksY(); ++by)
+				{
+					for (int bx = 0; bx < compressed.GetBricksX(); ++bx)
+					{
+						compressed.DecodeBrick((bz * compressed.GetBricksY() + by) * compressed.GetBricksX() + bx, voxels.data());
+						int x1 = std::min(size, volume.GetWidth() - bx * size);
+						int y1 = std::min(size, volume.GetHeight() - by * size);
+						int z1 = std::min(size, volume.GetDepth() - bz * size);
+						for (int z = 0; z < z1; ++z)
+						{
+							for (int y = 0; y < y1; ++y)
+							{
+								for (int x = 0; x < x1; ++x)
+								{
+									double error = voxels[(z * size + y) * size + x] - volume.Load<T>(bx * size + x, by * size + y, bz * size + z);
+									squared += error * error;
+									maxError = std::max(maxError, std::fabs(error));
+								}
+							}
+						}
+					}
+				}
+			}
+		});
+	}
+}
+
+int RunCompressionBenchmark(int argc, char* argv[])
+{
+	std::string volumeFile = argc > 0 ? argv[0] : "../VolumeRenderer/foot.raw";
+	int width = argc > 1 ? atoi(argv[1]) : 800;
+	int height = argc > 2 ? atoi(argv[2]) : 600;
+	int frames = argc > 3 ? atoi(argv[3]) : 10;
+	VolumeDesc desc(256, 256, 256);
+	if (argc > 4 && !ParseVolumeDesc(argv[4], desc))
+	{
+		fprintf(stderr, "Invalid volume layout %s, expected WxHxD[:type]\n", argv[4]);
+		return 1;
+	}
+
+	CpuVolumeRenderer renderer;
+	if (!renderer.Initialize(width, height) || frames <= 0)
+	{
+		fprintf(stderr, "Invalid frame size or count\n");
+		return 1;
+	}
+	if (!renderer.LoadVolume(volumeFile, desc))
+	{
+		fprintf(stderr, "%s\n", renderer.GetLoadError().c_str());
+		return 1;
+	}
+
+	// the compressed volume has no mips, compare against full resolution
+	renderer.SetLevelOfDetail(false);
+	const Volume& volume = renderer.GetVolume();
+	double voxels = static_cast<double>(volume.GetWidth()) * volume.GetHeight() * volume.GetDepth();
+
+	// PSNR peak: the whole range of the integer types, the data range of the float ones
+	double peak = 0.0;
+	if (desc.type == VoxelType::UInt8 || desc.type == VoxelType::UInt16)
+	{
+		peak = desc.type == VoxelType::UInt8 ? 255.0 : 65535.0;
+	}
+	else
+	{
+		const MacrocellGrid& grid = volume.GetMacrocells();
+		float lo = grid.GetMin(0);
+		float hi = grid.GetMax(0);
+		for (int i = 1; i < grid.GetCellCount(); ++i)
+		{
+			lo = std::min(lo, grid.GetMin(i));
+			hi = std::max(hi, grid.GetMax(i));
+		}
+		peak = hi - lo;
+	}
+
+	uint64_t baseSamples = 0;
+	uint64_t decoded = 0;
+	std::vector<uint8_t> reference;
+	double baseMs = RenderFrames(renderer, volume, frames, reference, &baseSamples, &decoded);
+
+	printf("%s, %d workers, %.2f MB uncompressed, peak %g\n", GetVoxelTypeName(desc.type), GetWorkerCount(),
+		desc.GetByteSize() / (1024.0 * 1024.0), peak);
+	printf("%-8s %8s %8s %8s %10s %10s %10s %10s %10s %10s\n", "bound", "ratio", "MB", "PSNR", "max err", "build ms",
+		"ms/frame", "Msamp/s", "bricks", "mean diff");
+	printf("%-8s %8s %8.2f %8s %10s %10s %10.2f %10.2f %10s %10.3f\n", "plain", "1.00", desc.GetByteSize() / (1024.0 * 1024.0),
+		"inf", "0", "-", baseMs, baseSamples / (baseMs * 1000.0 * frames), "-", 0.0);
+
+	// bounds as a fraction of the peak
+	const double bounds[] = { 0.0, 0.0025, 0.005, 0.01, 0.02 };
+	for (double bound : bounds)
+	{
+		CompressedVolume compressed;
+		auto start = std::chrono::high_resolution_clock::now();
+		if (!compressed.Compress(volume, static_cast<float>(bound * peak)))
+		{
+			fprintf(stderr, "Compression failed\n");
+			return 1;
+		}
+		double buildMs = ElapsedMs(start);
+
+		double squared = 0.0;
+		double maxError = 0.0;
+		MeasureError(volume, compressed, squared, maxError);
+		double psnr = squared > 0.0 ? 10.0 * std::log10(peak * peak / (squared / voxels)) : INFINITY;
+
+		uint64_t samples = 0;
+		std::vector<uint8_t> image;
+		double ms = RenderFrames(renderer, compressed, frames, image, &samples, &decoded);
+
+		char name[16];
+		snprintf(name, sizeof(name), "%.2f%%", bound * 100.0);
+		printf("%-8s %8.2f %8.2f %8.2f %10g %10.2f %10.2f %10.2f %10llu %10.3f\n", name, compressed.GetCompressionRatio(),
+			compressed.GetMemoryUsage() / (1024.0 * 1024.0), psnr, maxError, buildMs, ms, samples / (ms * 1000.0 * frames),
+			static_cast<unsigned long long>(decoded / frames), GetMeanDiff(image.data(), reference));
+	}
+
+	renderer.Shutdown();
+	return 0;
+}
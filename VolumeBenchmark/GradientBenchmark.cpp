@@ -0,0 +1,110 @@
+// Gradient volume build time for both filters, and what shading from it saves
+// per frame over central differences on the fly, with how many frames it
+// takes for the build to pay for itself. Both are measured on every kernel
+// this CPU supports, each against the baseline on the same kernel.
+#include "Benchmarks.h"
+#include "../VolumeRenderer/CpuVolumeRenderer.h"
+#include "../VolumeRenderer/Parallel.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+int RunGradientBenchmark(int argc, char* argv[])
+{
+	std::string volumeFile = argc > 0 ? argv[0] : "../VolumeRenderer/foot.raw";
+	int width = argc > 1 ? atoi(argv[1]) : 800;
+	int height = argc > 2 ? atoi(argv[2]) : 600;
+	int frames = argc > 3 ? atoi(argv[3]) : 10;
+	const int builds = 5;
+
+	CpuVolumeRenderer renderer;
+	if (!renderer.Initialize(width, height) || frames <= 0)
+	{
+		fprintf(stderr, "Invalid frame size or count\n");
+		return 1;
+	}
+	if (!renderer.LoadVolume(volumeFile))
+	{
+		fprintf(stderr, "%s\n", renderer.GetLoadError().c_str());
+		return 1;
+	}
+
+	Volume& volume = renderer.GetVolume();
+	double voxels = static_cast<double>(volume.GetWidth()) * volume.GetHeight() * volume.GetDepth();
+
+	// the volume alone, then with every mip level as LoadVolume builds them
+	printf("%d workers\n", GetWorkerCount());
+	printf("%-10s %10s %12s %10s %10s\n", "filter", "build ms", "Mvoxels/s", "MB", "+mips ms");
+	const GradientFilter filters[] = { GradientFilter::Central, GradientFilter::Sobel };
+	double buildMs[2];
+	for (int f = 0; f < 2; ++f)
+	{
+		GradientVolume gradients;
+		double ms = 0.0;
+		double chainMs = 0.0;
+		for (int i = 0; i < builds; ++i)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			gradients.Build(volume, filters[f]);
+			ms += ElapsedMs(start);
+
+			start = std::chrono::high_resolution_clock::now();
+			volume.BuildGradients(filters[f]);
+			chainMs += ElapsedMs(start);
+		}
+		buildMs[f] = chainMs / builds;
+		printf("%-10s %10.2f %12.1f %10.2f %10.2f\n", GetGradientFilterName(filters[f]), ms / builds, voxels * builds / (ms * 1.0e3),
+			gradients.GetMemoryUsage() / (1024.0 * 1024.0), buildMs[f]);
+	}
+
+	// per kernel, shaded from gradients on the fly is the baseline and
+	// differences are against it
+	printf("\n%-8s %-14s %10s %10s %10s %10s %12s\n", "kernel", "gradients", "ms/frame", "saved ms", "speedup", "mean diff", "break even");
+	const RayCastPath paths[] = { RayCastPath::Scalar, RayCastPath::AVX2, RayCastPath::AVX512 };
+	for (const RayCastPath path : paths)
+	{
+		if (!IsRayCastPathSupported(path, renderer.GetVolume()))
+		{
+			continue;
+		}
+		renderer.SetRayCastPath(path);
+		const char* kernel = GetRayCastPathName(path);
+
+		std::vector<uint8_t> unshaded, reference;
+		renderer.SetShading(false);
+		renderer.SetGradientVolume(false);
+		double unshadedMs = RenderFrames(renderer, frames, unshaded);
+		renderer.SetShading(true);
+		double referenceMs = RenderFrames(renderer, frames, reference);
+		printf("%-8s %-14s %10.2f %10s %10s %10s %12s\n", kernel, "unshaded", unshadedMs, "-", "-", "-", "-");
+		printf("%-8s %-14s %10.2f %10s %9.2fx %10s %12s\n", kernel, "on the fly", referenceMs, "-", 1.0, "-", "-");
+
+		for (int f = 0; f < 2; ++f)
+		{
+			// built at load time
+			renderer.SetGradientVolume(true, filters[f]);
+			if (!renderer.LoadVolume(volumeFile))
+			{
+				fprintf(stderr, "%s\n", renderer.GetLoadError().c_str());
+				return 1;
+			}
+
+			std::vector<uint8_t> image;
+			double ms = RenderFrames(renderer, frames, image);
+			double saved = referenceMs - ms;
+			char breakEven[32] = "never";
+			if (saved > 0.0)
+			{
+				snprintf(breakEven, sizeof(breakEven), "%.1f frames", buildMs[f] / saved);
+			}
+			printf("%-8s %-14s %10.2f %10.2f %9.2fx %10.3f %12s\n", kernel, GetGradientFilterName(filters[f]), ms, saved, referenceMs / ms,
+				GetMeanDiff(image.data(), reference), breakEven);
+		}
+	}
+	renderer.ClearRayCastPath();
+
+	renderer.Shutdown();
+	return 0;
+}
@@ -0,0 +1,68 @@
+// Background loading: asks VolumeLoader for every file twice in a row (the
+// second request should be deduplicated) and reports the latency of each load.
+#include "Benchmarks.h"
+#include "../VolumeRenderer/VolumeLoader.h"
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+int RunLoaderBenchmark(int argc, char* argv[])
+{
+	std::vector<std::string> files;
+	for (int i = 0; i < argc; ++i)
+	{
+		files.push_back(argv[i]);
+	}
+	if (files.empty())
+	{
+		files.push_back("../VolumeRenderer/foot.raw");
+	}
+
+	VolumeLoader loader;
+	loader.Initialize();
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (const std::string& file : files)
+	{
+		loader.Request(file, VolumeDesc(256, 256, 256));
+		loader.Request(file, VolumeDesc(256, 256, 256));
+	}
+	double requestMs = ElapsedMs(start);
+
+	printf("%-40s %10s %10s %10s\n", "file", "queued ms", "load ms", "ready ms");
+	int failed = 0;
+	while (loader.IsBusy())
+	{
+		VolumeLoader::Result result;
+		if (!loader.Poll(result))
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+
+		if (!result.volume)
+		{
+			printf("%-40s %s\n", result.file.c_str(), result.error.c_str());
+			++failed;
+			continue;
+		}
+		printf("%-40s %10.2f %10.2f %10.2f\n", result.file.c_str(), result.queuedMs, result.loadMs,
+			std::chrono::duration<double, std::milli>(VolumeLoader::Clock::now() - result.requested).count());
+	}
+
+	VolumeLoader::Stats stats = loader.GetStats();
+	int loads = static_cast<int>(stats.completed + stats.failed);
+	printf("%.3f ms to queue %llu requests, %llu deduplicated, %llu cached, %llu completed, %llu failed\n", requestMs,
+		static_cast<unsigned long long>(stats.requests), static_cast<unsigned long long>(stats.deduplicated),
+		static_cast<unsigned long long>(stats.cached),
+		static_cast<unsigned long long>(stats.completed), static_cast<unsigned long long>(stats.failed));
+	if (loads > 0)
+	{
+		printf("queued %.2f ms avg, %.2f ms max; load %.2f ms avg, %.2f ms max\n", stats.totalQueuedMs / loads,
+			stats.maxQueuedMs, stats.totalLoadMs / loads, stats.maxLoadMs);
+	}
+
+	loader.Shutdown();
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,77 @@
+// Mip chain build time for both filters, and what sampling the mip level picked
+// from the projected voxel size saves as the camera backs away from the volume
+// (checked against the full resolution render from the same distance).
+#include "Benchmarks.h"
+#include "../VolumeRenderer/CpuVolumeRenderer.h"
+#include "../VolumeRenderer/Parallel.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+int RunLodBenchmark(int argc, char* argv[])
+{
+	std::string volumeFile = argc > 0 ? argv[0] : "../VolumeRenderer/foot.raw";
+	int width = argc > 1 ? atoi(argv[1]) : 800;
+	int height = argc > 2 ? atoi(argv[2]) : 600;
+	int frames = argc > 3 ? atoi(argv[3]) : 10;
+	const int builds = 5;
+
+	CpuVolumeRenderer renderer;
+	if (!renderer.Initialize(width, height) || frames <= 0)
+	{
+		fprintf(stderr, "Invalid frame size or count\n");
+		return 1;
+	}
+	if (!renderer.LoadVolume(volumeFile))
+	{
+		fprintf(stderr, "%s\n", renderer.GetLoadError().c_str());
+		return 1;
+	}
+
+	Volume& volume = renderer.GetVolume();
+	double voxels = static_cast<double>(volume.GetWidth()) * volume.GetHeight() * volume.GetDepth();
+
+	printf("%d workers\n", GetWorkerCount());
+	printf("%-10s %8s %10s %10s\n", "filter", "levels", "build ms", "GB/s");
+	const MipFilter filters[] = { MipFilter::Gaussian, MipFilter::Box };
+	for (MipFilter filter : filters)
+	{
+		double buildMs = 0.0;
+		for (int i = 0; i < builds; ++i)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			volume.BuildMips(filter);
+			buildMs += ElapsedMs(start);
+		}
+		buildMs /= builds;
+		printf("%-10s %8d %10.2f %10.2f\n", GetMipFilterName(filter), volume.GetMipCount(), buildMs, voxels / (buildMs * 1.0e6));
+	}
+
+	// the box filtered chain from the last build is the one rendered
+	printf("\n%-10s %6s %12s %12s %10s %10s\n", "distance", "level", "full ms", "lod ms", "speedup", "mean diff");
+	const float distances[] = { 5.f, 10.f, 20.f, 40.f };
+	for (float distance : distances)
+	{
+		renderer.GetCamera().SetDistance(distance);
+
+		std::vector<uint8_t> reference;
+		renderer.SetLevelOfDetail(false);
+		double fullMs = RenderFrames(renderer, frames, reference);
+
+		std::vector<uint8_t> image;
+		renderer.SetLevelOfDetail(true);
+		double lodMs = RenderFrames(renderer, frames, image);
+
+		double diff = 0.0;
+		for (size_t i = 0; i < image.size(); ++i)
+		{
+			diff += abs(static_cast<int>(image[i]) - static_cast<int>(reference[i]));
+		}
+		printf("%-10.1f %6d %12.2f %12.2f %9.2fx %10.3f\n", distance, renderer.GetFrameStats().lod, fullMs, lodMs,
+			fullMs / lodMs, diff / image.size());
+	}
+
+	renderer.Shutdown();
+	return 0;
+}
@@ -0,0 +1,90 @@
+// Macrocell grid build time for a few cell sizes, and what empty space skipping
+// with each grid saves the CPU raycaster (checked against a render without it).
+#include "Benchmarks.h"
+#include "../VolumeRenderer/CpuVolumeRenderer.h"
+#include "../VolumeRenderer/Parallel.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+int RunMacrocellBenchmark(int argc, char* argv[])
+{
+	std::string volumeFile = argc > 0 ? argv[0] : "../VolumeRenderer/foot.raw";
+	int width = argc > 1 ? atoi(argv[1]) : 800;
+	int height = argc > 2 ? atoi(argv[2]) : 600;
+	int frames = argc > 3 ? atoi(argv[3]) : 10;
+	const int builds = 10;
+
+	CpuVolumeRenderer renderer;
+	if (!renderer.Initialize(width, height) || frames <= 0)
+	{
+		fprintf(stderr, "Invalid frame size or count\n");
+		return 1;
+	}
+	if (!renderer.LoadVolume(volumeFile))
+	{
+		fprintf(stderr, "%s\n", renderer.GetLoadError().c_str());
+		return 1;
+	}
+
+	// the grids are rebuilt on the full resolution volume, so always sample that
+	renderer.SetLevelOfDetail(false);
+	Volume& volume = renderer.GetVolume();
+	double voxels = static_cast<double>(volume.GetWidth()) * volume.GetHeight() * volume.GetDepth();
+
+	// reference: every step sampled
+	renderer.SetEmptySpaceSkipping(false);
+	uint64_t baseSamples = 0;
+	std::vector<uint8_t> reference;
+	double baseMs = RenderFrames(renderer, frames, reference, &baseSamples);
+	renderer.SetEmptySpaceSkipping(true);
+
+	printf("kernel %s, %d workers\n", GetRayCastPathName(renderer.GetFrameStats().path), GetWorkerCount());
+	printf("%-6s %10s %10s %10s %12s %12s %10s %10s\n", "cells", "build ms", "GB/s", "occupied", "ms/frame", "samples", "speedup", "max diff");
+	printf("%-6s %10s %10s %10s %12.2f %12llu %9.2fx %10d\n", "off", "-", "-", "-", baseMs,
+		static_cast<unsigned long long>(baseSamples / frames), 1.0, 0);
+
+	const int cellSizes[] = { 8, 16, 32 };
+	for (int cellSize : cellSizes)
+	{
+		double buildMs = 0.0;
+		for (int i = 0; i < builds; ++i)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			volume.BuildMacrocells(cellSize);
+			buildMs += ElapsedMs(start);
+		}
+		buildMs /= builds;
+
+		const MacrocellGrid& grid = volume.GetMacrocells();
+		float opacity[256];
+		MacrocellGrid::GetIdentityOpacity(opacity);
+		std::vector<uint8_t> occupancy;
+		grid.Classify(opacity, VoxelWindow::GetDefault(volume.GetDesc().type), occupancy);
+		int occupied = 0;
+		for (int i = 0; i < grid.GetCellCount(); ++i)
+		{
+			occupied += occupancy[i];
+		}
+
+		uint64_t samples = 0;
+		std::vector<uint8_t> image;
+		double ms = RenderFrames(renderer, frames, image, &samples);
+
+		int maxDiff = 0;
+		for (size_t i = 0; i < image.size(); ++i)
+		{
+			int diff = abs(static_cast<int>(image[i]) - static_cast<int>(reference[i]));
+			maxDiff = diff > maxDiff ? diff : maxDiff;
+		}
+
+		char name[16];
+		snprintf(name, sizeof(name), "%d^3", cellSize);
+		printf("%-6s %10.2f %10.2f %9.1f%% %12.2f %12llu %9.2fx %10d\n", name, buildMs, voxels / (buildMs * 1.0e6),
+			100.0 * occupied / grid.GetCellCount(), ms, static_cast<unsigned long long>(samples / frames), baseMs / ms, maxDiff);
+	}
+
+	renderer.Shutdown();
+	return 0;
+}
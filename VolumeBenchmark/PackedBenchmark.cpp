@@ -0,0 +1,143 @@
+// Packed (.pvol) volume files: size and write time with each filter, and how
+// fast they load compared to mapping the RAW file. Both loads end with a pass
+// over every voxel, so the mapping's page faults are counted too. Files are
+// read warm from the page cache; the ratio is how much less a cold load reads.
+#include "Benchmarks.h"
+#include "../VolumeRenderer/PackedVolume.h"
+#include "../VolumeRenderer/Parallel.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// reads every voxel so lazily mapped pages are faulted in
+	uint64_t Touch(const Volume& volume)
+	{
+		const uint8_t* data = volume.GetData();
+		const size_t size = volume.GetDesc().GetByteSize();
+		uint64_t sum = 0;
+		for (size_t i = 0; i < size; i += sizeof(uint64_t))
+		{
+			uint64_t word = 0;
+			memcpy(&word, data + i, std::min(sizeof(uint64_t), size - i));
+			sum += word;
+		}
+		return sum;
+	}
+
+	// best of loads, ms
+	template <typename LoadFunc>
+	double TimeLoad(const int loads, LoadFunc&& load)
+	{
+		double best = 0.0;
+		for (int i = 0; i < loads; ++i)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			if (!load())
+			{
+				return -1.0;
+			}
+			double ms = ElapsedMs(start);
+			best = i == 0 || ms < best ? ms : best;
+		}
+		return best;
+	}
+}
+
+int RunPackedBenchmark(int argc, char* argv[])
+{
+	// an optional layout first, the bundled datasets are all 256^3 uint8
+	VolumeDesc desc(256, 256, 256);
+	int first = argc > 0 && ParseVolumeDesc(argv[0], desc) ? 1 : 0;
+	std::vector<std::string> files(argv + first, argv + argc);
+	if (files.empty())
+	{
+		files.push_back("../VolumeRenderer/foot.raw");
+		files.push_back("../VolumeRenderer/skull.raw");
+		files.push_back("../VolumeRenderer/bonsai.raw");
+		files.push_back("../VolumeRenderer/aneurism.raw");
+	}
+	const int loads = 5;
+	const double megabytes = desc.GetByteSize() / (1024.0 * 1024.0);
+
+	printf("%s, %d workers, %.2f MB per volume, best of %d loads\n", GetVoxelTypeName(desc.type), GetWorkerCount(), megabytes, loads);
+	printf("%-32s %-8s %10s %8s %10s %10s %10s %8s\n", "file", "filter", "MB", "ratio", "write ms", "load ms", "GB/s", "speedup");
+
+	int failed = 0;
+	for (const std::string& file : files)
+	{
+		Volume raw;
+		uint64_t expected = 0;
+		double rawMs = TimeLoad(loads, [&]() {
+			// a fresh mapping every time, the old one would keep its pages
+			Volume volume;
+			if (!volume.LoadRaw(file, desc))
+			{
+				fprintf(stderr, "%s\n", volume.GetError().c_str());
+				return false;
+			}
+			expected = Touch(volume);
+			return true;
+		});
+		if (rawMs < 0.0 || !raw.LoadRaw(file, desc))
+		{
+			++failed;
+			continue;
+		}
+		printf("%-32s %-8s %10.2f %8.2f %10s %10.2f %10.2f %7.2fx\n", file.c_str(), "raw", megabytes, 1.0, "-", rawMs,
+			desc.GetByteSize() / (rawMs * 1.0e6), 1.0);
+
+		const PackedFilter filters[] = { PackedFilter::None, PackedFilter::Delta, PackedFilter::DeltaPlanes, PackedFilter::Auto };
+		const std::string packedFile = file + ".pvol";
+		for (PackedFilter filter : filters)
+		{
+			// byte planes only differ from delta for multi byte voxels
+			if (filter == PackedFilter::DeltaPlanes && GetVoxelSize(desc.type) == 1)
+			{
+				continue;
+			}
+
+			std::string error;
+			auto start = std::chrono::high_resolution_clock::now();
+			if (!WritePackedVolume(raw, packedFile, filter, kDefaultPackedChunkSize, error))
+			{
+				fprintf(stderr, "%s\n", error.c_str());
+				++failed;
+				break;
+			}
+			double writeMs = ElapsedMs(start);
+
+			uint64_t sum = 0;
+			double loadMs = TimeLoad(loads, [&]() {
+				Volume volume;
+				if (!volume.LoadPacked(packedFile))
+				{
+					fprintf(stderr, "%s\n", volume.GetError().c_str());
+					return false;
+				}
+				sum = Touch(volume);
+				return true;
+			});
+
+			// checked outside the timed loads
+			Volume packed;
+			MappedFile written;
+			if (loadMs < 0.0 || sum != expected || !packed.LoadPacked(packedFile) ||
+				memcmp(packed.GetData(), raw.GetData(), desc.GetByteSize()) != 0 || !written.Open(packedFile))
+			{
+				fprintf(stderr, "%s: %s filter doesn't load back to the same voxels\n", file.c_str(), GetPackedFilterName(filter));
+				++failed;
+				continue;
+			}
+			double packedMegabytes = written.GetSize() / (1024.0 * 1024.0);
+			printf("%-32s %-8s %10.2f %8.2f %10.2f %10.2f %10.2f %7.2fx\n", "", GetPackedFilterName(filter), packedMegabytes,
+				megabytes / packedMegabytes, writeMs, loadMs, desc.GetByteSize() / (loadMs * 1.0e6), rawMs / loadMs);
+		}
+		remove(packedFile.c_str());
+	}
+
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,102 @@
+// Progressive refinement: frames of a rotating camera, each a coarse image,
+// then the camera held still until the image has converged. Reports the
+// coarse frame's cost against a full quality one, the time to the first and
+// to the converged image, and how far each is from the full quality render.
+#include "Benchmarks.h"
+#include "../VolumeRenderer/CpuVolumeRenderer.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace
+{
+	void Run(CpuVolumeRenderer& renderer, const char* name, const int motionFrames, const int maxFrames)
+	{
+		renderer.SetProgressive(false);
+		renderer.GetCamera().SetRotation(1.f);
+		double fullMs = 0.0;
+		for (int i = 0; i < motionFrames; ++i)
+		{
+			renderer.Update(1.f / 60.f);
+			renderer.Render();
+			fullMs += renderer.GetFrameStats().renderMs;
+		}
+		std::vector<uint8_t> reference;
+		CopyFrame(renderer, reference);
+
+		// the same path, every frame a changed view
+		renderer.SetProgressive(true);
+		renderer.GetCamera().SetRotation(1.f);
+		double coarseMs = 0.0;
+		for (int i = 0; i < motionFrames; ++i)
+		{
+			renderer.Update(1.f / 60.f);
+			renderer.Render();
+			coarseMs += renderer.GetProgressiveStats().firstImageMs;
+		}
+		const double coarseDiff = GetMeanDiff(renderer.GetFrame(), reference);
+
+		// held still on the last view
+		const CpuVolumeRenderer::ProgressiveStats& stats = renderer.GetProgressiveStats();
+		const double firstImageMs = stats.firstImageMs;
+		double fullQualityMs = -1.0;
+		double fullQualityDiff = 0.0;
+		while (!stats.converged && stats.frames < maxFrames)
+		{
+			renderer.Render();
+			if (fullQualityMs < 0.0 && stats.tier == 1 && stats.coverage == 1.f)
+			{
+				fullQualityMs = stats.renderMs;
+				fullQualityDiff = GetMeanDiff(renderer.GetFrame(), reference);
+			}
+		}
+
+		printf("%-16s %9.2f %9.2f %7.1fx %9.2f %9.2f %9.2f %9.2f %7d %5d %9.3f %9.3f %9.3f\n", name, fullMs / motionFrames, coarseMs / motionFrames,
+			coarseMs > 0.0 ? fullMs / coarseMs : 0.0, firstImageMs, fullQualityMs, stats.convergedMs, stats.renderMs, stats.frames, stats.tier,
+			coarseDiff, fullQualityDiff, GetMeanDiff(renderer.GetFrame(), reference));
+	}
+}
+
+int RunProgressiveBenchmark(int argc, char* argv[])
+{
+	std::string volumeFile = argc > 0 ? argv[0] : "../VolumeRenderer/foot.raw";
+	int width = argc > 1 ? atoi(argv[1]) : 800;
+	int height = argc > 2 ? atoi(argv[2]) : 600;
+	int frames = argc > 3 ? atoi(argv[3]) : 10;
+	const int maxFrames = 200;
+
+	CpuVolumeRenderer renderer;
+	if (!renderer.Initialize(width, height) || frames <= 0)
+	{
+		fprintf(stderr, "Invalid frame size or count\n");
+		return 1;
+	}
+	if (!renderer.LoadVolume(volumeFile))
+	{
+		fprintf(stderr, "%s\n", renderer.GetLoadError().c_str());
+		return 1;
+	}
+
+	// motion: ms per frame at full quality and coarse; still: ms to the first
+	// image, the full quality one and converged, frames and tiers it took;
+	// mean RGB difference to the full quality render of each
+	printf("%-16s %9s %9s %8s %9s %9s %9s %9s %7s %5s %9s %9s %9s\n", "classification", "full ms", "coarse ms", "speedup", "first ms",
+		"full q ms", "conv ms", "render ms", "frames", "tier", "diff 1st", "diff full", "diff conv");
+
+	Run(renderer, "identity", frames, maxFrames);
+
+	std::vector<TransferPoint> points = {
+		{ 0.f, 0.f, 0.f, 0.f, 0.f },
+		{ 0.2f, 1.f, 0.5f, 0.2f, 0.f },
+		{ 0.3f, 1.f, 0.6f, 0.4f, 0.3f },
+		{ 0.45f, 1.f, 1.f, 1.f, 0.9f },
+		{ 1.f, 1.f, 1.f, 1.f, 0.9f } };
+	renderer.SetTransferFunction(TransferFunction(points));
+	renderer.SetClassification(Classification::PostClassified);
+	Run(renderer, "post-classified", frames, maxFrames);
+
+	renderer.Shutdown();
+	return 0;
+}
@@ -0,0 +1,113 @@
+// Proxy geometry around the occupied macrocells as the opacity threshold is
+// raised step by step: how tight it is, how much face merging saves, and what
+// re-meshing only the changed planes costs against building from scratch.
+#include "Benchmarks.h"
+#include "../VolumeRenderer/CpuVolumeRenderer.h"
+#include "../VolumeRenderer/ProxyGeometry.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// the identity, transparent below the threshold
+	void GetThresholdOpacity(const float threshold, float opacity[256])
+	{
+		MacrocellGrid::GetIdentityOpacity(opacity);
+		for (int v = 0; v < 256; ++v)
+		{
+			opacity[v] = opacity[v] > threshold ? opacity[v] : 0.f;
+		}
+	}
+
+	bool IsSameMesh(const ProxyGeometry& a, const ProxyGeometry& b)
+	{
+		if (a.GetIndices() != b.GetIndices() || a.GetVertices().size() != b.GetVertices().size())
+		{
+			return false;
+		}
+		for (size_t i = 0; i < a.GetVertices().size(); ++i)
+		{
+			const Vec3& p = a.GetVertices()[i];
+			const Vec3& q = b.GetVertices()[i];
+			if (p.x != q.x || p.y != q.y || p.z != q.z)
+			{
+				return false;
+			}
+		}
+		return a.GetFaceCount() == b.GetFaceCount();
+	}
+
+	// fraction of the [-1,1] cube inside the bounds
+	double GetBoundsFraction(const ProxyGeometry& proxy)
+	{
+		const Vec3 size = proxy.GetMax() - proxy.GetMin();
+		return size.x > 0.f ? size.x * size.y * size.z / 8.0 : 0.0;
+	}
+}
+
+int RunProxyBenchmark(int argc, char* argv[])
+{
+	std::string volumeFile = argc > 0 ? argv[0] : "../VolumeRenderer/bonsai.raw";
+	const int steps = 10;
+	const int builds = 20;
+
+	CpuVolumeRenderer renderer;
+	if (!renderer.Initialize(64, 64))
+	{
+		fprintf(stderr, "Invalid frame size\n");
+		return 1;
+	}
+	if (!renderer.LoadVolume(volumeFile))
+	{
+		fprintf(stderr, "%s\n", renderer.GetLoadError().c_str());
+		return 1;
+	}
+
+	const Volume& volume = renderer.GetVolume();
+	const MacrocellGrid& grid = volume.GetMacrocells();
+	const VoxelWindow window = VoxelWindow::GetDefault(volume.GetDesc().type);
+	printf("%dx%dx%d cells of %d voxels\n", grid.GetCellsX(), grid.GetCellsY(), grid.GetCellsZ(), grid.GetCellSize());
+	printf("%-9s %9s %8s %8s %7s %9s %9s %10s %10s %8s\n", "threshold", "occupied", "faces", "quads", "merge", "bounds", "build ms",
+		"update ms", "planes", "matches");
+
+	// the incremental proxy follows the threshold, the reference is built anew each step
+	ProxyGeometry proxy;
+	std::vector<uint8_t> occupancy;
+	for (int step = 0; step < steps; ++step)
+	{
+		const float threshold = 0.05f * step;
+		float opacity[256];
+		GetThresholdOpacity(threshold, opacity);
+		grid.Classify(opacity, window, occupancy);
+
+		int occupied = 0;
+		for (int i = 0; i < grid.GetCellCount(); ++i)
+		{
+			occupied += occupancy[i];
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+		int planes = proxy.Update(volume, occupancy);
+		double updateMs = ElapsedMs(start);
+
+		ProxyGeometry reference;
+		double buildMs = 0.0;
+		for (int i = 0; i < builds; ++i)
+		{
+			reference.Shutdown();
+			start = std::chrono::high_resolution_clock::now();
+			reference.Update(volume, occupancy);
+			buildMs += ElapsedMs(start);
+		}
+
+		const bool matches = IsSameMesh(proxy, reference);
+		printf("%-9.2f %8.1f%% %8d %8d %6.1fx %8.1f%% %9.3f %10.3f %10d %8s\n", threshold, 100.0 * occupied / grid.GetCellCount(),
+			proxy.GetFaceCount(), proxy.GetQuadCount(), proxy.GetQuadCount() > 0 ? static_cast<double>(proxy.GetFaceCount()) / proxy.GetQuadCount() : 0.0,
+			100.0 * GetBoundsFraction(proxy), buildMs / builds, updateMs, planes, matches ? "yes" : "NO");
+	}
+
+	renderer.Shutdown();
+	return 0;
+}
@@ -0,0 +1,87 @@
+// Compares samples/second of the scalar and SIMD ray packet kernels over the
+// same frames, and checks the SIMD images against the scalar one.
+#include "Benchmarks.h"
+#include "../VolumeRenderer/CpuVolumeRenderer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+int RunRayCastBenchmark(int argc, char* argv[])
+{
+	std::string volumeFile = argc > 0 ? argv[0] : "../VolumeRenderer/foot.raw";
+	int width = argc > 1 ? atoi(argv[1]) : 800;
+	int height = argc > 2 ? atoi(argv[2]) : 600;
+	int frames = argc > 3 ? atoi(argv[3]) : 10;
+
+	CpuVolumeRenderer renderer;
+	if (!renderer.Initialize(width, height) || frames <= 0)
+	{
+		fprintf(stderr, "Invalid frame size or count\n");
+		return 1;
+	}
+	if (!renderer.LoadVolume(volumeFile))
+	{
+		fprintf(stderr, "%s\n", renderer.GetLoadError().c_str());
+		return 1;
+	}
+
+	// kernel throughput only, MacrocellBenchmark covers empty space skipping
+	// and LodBenchmark the mip levels
+	renderer.SetEmptySpaceSkipping(false);
+	renderer.SetLevelOfDetail(false);
+
+	const RayCastPath paths[] = { RayCastPath::Scalar, RayCastPath::AVX2, RayCastPath::AVX512 };
+	double scalarRate = 0.0;
+	std::vector<uint8_t> reference;
+
+	printf("%-8s %12s %16s %10s %10s %10s\n", "path", "ms/frame", "samples/s", "speedup", "max diff", "saved");
+	for (RayCastPath path : paths)
+	{
+		if (!IsRayCastPathSupported(path, renderer.GetVolume()))
+		{
+			printf("%-8s %12s\n", GetRayCastPathName(path), "unsupported");
+			continue;
+		}
+
+		renderer.SetRayCastPath(path);
+		renderer.GetCamera().SetRotation(1.f);
+
+		double totalMs = 0.0;
+		uint64_t samples = 0;
+		uint64_t saved = 0;
+		for (int i = 0; i < frames; ++i)
+		{
+			renderer.Update(1.f / 60.f);
+			renderer.Render();
+			totalMs += renderer.GetFrameStats().renderMs;
+			samples += renderer.GetFrameStats().samples;
+			saved += renderer.GetFrameStats().samplesSaved;
+		}
+
+		// compare the last frame against the scalar kernel's
+		const uint8_t* frame = renderer.GetFrame();
+		size_t bytes = static_cast<size_t>(width) * height * 4;
+		int maxDiff = 0;
+		if (reference.empty())
+		{
+			reference.assign(frame, frame + bytes);
+		}
+		for (size_t i = 0; i < bytes; ++i)
+		{
+			int diff = abs(static_cast<int>(frame[i]) - static_cast<int>(reference[i]));
+			maxDiff = diff > maxDiff ? diff : maxDiff;
+		}
+
+		double rate = samples / (totalMs / 1000.0);
+		if (path == RayCastPath::Scalar)
+		{
+			scalarRate = rate;
+		}
+		printf("%-8s %12.2f %16.3e %9.2fx %10d %9.1f%%\n", GetRayCastPathName(path), totalMs / frames, rate,
+			scalarRate > 0.0 ? rate / scalarRate : 0.0, maxDiff, 100.0 * saved / (samples + saved));
+	}
+
+	renderer.Shutdown();
+	return 0;
+}
@@ -0,0 +1,89 @@
+// Tile scheduling across the workers: a static split into equal runs of tiles
+// (what bands of rows amount to), work stealing, and work stealing with the
+// split weighted by the frame before's tile times. Reports the frame time and
+// how unevenly the work fell: the busiest worker over the mean, and how long
+// workers sat idle while the frame was still being drawn.
+#include "Benchmarks.h"
+#include "../VolumeRenderer/CpuVolumeRenderer.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace
+{
+	struct Config
+	{
+		const char* name;
+		bool stealing;
+		bool costHints;
+	};
+}
+
+int RunSchedulerBenchmark(int argc, char* argv[])
+{
+	std::string volumeFile = argc > 0 ? argv[0] : "../VolumeRenderer/foot.raw";
+	int width = argc > 1 ? atoi(argv[1]) : 800;
+	int height = argc > 2 ? atoi(argv[2]) : 600;
+	int frames = argc > 3 ? atoi(argv[3]) : 30;
+	int workers = argc > 4 ? atoi(argv[4]) : 0;
+
+	CpuVolumeRenderer renderer;
+	if (!renderer.Initialize(width, height) || frames <= 0)
+	{
+		fprintf(stderr, "Invalid frame size or count\n");
+		return 1;
+	}
+	if (!renderer.LoadVolume(volumeFile))
+	{
+		fprintf(stderr, "%s\n", renderer.GetLoadError().c_str());
+		return 1;
+	}
+
+	TileScheduler& scheduler = renderer.GetScheduler();
+	scheduler.SetWorkerCount(workers);
+	printf("%d workers, %dx%d tiles of %d pixels, %d frames turning\n", scheduler.GetWorkerCount(), (width + CpuVolumeRenderer::kTileSize - 1) / CpuVolumeRenderer::kTileSize,
+		(height + CpuVolumeRenderer::kTileSize - 1) / CpuVolumeRenderer::kTileSize, CpuVolumeRenderer::kTileSize, frames);
+	printf("%-16s %10s %10s %10s %10s %10s  %s\n", "scheduling", "ms/frame", "imbalance", "idle ms", "max idle", "stolen", "idle ms per worker, last frame");
+
+	const Config configs[] =
+	{
+		{ "static", false, false },
+		{ "stealing", true, false },
+		{ "stealing+hints", true, true },
+	};
+	for (const Config& config : configs)
+	{
+		scheduler.SetStealing(config.stealing);
+		scheduler.SetCostHints(config.costHints);
+		renderer.GetCamera().SetRotation(0.f);
+
+		double totalMs = 0.0;
+		double imbalance = 0.0;
+		double idleMs = 0.0;
+		double maxIdleMs = 0.0;
+		int stolen = 0;
+		for (int i = 0; i < frames; ++i)
+		{
+			renderer.Update(1.f / 60.f);
+			renderer.Render();
+			const CpuVolumeRenderer::FrameStats& stats = renderer.GetFrameStats();
+			totalMs += stats.renderMs;
+			imbalance += stats.imbalance;
+			idleMs += stats.meanIdleMs;
+			maxIdleMs = std::max(maxIdleMs, stats.maxIdleMs);
+			stolen += stats.tilesStolen;
+		}
+
+		printf("%-16s %10.2f %10.2f %10.2f %10.2f %10.1f  ", config.name, totalMs / frames, imbalance / frames, idleMs / frames, maxIdleMs,
+			static_cast<double>(stolen) / frames);
+		for (double ms : renderer.GetFrameStats().workerIdleMs)
+		{
+			printf(" %.2f", ms);
+		}
+		printf("\n");
+	}
+
+	renderer.Shutdown();
+	return 0;
+}
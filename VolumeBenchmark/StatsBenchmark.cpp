@@ -0,0 +1,182 @@
+// Volume statistics: the histogram pass against the load it is added to,
+// scalar and AVX2, and reading the sidecar instead. Each file is loaded as
+// given and converted to each voxel type (scaled into [0,1] for the float
+// types), so every pass is timed on the same data. The AVX2 results must
+// match the scalar ones bin for bin.
+#include "Benchmarks.h"
+#include "../VolumeRenderer/CpuFeatures.h"
+#include "../VolumeRenderer/Parallel.h"
+#include "../VolumeRenderer/Volume.h"
+#include "../VolumeRenderer/VolumeStats.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// best of runs, ms
+	template <typename Func>
+	double TimeBest(const int runs, Func&& func)
+	{
+		double best = 0.0;
+		for (int i = 0; i < runs; ++i)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			func();
+			double ms = ElapsedMs(start);
+			best = i == 0 || ms < best ? ms : best;
+		}
+		return best;
+	}
+
+	// source (any type) converted to type, written to file so the sidecar
+	// has a file to sit next to
+	bool ConvertVolume(const Volume& source, const VoxelType type, const std::string& file, Volume& volume)
+	{
+		VolumeDesc desc = source.GetDesc();
+		const VoxelWindow window = VoxelWindow::GetDefault(desc.type);
+		const size_t voxels = desc.GetByteSize() / GetVoxelSize(desc.type);
+		std::vector<float> values(voxels);
+		DispatchVoxelType(desc.type, [&](auto voxel) {
+			typedef decltype(voxel) T;
+			const T* data = source.GetVoxels<T>();
+			for (size_t i = 0; i < voxels; ++i)
+			{
+				values[i] = window.Apply(VoxelTraits<T>::ToFloat(data[i]));
+			}
+		});
+
+		desc.type = type;
+		std::vector<uint8_t> converted(desc.GetByteSize());
+		for (size_t i = 0; i < voxels; ++i)
+		{
+			switch (type)
+			{
+			case VoxelType::UInt8:
+				converted[i] = static_cast<uint8_t>(std::lround(values[i] * 255.f));
+				break;
+			case VoxelType::UInt16:
+			{
+				uint16_t value = static_cast<uint16_t>(std::lround(values[i] * 65535.f));
+				memcpy(&converted[i * 2], &value, 2);
+				break;
+			}
+			case VoxelType::Float16:
+			{
+				uint16_t value = FloatToHalf(values[i]);
+				memcpy(&converted[i * 2], &value, 2);
+				break;
+			}
+			default:
+				memcpy(&converted[i * 4], &values[i], 4);
+				break;
+			}
+		}
+
+		FILE* out = fopen(file.c_str(), "wb");
+		if (out == nullptr)
+		{
+			return false;
+		}
+		bool ok = fwrite(converted.data(), 1, converted.size(), out) == converted.size();
+		ok = fclose(out) == 0 && ok;
+		return ok && volume.LoadRaw(file, desc);
+	}
+
+	bool IsSameStats(const VolumeStats& a, const VolumeStats& b)
+	{
+		return a.count == b.count && a.min == b.min && a.max == b.max && a.histogram == b.histogram &&
+			std::fabs(a.mean - b.mean) <= 1e-6 * std::fmax(std::fabs(a.mean), 1.0) &&
+			std::fabs(a.deviation - b.deviation) <= 1e-6 * std::fmax(a.deviation, 1.0);
+	}
+}
+
+int RunStatsBenchmark(int argc, char* argv[])
+{
+	// an optional layout first, the bundled datasets are all 256^3 uint8
+	VolumeDesc desc(256, 256, 256);
+	int first = argc > 0 && ParseVolumeDesc(argv[0], desc) ? 1 : 0;
+	std::vector<std::string> files(argv + first, argv + argc);
+	if (files.empty())
+	{
+		files.push_back("../VolumeRenderer/foot.raw");
+		files.push_back("../VolumeRenderer/skull.raw");
+	}
+	const int runs = 5;
+	const bool avx2 = GetCpuFeatures().avx2;
+
+	printf("%d workers, %s, best of %d runs\n", GetWorkerCount(), avx2 ? "AVX2" : "no AVX2", runs);
+	printf("%-32s %-8s %10s %10s %10s %8s %10s %8s %16s %16s %8s\n", "file", "type", "load ms", "scalar ms", "AVX2 ms", "GB/s",
+		"sidecar ms", "speedup", "min-max", "p1-p99", "occupied");
+
+	const VoxelType types[] = { VoxelType::UInt8, VoxelType::UInt16, VoxelType::Float16, VoxelType::Float32 };
+	int failed = 0;
+	for (const std::string& file : files)
+	{
+		Volume source;
+		if (!source.Load(file, desc))
+		{
+			fprintf(stderr, "%s\n", source.GetError().c_str());
+			++failed;
+			continue;
+		}
+
+		for (VoxelType type : types)
+		{
+			const std::string converted = file + "." + GetVoxelTypeName(type) + ".raw";
+			Volume volume;
+			if (!ConvertVolume(source, type, converted, volume))
+			{
+				fprintf(stderr, "Can't write %s\n", converted.c_str());
+				++failed;
+				continue;
+			}
+			const double bytes = static_cast<double>(volume.GetDesc().GetByteSize());
+
+			// a fresh mapping with every page read, what LoadVolume's pass adds to
+			uint64_t touched = 0;
+			double loadMs = TimeBest(runs, [&]() {
+				Volume loaded;
+				loaded.LoadRaw(converted, volume.GetDesc());
+				for (size_t i = 0; i < volume.GetDesc().GetByteSize(); i += 64)
+				{
+					touched += loaded.GetData()[i];
+				}
+			});
+
+			VolumeStats scalar, vectorized;
+			double scalarMs = TimeBest(runs, [&]() { ComputeVolumeStats(volume, scalar, false); });
+			double vectorMs = TimeBest(runs, [&]() { ComputeVolumeStats(volume, vectorized, true); });
+			if (!IsSameStats(scalar, vectorized))
+			{
+				fprintf(stderr, "%s: AVX2 statistics differ from the scalar ones\n", converted.c_str());
+				++failed;
+			}
+
+			std::string error;
+			VolumeStats read;
+			bool wrote = WriteVolumeStats(converted, volume.GetDesc(), vectorized, error);
+			double sidecarMs = TimeBest(runs, [&]() { ReadVolumeStats(converted, volume.GetDesc(), read); });
+			if (!wrote || !IsSameStats(read, vectorized))
+			{
+				fprintf(stderr, "%s: %s\n", converted.c_str(), wrote ? "the sidecar doesn't read back" : error.c_str());
+				++failed;
+			}
+
+			char range[64], percentiles[64];
+			snprintf(range, sizeof(range), "%.4g-%.4g", vectorized.min, vectorized.max);
+			snprintf(percentiles, sizeof(percentiles), "%.4g-%.4g", vectorized.GetPercentile(0.01), vectorized.GetPercentile(0.99));
+			printf("%-32s %-8s %10.2f %10.2f %10.2f %8.2f %10.3f %7.0fx %16s %16s %7.1f%%\n", file.c_str(), GetVoxelTypeName(type), loadMs,
+				scalarMs, vectorMs, bytes / (vectorMs * 1.0e6), sidecarMs, vectorMs / sidecarMs, range, percentiles,
+				100.0 * vectorized.GetOccupancy());
+
+			volume.Shutdown();
+			remove(GetVolumeStatsFile(converted).c_str());
+			remove(converted.c_str());
+		}
+	}
+
+	return failed > 0 ? 1 : 0;
+}
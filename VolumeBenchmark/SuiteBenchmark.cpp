@@ -0,0 +1,396 @@
+// The regression suite: replays the standard camera paths (CameraPath) over
+// every dataset, resolution and step, and writes frames/s, rays/s, samples/s,
+// frame time percentiles and peak memory as JSON, so releases can be compared
+// on headless machines. Frames are placed on the path by index, not time, so
+// every run renders the same views.
+#include "Benchmarks.h"
+#include "../VolumeRenderer/CameraPath.h"
+#include "../VolumeRenderer/CpuFeatures.h"
+#include "../VolumeRenderer/CpuVolumeRenderer.h"
+#include "../VolumeRenderer/Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+	struct SuiteOptions
+	{
+		std::string outFile;
+		int frames;
+		std::vector<std::pair<int, int>> sizes;
+		std::vector<float> steps;
+		std::vector<CameraPath> paths;
+		Classification classification;
+		VolumeDesc desc;
+		std::vector<std::string> volumes;
+	};
+
+	struct SuiteRun
+	{
+		std::string volume;
+		std::string path;
+		int width;
+		int height;
+		float step;
+		RayCastPath rayCastPath;
+		std::vector<double> frameMs;
+		uint64_t rays;
+		uint64_t samples;
+		size_t volumeBytes;
+		size_t peakBytes;
+	};
+
+	// the process' peak resident set so far, 0 if unknown
+	size_t GetPeakMemoryUsage()
+	{
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters;
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		{
+			return counters.PeakWorkingSetSize;
+		}
+		return 0;
+#else
+		struct rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+		{
+			return 0;
+		}
+#ifdef __APPLE__
+		return static_cast<size_t>(usage.ru_maxrss);
+#else
+		return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+	}
+
+	// nearest rank, sorted must be sorted and not empty
+	double Percentile(const std::vector<double>& sorted, const double percent)
+	{
+		size_t rank = static_cast<size_t>(std::ceil(percent / 100.0 * sorted.size()));
+		return sorted[std::min(std::max(rank, static_cast<size_t>(1)), sorted.size()) - 1];
+	}
+
+	// a JSON string literal
+	std::string Quote(const std::string& text)
+	{
+		std::string quoted = "\"";
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+			{
+				quoted += '\\';
+				quoted += c;
+			}
+			else if (static_cast<unsigned char>(c) < 0x20)
+			{
+				char escaped[8];
+				snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned int>(c));
+				quoted += escaped;
+			}
+			else
+			{
+				quoted += c;
+			}
+		}
+		return quoted + "\"";
+	}
+
+	// splits "a,b,c"
+	std::vector<std::string> Split(const std::string& text)
+	{
+		std::vector<std::string> items;
+		size_t begin = 0;
+		while (begin <= text.size())
+		{
+			size_t end = text.find(',', begin);
+			end = end == std::string::npos ? text.size() : end;
+			if (end > begin)
+			{
+				items.push_back(text.substr(begin, end - begin));
+			}
+			begin = end + 1;
+		}
+		return items;
+	}
+
+	bool ParseOptions(int argc, char* argv[], SuiteOptions& options)
+	{
+		options.outFile = "suite.json";
+		options.frames = 60;
+		options.sizes.push_back(std::make_pair(800, 600));
+		options.steps = { 1.f, 2.f, 4.f };
+		options.paths = CameraPath::GetStandardPaths();
+		options.classification = Classification::PostClassified;
+		options.desc = VolumeDesc(256, 256, 256);
+
+		for (int i = 0; i < argc; ++i)
+		{
+			std::string arg = argv[i];
+			if (arg.compare(0, 2, "--") != 0)
+			{
+				options.volumes.push_back(arg);
+				continue;
+			}
+			if (i + 1 >= argc)
+			{
+				fprintf(stderr, "%s needs a value\n", arg.c_str());
+				return false;
+			}
+
+			std::string value = argv[++i];
+			if (arg == "--out")
+			{
+				options.outFile = value;
+			}
+			else if (arg == "--frames")
+			{
+				options.frames = atoi(value.c_str());
+			}
+			else if (arg == "--sizes")
+			{
+				options.sizes.clear();
+				for (const std::string& size : Split(value))
+				{
+					int width = 0, height = 0;
+					if (sscanf(size.c_str(), "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+					{
+						fprintf(stderr, "Invalid size %s, expected WxH\n", size.c_str());
+						return false;
+					}
+					options.sizes.push_back(std::make_pair(width, height));
+				}
+			}
+			else if (arg == "--steps")
+			{
+				options.steps.clear();
+				for (const std::string& step : Split(value))
+				{
+					float scale = static_cast<float>(atof(step.c_str()));
+					if (!(scale > 0.f))
+					{
+						fprintf(stderr, "Invalid step %s\n", step.c_str());
+						return false;
+					}
+					options.steps.push_back(scale);
+				}
+			}
+			else if (arg == "--paths")
+			{
+				options.paths.clear();
+				for (const std::string& name : Split(value))
+				{
+					CameraPath path;
+					if (!CameraPath::FindStandardPath(name, path))
+					{
+						fprintf(stderr, "Unknown camera path %s, expected orbit, zoom or closeup\n", name.c_str());
+						return false;
+					}
+					options.paths.push_back(path);
+				}
+			}
+			else if (arg == "--classification")
+			{
+				if (!ParseClassification(value, options.classification))
+				{
+					fprintf(stderr, "Unknown classification %s, expected identity, post-classified or pre-integrated\n", value.c_str());
+					return false;
+				}
+			}
+			else if (arg == "--layout")
+			{
+				if (!ParseVolumeDesc(value, options.desc))
+				{
+					fprintf(stderr, "Invalid volume description %s, expected WxHxD[:type][:sx,sy,sz]\n", value.c_str());
+					return false;
+				}
+			}
+			else
+			{
+				fprintf(stderr, "Unknown option %s\n", arg.c_str());
+				return false;
+			}
+		}
+
+		if (options.volumes.empty())
+		{
+			options.volumes.push_back("../VolumeRenderer/foot.raw");
+			options.volumes.push_back("../VolumeRenderer/skull.raw");
+			options.volumes.push_back("../VolumeRenderer/bonsai.raw");
+			options.volumes.push_back("../VolumeRenderer/aneurism.raw");
+		}
+		// the identity classification has no step to scale
+		if (options.classification == Classification::Identity)
+		{
+			options.steps.assign(1, 1.f);
+		}
+		if (options.frames <= 0 || options.sizes.empty() || options.steps.empty() || options.paths.empty())
+		{
+			fprintf(stderr, "Nothing to run\n");
+			return false;
+		}
+		return true;
+	}
+
+	bool WriteReport(const SuiteOptions& options, const std::vector<SuiteRun>& runs, const size_t peakBytes)
+	{
+		FILE* file = fopen(options.outFile.c_str(), "w");
+		if (file == nullptr)
+		{
+			fprintf(stderr, "Writing %s failed\n", options.outFile.c_str());
+			return false;
+		}
+
+		const CpuFeatures& features = GetCpuFeatures();
+		fprintf(file, "{\n");
+		fprintf(file, "  \"format\": 1,\n");
+		fprintf(file, "  \"workers\": %d,\n", GetWorkerCount());
+		fprintf(file, "  \"avx2\": %s,\n", features.avx2 ? "true" : "false");
+		fprintf(file, "  \"avx512\": %s,\n", features.avx512 ? "true" : "false");
+		fprintf(file, "  \"classification\": %s,\n", Quote(GetClassificationName(options.classification)).c_str());
+		fprintf(file, "  \"framesPerRun\": %d,\n", options.frames);
+		fprintf(file, "  \"peakMemoryBytes\": %llu,\n", static_cast<unsigned long long>(peakBytes));
+		fprintf(file, "  \"runs\": [");
+		for (size_t i = 0; i < runs.size(); ++i)
+		{
+			const SuiteRun& run = runs[i];
+			std::vector<double> sorted = run.frameMs;
+			std::sort(sorted.begin(), sorted.end());
+			double totalMs = 0.0;
+			for (double ms : sorted)
+			{
+				totalMs += ms;
+			}
+			const double seconds = totalMs / 1000.0;
+
+			fprintf(file, "%s\n    {\n", i > 0 ? "," : "");
+			fprintf(file, "      \"volume\": %s,\n", Quote(run.volume).c_str());
+			fprintf(file, "      \"path\": %s,\n", Quote(run.path).c_str());
+			fprintf(file, "      \"width\": %d,\n", run.width);
+			fprintf(file, "      \"height\": %d,\n", run.height);
+			fprintf(file, "      \"step\": %g,\n", run.step);
+			fprintf(file, "      \"rayCastPath\": %s,\n", Quote(GetRayCastPathName(run.rayCastPath)).c_str());
+			fprintf(file, "      \"frames\": %d,\n", static_cast<int>(sorted.size()));
+			fprintf(file, "      \"framesPerSecond\": %.3f,\n", sorted.size() / seconds);
+			fprintf(file, "      \"raysPerSecond\": %.0f,\n", run.rays / seconds);
+			fprintf(file, "      \"samplesPerSecond\": %.0f,\n", run.samples / seconds);
+			fprintf(file, "      \"frameMs\": { \"mean\": %.3f, \"min\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f },\n",
+				totalMs / sorted.size(), sorted.front(), Percentile(sorted, 50.0), Percentile(sorted, 95.0), Percentile(sorted, 99.0), sorted.back());
+			fprintf(file, "      \"volumeBytes\": %llu,\n", static_cast<unsigned long long>(run.volumeBytes));
+			fprintf(file, "      \"peakMemoryBytes\": %llu\n", static_cast<unsigned long long>(run.peakBytes));
+			fprintf(file, "    }");
+		}
+		fprintf(file, "\n  ]\n}\n");
+
+		bool written = ferror(file) == 0;
+		written = fclose(file) == 0 && written;
+		if (!written)
+		{
+			fprintf(stderr, "Writing %s failed\n", options.outFile.c_str());
+		}
+		return written;
+	}
+}
+
+int RunSuiteBenchmark(int argc, char* argv[])
+{
+	SuiteOptions options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		return 1;
+	}
+
+	printf("%d workers, %s, %d frames per run\n", GetWorkerCount(), GetClassificationName(options.classification), options.frames);
+	printf("%-28s %-8s %10s %5s %8s %10s %12s %8s %8s %8s\n", "volume", "path", "size", "step", "fps", "Mrays/s", "Msamples/s", "p50 ms", "p95 ms", "p99 ms");
+
+	std::vector<SuiteRun> runs;
+	int failed = 0;
+	for (const std::pair<int, int>& size : options.sizes)
+	{
+		CpuVolumeRenderer renderer;
+		renderer.Initialize(size.first, size.second);
+		renderer.SetClassification(options.classification);
+
+		for (const std::string& volume : options.volumes)
+		{
+			if (!renderer.LoadVolume(volume, options.desc))
+			{
+				fprintf(stderr, "%s\n", renderer.GetLoadError().c_str());
+				++failed;
+				continue;
+			}
+
+			for (float step : options.steps)
+			{
+				renderer.SetStepScale(step);
+				for (const CameraPath& path : options.paths)
+				{
+					SuiteRun run;
+					run.volume = volume;
+					run.path = path.GetName();
+					run.width = size.first;
+					run.height = size.second;
+					run.step = step;
+					run.rays = 0;
+					run.samples = 0;
+
+					// one frame first so the transfer tables and caches are warm
+					path.Apply(renderer.GetCamera(), 0, options.frames);
+					renderer.Render();
+
+					for (int frame = 0; frame < options.frames; ++frame)
+					{
+						path.Apply(renderer.GetCamera(), frame, options.frames);
+						renderer.Render();
+						const CpuVolumeRenderer::FrameStats& stats = renderer.GetFrameStats();
+						run.frameMs.push_back(stats.renderMs);
+						run.rays += stats.rays;
+						run.samples += stats.samples;
+						run.rayCastPath = stats.path;
+					}
+					run.volumeBytes = renderer.GetVolume().GetMemoryUsage();
+					run.peakBytes = GetPeakMemoryUsage();
+
+					std::vector<double> sorted = run.frameMs;
+					std::sort(sorted.begin(), sorted.end());
+					double seconds = 0.0;
+					for (double ms : sorted)
+					{
+						seconds += ms / 1000.0;
+					}
+					char sizeText[32];
+					snprintf(sizeText, sizeof(sizeText), "%dx%d", size.first, size.second);
+					printf("%-28s %-8s %10s %5g %8.2f %10.2f %12.2f %8.2f %8.2f %8.2f\n", volume.c_str(), run.path.c_str(), sizeText, step,
+						options.frames / seconds, run.rays / seconds / 1.0e6, run.samples / seconds / 1.0e6,
+						Percentile(sorted, 50.0), Percentile(sorted, 95.0), Percentile(sorted, 99.0));
+					runs.push_back(run);
+				}
+			}
+		}
+	}
+
+	size_t peakBytes = GetPeakMemoryUsage();
+	printf("peak memory %.1f MB\n", peakBytes / (1024.0 * 1024.0));
+	if (!WriteReport(options, runs, peakBytes))
+	{
+		return 1;
+	}
+	printf("wrote %s\n", options.outFile.c_str());
+	return failed > 0 ? 1 : 0;
+}
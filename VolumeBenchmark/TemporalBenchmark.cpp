@@ -0,0 +1,148 @@
+// Jittered ray starts and temporal accumulation, with a transfer function so
+// the step can be lengthened. A still view is accumulated for a number of
+// frames and compared with a render at a quarter of the step (the reference),
+// next to the wood grain of unjittered steps and the noise of jitter alone.
+// The camera then turns a little every frame, compared per frame with the
+// reference for that view, to show what reprojection keeps.
+#include "Benchmarks.h"
+#include "../VolumeRenderer/CpuVolumeRenderer.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace
+{
+	struct Config
+	{
+		const char* name;
+		float stepScale;
+		bool jitter;
+		bool temporal;
+	};
+
+	void Configure(CpuVolumeRenderer& renderer, const Config& config)
+	{
+		renderer.SetStepScale(config.stepScale);
+		renderer.SetJitter(config.jitter);
+		renderer.SetTemporalAccumulation(config.temporal);
+	}
+
+	void RenderReference(CpuVolumeRenderer& renderer, const float rotation, std::vector<uint8_t>& reference)
+	{
+		const Config config = { "reference", 0.25f, false, false };
+		Configure(renderer, config);
+		renderer.GetCamera().SetRotation(rotation);
+		renderer.Render();
+		CopyFrame(renderer, reference);
+	}
+}
+
+int RunTemporalBenchmark(int argc, char* argv[])
+{
+	std::string volumeFile = argc > 0 ? argv[0] : "../VolumeRenderer/foot.raw";
+	int width = argc > 1 ? atoi(argv[1]) : 800;
+	int height = argc > 2 ? atoi(argv[2]) : 600;
+	int frames = argc > 3 ? atoi(argv[3]) : 16;
+
+	CpuVolumeRenderer renderer;
+	if (!renderer.Initialize(width, height) || frames <= 0)
+	{
+		fprintf(stderr, "Invalid frame size or count\n");
+		return 1;
+	}
+	if (!renderer.LoadVolume(volumeFile))
+	{
+		fprintf(stderr, "%s\n", renderer.GetLoadError().c_str());
+		return 1;
+	}
+
+	// the step is only what the scale makes it
+	renderer.SetLevelOfDetail(false);
+	std::vector<TransferPoint> points = {
+		{ 0.f, 0.f, 0.f, 0.f, 0.f },
+		{ 0.185f, 1.f, 0.5f, 0.2f, 0.f },
+		{ 0.2f, 1.f, 0.5f, 0.2f, 0.5f },
+		{ 0.215f, 1.f, 0.5f, 0.2f, 0.f },
+		{ 0.42f, 1.f, 1.f, 1.f, 0.f },
+		{ 0.43f, 1.f, 1.f, 1.f, 0.9f },
+		{ 1.f, 1.f, 1.f, 1.f, 0.9f } };
+	renderer.SetTransferFunction(TransferFunction(points));
+	renderer.SetClassification(Classification::PostClassified);
+
+	const Config configs[] =
+	{
+		{ "step 1", 1.f, false, false },
+		{ "step 1 jitter", 1.f, true, false },
+		{ "step 1 accumulated", 1.f, true, true },
+		{ "step 2", 2.f, false, false },
+		{ "step 2 jitter", 2.f, true, false },
+		{ "step 2 accumulated", 2.f, true, true },
+		{ "step 4 accumulated", 4.f, true, true },
+	};
+
+	// still: the last of frames renders against the reference
+	const float rotation = 1.f;
+	std::vector<uint8_t> reference;
+	RenderReference(renderer, rotation, reference);
+	printf("still, %d frames against a quarter step\n", frames);
+	printf("%-20s %10s %12s %10s %10s\n", "config", "ms/frame", "samples", "mean diff", "PSNR dB");
+	for (const Config& config : configs)
+	{
+		Configure(renderer, config);
+		renderer.GetCamera().SetRotation(rotation);
+		double totalMs = 0.0;
+		uint64_t samples = 0;
+		for (int i = 0; i < frames; ++i)
+		{
+			renderer.Render();
+			totalMs += renderer.GetFrameStats().renderMs + (config.temporal ? renderer.GetTemporalStats().accumulateMs : 0.0);
+			samples += renderer.GetFrameStats().samples;
+		}
+		double meanDiff = 0.0;
+		double psnr = 0.0;
+		CompareImages(renderer.GetFrame(), reference, meanDiff, psnr);
+		printf("%-20s %10.2f %12llu %10.3f %10.2f\n", config.name, totalMs / frames, static_cast<unsigned long long>(samples / frames), meanDiff, psnr);
+	}
+
+	// turning: every frame against its own reference, the history carried
+	// across the rotation (the references render on a second renderer)
+	CpuVolumeRenderer referenceRenderer;
+	referenceRenderer.Initialize(width, height);
+	referenceRenderer.LoadVolume(volumeFile);
+	referenceRenderer.SetLevelOfDetail(false);
+	referenceRenderer.SetTransferFunction(renderer.GetTransferFunction());
+	referenceRenderer.SetClassification(Classification::PostClassified);
+
+	const float turn = 0.01f;
+	printf("\nturning %.3f rad per frame, %d frames\n", turn, frames);
+	printf("%-20s %10s %10s %10s %12s\n", "config", "ms/frame", "mean diff", "PSNR dB", "reprojected");
+	for (const Config& config : configs)
+	{
+		Configure(renderer, config);
+		double totalMs = 0.0;
+		double diffSum = 0.0;
+		double psnrSum = 0.0;
+		double reprojected = 0.0;
+		for (int i = 0; i < frames; ++i)
+		{
+			renderer.GetCamera().SetRotation(rotation + turn * i);
+			renderer.Render();
+			totalMs += renderer.GetFrameStats().renderMs + (config.temporal ? renderer.GetTemporalStats().accumulateMs : 0.0);
+			reprojected += config.temporal ? renderer.GetTemporalStats().reprojected : 0.f;
+
+			RenderReference(referenceRenderer, rotation + turn * i, reference);
+			double meanDiff = 0.0;
+			double psnr = 0.0;
+			CompareImages(renderer.GetFrame(), reference, meanDiff, psnr);
+			diffSum += meanDiff;
+			psnrSum += psnr;
+		}
+		printf("%-20s %10.2f %10.3f %10.2f %11.1f%%\n", config.name, totalMs / frames, diffSum / frames, psnrSum / frames, 100.0 * reprojected / frames);
+	}
+
+	referenceRenderer.Shutdown();
+	renderer.Shutdown();
+	return 0;
+}
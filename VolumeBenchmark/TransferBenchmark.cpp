@@ -0,0 +1,110 @@
+// Transfer function classification: how long the tables take to build and to
+// update after an edit, and the image quality of post-classification and
+// pre-integration as the step grows, against a pre-integrated render at a
+// quarter of the step. The transfer function is deliberately sharp, a thin
+// shell and a hard edge, which is where post-classification needs small steps.
+#include "Benchmarks.h"
+#include "../VolumeRenderer/CpuVolumeRenderer.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// a thin orange shell at skin and opaque white past the bone edge
+	TransferFunction MakeSharpTransfer(const float skin)
+	{
+		std::vector<TransferPoint> points = {
+			{ 0.f, 0.f, 0.f, 0.f, 0.f },
+			{ skin - 0.015f, 1.f, 0.5f, 0.2f, 0.f },
+			{ skin, 1.f, 0.5f, 0.2f, 0.6f },
+			{ skin + 0.015f, 1.f, 0.5f, 0.2f, 0.f },
+			{ 0.42f, 1.f, 1.f, 1.f, 0.f },
+			{ 0.43f, 1.f, 1.f, 1.f, 0.9f },
+			{ 1.f, 1.f, 1.f, 1.f, 0.9f } };
+		return TransferFunction(points);
+	}
+
+}
+
+int RunTransferBenchmark(int argc, char* argv[])
+{
+	std::string volumeFile = argc > 0 ? argv[0] : "../VolumeRenderer/foot.raw";
+	int width = argc > 1 ? atoi(argv[1]) : 800;
+	int height = argc > 2 ? atoi(argv[2]) : 600;
+	int frames = argc > 3 ? atoi(argv[3]) : 10;
+	const int updates = 20;
+
+	CpuVolumeRenderer renderer;
+	if (!renderer.Initialize(width, height) || frames <= 0)
+	{
+		fprintf(stderr, "Invalid frame size or count\n");
+		return 1;
+	}
+	if (!renderer.LoadVolume(volumeFile))
+	{
+		fprintf(stderr, "%s\n", renderer.GetLoadError().c_str());
+		return 1;
+	}
+
+	// the step is only what the scale makes it
+	renderer.SetLevelOfDetail(false);
+
+	// a new step rebuilds every entry, moving the shell only the segments across it
+	TransferTables tables;
+	const TransferFunction transfer = MakeSharpTransfer(0.2f);
+	double buildMs = 0.0;
+	double editMs = 0.0;
+	int built = 0;
+	int edited = 0;
+	for (int i = 0; i < updates; ++i)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		tables.Update(transfer, 1.f + (i + 1) * 0.01f);
+		buildMs += ElapsedMs(start);
+		built = tables.GetUpdatedEntries();
+
+		start = std::chrono::high_resolution_clock::now();
+		tables.Update(MakeSharpTransfer(0.2f + (i + 1) * 0.002f), tables.GetStepScale());
+		editMs += ElapsedMs(start);
+		edited = tables.GetUpdatedEntries();
+	}
+	printf("%-18s %10s %10s\n", "table update", "ms", "entries");
+	printf("%-18s %10.3f %10d\n", "new step", buildMs / updates, built);
+	printf("%-18s %10.3f %10d\n", "moved shell", editMs / updates, edited);
+
+	renderer.SetTransferFunction(transfer);
+
+	std::vector<uint8_t> reference;
+	uint64_t samples = 0;
+	const float referenceScale = 0.25f;
+	renderer.SetClassification(Classification::PreIntegrated);
+	renderer.SetStepScale(referenceScale);
+	double referenceMs = RenderFrames(renderer, 1, reference, &samples);
+	printf("\nreference: %s, %.2fx step, %.2f ms/frame, %.1f samples/ray\n", GetClassificationName(Classification::PreIntegrated),
+		referenceScale, referenceMs, static_cast<double>(samples) / renderer.GetFrameStats().rays);
+
+	printf("%-16s %6s %12s %12s %10s %10s\n", "classification", "step", "ms/frame", "samples/ray", "mean diff", "PSNR dB");
+	const Classification classifications[] = { Classification::PostClassified, Classification::PreIntegrated };
+	const float scales[] = { 1.f, 2.f, 4.f };
+	for (Classification classification : classifications)
+	{
+		renderer.SetClassification(classification);
+		for (float scale : scales)
+		{
+			renderer.SetStepScale(scale);
+
+			std::vector<uint8_t> image;
+			double ms = RenderFrames(renderer, frames, image, &samples);
+			double meanDiff, psnr;
+			CompareImages(image.data(), reference, meanDiff, psnr);
+			printf("%-16s %5.0fx %12.2f %12.1f %10.3f %10.2f\n", GetClassificationName(classification), scale, ms,
+				static_cast<double>(samples) / frames / renderer.GetFrameStats().rays, meanDiff, psnr);
+		}
+	}
+
+	renderer.Shutdown();
+	return 0;
+}
@@ -0,0 +1,96 @@
+/// <summary>
+/// ConverterMain is the entry point of the .raw converter.
+/// Maps the RAW volume and writes it out as bricks with ghost
+/// borders for out-of-core rendering (.bvol), or losslessly
+/// compressed in chunks for faster loading (.pvol).
+///
+/// usage: VolumeConverter volume.raw WxHxD[:type][:sx,sy,sz] out.bvol [brick size]
+///        VolumeConverter volume.raw WxHxD[:type][:sx,sy,sz] out.pvol [none|delta|planes|auto]
+///
+/// The brick size defaults to 64 voxels, the filter to auto.
+/// </summary>
+#include "../VolumeRenderer/BrickedVolume.h"
+#include "../VolumeRenderer/PackedVolume.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+int main(int argc, char* argv[])
+{
+	if (argc < 4)
+	{
+		printf("usage: VolumeConverter volume.raw WxHxD[:type][:sx,sy,sz] out.bvol [brick size]\n");
+		printf("       VolumeConverter volume.raw WxHxD[:type][:sx,sy,sz] out.pvol [none|delta|planes|auto]\n");
+		return 1;
+	}
+
+	VolumeDesc desc;
+	if (!ParseVolumeDesc(argv[2], desc))
+	{
+		fprintf(stderr, "Invalid volume description %s, expected WxHxD[:type][:sx,sy,sz]\n", argv[2]);
+		return 1;
+	}
+	const bool packed = IsPackedVolumeFile(argv[3]);
+	PackedFilter filter = PackedFilter::Auto;
+	if (packed && argc > 4 && !ParsePackedFilter(argv[4], filter))
+	{
+		fprintf(stderr, "Unknown filter %s, expected none, delta, planes or auto\n", argv[4]);
+		return 1;
+	}
+	int brickSize = !packed && argc > 4 ? atoi(argv[4]) : BrickedVolume::kDefaultBrickSize;
+
+	Volume volume;
+	if (!volume.LoadRaw(argv[1], desc))
+	{
+		fprintf(stderr, "%s\n", volume.GetError().c_str());
+		return 1;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	std::string error;
+	if (packed)
+	{
+		if (!WritePackedVolume(volume, argv[3], filter, kDefaultPackedChunkSize, error))
+		{
+			fprintf(stderr, "%s\n", error.c_str());
+			return 1;
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		// read it back, a packed volume is only useful if it loads to the same voxels
+		Volume check;
+		if (!check.LoadPacked(argv[3]))
+		{
+			fprintf(stderr, "%s\n", check.GetError().c_str());
+			return 1;
+		}
+		if (memcmp(check.GetData(), volume.GetData(), desc.GetByteSize()) != 0)
+		{
+			fprintf(stderr, "Verifying %s failed, the voxels differ\n", argv[3]);
+			return 1;
+		}
+		MappedFile written;
+		written.Open(argv[3]);
+		printf("%s: %.2f MB -> %.2f MB (%.2fx), %s filter, %.0f ms\n", argv[3], desc.GetByteSize() / (1024.0 * 1024.0),
+			written.GetSize() / (1024.0 * 1024.0), static_cast<double>(desc.GetByteSize()) / written.GetSize(), GetPackedFilterName(filter), ms);
+		return 0;
+	}
+
+	if (!BrickedVolume::Convert(volume, argv[3], brickSize, error))
+	{
+		fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	BrickedVolume bricked;
+	if (!bricked.Open(argv[3]))
+	{
+		fprintf(stderr, "%s\n", bricked.GetError().c_str());
+		return 1;
+	}
+	printf("%s: %d bricks of %d^3 voxels, %.0f ms\n", argv[3], bricked.GetBrickCount(), brickSize, ms);
+	return 0;
+}
@@ -0,0 +1,541 @@
+/// <summary>
+/// DistributedMain is the entry point for sort-last rendering on a
+/// group of worker processes (see DistributedRenderer): every worker
+/// loads one brick of the volume, renders it and takes part in the
+/// binary swap, the first writes the frames out. Reports where the
+/// time went per frame, and with --scaling the speedup and efficiency
+/// of 1, 2, 4, ... up to n workers against one.
+///
+/// usage: VolumeDistributed volume.raw [--workers n | --scaling n]
+///     [--transport socket|local] [--threads n] [--frames n] [--size WxH]
+///     [--desc WxHxD[:type][:sx,sy,sz]] [--transfer v:r,g,b,a;...]
+///     [--classification identity|post-classified|pre-integrated]
+///     [--step scale] [--port p] [--out frame.tga]
+///
+/// --workers is a power of two (4 by default). The socket transport
+/// (the default) runs each worker in a process of its own, this one
+/// being worker 0 and starting the others with --rank; the local one
+/// runs them as threads of this process. Each worker draws its tiles
+/// on --threads threads (1 by default), so a group of n workers uses
+/// n of them and scales like n machines would, as long as the cores
+/// go round. The camera turns a little every frame, the same on every
+/// worker, and the first frame is not counted.
+/// </summary>
+#include "../VolumeRenderer/DistributedRenderer.h"
+#include "../VolumeRenderer/ImageWriter.h"
+#include "../VolumeRenderer/Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+extern char** environ;
+#endif
+
+namespace
+{
+	const float kTurn = 0.02f;
+
+	struct Options
+	{
+		std::string file;
+		VolumeDesc desc;
+		int workers;
+		int scaling;
+		bool sockets;
+		int threads;
+		int frames;
+		int width;
+		int height;
+		TransferFunction transfer;
+		Classification classification;
+		float stepScale;
+		int port;
+		std::string out;
+		// worker processes started by worker 0
+		int rank;
+		// what they are started with, --workers and --rank added
+		std::vector<std::string> args;
+	};
+
+	// per frame of one worker, averaged over the frames counted
+	struct WorkerTimes
+	{
+		double frameMs;
+		double renderMs;
+		double compositeMs;
+		double gatherMs;
+		double bytesSent;
+		double samples;
+	};
+
+	struct GroupResult
+	{
+		// of worker 0, the whole frame
+		double frameMs;
+		// the slowest worker's
+		double renderMs;
+		double compositeMs;
+		double gatherMs;
+		// all workers together
+		double bytesSent;
+		double samples;
+		std::vector<uint8_t> frame;
+	};
+
+	bool ParseSize(const std::string& text, int& width, int& height)
+	{
+		size_t x = text.find('x');
+		if (x == std::string::npos)
+		{
+			return false;
+		}
+		width = atoi(text.substr(0, x).c_str());
+		height = atoi(text.substr(x + 1).c_str());
+		return width > 0 && height > 0;
+	}
+
+	bool ParseOptions(int argc, char* argv[], Options& options)
+	{
+		options.file = argv[1];
+		options.desc = VolumeDesc(256, 256, 256);
+		options.workers = 4;
+		options.scaling = 0;
+		options.sockets = true;
+		options.threads = 1;
+		options.frames = 16;
+		options.width = 512;
+		options.height = 512;
+		options.classification = Classification::Identity;
+		options.stepScale = 1.f;
+		options.port = 47300;
+		options.rank = -1;
+		options.args.push_back(argv[1]);
+
+		for (int i = 2; i < argc; ++i)
+		{
+			std::string arg = argv[i];
+			if (i + 1 >= argc)
+			{
+				fprintf(stderr, "Missing value for %s\n", arg.c_str());
+				return false;
+			}
+			std::string value = argv[++i];
+			bool valid = true;
+			// what only worker 0 needs isn't passed on
+			bool forward = false;
+			if (arg == "--workers")
+			{
+				options.workers = atoi(value.c_str());
+				valid = options.workers > 0 && (options.workers & (options.workers - 1)) == 0;
+			}
+			else if (arg == "--rank")
+			{
+				options.rank = atoi(value.c_str());
+				valid = options.rank >= 0;
+			}
+			else if (arg == "--scaling")
+			{
+				options.scaling = atoi(value.c_str());
+				valid = options.scaling > 0;
+			}
+			else if (arg == "--out")
+			{
+				options.out = value;
+			}
+			else if (arg == "--transport")
+			{
+				forward = true;
+				options.sockets = value == "socket";
+				valid = options.sockets || value == "local";
+			}
+			else if (arg == "--threads")
+			{
+				forward = true;
+				options.threads = atoi(value.c_str());
+				valid = options.threads > 0;
+			}
+			else if (arg == "--frames")
+			{
+				forward = true;
+				options.frames = atoi(value.c_str());
+				valid = options.frames > 0;
+			}
+			else if (arg == "--size")
+			{
+				forward = true;
+				valid = ParseSize(value, options.width, options.height);
+			}
+			else if (arg == "--desc")
+			{
+				forward = true;
+				valid = ParseVolumeDesc(value, options.desc);
+			}
+			else if (arg == "--transfer")
+			{
+				forward = true;
+				valid = ParseTransferFunction(value, options.transfer);
+			}
+			else if (arg == "--classification")
+			{
+				forward = true;
+				valid = ParseClassification(value, options.classification);
+			}
+			else if (arg == "--step")
+			{
+				forward = true;
+				options.stepScale = static_cast<float>(atof(value.c_str()));
+				valid = options.stepScale > 0.f;
+			}
+			else if (arg == "--port")
+			{
+				forward = true;
+				options.port = atoi(value.c_str());
+				valid = options.port > 0 && options.port < 65536;
+			}
+			else
+			{
+				fprintf(stderr, "Unknown option %s\n", arg.c_str());
+				return false;
+			}
+			if (!valid)
+			{
+				fprintf(stderr, "Invalid %s %s\n", arg.c_str(), value.c_str());
+				return false;
+			}
+			if (forward)
+			{
+				options.args.push_back(arg);
+				options.args.push_back(value);
+			}
+		}
+		if (options.workers <= 0 || (options.workers & (options.workers - 1)) != 0)
+		{
+			fprintf(stderr, "--workers must be a power of two\n");
+			return false;
+		}
+		return true;
+	}
+
+	// every worker learns whether all of them got this far, so none is left
+	// waiting on one that gave up
+	bool Agree(Transport& transport, const bool ok)
+	{
+		uint8_t all = ok ? 1 : 0;
+		if (transport.GetRank() != 0)
+		{
+			return transport.Send(0, &all, 1) && transport.Receive(0, &all, 1) && all != 0;
+		}
+		for (int peer = 1; peer < transport.GetSize(); ++peer)
+		{
+			uint8_t peerOk = 0;
+			if (!transport.Receive(peer, &peerOk, 1))
+			{
+				return false;
+			}
+			all = all != 0 && peerOk != 0 ? 1 : 0;
+		}
+		for (int peer = 1; peer < transport.GetSize(); ++peer)
+		{
+			transport.Send(peer, &all, 1);
+		}
+		return all != 0;
+	}
+
+	// One worker's part: load, render the frames, send the times to worker 0,
+	// which puts the group's together into result.
+	bool RunWorker(const Options& options, Transport& transport, GroupResult& result)
+	{
+		const int rank = transport.GetRank();
+		DistributedRenderer renderer;
+		bool ok = renderer.Initialize(&transport, options.width, options.height) && renderer.LoadBrick(options.file, options.desc);
+		if (!ok)
+		{
+			fprintf(stderr, "worker %d: %s\n", rank, renderer.GetError().c_str());
+		}
+		if (!Agree(transport, ok))
+		{
+			return false;
+		}
+
+		renderer.GetScheduler().SetWorkerCount(options.threads);
+		renderer.SetTransferFunction(options.transfer);
+		renderer.SetClassification(options.classification);
+		renderer.SetStepScale(options.stepScale);
+
+		WorkerTimes times = WorkerTimes();
+		for (int i = 0; i <= options.frames; ++i)
+		{
+			renderer.GetCamera().SetRotation(1.f + kTurn * i);
+			if (!renderer.Render())
+			{
+				fprintf(stderr, "worker %d: %s\n", rank, renderer.GetError().c_str());
+				return false;
+			}
+			if (i == 0)
+			{
+				continue;
+			}
+			const DistributedRenderer::FrameStats& stats = renderer.GetFrameStats();
+			times.frameMs += stats.frameMs / options.frames;
+			times.renderMs += stats.renderMs / options.frames;
+			times.compositeMs += stats.compositeMs / options.frames;
+			times.gatherMs += stats.gatherMs / options.frames;
+			times.bytesSent += static_cast<double>(stats.bytesSent) / options.frames;
+			times.samples += static_cast<double>(stats.samples) / options.frames;
+		}
+
+		if (rank != 0)
+		{
+			return transport.Send(0, &times, sizeof(times));
+		}
+		result.frameMs = times.frameMs;
+		result.renderMs = times.renderMs;
+		result.compositeMs = times.compositeMs;
+		result.gatherMs = times.gatherMs;
+		result.bytesSent = times.bytesSent;
+		result.samples = times.samples;
+		for (int peer = 1; peer < transport.GetSize(); ++peer)
+		{
+			WorkerTimes other;
+			if (!transport.Receive(peer, &other, sizeof(other)))
+			{
+				return false;
+			}
+			result.renderMs = std::max(result.renderMs, other.renderMs);
+			result.compositeMs = std::max(result.compositeMs, other.compositeMs);
+			result.gatherMs = std::max(result.gatherMs, other.gatherMs);
+			result.bytesSent += other.bytesSent;
+			result.samples += other.samples;
+		}
+		const uint8_t* frame = renderer.GetFrame();
+		result.frame.assign(frame, frame + static_cast<size_t>(options.width) * options.height * 4);
+		return true;
+	}
+
+#ifdef _WIN32
+	typedef HANDLE Process;
+
+	bool StartProcess(const std::vector<std::string>& args, Process& process)
+	{
+		char exe[MAX_PATH];
+		if (GetModuleFileNameA(NULL, exe, MAX_PATH) == 0)
+		{
+			return false;
+		}
+		std::string commandLine = std::string("\"") + exe + "\"";
+		for (const std::string& arg : args)
+		{
+			commandLine += " \"" + arg + "\"";
+		}
+		STARTUPINFOA startup = {};
+		startup.cb = sizeof(startup);
+		PROCESS_INFORMATION info = {};
+		if (!CreateProcessA(exe, &commandLine[0], NULL, NULL, FALSE, 0, NULL, NULL, &startup, &info))
+		{
+			return false;
+		}
+		CloseHandle(info.hThread);
+		process = info.hProcess;
+		return true;
+	}
+
+	bool WaitProcess(const Process process)
+	{
+		DWORD code = 1;
+		WaitForSingleObject(process, INFINITE);
+		GetExitCodeProcess(process, &code);
+		CloseHandle(process);
+		return code == 0;
+	}
+#else
+	typedef pid_t Process;
+
+	bool StartProcess(const std::string& exe, const std::vector<std::string>& args, Process& process)
+	{
+		std::vector<char*> argv;
+		argv.push_back(const_cast<char*>(exe.c_str()));
+		for (const std::string& arg : args)
+		{
+			argv.push_back(const_cast<char*>(arg.c_str()));
+		}
+		argv.push_back(nullptr);
+		return posix_spawnp(&process, exe.c_str(), nullptr, nullptr, argv.data(), environ) == 0;
+	}
+
+	bool WaitProcess(const Process process)
+	{
+		int status = 0;
+		return waitpid(process, &status, 0) == process && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	}
+#endif
+
+	// workers threads of this process, connected by a LocalTransport
+	bool RunLocalGroup(const Options& options, const int workers, GroupResult& result)
+	{
+		std::vector<std::unique_ptr<Transport>> transports = LocalTransport::CreateGroup(workers);
+		std::vector<std::thread> threads;
+		std::vector<char> ok(workers, 0);
+		for (int rank = 1; rank < workers; ++rank)
+		{
+			threads.emplace_back([&, rank]() {
+				GroupResult unused;
+				ok[rank] = RunWorker(options, *transports[rank], unused);
+			});
+		}
+		ok[0] = RunWorker(options, *transports[0], result);
+		for (std::thread& t : threads)
+		{
+			t.join();
+		}
+		return std::find(ok.begin(), ok.end(), 0) == ok.end();
+	}
+
+	// workers processes over SocketTransport, this one worker 0
+	bool RunSocketGroup(const Options& options, const std::string& exe, const int workers, GroupResult& result)
+	{
+		std::vector<Process> processes;
+		bool ok = true;
+		for (int rank = 1; rank < workers && ok; ++rank)
+		{
+			std::vector<std::string> args = options.args;
+			args.push_back("--workers");
+			args.push_back(std::to_string(workers));
+			args.push_back("--rank");
+			args.push_back(std::to_string(rank));
+			Process process;
+#ifdef _WIN32
+			ok = StartProcess(args, process);
+#else
+			ok = StartProcess(exe, args, process);
+#endif
+			if (ok)
+			{
+				processes.push_back(process);
+			}
+			else
+			{
+				fprintf(stderr, "Can't start worker %d\n", rank);
+			}
+		}
+
+		// a worker that failed to start leaves the others waiting to connect
+		// until they time out
+		SocketTransport transport;
+		if (ok && !transport.Connect(0, workers, options.port))
+		{
+			fprintf(stderr, "worker 0: %s\n", transport.GetError().c_str());
+			ok = false;
+		}
+		ok = ok && RunWorker(options, transport, result);
+		transport.Close();
+		for (Process process : processes)
+		{
+			ok = WaitProcess(process) && ok;
+		}
+		return ok;
+	}
+
+	double GetMeanDifference(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b)
+	{
+		double sum = 0.0;
+		for (size_t i = 0; i < a.size(); ++i)
+		{
+			if (i % 4 != 3)
+			{
+				sum += std::fabs(static_cast<double>(a[i]) - b[i]);
+			}
+		}
+		return a.empty() ? 0.0 : sum / (a.size() / 4 * 3);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		printf("usage: VolumeDistributed volume.raw [--workers n | --scaling n] [--transport socket|local] [--threads n] [--frames n]\n"
+			"    [--size WxH] [--desc WxHxD[:type][:sx,sy,sz]] [--transfer v:r,g,b,a;...]\n"
+			"    [--classification identity|post-classified|pre-integrated] [--step scale] [--port p] [--out frame.tga]\n");
+		return 1;
+	}
+
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		return 1;
+	}
+
+	// started by worker 0
+	if (options.rank >= 0)
+	{
+		SocketTransport transport;
+		if (!transport.Connect(options.rank, options.workers, options.port))
+		{
+			fprintf(stderr, "worker %d: %s\n", options.rank, transport.GetError().c_str());
+			return 1;
+		}
+		GroupResult unused;
+		return RunWorker(options, transport, unused) ? 0 : 1;
+	}
+
+	std::vector<int> groups;
+	if (options.scaling > 0)
+	{
+		for (int workers = 1; workers <= options.scaling; workers *= 2)
+		{
+			groups.push_back(workers);
+		}
+	}
+	else
+	{
+		groups.push_back(options.workers);
+	}
+
+	printf("%s, %dx%d, %d frames, %s transport, %d thread%s per worker, %d cores\n", options.file.c_str(), options.width, options.height, options.frames,
+		options.sockets ? "socket" : "local", options.threads, options.threads == 1 ? "" : "s", GetWorkerCount());
+	printf("%8s %10s %10s %10s %10s %10s %12s %8s %10s %10s\n", "workers", "ms/frame", "render", "composite", "gather", "MB/frame", "samples", "speedup",
+		"efficiency", "mean diff");
+
+	GroupResult first;
+	bool ok = true;
+	for (int workers : groups)
+	{
+		GroupResult result = GroupResult();
+		bool groupOk = options.sockets ? RunSocketGroup(options, argv[0], workers, result) : RunLocalGroup(options, workers, result);
+		if (!groupOk)
+		{
+			fprintf(stderr, "%d workers failed\n", workers);
+			ok = false;
+			break;
+		}
+		if (workers == groups.front())
+		{
+			first = result;
+		}
+
+		// against the first group, one worker when scaling; the image should
+		// only differ where early termination stopped a brick's rays short
+		const double speedup = first.frameMs / result.frameMs;
+		const double efficiency = speedup * groups.front() / workers;
+		printf("%8d %10.2f %10.2f %10.2f %10.2f %10.2f %12.0f %8.2f %9.1f%% %10.3f\n", workers, result.frameMs, result.renderMs, result.compositeMs,
+			result.gatherMs, result.bytesSent / (1 << 20), result.samples, speedup, 100.0 * efficiency, GetMeanDifference(result.frame, first.frame));
+
+		if (!options.out.empty() && workers == groups.back() && !WriteTGA(options.out, result.frame.data(), options.width, options.height))
+		{
+			fprintf(stderr, "Can't write %s\n", options.out.c_str());
+			ok = false;
+		}
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+#include "BlueNoise.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+	const int kCount = kBlueNoiseSize * kBlueNoiseSize;
+
+	// energy of the pattern, a gaussian (sigma 1.5) around every set pixel,
+	// wrapped around the tile's edges
+	class EnergyField
+	{
+	public:
+		EnergyField() : m_energy(kCount, 0.f), m_kernel(kCount)
+		{
+			for (int dy = 0; dy < kBlueNoiseSize; ++dy)
+			{
+				for (int dx = 0; dx < kBlueNoiseSize; ++dx)
+				{
+					const int wx = std::min(dx, kBlueNoiseSize - dx);
+					const int wy = std::min(dy, kBlueNoiseSize - dy);
+					m_kernel[dy * kBlueNoiseSize + dx] = std::exp(-(wx * wx + wy * wy) / (2.f * 1.5f * 1.5f));
+				}
+			}
+		}
+
+		void Splat(const int index, const float sign)
+		{
+			const int x0 = index % kBlueNoiseSize;
+			const int y0 = index / kBlueNoiseSize;
+			for (int y = 0; y < kBlueNoiseSize; ++y)
+			{
+				const float* kernel = &m_kernel[((y - y0) & (kBlueNoiseSize - 1)) * kBlueNoiseSize];
+				float* energy = &m_energy[y * kBlueNoiseSize];
+				for (int x = 0; x < kBlueNoiseSize; ++x)
+				{
+					energy[x] += sign * kernel[(x - x0) & (kBlueNoiseSize - 1)];
+				}
+			}
+		}
+
+		// the tightest cluster (set) or the largest void (not set)
+		int Find(const std::vector<uint8_t>& pattern, const bool set) const
+		{
+			int best = -1;
+			for (int i = 0; i < kCount; ++i)
+			{
+				if ((pattern[i] != 0) == set && (best < 0 || (set ? m_energy[i] > m_energy[best] : m_energy[i] < m_energy[best])))
+				{
+					best = i;
+				}
+			}
+			return best;
+		}
+
+	private:
+		std::vector<float> m_energy;
+		std::vector<float> m_kernel;
+	};
+
+	std::vector<float> GenerateTile()
+	{
+		// initial pattern, a tenth of the pixels from a fixed LCG
+		std::vector<uint8_t> initial(kCount, 0);
+		EnergyField field;
+		uint32_t seed = 12345u;
+		int ones = 0;
+		while (ones < kCount / 10)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			const int i = static_cast<int>(seed >> 20) & (kCount - 1);
+			if (!initial[i])
+			{
+				initial[i] = 1;
+				field.Splat(i, 1.f);
+				++ones;
+			}
+		}
+
+		// spread it out: move the tightest cluster into the largest void until
+		// that's where it came from
+		for (;;)
+		{
+			const int cluster = field.Find(initial, true);
+			initial[cluster] = 0;
+			field.Splat(cluster, -1.f);
+			const int hole = field.Find(initial, false);
+			initial[hole] = 1;
+			field.Splat(hole, 1.f);
+			if (hole == cluster)
+			{
+				break;
+			}
+		}
+		const EnergyField initialField = field;
+
+		// ranks below the initial pattern's size, taking its tightest clusters away
+		std::vector<int> rank(kCount, 0);
+		std::vector<uint8_t> pattern = initial;
+		for (int r = ones - 1; r >= 0; --r)
+		{
+			const int cluster = field.Find(pattern, true);
+			pattern[cluster] = 0;
+			field.Splat(cluster, -1.f);
+			rank[cluster] = r;
+		}
+
+		// the ranks above it, filling the largest voids
+		pattern = initial;
+		field = initialField;
+		for (int r = ones; r < kCount; ++r)
+		{
+			const int hole = field.Find(pattern, false);
+			pattern[hole] = 1;
+			field.Splat(hole, 1.f);
+			rank[hole] = r;
+		}
+
+		std::vector<float> tile(kCount);
+		for (int i = 0; i < kCount; ++i)
+		{
+			tile[i] = (rank[i] + 0.5f) / kCount;
+		}
+		return tile;
+	}
+}
+
+const float* GetBlueNoiseTile()
+{
+	static const std::vector<float> tile = GenerateTile();
+	return tile.data();
+}
+
+float GetBlueNoise(const int x, const int y, const uint32_t frame)
+{
+	const float value = GetBlueNoiseTile()[(y & (kBlueNoiseSize - 1)) * kBlueNoiseSize + (x & (kBlueNoiseSize - 1))];
+	const double shifted = value + 0.6180339887498949 * frame;
+	return static_cast<float>(shifted - std::floor(shifted));
+}
@@ -0,0 +1,31 @@
+/// <summary>
+/// BlueNoise.h
+///
+/// About:
+/// A tileable blue noise texture for jittering where rays
+/// start. Offsetting each pixel's first sample by a fraction
+/// of a step turns the wood grain rings of a fixed step into
+/// noise, and blue noise keeps that noise high frequency,
+/// without the clumps of white noise, so it averages out
+/// over a few neighbouring pixels or frames.
+///
+/// The tile is generated once, on first use, with Ulichney's
+/// void and cluster method. Each frame shifts every value by
+/// the golden ratio (mod 1), which keeps the pattern blue in
+/// space and spreads a pixel's values evenly over time.
+/// </summary>
+#ifndef BlueNoise_h__
+#define BlueNoise_h__
+
+#include <cstdint>
+
+// width and height of the tile, a power of two
+const int kBlueNoiseSize = 64;
+
+// kBlueNoiseSize^2 values in [0,1), row by row, each (i + 0.5) / kBlueNoiseSize^2 once
+const float* GetBlueNoiseTile();
+
+// the value for a pixel in a frame, the tile repeated across the image
+float GetBlueNoise(const int x, const int y, const uint32_t frame);
+
+#endif // BlueNoise_h__
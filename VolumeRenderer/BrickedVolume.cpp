@@ -0,0 +1,639 @@
+#include "BrickedVolume.h"
+#include "Parallel.h"
+#include "RayCastKernel.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	int CeilDiv(const int a, const int b)
+	{
+		return (a + b - 1) / b;
+	}
+
+	// copies brick (bx, by, bz) plus its ghost border out of volume, zero outside
+	void GatherBrick(const Volume& volume, const int brickSize, const int bx, const int by, const int bz, uint8_t* const voxels, BrickIndexEntry& entry)
+	{
+		const int edge = brickSize + 2 * BrickedVolume::kGhost;
+		const int width = volume.GetWidth();
+		const int height = volume.GetHeight();
+		const int depth = volume.GetDepth();
+		const int x0 = bx * brickSize - BrickedVolume::kGhost;
+		const int y0 = by * brickSize - BrickedVolume::kGhost;
+		const int z0 = bz * brickSize - BrickedVolume::kGhost;
+
+		// columns of each row that lie inside the volume
+		const int first = std::max(0, -x0);
+		const int last = std::min(edge, width - x0);
+
+		uint8_t lo = 255;
+		uint8_t hi = 0;
+		for (int z = 0; z < edge; ++z)
+		{
+			for (int y = 0; y < edge; ++y)
+			{
+				uint8_t* row = voxels + (static_cast<size_t>(z) * edge + y) * edge;
+				int gy = y0 + y;
+				int gz = z0 + z;
+				if (gy < 0 || gz < 0 || gy >= height || gz >= depth || first >= last)
+				{
+					memset(row, 0, edge);
+					lo = 0;
+					continue;
+				}
+
+				memset(row, 0, first);
+				memset(row + last, 0, edge - last);
+				if (first > 0 || last < edge)
+				{
+					lo = 0;
+				}
+				memcpy(row + first, volume.GetData() + (static_cast<size_t>(gz) * height + gy) * width + x0 + first, last - first);
+				for (int x = first; x < last; ++x)
+				{
+					lo = std::min(lo, row[x]);
+					hi = std::max(hi, row[x]);
+				}
+			}
+		}
+
+		entry = BrickIndexEntry();
+		entry.min = lo;
+		entry.max = hi;
+	}
+}
+
+BrickedVolume::BrickedVolume()
+{
+	m_brickSize = 0;
+	m_bricksX = m_bricksY = m_bricksZ = 0;
+	m_budget = static_cast<size_t>(1) << 30;
+	m_resident = 0;
+	m_frame = 0;
+	m_stats = FrameStats();
+#ifdef _WIN32
+	m_file = INVALID_HANDLE_VALUE;
+#else
+	m_file = -1;
+#endif
+}
+
+BrickedVolume::~BrickedVolume()
+{
+	Close();
+}
+
+bool BrickedVolume::Convert(const Volume& volume, const std::string& file, const int brickSize, std::string& error)
+{
+	if (!volume.IsLoaded())
+	{
+		error = "No volume to convert";
+		return false;
+	}
+	if (brickSize < 8 || brickSize > 256)
+	{
+		error = "Brick size must be between 8 and 256";
+		return false;
+	}
+	// the brick marcher only samples 8-bit voxels so far
+	if (volume.GetDesc().type != VoxelType::UInt8)
+	{
+		error = std::string("Unsupported voxel type ") + GetVoxelTypeName(volume.GetDesc().type);
+		return false;
+	}
+
+	const VolumeDesc& desc = volume.GetDesc();
+	BrickFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "BVOL", 4);
+	header.version = kVersion;
+	header.width = desc.width;
+	header.height = desc.height;
+	header.depth = desc.depth;
+	header.voxelType = static_cast<uint32_t>(desc.type);
+	header.spacing[0] = desc.spacing.x;
+	header.spacing[1] = desc.spacing.y;
+	header.spacing[2] = desc.spacing.z;
+	header.brickSize = brickSize;
+	header.bricksX = CeilDiv(desc.width, brickSize);
+	header.bricksY = CeilDiv(desc.height, brickSize);
+	header.bricksZ = CeilDiv(desc.depth, brickSize);
+
+	std::ofstream out(file, std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		error = "Creating " + file + " failed";
+		return false;
+	}
+
+	// the header is written again once the index offset is known
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	const int edge = brickSize + 2 * kGhost;
+	const size_t brickBytes = static_cast<size_t>(edge) * edge * edge;
+	const int slabBricks = header.bricksX * header.bricksY;
+	std::vector<BrickIndexEntry> index(static_cast<size_t>(slabBricks) * header.bricksZ);
+	std::vector<uint8_t> slab(slabBricks * brickBytes);
+	uint64_t offset = sizeof(header);
+
+	for (int bz = 0; bz < header.bricksZ && out; ++bz)
+	{
+		BrickIndexEntry* entries = index.data() + static_cast<size_t>(bz) * slabBricks;
+		ParallelFor(slabBricks, [&](int begin, int end) {
+			for (int i = begin; i < end; ++i)
+			{
+				GatherBrick(volume, brickSize, i % header.bricksX, i / header.bricksX, bz, slab.data() + i * brickBytes, entries[i]);
+			}
+		});
+
+		for (int i = 0; i < slabBricks; ++i)
+		{
+			if (entries[i].max == 0)
+			{
+				continue;
+			}
+			entries[i].offset = offset;
+			out.write(reinterpret_cast<const char*>(slab.data() + i * brickBytes), brickBytes);
+			offset += brickBytes;
+		}
+	}
+
+	header.indexOffset = offset;
+	out.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(BrickIndexEntry));
+	out.seekp(0);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.close();
+	if (!out)
+	{
+		error = "Writing " + file + " failed";
+		return false;
+	}
+	return true;
+}
+
+bool BrickedVolume::Open(const std::string& file)
+{
+	Close();
+
+#ifdef _WIN32
+	m_file = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	bool opened = m_file != INVALID_HANDLE_VALUE;
+#else
+	m_file = open(file.c_str(), O_RDONLY);
+	bool opened = m_file >= 0;
+#endif
+	if (!opened)
+	{
+		m_error = "Opening bricked volume failed: " + file;
+		return false;
+	}
+
+	BrickFileHeader header;
+	if (!ReadAt(0, &header, sizeof(header)) || memcmp(header.magic, "BVOL", 4) != 0)
+	{
+		Close();
+		m_error = file + " is not a bricked volume";
+		return false;
+	}
+	if (header.version != kVersion)
+	{
+		Close();
+		m_error = file + " has an unsupported version";
+		return false;
+	}
+	if (header.width <= 0 || header.height <= 0 || header.depth <= 0 || header.brickSize <= 0 ||
+		header.bricksX != CeilDiv(header.width, header.brickSize) ||
+		header.bricksY != CeilDiv(header.height, header.brickSize) ||
+		header.bricksZ != CeilDiv(header.depth, header.brickSize))
+	{
+		Close();
+		m_error = file + " has an invalid header";
+		return false;
+	}
+	// the sampler only reads 8-bit voxels so far
+	if (header.voxelType != static_cast<uint32_t>(VoxelType::UInt8))
+	{
+		Close();
+		m_error = file + " has an unsupported voxel type";
+		return false;
+	}
+
+	std::vector<BrickIndexEntry> index(static_cast<size_t>(header.bricksX) * header.bricksY * header.bricksZ);
+	if (!ReadAt(header.indexOffset, index.data(), index.size() * sizeof(BrickIndexEntry)))
+	{
+		Close();
+		m_error = "Reading the brick index of " + file + " failed";
+		return false;
+	}
+
+	m_desc = VolumeDesc(header.width, header.height, header.depth, VoxelType::UInt8,
+		Vec3(header.spacing[0], header.spacing[1], header.spacing[2]));
+	m_brickSize = header.brickSize;
+	m_bricksX = header.bricksX;
+	m_bricksY = header.bricksY;
+	m_bricksZ = header.bricksZ;
+
+	m_bricks.resize(index.size());
+	for (size_t i = 0; i < index.size(); ++i)
+	{
+		m_bricks[i].offset = index[i].offset;
+		m_bricks[i].min = index[i].min;
+		m_bricks[i].max = index[i].max;
+		m_bricks[i].lastUsed = 0;
+	}
+	m_error.clear();
+	return true;
+}
+
+void BrickedVolume::Close()
+{
+#ifdef _WIN32
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (m_file >= 0)
+	{
+		close(m_file);
+		m_file = -1;
+	}
+#endif
+
+	m_bricks.clear();
+	m_free.clear();
+	m_resident = 0;
+	m_desc = VolumeDesc();
+	m_brickSize = 0;
+	m_bricksX = m_bricksY = m_bricksZ = 0;
+	m_stats = FrameStats();
+}
+
+size_t BrickedVolume::GetBrickBytes() const
+{
+	size_t edge = static_cast<size_t>(m_brickSize + 2 * kGhost);
+	return edge * edge * edge;
+}
+
+void BrickedVolume::SetBudget(const size_t bytes)
+{
+	m_budget = bytes;
+	if (!IsOpen())
+	{
+		return;
+	}
+
+	std::vector<std::pair<uint64_t, int>> resident;
+	for (int i = 0; i < GetBrickCount(); ++i)
+	{
+		if (!m_bricks[i].voxels.empty())
+		{
+			resident.push_back(std::make_pair(m_bricks[i].lastUsed, i));
+		}
+	}
+	std::sort(resident.begin(), resident.end());
+	for (size_t i = 0; i < resident.size() && GetMemoryUsage() > m_budget; ++i)
+	{
+		Evict(resident[i].second);
+	}
+	m_free.clear();
+}
+
+void BrickedVolume::BeginFrame(const Matrix4& worldViewProj)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	++m_frame;
+	m_stats = FrameStats();
+	if (!IsOpen())
+	{
+		return;
+	}
+
+	// stored bricks in view, nearest first
+	std::vector<std::pair<float, int>> wanted;
+	for (int bz = 0; bz < m_bricksZ; ++bz)
+	{
+		for (int by = 0; by < m_bricksY; ++by)
+		{
+			for (int bx = 0; bx < m_bricksX; ++bx)
+			{
+				int index = (bz * m_bricksY + by) * m_bricksX + bx;
+				float distance;
+				if (m_bricks[index].offset != 0 && IsVisible(worldViewProj, bx, by, bz, distance))
+				{
+					wanted.push_back(std::make_pair(distance, index));
+				}
+			}
+		}
+	}
+	std::sort(wanted.begin(), wanted.end());
+	m_stats.touched = static_cast<int>(wanted.size());
+
+	// as many as the budget holds
+	const size_t brickBytes = GetBrickBytes();
+	const size_t capacity = m_budget / brickBytes;
+	const size_t keep = std::min(wanted.size(), capacity);
+	std::vector<int> load;
+	for (size_t i = 0; i < keep; ++i)
+	{
+		Brick& brick = m_bricks[wanted[i].second];
+		brick.lastUsed = m_frame;
+		if (brick.voxels.empty())
+		{
+			load.push_back(wanted[i].second);
+		}
+	}
+
+	// make room, least recently used first and never a brick this frame keeps
+	if (m_resident + load.size() > capacity)
+	{
+		std::vector<std::pair<uint64_t, int>> unused;
+		for (int i = 0; i < GetBrickCount(); ++i)
+		{
+			if (!m_bricks[i].voxels.empty() && m_bricks[i].lastUsed != m_frame)
+			{
+				unused.push_back(std::make_pair(m_bricks[i].lastUsed, i));
+			}
+		}
+		std::sort(unused.begin(), unused.end());
+		for (size_t i = 0; i < unused.size() && m_resident + load.size() > capacity; ++i)
+		{
+			Evict(unused[i].second);
+			++m_stats.evicted;
+		}
+	}
+
+	for (int index : load)
+	{
+		Brick& brick = m_bricks[index];
+		if (!m_free.empty())
+		{
+			brick.voxels.swap(m_free.back());
+			m_free.pop_back();
+		}
+		else
+		{
+			brick.voxels.resize(brickBytes);
+		}
+		++m_resident;
+	}
+
+	// the reads are independent, so spread them over the workers
+	std::vector<uint8_t> failed(load.size(), 0);
+	ParallelFor(static_cast<int>(load.size()), [&](int begin, int end) {
+		for (int i = begin; i < end; ++i)
+		{
+			Brick& brick = m_bricks[load[i]];
+			failed[i] = ReadAt(brick.offset, brick.voxels.data(), brickBytes) ? 0 : 1;
+		}
+	});
+
+	for (size_t i = 0; i < load.size(); ++i)
+	{
+		if (failed[i])
+		{
+			Evict(load[i]);
+			m_error = "Reading bricks failed";
+		}
+		else
+		{
+			++m_stats.loaded;
+		}
+	}
+
+	for (const std::pair<float, int>& brick : wanted)
+	{
+		if (m_bricks[brick.second].voxels.empty())
+		{
+			++m_stats.missing;
+		}
+	}
+	m_stats.resident = static_cast<int>(m_resident);
+	m_stats.bytesRead = m_stats.loaded * static_cast<uint64_t>(brickBytes);
+	m_stats.loadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void BrickedVolume::Evict(const int index)
+{
+	Brick& brick = m_bricks[index];
+	if (brick.voxels.empty())
+	{
+		return;
+	}
+	m_free.push_back(std::vector<uint8_t>());
+	m_free.back().swap(brick.voxels);
+	--m_resident;
+}
+
+bool BrickedVolume::IsVisible(const Matrix4& worldViewProj, const int bx, const int by, const int bz, float& distance) const
+{
+	// the brick's box in model space, texture space [0,1] maps to the [-1,1] cube
+	const int dims[3] = { m_desc.width, m_desc.height, m_desc.depth };
+	const int b[3] = { bx, by, bz };
+	float lo[3], hi[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		lo[axis] = 2.f * b[axis] * m_brickSize / dims[axis] - 1.f;
+		hi[axis] = 2.f * std::min((b[axis] + 1) * m_brickSize, dims[axis]) / dims[axis] - 1.f;
+	}
+
+	// culled if all eight corners are outside the same clip plane
+	int outside[6] = { 0, 0, 0, 0, 0, 0 };
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		Vec4 c = Mul(worldViewProj, Vec4(corner & 1 ? hi[0] : lo[0], corner & 2 ? hi[1] : lo[1], corner & 4 ? hi[2] : lo[2], 1.f));
+		outside[0] += c.x < -c.w;
+		outside[1] += c.x > c.w;
+		outside[2] += c.y < -c.w;
+		outside[3] += c.y > c.w;
+		outside[4] += c.z < 0.f;
+		outside[5] += c.z > c.w;
+	}
+	for (int plane = 0; plane < 6; ++plane)
+	{
+		if (outside[plane] == 8)
+		{
+			return false;
+		}
+	}
+
+	// view depth of the centre
+	Vec4 centre = Mul(worldViewProj, Vec4(0.5f * (lo[0] + hi[0]), 0.5f * (lo[1] + hi[1]), 0.5f * (lo[2] + hi[2]), 1.f));
+	distance = centre.w;
+	return true;
+}
+
+int BrickedVolume::March(const Vec3& front, const Vec3& step, const int numSteps, float& resultX, float& resultY) const
+{
+	// same 3D-DDA as the macrocell walk in RayCastKernel.cpp, over bricks
+	const int bricks[3] = { m_bricksX, m_bricksY, m_bricksZ };
+	const float scale[3] = {
+		static_cast<float>(m_desc.width) / m_brickSize,
+		static_cast<float>(m_desc.height) / m_brickSize,
+		static_cast<float>(m_desc.depth) / m_brickSize };
+	const float origin[3] = { front.x * scale[0], front.y * scale[1], front.z * scale[2] };
+	const float dir[3] = { step.x * scale[0], step.y * scale[1], step.z * scale[2] };
+
+	int cell[3], cellStep[3];
+	float tMax[3], tDelta[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		cell[axis] = std::min(std::max(static_cast<int>(std::floor(origin[axis])), 0), bricks[axis] - 1);
+		if (dir[axis] > 0.f)
+		{
+			cellStep[axis] = 1;
+			tMax[axis] = (cell[axis] + 1 - origin[axis]) / dir[axis];
+			tDelta[axis] = 1.f / dir[axis];
+		}
+		else if (dir[axis] < 0.f)
+		{
+			cellStep[axis] = -1;
+			tMax[axis] = (cell[axis] - origin[axis]) / dir[axis];
+			tDelta[axis] = -1.f / dir[axis];
+		}
+		else
+		{
+			cellStep[axis] = 0;
+			tMax[axis] = tDelta[axis] = std::numeric_limits<float>::infinity();
+		}
+	}
+
+	int taken = 0;
+	int i = 0;
+	while (i < numSteps && resultY < g_fOpacityThreshold)
+	{
+		int axis = tMax[0] < tMax[1] ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+		float tExit = tMax[axis];
+		int end = tExit >= static_cast<float>(numSteps) ? numSteps : static_cast<int>(std::floor(tExit)) + 1;
+		int index = (cell[2] * m_bricksY + cell[1]) * m_bricksX + cell[0];
+
+		taken += MarchBrick(index, front, step, i, end, resultX, resultY);
+		i = std::max(i, end);
+
+		cell[axis] += cellStep[axis];
+		if (cell[axis] < 0 || cell[axis] >= bricks[axis])
+		{
+			// left the grid, any remaining step is right on the boundary
+			// and still inside the last brick's ghost border
+			taken += MarchBrick(index, front, step, i, numSteps, resultX, resultY);
+			break;
+		}
+		tMax[axis] += tDelta[axis];
+	}
+	return taken;
+}
+
+int BrickedVolume::MarchBrick(const int index, const Vec3& front, const Vec3& step, const int begin, const int end, float& resultX, float& resultY) const
+{
+	const Brick& brick = m_bricks[index];
+	if (brick.voxels.empty() || begin >= end)
+	{
+		return 0;
+	}
+
+	const int edge = m_brickSize + 2 * kGhost;
+	const uint8_t* voxels = brick.voxels.data();
+	// volume coordinates of the brick's first stored voxel
+	const int ox = (index % m_bricksX) * m_brickSize - kGhost;
+	const int oy = (index / m_bricksX % m_bricksY) * m_brickSize - kGhost;
+	const int oz = (index / (m_bricksX * m_bricksY)) * m_brickSize - kGhost;
+	const float norm = 1.f / 255.f;
+
+	int i = begin;
+	for (; i < end && resultY < g_fOpacityThreshold; ++i)
+	{
+		// Volume::Sample with the fetches taken from the brick; rounding can put
+		// a sample a hair outside the brick, the ghost border covers it
+		Vec3 uvw = front + step * static_cast<float>(i);
+		float fx = uvw.x * m_desc.width - 0.5f;
+		float fy = uvw.y * m_desc.height - 0.5f;
+		float fz = uvw.z * m_desc.depth - 0.5f;
+
+		float flx = std::floor(fx);
+		float fly = std::floor(fy);
+		float flz = std::floor(fz);
+
+		int x0 = std::min(std::max(static_cast<int>(flx) - ox, 0), edge - 2);
+		int y0 = std::min(std::max(static_cast<int>(fly) - oy, 0), edge - 2);
+		int z0 = std::min(std::max(static_cast<int>(flz) - oz, 0), edge - 2);
+
+		float tx = fx - flx;
+		float ty = fy - fly;
+		float tz = fz - flz;
+
+		const uint8_t* v = voxels + (static_cast<size_t>(z0) * edge + y0) * edge + x0;
+		const size_t dy = edge;
+		const size_t dz = static_cast<size_t>(edge) * edge;
+		float c000 = v[0] * norm;
+		float c100 = v[1] * norm;
+		float c010 = v[dy] * norm;
+		float c110 = v[dy + 1] * norm;
+		float c001 = v[dz] * norm;
+		float c101 = v[dz + 1] * norm;
+		float c011 = v[dz + dy] * norm;
+		float c111 = v[dz + dy + 1] * norm;
+
+		float c00 = c000 + (c100 - c000) * tx;
+		float c10 = c010 + (c110 - c010) * tx;
+		float c01 = c001 + (c101 - c001) * tx;
+		float c11 = c011 + (c111 - c011) * tx;
+
+		float c0 = c00 + (c10 - c00) * ty;
+		float c1 = c01 + (c11 - c01) * ty;
+		float src = c0 + (c1 - c0) * tz;
+
+		// Front to back blending
+		float weight = (1.f - resultY) * src;
+		resultX += weight * src;
+		resultY += weight * src;
+	}
+	return i - begin;
+}
+
+bool BrickedVolume::ReadAt(const uint64_t offset, void* const data, const size_t size) const
+{
+	uint8_t* dst = static_cast<uint8_t*>(data);
+	uint64_t at = offset;
+	size_t remaining = size;
+	while (remaining > 0)
+	{
+#ifdef _WIN32
+		// positioned read, safe from several threads on the one handle
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = static_cast<DWORD>(at);
+		overlapped.OffsetHigh = static_cast<DWORD>(at >> 32);
+		DWORD chunk = static_cast<DWORD>(std::min<size_t>(remaining, 1u << 30));
+		DWORD read = 0;
+		if (!ReadFile(m_file, dst, chunk, &read, &overlapped) || read == 0)
+		{
+			return false;
+		}
+#else
+		ssize_t read = pread(m_file, dst, remaining, static_cast<off_t>(at));
+		if (read <= 0)
+		{
+			return false;
+		}
+#endif
+		dst += read;
+		at += read;
+		remaining -= read;
+	}
+	return true;
+}
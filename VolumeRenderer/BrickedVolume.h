@@ -0,0 +1,151 @@
+/// <summary>
+/// BrickedVolume.h
+///
+/// About:
+/// Out-of-core counterpart of Volume for scans that don't
+/// fit in memory. A .bvol file stores the volume as bricks
+/// of brickSize^3 voxels, each padded with a one voxel ghost
+/// border copied from its neighbours so a trilinear sample
+/// never reads more than one brick. The bricks are followed
+/// by an index holding each brick's file offset and min/max
+/// range; all-zero bricks aren't stored at all.
+///
+/// BeginFrame() works out which bricks the view can touch
+/// and pages them in, nearest first, until the memory budget
+/// is used up, evicting the least recently used bricks the
+/// view doesn't need. The ray marcher then walks the brick
+/// grid and only samples resident bricks. Bricks the budget
+/// leaves out render as empty and are counted as missing
+/// in the frame stats.
+/// </summary>
+#ifndef BrickedVolume_h__
+#define BrickedVolume_h__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Volume.h"
+#include "VolumeMath.h"
+
+// On-disk layout, little endian: header, bricks, brick index
+struct BrickFileHeader
+{
+	char magic[4];			// "BVOL"
+	uint32_t version;
+	uint64_t indexOffset;	// bricksX * bricksY * bricksZ BrickIndexEntry, x fastest
+	int32_t width;
+	int32_t height;
+	int32_t depth;
+	uint32_t voxelType;		// VoxelType
+	float spacing[3];
+	int32_t brickSize;		// voxels per brick edge, without the ghost border
+	int32_t bricksX;
+	int32_t bricksY;
+	int32_t bricksZ;
+	uint32_t reserved;
+};
+
+struct BrickIndexEntry
+{
+	uint64_t offset;		// 0 if the brick is all zero and not stored
+	uint8_t min;			// voxel range, ghost border included
+	uint8_t max;
+	uint8_t reserved[6];
+};
+
+class BrickedVolume
+{
+public:
+	static const uint32_t kVersion = 1;
+	static const int kDefaultBrickSize = 64;
+	static const int kGhost = 1;
+
+	struct FrameStats
+	{
+		int touched;			// stored bricks inside the view
+		int resident;
+		int loaded;				// paged in by this frame
+		int evicted;
+		int missing;			// touched but left out by the budget
+		uint64_t bytesRead;
+		double loadMs;
+	};
+
+	BrickedVolume();
+	~BrickedVolume();
+
+	// Writes volume to file as bricks of brickSize^3 voxels. One slab of bricks
+	// is gathered at a time, in parallel, so the source can be a mapping larger
+	// than memory. error says why on failure.
+	static bool Convert(const Volume& volume, const std::string& file, const int brickSize, std::string& error);
+
+	// reads the header and brick index, voxels are only read by BeginFrame
+	bool Open(const std::string& file);
+	void Close();
+
+	// bytes of brick data kept resident, evicts straight away if lowered
+	void SetBudget(const size_t bytes);
+	size_t GetBudget() const { return m_budget; }
+
+	// pages in the bricks visible through worldViewProj (the camera's
+	// GetWorldViewProj), call before rendering a frame
+	void BeginFrame(const Matrix4& worldViewProj);
+	const FrameStats& GetFrameStats() const { return m_stats; }
+
+	// Marches steps [0, numSteps) of one ray like RayCastPacketScalar, front in
+	// texture space. Returns the steps taken, only resident bricks are sampled.
+	int March(const Vec3& front, const Vec3& step, const int numSteps, float& resultX, float& resultY) const;
+
+	bool IsOpen() const { return !m_bricks.empty(); }
+	const VolumeDesc& GetDesc() const { return m_desc; }
+	const std::string& GetError() const { return m_error; }
+	int GetBrickSize() const { return m_brickSize; }
+	int GetBrickCount() const { return static_cast<int>(m_bricks.size()); }
+	// bytes of one resident brick, ghost border included
+	size_t GetBrickBytes() const;
+	// resident brick data
+	size_t GetMemoryUsage() const { return m_resident * GetBrickBytes(); }
+	Vec3 GetExtent() const { return m_desc.GetExtent(); }
+
+private:
+	struct Brick
+	{
+		uint64_t offset;
+		uint8_t min;
+		uint8_t max;
+		uint64_t lastUsed;		// frame the view last needed it
+		std::vector<uint8_t> voxels;	// empty unless resident
+	};
+
+	// owns the file handle
+	BrickedVolume(const BrickedVolume&);
+	BrickedVolume& operator=(const BrickedVolume&);
+
+	bool ReadAt(const uint64_t offset, void* const data, const size_t size) const;
+	void Evict(const int index);
+	bool IsVisible(const Matrix4& worldViewProj, const int bx, const int by, const int bz, float& distance) const;
+	int MarchBrick(const int index, const Vec3& front, const Vec3& step, const int begin, const int end, float& resultX, float& resultY) const;
+
+	VolumeDesc m_desc;
+	int m_brickSize;
+	int m_bricksX;
+	int m_bricksY;
+	int m_bricksZ;
+	std::vector<Brick> m_bricks;
+	// buffers of evicted bricks, reused by the next loads
+	std::vector<std::vector<uint8_t>> m_free;
+	size_t m_budget;
+	size_t m_resident;
+	uint64_t m_frame;
+	FrameStats m_stats;
+	std::string m_error;
+
+#ifdef _WIN32
+	void* m_file;
+#else
+	int m_file;
+#endif
+};
+
+#endif // BrickedVolume_h__
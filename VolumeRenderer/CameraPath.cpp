@@ -0,0 +1,69 @@
+#include "CameraPath.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	const float kPi = 3.141592654f;
+	// VolumeCamera's default, |(0, 1.5, -5)|
+	const float kDefaultDistance = 5.2201533f;
+}
+
+CameraPath::CameraPath()
+{
+}
+
+CameraPath::CameraPath(const std::string& name, const std::vector<CameraKey>& keys)
+	: m_name(name), m_keys(keys)
+{
+}
+
+CameraKey CameraPath::Evaluate(const float t) const
+{
+	if (m_keys.empty())
+	{
+		CameraKey key = { 0.f, kDefaultDistance };
+		return key;
+	}
+	if (m_keys.size() == 1)
+	{
+		return m_keys[0];
+	}
+
+	const float x = std::min(std::max(t, 0.f), 1.f) * (m_keys.size() - 1);
+	const size_t i = std::min(static_cast<size_t>(x), m_keys.size() - 2);
+	const float s = x - i;
+	const CameraKey& a = m_keys[i];
+	const CameraKey& b = m_keys[i + 1];
+	CameraKey key = { a.rotation + (b.rotation - a.rotation) * s, a.distance + (b.distance - a.distance) * s };
+	return key;
+}
+
+void CameraPath::Apply(VolumeCamera& camera, const int frame, const int frames) const
+{
+	CameraKey key = Evaluate(frames > 1 ? static_cast<float>(frame) / (frames - 1) : 0.f);
+	camera.SetRotation(key.rotation);
+	camera.SetDistance(key.distance);
+}
+
+std::vector<CameraPath> CameraPath::GetStandardPaths()
+{
+	std::vector<CameraPath> paths;
+	paths.push_back(CameraPath("orbit", { { 0.f, kDefaultDistance }, { 2.f * kPi, kDefaultDistance } }));
+	paths.push_back(CameraPath("zoom", { { 0.f, 20.f }, { 0.25f * kPi, kDefaultDistance }, { 0.5f * kPi, 2.5f } }));
+	paths.push_back(CameraPath("closeup", { { 0.f, 2.5f }, { kPi, 2.5f } }));
+	return paths;
+}
+
+bool CameraPath::FindStandardPath(const std::string& name, CameraPath& path)
+{
+	for (const CameraPath& standard : GetStandardPaths())
+	{
+		if (standard.GetName() == name)
+		{
+			path = standard;
+			return true;
+		}
+	}
+	return false;
+}
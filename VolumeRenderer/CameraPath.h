@@ -0,0 +1,51 @@
+/// <summary>
+/// CameraPath.h
+///
+/// About:
+/// A deterministic camera flight for benchmarks and batch
+/// renders: keyframes of VolumeCamera's rotation and
+/// distance, interpolated linearly over the path's length.
+/// Frame i of n always sees the same view, however long
+/// the frames before it took, unlike VolumeCamera::Update
+/// which spins with the frame time.
+/// </summary>
+#ifndef CameraPath_h__
+#define CameraPath_h__
+
+#include <string>
+#include <vector>
+#include "VolumeCamera.h"
+
+struct CameraKey
+{
+	float rotation;	// radians around the y-axis
+	float distance;	// eye to volume centre
+};
+
+class CameraPath
+{
+public:
+	CameraPath();
+	CameraPath(const std::string& name, const std::vector<CameraKey>& keys);
+
+	const std::string& GetName() const { return m_name; }
+	const std::vector<CameraKey>& GetKeys() const { return m_keys; }
+
+	// the view at t in [0,1] along the path (clamped), keys evenly spaced
+	CameraKey Evaluate(const float t) const;
+	// frame i of frames, the first and last frame on the first and last key
+	void Apply(VolumeCamera& camera, const int frame, const int frames) const;
+
+	// orbit: a full turn at the default distance; zoom: from far, where
+	// coarse mip levels are sampled, to close up while turning a quarter;
+	// closeup: half a turn with the volume filling the view
+	static std::vector<CameraPath> GetStandardPaths();
+	// one of GetStandardPaths by name
+	static bool FindStandardPath(const std::string& name, CameraPath& path);
+
+private:
+	std::string m_name;
+	std::vector<CameraKey> m_keys;
+};
+
+#endif // CameraPath_h__
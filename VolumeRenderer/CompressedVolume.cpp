@@ -0,0 +1,535 @@
+#include "CompressedVolume.h"
+#include "Parallel.h"
+#include "RayCastKernel.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+	const uint8_t kRawBlock = 0xff;
+	const int kBlocksPerBrick = CompressedVolume::kBrickSize / CompressedVolume::kBlockSize;
+	const int kBlockVoxels = CompressedVolume::kBlockSize * CompressedVolume::kBlockSize * CompressedVolume::kBlockSize;
+
+	std::atomic<uint64_t> g_nextVolumeId(1);
+
+	// value of index idx, shared by the encoder and the decoder so the error
+	// the encoder checks is exactly the error the decoder produces
+	inline float Dequantize(const float lo, const float step, const uint32_t idx)
+	{
+		return lo + static_cast<float>(idx) * step;
+	}
+
+	template <typename T>
+	void Append(const T& value, std::vector<uint8_t>& out)
+	{
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+		out.insert(out.end(), bytes, bytes + sizeof(T));
+	}
+
+	template <typename T>
+	T Read(const uint8_t*& p)
+	{
+		T value;
+		memcpy(&value, p, sizeof(T));
+		p += sizeof(T);
+		return value;
+	}
+
+	// kBlockVoxels indices of bits each, LSB first; always whole bytes
+	void PackIndices(const uint32_t* const indices, const int bits, std::vector<uint8_t>& out)
+	{
+		uint64_t pending = 0;
+		int filled = 0;
+		for (int i = 0; i < kBlockVoxels; ++i)
+		{
+			pending |= static_cast<uint64_t>(indices[i]) << filled;
+			filled += bits;
+			while (filled >= 8)
+			{
+				out.push_back(static_cast<uint8_t>(pending));
+				pending >>= 8;
+				filled -= 8;
+			}
+		}
+	}
+
+	// fewest index bits whose half step is within maxError, the encoder
+	// checks the actual error from there on
+	int EstimateIndexBits(const float range, const float maxError)
+	{
+		if (!(maxError > 0.f))
+		{
+			return 1;
+		}
+		float levels = std::ceil(range / (2.f * maxError));
+		int bits = 1;
+		while (bits < CompressedVolume::kMaxIndexBits && static_cast<float>((1u << bits) - 1) < levels)
+		{
+			++bits;
+		}
+		return bits;
+	}
+}
+
+CompressedVolume::DecodeCache::DecodeCache(const int slots)
+{
+	const int count = std::max(slots, 1);
+	m_volumeId = 0;
+	m_voxels.resize(static_cast<size_t>(count) * kBrickVoxels);
+	m_slotBrick.assign(count, -1);
+	m_slotUsed.assign(count, 0);
+	m_lastIndex = -1;
+	m_lastVoxels = nullptr;
+	m_clock = 0;
+	m_hits = 0;
+	m_misses = 0;
+}
+
+void CompressedVolume::DecodeCache::Bind(const CompressedVolume& volume)
+{
+	m_volumeId = volume.m_id;
+	m_brickSlot.assign(volume.GetBrickCount(), -1);
+	std::fill(m_slotBrick.begin(), m_slotBrick.end(), -1);
+	std::fill(m_slotUsed.begin(), m_slotUsed.end(), 0);
+	m_lastIndex = -1;
+	m_lastVoxels = nullptr;
+}
+
+const float* CompressedVolume::DecodeCache::GetBrick(const CompressedVolume& volume, const int index)
+{
+	if (m_volumeId != volume.m_id)
+	{
+		Bind(volume);
+	}
+
+	// consecutive samples mostly stay in one brick
+	if (index == m_lastIndex)
+	{
+		++m_hits;
+		return m_lastVoxels;
+	}
+
+	int slot = m_brickSlot[index];
+	if (slot >= 0)
+	{
+		++m_hits;
+	}
+	else
+	{
+		// least recently used slot, free ones have never been used
+		++m_misses;
+		slot = static_cast<int>(std::min_element(m_slotUsed.begin(), m_slotUsed.end()) - m_slotUsed.begin());
+		if (m_slotBrick[slot] >= 0)
+		{
+			m_brickSlot[m_slotBrick[slot]] = -1;
+		}
+		volume.DecodeBrick(index, m_voxels.data() + static_cast<size_t>(slot) * kBrickVoxels);
+		m_slotBrick[slot] = index;
+		m_brickSlot[index] = slot;
+	}
+
+	m_slotUsed[slot] = ++m_clock;
+	m_lastIndex = index;
+	m_lastVoxels = m_voxels.data() + static_cast<size_t>(slot) * kBrickVoxels;
+	return m_lastVoxels;
+}
+
+CompressedVolume::CompressedVolume()
+{
+	m_maxError = 0.f;
+	m_id = 0;
+	m_bricksX = m_bricksY = m_bricksZ = 0;
+}
+
+bool CompressedVolume::Compress(const Volume& volume, const float maxError)
+{
+	if (!volume.IsLoaded() || !(maxError >= 0.f))
+	{
+		return false;
+	}
+
+	Shutdown();
+	m_desc = volume.GetDesc();
+	m_maxError = maxError;
+	m_bricksX = (m_desc.width + kBrickSize - 1) / kBrickSize;
+	m_bricksY = (m_desc.height + kBrickSize - 1) / kBrickSize;
+	m_bricksZ = (m_desc.depth + kBrickSize - 1) / kBrickSize;
+
+	// the brick ranges are those of a macrocell grid with brick sized cells
+	if (!m_ranges.Build(volume, kBrickSize))
+	{
+		Shutdown();
+		return false;
+	}
+
+	// one job per row of bricks, each brick compressed into its own buffer
+	const int count = m_bricksX * m_bricksY * m_bricksZ;
+	std::vector<std::vector<uint8_t>> bricks(count);
+	DispatchVoxelType(m_desc.type, [&](auto voxel) {
+		typedef decltype(voxel) T;
+		ParallelFor(m_bricksY * m_bricksZ, [&](int begin, int end) {
+			for (int row = begin; row < end; ++row)
+			{
+				for (int bx = 0; bx < m_bricksX; ++bx)
+				{
+					CompressBrick<T>(volume, bx, row % m_bricksY, row / m_bricksY, bricks[row * m_bricksX + bx]);
+				}
+			}
+		});
+	});
+
+	size_t total = 0;
+	for (const std::vector<uint8_t>& brick : bricks)
+	{
+		total += brick.size();
+	}
+	m_data.reserve(total);
+	m_brickOffsets.resize(count);
+	for (int i = 0; i < count; ++i)
+	{
+		m_brickOffsets[i] = m_data.size();
+		m_data.insert(m_data.end(), bricks[i].begin(), bricks[i].end());
+	}
+
+	m_id = g_nextVolumeId++;
+	return true;
+}
+
+void CompressedVolume::Shutdown()
+{
+	m_data.clear();
+	m_data.shrink_to_fit();
+	m_brickOffsets.clear();
+	m_brickOffsets.shrink_to_fit();
+	m_ranges.Shutdown();
+	m_desc = VolumeDesc();
+	m_maxError = 0.f;
+	m_bricksX = m_bricksY = m_bricksZ = 0;
+	// caches bound to the old contents rebind on their next lookup
+	m_id = 0;
+}
+
+size_t CompressedVolume::GetMemoryUsage() const
+{
+	return m_data.size() + m_brickOffsets.size() * sizeof(uint64_t) + m_ranges.GetMemoryUsage();
+}
+
+double CompressedVolume::GetCompressionRatio() const
+{
+	size_t used = GetMemoryUsage();
+	return used > 0 ? static_cast<double>(m_desc.GetByteSize()) / used : 0.0;
+}
+
+template <typename T>
+void CompressedVolume::CompressBrick(const Volume& volume, const int bx, const int by, const int bz, std::vector<uint8_t>& out) const
+{
+	typedef VoxelTraits<T> Traits;
+	const int width = m_desc.width;
+	const int height = m_desc.height;
+	const int depth = m_desc.depth;
+	const T* data = volume.GetVoxels<T>();
+
+	T raw[kBlockVoxels];
+	float values[kBlockVoxels];
+	uint32_t indices[kBlockVoxels];
+
+	for (int blockZ = 0; blockZ < kBlocksPerBrick; ++blockZ)
+	{
+		for (int blockY = 0; blockY < kBlocksPerBrick; ++blockY)
+		{
+			for (int blockX = 0; blockX < kBlocksPerBrick; ++blockX)
+			{
+				const int x0 = bx * kBrickSize + blockX * kBlockSize;
+				const int y0 = by * kBrickSize + blockY * kBlockSize;
+				const int z0 = bz * kBrickSize + blockZ * kBlockSize;
+				if (x0 >= width || y0 >= height || z0 >= depth)
+				{
+					// past the edge, never sampled
+					out.push_back(0);
+					Append(T(), out);
+					continue;
+				}
+
+				// blocks straddling the edge repeat the last voxel
+				int lo = 0;
+				int hi = 0;
+				bool finite = true;
+				for (int i = 0; i < kBlockVoxels; ++i)
+				{
+					int x = std::min(x0 + i % kBlockSize, width - 1);
+					int y = std::min(y0 + i / kBlockSize % kBlockSize, height - 1);
+					int z = std::min(z0 + i / (kBlockSize * kBlockSize), depth - 1);
+					raw[i] = data[(static_cast<size_t>(z) * height + y) * width + x];
+					values[i] = Traits::ToFloat(raw[i]);
+					finite = finite && std::isfinite(values[i]);
+					lo = values[i] < values[lo] ? i : lo;
+					hi = values[i] > values[hi] ? i : hi;
+				}
+
+				if (finite && values[lo] == values[hi])
+				{
+					out.push_back(0);
+					Append(raw[lo], out);
+					continue;
+				}
+
+				// the fewest index bits that meet the bound
+				int bits = finite ? EstimateIndexBits(values[hi] - values[lo], m_maxError) : kMaxIndexBits + 1;
+				for (; bits <= kMaxIndexBits; ++bits)
+				{
+					const uint32_t levels = (1u << bits) - 1;
+					const float base = values[lo];
+					const float step = (values[hi] - base) / static_cast<float>(levels);
+					const float scale = static_cast<float>(levels) / (values[hi] - base);
+					bool within = true;
+					for (int i = 0; i < kBlockVoxels && within; ++i)
+					{
+						uint32_t q = std::min(static_cast<uint32_t>((values[i] - base) * scale + 0.5f), levels);
+						indices[i] = q;
+						within = std::fabs(Dequantize(base, step, q) - values[i]) <= m_maxError;
+					}
+					if (within)
+					{
+						break;
+					}
+				}
+
+				if (bits > kMaxIndexBits)
+				{
+					out.push_back(kRawBlock);
+					for (int i = 0; i < kBlockVoxels; ++i)
+					{
+						Append(raw[i], out);
+					}
+					continue;
+				}
+
+				out.push_back(static_cast<uint8_t>(bits));
+				Append(raw[lo], out);
+				Append(raw[hi], out);
+				PackIndices(indices, bits, out);
+			}
+		}
+	}
+}
+
+void CompressedVolume::DecodeBrick(const int index, float* const voxels) const
+{
+	DispatchVoxelType(m_desc.type, [&](auto voxel) {
+		DecodeBrickBlocks<decltype(voxel)>(index, voxels);
+	});
+}
+
+template <typename T>
+void CompressedVolume::DecodeBrickBlocks(const int index, float* const voxels) const
+{
+	typedef VoxelTraits<T> Traits;
+	const uint8_t* p = m_data.data() + m_brickOffsets[index];
+
+	for (int blockZ = 0; blockZ < kBlocksPerBrick; ++blockZ)
+	{
+		for (int blockY = 0; blockY < kBlocksPerBrick; ++blockY)
+		{
+			for (int blockX = 0; blockX < kBlocksPerBrick; ++blockX)
+			{
+				float* block = voxels + ((blockZ * kBrickSize + blockY) * kBrickSize + blockX) * kBlockSize;
+				const uint8_t bits = *p++;
+
+				float values[kBlockVoxels];
+				if (bits == kRawBlock)
+				{
+					for (int i = 0; i < kBlockVoxels; ++i)
+					{
+						values[i] = Traits::ToFloat(Read<T>(p));
+					}
+				}
+				else if (bits == 0)
+				{
+					std::fill(values, values + kBlockVoxels, Traits::ToFloat(Read<T>(p)));
+				}
+				else
+				{
+					const float base = Traits::ToFloat(Read<T>(p));
+					const float top = Traits::ToFloat(Read<T>(p));
+					const uint32_t levels = (1u << bits) - 1;
+					const float step = (top - base) / static_cast<float>(levels);
+
+					uint64_t pending = 0;
+					int filled = 0;
+					for (int i = 0; i < kBlockVoxels; ++i)
+					{
+						while (filled < bits)
+						{
+							pending |= static_cast<uint64_t>(*p++) << filled;
+							filled += 8;
+						}
+						values[i] = Dequantize(base, step, static_cast<uint32_t>(pending) & levels);
+						pending >>= bits;
+						filled -= bits;
+					}
+				}
+
+				// one row of kBlockSize voxels at a time
+				for (int row = 0; row < kBlockSize * kBlockSize; ++row)
+				{
+					int y = row % kBlockSize;
+					int z = row / kBlockSize;
+					memcpy(block + (z * kBrickSize + y) * kBrickSize, values + row * kBlockSize, kBlockSize * sizeof(float));
+				}
+			}
+		}
+	}
+}
+
+float CompressedVolume::Load(DecodeCache& cache, const int x, const int y, const int z) const
+{
+	if (x < 0 || y < 0 || z < 0 || x >= m_desc.width || y >= m_desc.height || z >= m_desc.depth)
+	{
+		return 0.f;
+	}
+	const int mask = kBrickSize - 1;
+	int index = ((z >> kBrickShift) * m_bricksY + (y >> kBrickShift)) * m_bricksX + (x >> kBrickShift);
+	const float* brick = cache.GetBrick(*this, index);
+	return brick[(((z & mask) << kBrickShift) + (y & mask)) * kBrickSize + (x & mask)];
+}
+
+float CompressedVolume::Sample(DecodeCache& cache, const Vec3& uvw) const
+{
+	// Volume::Sample on the decoded voxels
+	float fx = uvw.x * m_desc.width - 0.5f;
+	float fy = uvw.y * m_desc.height - 0.5f;
+	float fz = uvw.z * m_desc.depth - 0.5f;
+
+	float flx = std::floor(fx);
+	float fly = std::floor(fy);
+	float flz = std::floor(fz);
+
+	int x0 = static_cast<int>(flx);
+	int y0 = static_cast<int>(fly);
+	int z0 = static_cast<int>(flz);
+
+	float tx = fx - flx;
+	float ty = fy - fly;
+	float tz = fz - flz;
+
+	float c000, c100, c010, c110, c001, c101, c011, c111;
+	const int mask = kBrickSize - 1;
+	if (x0 >= 0 && y0 >= 0 && z0 >= 0 && x0 + 1 < m_desc.width && y0 + 1 < m_desc.height && z0 + 1 < m_desc.depth &&
+		(x0 & mask) != mask && (y0 & mask) != mask && (z0 & mask) != mask)
+	{
+		// all eight corners in one brick
+		int index = ((z0 >> kBrickShift) * m_bricksY + (y0 >> kBrickShift)) * m_bricksX + (x0 >> kBrickShift);
+		const float* v = cache.GetBrick(*this, index) + (((z0 & mask) << kBrickShift) + (y0 & mask)) * kBrickSize + (x0 & mask);
+		const int dy = kBrickSize;
+		const int dz = kBrickSize * kBrickSize;
+		c000 = v[0];
+		c100 = v[1];
+		c010 = v[dy];
+		c110 = v[dy + 1];
+		c001 = v[dz];
+		c101 = v[dz + 1];
+		c011 = v[dz + dy];
+		c111 = v[dz + dy + 1];
+	}
+	else
+	{
+		c000 = Load(cache, x0, y0, z0);
+		c100 = Load(cache, x0 + 1, y0, z0);
+		c010 = Load(cache, x0, y0 + 1, z0);
+		c110 = Load(cache, x0 + 1, y0 + 1, z0);
+		c001 = Load(cache, x0, y0, z0 + 1);
+		c101 = Load(cache, x0 + 1, y0, z0 + 1);
+		c011 = Load(cache, x0, y0 + 1, z0 + 1);
+		c111 = Load(cache, x0 + 1, y0 + 1, z0 + 1);
+	}
+
+	float c00 = c000 + (c100 - c000) * tx;
+	float c10 = c010 + (c110 - c010) * tx;
+	float c01 = c001 + (c101 - c001) * tx;
+	float c11 = c011 + (c111 - c011) * tx;
+
+	float c0 = c00 + (c10 - c00) * ty;
+	float c1 = c01 + (c11 - c01) * ty;
+
+	return c0 + (c1 - c0) * tz;
+}
+
+int CompressedVolume::MarchSegment(DecodeCache& cache, const VoxelWindow& window, const Vec3& front, const Vec3& step, const int begin, const int end, float& resultX, float& resultY) const
+{
+	int i = begin;
+	for (; i < end && resultY < g_fOpacityThreshold; ++i)
+	{
+		float src = window.Apply(Sample(cache, front + step * static_cast<float>(i)));
+
+		// Front to back blending
+		float weight = (1.f - resultY) * src;
+		resultX += weight * src;
+		resultY += weight * src;
+	}
+	return i - begin;
+}
+
+int CompressedVolume::March(DecodeCache& cache, const VoxelWindow& window, const Vec3& front, const Vec3& step, const int numSteps, float& resultX, float& resultY) const
+{
+	// same 3D-DDA as the macrocell walk in RayCastKernel.cpp, over bricks;
+	// bricks whose range (apron included) is transparent aren't decoded
+	const int bricks[3] = { m_bricksX, m_bricksY, m_bricksZ };
+	const float scale[3] = {
+		static_cast<float>(m_desc.width) / kBrickSize,
+		static_cast<float>(m_desc.height) / kBrickSize,
+		static_cast<float>(m_desc.depth) / kBrickSize };
+	const float origin[3] = { front.x * scale[0], front.y * scale[1], front.z * scale[2] };
+	const float dir[3] = { step.x * scale[0], step.y * scale[1], step.z * scale[2] };
+
+	int cell[3], cellStep[3];
+	float tMax[3], tDelta[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		cell[axis] = std::min(std::max(static_cast<int>(std::floor(origin[axis])), 0), bricks[axis] - 1);
+		if (dir[axis] > 0.f)
+		{
+			cellStep[axis] = 1;
+			tMax[axis] = (cell[axis] + 1 - origin[axis]) / dir[axis];
+			tDelta[axis] = 1.f / dir[axis];
+		}
+		else if (dir[axis] < 0.f)
+		{
+			cellStep[axis] = -1;
+			tMax[axis] = (cell[axis] - origin[axis]) / dir[axis];
+			tDelta[axis] = -1.f / dir[axis];
+		}
+		else
+		{
+			cellStep[axis] = 0;
+			tMax[axis] = tDelta[axis] = std::numeric_limits<float>::infinity();
+		}
+	}
+
+	int taken = 0;
+	int i = 0;
+	while (i < numSteps && resultY < g_fOpacityThreshold)
+	{
+		int axis = tMax[0] < tMax[1] ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+		float tExit = tMax[axis];
+		int end = tExit >= static_cast<float>(numSteps) ? numSteps : static_cast<int>(std::floor(tExit)) + 1;
+
+		if (window.Apply(m_ranges.GetMax(m_ranges.GetIndex(cell[0], cell[1], cell[2]))) > 0.f)
+		{
+			taken += MarchSegment(cache, window, front, step, i, end, resultX, resultY);
+		}
+		i = std::max(i, end);
+
+		cell[axis] += cellStep[axis];
+		if (cell[axis] < 0 || cell[axis] >= bricks[axis])
+		{
+			// left the grid, any remaining step is right on the boundary
+			taken += MarchSegment(cache, window, front, step, i, numSteps, resultX, resultY);
+			break;
+		}
+		tMax[axis] += tDelta[axis];
+	}
+	return taken;
+}
@@ -0,0 +1,124 @@
+/// <summary>
+/// CompressedVolume.h
+///
+/// About:
+/// Lossy in-memory copy of a Volume, for keeping more of
+/// them resident. The voxels are split into 4x4x4 blocks,
+/// each stored BC4-style as two endpoints (its min and max)
+/// plus a b-bit index per voxel into the evenly spaced
+/// levels between them. Every block gets the fewest bits
+/// that keep all of its voxels within the error bound, flat
+/// blocks none at all. Blocks the bound can't be met for
+/// with 16 bits are stored as they are.
+///
+/// Blocks are grouped into 16^3 voxel bricks, the unit the
+/// sampler decodes. Each render thread keeps a small
+/// DecodeCache of decoded bricks, least recently used out
+/// first, and March() samples straight from it, skipping
+/// the bricks that are empty under the window.
+/// </summary>
+#ifndef CompressedVolume_h__
+#define CompressedVolume_h__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Volume.h"
+#include "VolumeMath.h"
+
+class CompressedVolume
+{
+public:
+	static const int kBlockSize = 4;
+	static const int kBrickShift = 4;
+	static const int kBrickSize = 1 << kBrickShift;
+	static const int kBrickVoxels = kBrickSize * kBrickSize * kBrickSize;
+	// most index bits a block uses before it is stored as is
+	static const int kMaxIndexBits = 16;
+	static const int kDefaultCacheSlots = 128;
+
+	// Decoded bricks of one volume for one thread, not thread safe
+	class DecodeCache
+	{
+	public:
+		explicit DecodeCache(const int slots = kDefaultCacheSlots);
+
+		// brick index of volume as kBrickVoxels raw values (x fastest),
+		// decoded on a miss; valid until the next call
+		const float* GetBrick(const CompressedVolume& volume, const int index);
+
+		uint64_t GetHits() const { return m_hits; }
+		uint64_t GetMisses() const { return m_misses; }
+		void ResetStats() { m_hits = m_misses = 0; }
+
+	private:
+		void Bind(const CompressedVolume& volume);
+
+		// CompressedVolume::m_id the bricks were decoded from
+		uint64_t m_volumeId;
+		std::vector<float> m_voxels;
+		std::vector<int> m_slotBrick;		// brick held by each slot, -1 if free
+		std::vector<uint64_t> m_slotUsed;	// last lookup, for LRU
+		std::vector<int> m_brickSlot;		// slot of each brick, -1 if not cached
+		int m_lastIndex;
+		const float* m_lastVoxels;
+		uint64_t m_clock;
+		uint64_t m_hits;
+		uint64_t m_misses;
+	};
+
+	CompressedVolume();
+
+	// Compresses volume so that no decoded voxel is further than maxError
+	// (in raw voxel units) from the original, bricks in parallel. The
+	// source isn't needed afterwards.
+	bool Compress(const Volume& volume, const float maxError);
+	void Shutdown();
+
+	bool IsCompressed() const { return !m_brickOffsets.empty(); }
+	const VolumeDesc& GetDesc() const { return m_desc; }
+	Vec3 GetExtent() const { return m_desc.GetExtent(); }
+	float GetMaxError() const { return m_maxError; }
+	int GetBricksX() const { return m_bricksX; }
+	int GetBricksY() const { return m_bricksY; }
+	int GetBricksZ() const { return m_bricksZ; }
+	int GetBrickCount() const { return static_cast<int>(m_brickOffsets.size()); }
+	// compressed blocks plus the per brick tables
+	size_t GetMemoryUsage() const;
+	// uncompressed voxel bytes per byte used
+	double GetCompressionRatio() const;
+
+	// decodes brick index into kBrickVoxels raw values, x fastest; voxels
+	// past the edge of the volume are undefined
+	void DecodeBrick(const int index, float* const voxels) const;
+
+	// Marches steps [0, numSteps) of one ray like RayCastPacketScalar at lod 0,
+	// front in texture space, samples put through window. Returns the steps taken.
+	int March(DecodeCache& cache, const VoxelWindow& window, const Vec3& front, const Vec3& step, const int numSteps, float& resultX, float& resultY) const;
+
+private:
+	template <typename T>
+	void CompressBrick(const Volume& volume, const int bx, const int by, const int bz, std::vector<uint8_t>& out) const;
+	template <typename T>
+	void DecodeBrickBlocks(const int index, float* const voxels) const;
+
+	float Load(DecodeCache& cache, const int x, const int y, const int z) const;
+	float Sample(DecodeCache& cache, const Vec3& uvw) const;
+	int MarchSegment(DecodeCache& cache, const VoxelWindow& window, const Vec3& front, const Vec3& step, const int begin, const int end, float& resultX, float& resultY) const;
+
+	VolumeDesc m_desc;
+	float m_maxError;
+	// unique per Compress, so caches notice a volume compressed again in place
+	uint64_t m_id;
+	int m_bricksX;
+	int m_bricksY;
+	int m_bricksZ;
+	// the blocks of every brick back to back, x fastest within the brick:
+	// index bits (0xff: stored as is), endpoints, packed indices
+	std::vector<uint8_t> m_data;
+	std::vector<uint64_t> m_brickOffsets;
+	// raw range of every brick and its apron, cells and bricks line up
+	MacrocellGrid m_ranges;
+};
+
+#endif // CompressedVolume_h__
@@ -0,0 +1,85 @@
+#include "CpuFeatures.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#endif
+
+#if defined(_MSC_VER) || (defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)))
+#define CPUFEATURES_X86
+#endif
+
+#ifdef CPUFEATURES_X86
+static void CpuId(const int leaf, const int subLeaf, unsigned int regs[4])
+{
+#if defined(_MSC_VER)
+	int r[4];
+	__cpuidex(r, leaf, subLeaf);
+	for (int i = 0; i < 4; ++i)
+	{
+		regs[i] = static_cast<unsigned int>(r[i]);
+	}
+#else
+	__cpuid_count(leaf, subLeaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static unsigned long long ReadXCR0()
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+}
+#endif
+
+static CpuFeatures DetectCpuFeatures()
+{
+	CpuFeatures features = {};
+
+#ifdef CPUFEATURES_X86
+	unsigned int regs[4];
+	CpuId(0, 0, regs);
+	unsigned int maxLeaf = regs[0];
+	if (maxLeaf < 7)
+	{
+		return features;
+	}
+
+	CpuId(1, 0, regs);
+	bool osxsave = (regs[2] & (1u << 27)) != 0;
+	bool fma = (regs[2] & (1u << 12)) != 0;
+	bool avx = (regs[2] & (1u << 28)) != 0;
+	bool f16c = (regs[2] & (1u << 29)) != 0;
+	if (!osxsave || !avx)
+	{
+		return features;
+	}
+
+	// OS must save XMM/YMM (bits 1,2) and for AVX-512 opmask/ZMM (bits 5,6,7)
+	unsigned long long xcr0 = ReadXCR0();
+	bool ymmState = (xcr0 & 0x6) == 0x6;
+	bool zmmState = (xcr0 & 0xe6) == 0xe6;
+
+	CpuId(7, 0, regs);
+	bool avx2 = (regs[1] & (1u << 5)) != 0;
+	bool avx512f = (regs[1] & (1u << 16)) != 0;
+	bool avx512bw = (regs[1] & (1u << 30)) != 0;
+
+	features.avx2 = ymmState && avx2 && fma && f16c;
+	features.avx512 = features.avx2 && zmmState && avx512f && avx512bw;
+#endif
+
+	return features;
+}
+
+const CpuFeatures& GetCpuFeatures()
+{
+	static const CpuFeatures features = DetectCpuFeatures();
+	return features;
+}
@@ -0,0 +1,21 @@
+/// <summary>
+/// CpuFeatures.h
+///
+/// About:
+/// Runtime detection of the SIMD instruction sets the CPU
+/// kernels can use. Checks both the CPU (cpuid) and that the
+/// OS saves the wider registers (xgetbv).
+/// </summary>
+#ifndef CpuFeatures_h__
+#define CpuFeatures_h__
+
+struct CpuFeatures
+{
+	bool avx2;		// AVX2 + FMA + F16C (half voxels)
+	bool avx512;	// AVX-512 F + BW
+};
+
+// detected once, then cached
+const CpuFeatures& GetCpuFeatures();
+
+#endif // CpuFeatures_h__
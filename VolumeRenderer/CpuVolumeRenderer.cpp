@@ -0,0 +1,807 @@
+#include "CpuVolumeRenderer.h"
+#include "BlueNoise.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	// phase k of the 4x4 blocks is pixel kRefineOrder[k] (y * 4 + x), the
+	// order of a 4x4 Bayer matrix so every few phases cover the block evenly
+	const int kRefineOrder[16] = { 0, 10, 2, 8, 5, 15, 7, 13, 1, 11, 3, 9, 4, 14, 6, 12 };
+
+	// tiers refine down to a quarter of the step the view is drawn with
+	const float kMinRefineStepScale = 0.25f;
+
+	// frames of history a pixel keeps while the camera moves
+	const int kMotionHistoryLength = 2;
+
+	// each byte's minimum and maximum with the pixels either side, the row's
+	// ends clamped
+	void RowMinMax(const uint8_t* row, const int width, uint8_t* lo, uint8_t* hi)
+	{
+		const int bytes = width * 4;
+		for (int i = 0; i < bytes; ++i)
+		{
+			const uint8_t left = row[i >= 4 ? i - 4 : i];
+			const uint8_t right = row[i + 4 < bytes ? i + 4 : i];
+			lo[i] = std::min(std::min(left, row[i]), right);
+			hi[i] = std::max(std::max(left, row[i]), right);
+		}
+	}
+}
+
+CpuVolumeRenderer::CpuVolumeRenderer()
+{
+	m_width = 0;
+	m_height = 0;
+	m_stats = FrameStats();
+	m_forcePath = false;
+	m_forcedPath = RayCastPath::Scalar;
+	m_skipEmpty = true;
+	m_levelOfDetail = true;
+	m_customWindow = false;
+	m_classification = Classification::Identity;
+	m_stepScale = 1.f;
+	m_shading = false;
+	m_gradientVolume = false;
+	m_gradientFilter = GradientFilter::Central;
+	m_computeStats = true;
+	m_statsCached = false;
+	m_progressive = false;
+	m_convergenceThreshold = 0.5f;
+	m_progressiveStats = ProgressiveStats();
+	m_jitter = false;
+	m_jitterFrame = 0;
+	m_temporal = false;
+	m_historyLength = 16;
+	m_temporalStats = TemporalStats();
+	m_volume = std::make_shared<Volume>();
+	m_cache = nullptr;
+}
+
+bool CpuVolumeRenderer::Initialize(const int width, const int height)
+{
+	if (width <= 0 || height <= 0)
+	{
+		return false;
+	}
+
+	m_width = width;
+	m_height = height;
+	m_frame.assign(static_cast<size_t>(width) * height * 4, 0);
+
+	m_camera.Initialize();
+	return true;
+}
+
+bool CpuVolumeRenderer::LoadVolume(const std::string& file, const VolumeDesc& desc)
+{
+	std::shared_ptr<Volume> volume = m_cache != nullptr ? m_cache->Find(file, desc) : nullptr;
+	if (volume && m_gradientVolume && (!volume->GetGradients().IsBuilt() || volume->GetGradients().GetFilter() != m_gradientFilter))
+	{
+		// cached without the gradients wanted, loaded again rather than built
+		// into a volume other renderers may be drawing
+		volume = nullptr;
+	}
+	if (!volume)
+	{
+		// a fresh volume, so a failed load leaves the current one (and any
+		// renderer sharing it through the cache) untouched; copied out of the
+		// mapping, which the kernels' gathers are slower from
+		volume = std::make_shared<Volume>();
+		if (!volume->Load(file, desc) || !volume->CopyToMemory() || !volume->BuildMacrocells() || !volume->BuildMips() ||
+			(m_gradientVolume && !volume->BuildGradients(m_gradientFilter)))
+		{
+			m_loadError = volume->GetError();
+			return false;
+		}
+		if (m_cache != nullptr)
+		{
+			m_cache->Insert(file, desc, volume);
+		}
+	}
+
+	SetVolume(volume);
+	if (m_computeStats)
+	{
+		// from the sidecar when it is current, so reloads skip the pass
+		LoadVolumeStats(file, *volume, m_volumeStats, m_statsCached);
+	}
+	m_loadError.clear();
+	return true;
+}
+
+void CpuVolumeRenderer::SetVolume(const std::shared_ptr<Volume>& volume)
+{
+	m_volume = volume;
+	m_volumeStats = VolumeStats();
+	m_statsCached = false;
+	m_refine.valid = false;
+	m_history.valid = false;
+	m_camera.SetScale(m_volume->GetExtent());
+}
+
+void CpuVolumeRenderer::Update(const float dt)
+{
+	m_camera.Update(dt);
+}
+
+void CpuVolumeRenderer::Render()
+{
+	Render(m_camera, *m_volume);
+}
+
+void CpuVolumeRenderer::Render(const VolumeCamera& camera, const Volume& volume)
+{
+	if (m_progressive)
+	{
+		RenderProgressive(camera, volume);
+		return;
+	}
+
+	RefinePass pass;
+	pass.jitter = m_jitter;
+	pass.entries = m_temporal;
+	RenderPass(camera, volume, pass);
+	if (pass.jitter)
+	{
+		++m_jitterFrame;
+	}
+	if (m_temporal)
+	{
+		Accumulate(camera, volume);
+	}
+}
+
+int CpuVolumeRenderer::SelectLevel(const VolumeCamera& camera, const Volume& volume) const
+{
+	// the coarsest level whose voxels still cover about a pixel
+	if (!m_levelOfDetail)
+	{
+		return 0;
+	}
+	float footprint = camera.GetVoxelFootprint(volume.GetWidth(), volume.GetHeight(), volume.GetDepth(), m_height);
+	return MipChain::SelectLevel(footprint, volume.GetMipCount() - 1);
+}
+
+void CpuVolumeRenderer::RenderPass(const VolumeCamera& camera, const Volume& volume, const RefinePass& pass)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if (pass.clear)
+	{
+		std::fill(m_frame.begin(), m_frame.end(), 0);
+	}
+
+	const int lod = std::min(std::max(SelectLevel(camera, volume) + pass.lodBias, 0), volume.GetMipCount() - 1);
+	const Volume& level = volume.GetMip(lod);
+
+	RayCastPath path = GetBestRayCastPath(level);
+	if (m_forcePath && IsRayCastPathSupported(m_forcedPath, level))
+	{
+		path = m_forcedPath;
+	}
+
+	// the transfer function's tables for this frame's step, rebuilt only where
+	// the function or the step changed
+	const bool classify = m_classification != Classification::Identity;
+	const float stepScale = classify ? m_stepScale * pass.stepScale : 1.f;
+	if (classify)
+	{
+		m_transferTables.Update(m_transfer, std::ldexp(stepScale, lod));
+	}
+
+	// classify the level's macrocells for this frame, volumes without a grid sample every step
+	VoxelWindow window = m_customWindow ? m_window : VoxelWindow::GetDefault(volume.GetDesc().type);
+	const GradientVolume* gradients = m_gradientVolume && level.GetGradients().IsBuilt() ? &level.GetGradients() : nullptr;
+	RayCastContext context = { &level, nullptr, nullptr, lod, window, m_classification, classify ? &m_transferTables : nullptr, m_shading, gradients };
+	if (m_skipEmpty && level.GetMacrocells().IsBuilt())
+	{
+		float opacity[256];
+		if (classify)
+		{
+			m_transfer.GetOpacity(opacity);
+		}
+		else
+		{
+			MacrocellGrid::GetIdentityOpacity(opacity);
+		}
+		level.GetMacrocells().Classify(opacity, window, m_occupancy);
+		context.macrocells = &level.GetMacrocells();
+		context.occupancy = m_occupancy.data();
+	}
+
+	// every pixel starts as a miss, RenderTile keeps the entry points of the hits
+	if (pass.entries)
+	{
+		m_history.entry.assign(static_cast<size_t>(m_width) * m_height, Vec3(-1.f, -1.f, -1.f));
+	}
+
+	std::atomic<uint64_t> rays(0);
+	std::atomic<uint64_t> samples(0);
+	Matrix4 invWVP;
+	m_stats = FrameStats();
+	if (volume.IsLoaded() && Matrix4::Inverse(camera.GetWorldViewProj(), invWVP))
+	{
+		const int tiles = ((m_width + kTileSize - 1) / kTileSize) * ((m_height + kTileSize - 1) / kTileSize);
+		m_scheduler.Run(tiles, [&](int tile) {
+			uint64_t tileRays = 0;
+			uint64_t tileSamples = 0;
+			RenderTile(invWVP, context, path, stepScale, pass, tile, tileRays, tileSamples);
+			rays += tileRays;
+			samples += tileSamples;
+		});
+
+		m_stats.tiles = tiles;
+		double busyMs = 0.0;
+		double maxBusyMs = 0.0;
+		for (const TileScheduler::WorkerStats& worker : m_scheduler.GetWorkerStats())
+		{
+			m_stats.tilesStolen += worker.stolen;
+			m_stats.workerIdleMs.push_back(worker.idleMs);
+			m_stats.maxIdleMs = std::max(m_stats.maxIdleMs, worker.idleMs);
+			m_stats.meanIdleMs += worker.idleMs / m_scheduler.GetWorkerStats().size();
+			busyMs += worker.busyMs;
+			maxBusyMs = std::max(maxBusyMs, worker.busyMs);
+		}
+		m_stats.imbalance = busyMs > 0.0 ? static_cast<float>(maxBusyMs * m_scheduler.GetWorkerStats().size() / busyMs) : 1.f;
+	}
+
+	auto stop = std::chrono::high_resolution_clock::now();
+	m_stats.renderMs = std::chrono::duration<double, std::milli>(stop - start).count();
+	m_stats.rays = rays;
+	m_stats.samples = samples;
+	m_stats.samplesSaved = m_stats.rays * GetMaxStepCount(lod, stepScale) - m_stats.samples;
+	m_stats.path = path;
+	m_stats.lod = lod;
+	m_stats.bricksDecoded = 0;
+}
+
+void CpuVolumeRenderer::Render(const VolumeCamera& camera, BrickedVolume& volume)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::fill(m_frame.begin(), m_frame.end(), 0);
+	m_stats = FrameStats();
+
+	std::atomic<uint64_t> rays(0);
+	std::atomic<uint64_t> samples(0);
+	Matrix4 invWVP;
+	if (volume.IsOpen() && Matrix4::Inverse(camera.GetWorldViewProj(), invWVP))
+	{
+		volume.BeginFrame(camera.GetWorldViewProj());
+		ParallelFor(m_height, [&](int begin, int end) {
+			uint64_t bandRays = 0;
+			uint64_t bandSamples = 0;
+			RenderBrickRows(invWVP, volume, begin, end, bandRays, bandSamples);
+			rays += bandRays;
+			samples += bandSamples;
+		});
+	}
+
+	auto stop = std::chrono::high_resolution_clock::now();
+	m_stats.renderMs = std::chrono::duration<double, std::milli>(stop - start).count();
+	m_stats.rays = rays;
+	m_stats.samples = samples;
+	m_stats.samplesSaved = m_stats.rays * g_iMaxIterations - m_stats.samples;
+	m_stats.path = RayCastPath::Scalar;
+	m_stats.lod = 0;
+	m_stats.bricksDecoded = 0;
+}
+
+void CpuVolumeRenderer::Render(const VolumeCamera& camera, const CompressedVolume& volume)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::fill(m_frame.begin(), m_frame.end(), 0);
+
+	// one band of rows per worker, each with its own cache
+	const int bands = std::min(GetWorkerCount(), m_height);
+	while (static_cast<int>(m_decodeCaches.size()) < bands)
+	{
+		m_decodeCaches.emplace_back(new CompressedVolume::DecodeCache());
+	}
+	for (const std::unique_ptr<CompressedVolume::DecodeCache>& cache : m_decodeCaches)
+	{
+		cache->ResetStats();
+	}
+
+	VoxelWindow window = m_customWindow ? m_window : VoxelWindow::GetDefault(volume.GetDesc().type);
+	m_stats = FrameStats();
+	std::atomic<uint64_t> rays(0);
+	std::atomic<uint64_t> samples(0);
+	Matrix4 invWVP;
+	if (volume.IsCompressed() && Matrix4::Inverse(camera.GetWorldViewProj(), invWVP))
+	{
+		ParallelFor(bands, [&](int begin, int end) {
+			for (int band = begin; band < end; ++band)
+			{
+				uint64_t bandRays = 0;
+				uint64_t bandSamples = 0;
+				RenderCompressedRows(invWVP, volume, window, *m_decodeCaches[band], m_height * band / bands, m_height * (band + 1) / bands, bandRays, bandSamples);
+				rays += bandRays;
+				samples += bandSamples;
+			}
+		});
+	}
+
+	auto stop = std::chrono::high_resolution_clock::now();
+	m_stats.renderMs = std::chrono::duration<double, std::milli>(stop - start).count();
+	m_stats.rays = rays;
+	m_stats.samples = samples;
+	m_stats.samplesSaved = m_stats.rays * g_iMaxIterations - m_stats.samples;
+	m_stats.path = RayCastPath::Scalar;
+	m_stats.lod = 0;
+	m_stats.bricksDecoded = 0;
+	for (const std::unique_ptr<CompressedVolume::DecodeCache>& cache : m_decodeCaches)
+	{
+		m_stats.bricksDecoded += cache->GetMisses();
+	}
+}
+
+void CpuVolumeRenderer::Shutdown()
+{
+	m_volume = std::make_shared<Volume>();
+	m_decodeCaches.clear();
+	m_frame.clear();
+	m_width = m_height = 0;
+}
+
+void CpuVolumeRenderer::RenderProgressive(const VolumeCamera& camera, const Volume& volume)
+{
+	ProgressiveStats& stats = m_progressiveStats;
+
+	// anything changed: the coarse image, a pixel per 4x4 block two levels down
+	ViewSettings settings;
+	GetViewSettings(volume, settings);
+	const Matrix4 wvp = camera.GetWorldViewProj();
+	if (!m_refine.valid || memcmp(&m_refine.wvp, &wvp, sizeof(wvp)) != 0 || !IsSameSettings(m_refine.settings, settings))
+	{
+		m_refine.valid = true;
+		m_refine.wvp = wvp;
+		m_refine.settings = std::move(settings);
+		m_refine.start = std::chrono::high_resolution_clock::now();
+
+		RefinePass coarse;
+		coarse.lodBias = 2;
+		coarse.phases = 1;
+		coarse.fill = 4;
+		RenderPass(camera, volume, coarse);
+
+		stats = ProgressiveStats();
+		stats.coverage = 1.f;
+		stats.frames = 1;
+		stats.firstImageMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_refine.start).count();
+		stats.convergedMs = -1.0;
+		stats.renderMs = m_stats.renderMs;
+
+		m_refine.tier = 1;
+		m_refine.phase = 0;
+		m_refine.lodBias = 0;
+		m_refine.tierStepScale = 1.f;
+		return;
+	}
+
+	++stats.frames;
+	if (stats.converged)
+	{
+		// the frame is left as it is
+		const FrameStats last = m_stats;
+		m_stats = FrameStats();
+		m_stats.path = last.path;
+		m_stats.lod = last.lod;
+		return;
+	}
+
+	// the next phases of the tier, kept over what the tiers before rendered
+	if (m_refine.phase == 0 && m_refine.tier > 1)
+	{
+		m_refine.previous = m_frame;
+	}
+	RefinePass refine;
+	refine.lodBias = m_refine.lodBias;
+	refine.stepScale = m_refine.tierStepScale;
+	refine.phases = 0;
+	for (int k = m_refine.phase; k < std::min(m_refine.phase + kRefinePhases, 16); ++k)
+	{
+		refine.phases |= static_cast<uint16_t>(1 << kRefineOrder[k]);
+	}
+	refine.clear = false;
+	RenderPass(camera, volume, refine);
+
+	m_refine.phase = std::min(m_refine.phase + kRefinePhases, 16);
+	stats.tier = m_refine.tier;
+	stats.coverage = m_refine.phase / 16.f;
+	stats.renderMs += m_stats.renderMs;
+	if (m_refine.phase < 16)
+	{
+		return;
+	}
+
+	// the tier is done, a finer one only if it changed the image enough
+	bool converged = false;
+	if (m_refine.tier > 1)
+	{
+		uint64_t diff = 0;
+		for (size_t i = 0; i < m_frame.size(); i += 4)
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				diff += std::abs(static_cast<int>(m_frame[i + c]) - m_refine.previous[i + c]);
+			}
+		}
+		stats.meanDiff = static_cast<double>(diff) / (m_frame.size() / 4 * 3);
+		converged = stats.meanDiff < m_convergenceThreshold;
+	}
+
+	const bool classify = m_classification != Classification::Identity;
+	if (!converged && SelectLevel(camera, volume) + m_refine.lodBias > 0)
+	{
+		--m_refine.lodBias;
+	}
+	else if (!converged && classify && m_refine.tierStepScale > kMinRefineStepScale)
+	{
+		m_refine.tierStepScale *= 0.5f;
+	}
+	else
+	{
+		converged = true;
+	}
+
+	if (converged)
+	{
+		stats.converged = true;
+		stats.convergedMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_refine.start).count();
+		m_refine.previous.clear();
+		return;
+	}
+	++m_refine.tier;
+	m_refine.phase = 0;
+}
+
+void CpuVolumeRenderer::GetViewSettings(const Volume& volume, ViewSettings& settings) const
+{
+	settings.volume = &volume;
+	settings.window = m_customWindow ? m_window : VoxelWindow::GetDefault(volume.GetDesc().type);
+	settings.classification = m_classification;
+	if (m_classification != Classification::Identity)
+	{
+		settings.transfer.assign(m_transfer.GetEntry(0), m_transfer.GetEntry(0) + TransferFunction::kSize * 4);
+	}
+	settings.stepScale = m_stepScale;
+	settings.shading = m_shading;
+	settings.levelOfDetail = m_levelOfDetail;
+}
+
+bool CpuVolumeRenderer::IsSameSettings(const ViewSettings& a, const ViewSettings& b)
+{
+	return a.volume == b.volume && a.window.scale == b.window.scale && a.window.bias == b.window.bias &&
+		a.classification == b.classification && a.transfer == b.transfer && a.stepScale == b.stepScale &&
+		a.shading == b.shading && a.levelOfDetail == b.levelOfDetail;
+}
+
+void CpuVolumeRenderer::Accumulate(const VolumeCamera& camera, const Volume& volume)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// the history only carries over if nothing but the camera moved
+	TemporalState& history = m_history;
+	ViewSettings settings;
+	GetViewSettings(volume, settings);
+	const size_t pixels = static_cast<size_t>(m_width) * m_height;
+	const bool reproject = history.valid && history.count.size() == pixels && history.entry.size() == pixels &&
+		IsSameSettings(history.settings, settings);
+
+	// while the camera moves the clamp can't tell parallax inside the volume
+	// from noise, a long history only blurs, so it is cut short
+	const Matrix4 wvp = camera.GetWorldViewProj();
+	const bool moving = reproject && std::memcmp(&wvp, &history.wvp, sizeof(Matrix4)) != 0;
+	const int length = moving ? std::min(m_historyLength, kMotionHistoryLength) : m_historyLength;
+
+	// the frame's horizontal minimum and maximum, AccumulateRows completes the
+	// 3x3 neighbourhood from the rows above and below
+	history.next.resize(pixels * 4);
+	history.nextCount.resize(pixels);
+	history.rowMin.resize(pixels * 4);
+	history.rowMax.resize(pixels * 4);
+	if (reproject)
+	{
+		ParallelFor(m_height, [&](int begin, int end) {
+			for (int y = begin; y < end; ++y)
+			{
+				const size_t row = static_cast<size_t>(y) * m_width * 4;
+				RowMinMax(&m_frame[row], m_width, &history.rowMin[row], &history.rowMax[row]);
+			}
+		});
+	}
+
+	std::atomic<uint64_t> rays(0);
+	std::atomic<uint64_t> reprojected(0);
+	ParallelFor(m_height, [&](int begin, int end) {
+		uint64_t bandRays = 0;
+		uint64_t bandReprojected = 0;
+		AccumulateRows(reproject, length, begin, end, bandRays, bandReprojected);
+		rays += bandRays;
+		reprojected += bandReprojected;
+	});
+
+	// the blend is next frame's history
+	history.history.swap(history.next);
+	history.count.swap(history.nextCount);
+	history.valid = true;
+	history.wvp = wvp;
+	history.settings = std::move(settings);
+
+	m_temporalStats.frames = reproject ? m_temporalStats.frames + 1 : 1;
+	m_temporalStats.reprojected = rays > 0 ? static_cast<float>(reprojected) / rays : 0.f;
+	m_temporalStats.accumulateMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void CpuVolumeRenderer::AccumulateRows(const bool reproject, const int length, const int begin, const int end, uint64_t& rays, uint64_t& reprojected)
+{
+	TemporalState& history = m_history;
+	const float kInv255 = 1.f / 255.f;
+	const size_t stride = static_cast<size_t>(m_width) * 4;
+	for (int y = begin; y < end; ++y)
+	{
+		// the neighbourhood's rows, clamped at the frame's edges
+		const size_t rows[3] = { std::max(y - 1, 0) * stride, y * stride, std::min(y + 1, m_height - 1) * stride };
+
+		for (int x = 0; x < m_width; ++x)
+		{
+			const size_t index = static_cast<size_t>(y) * m_width + x;
+			float* out = &history.next[index * 4];
+			uint8_t* px = &m_frame[index * 4];
+			for (int c = 0; c < 4; ++c)
+			{
+				out[c] = px[c] * kInv255;
+			}
+
+			// a miss has no history, and leaves none
+			const Vec3& entry = history.entry[index];
+			if (entry.x < -0.5f)
+			{
+				history.nextCount[index] = 0;
+				continue;
+			}
+			++rays;
+
+			// where the entry point was on last frame's screen, texture to model space
+			float previous[4];
+			int count = 0;
+			if (reproject)
+			{
+				Vec4 clip = Mul(history.wvp, Vec4(2.f * entry.x - 1.f, 2.f * entry.y - 1.f, 2.f * entry.z - 1.f, 1.f));
+				if (clip.w > 0.f)
+				{
+					float prevX = (clip.x / clip.w + 1.f) * 0.5f * m_width - 0.5f;
+					float prevY = (1.f - clip.y / clip.w) * 0.5f * m_height - 0.5f;
+					SampleHistory(prevX, prevY, previous, count);
+				}
+			}
+			if (count == 0)
+			{
+				history.nextCount[index] = 1;
+				continue;
+			}
+			++reprojected;
+
+			// clamped to this frame's 3x3 neighbourhood, so what the entry point
+			// doesn't reproject well (disocclusions, parallax inside the volume)
+			// can't ghost
+			const int frames = std::min(count + 1, length);
+			for (int c = 0; c < 4; ++c)
+			{
+				const size_t i = static_cast<size_t>(x) * 4 + c;
+				const uint8_t lo = std::min(std::min(history.rowMin[rows[0] + i], history.rowMin[rows[1] + i]), history.rowMin[rows[2] + i]);
+				const uint8_t hi = std::max(std::max(history.rowMax[rows[0] + i], history.rowMax[rows[1] + i]), history.rowMax[rows[2] + i]);
+				const float clamped = std::min(std::max(previous[c], lo * kInv255), hi * kInv255);
+				out[c] = clamped + (out[c] - clamped) / frames;
+				px[c] = static_cast<uint8_t>(std::min(std::max(out[c], 0.f), 1.f) * 255.f + 0.5f);
+			}
+			history.nextCount[index] = static_cast<uint16_t>(frames);
+		}
+	}
+}
+
+bool CpuVolumeRenderer::SampleHistory(const float x, const float y, float rgba[4], int& count) const
+{
+	// bilinear, only if all four texels hit the volume
+	count = 0;
+	const int x0 = static_cast<int>(std::floor(x));
+	const int y0 = static_cast<int>(std::floor(y));
+	if (x0 < 0 || y0 < 0 || x0 + 1 >= m_width || y0 + 1 >= m_height)
+	{
+		return false;
+	}
+	const float fx = x - x0;
+	const float fy = y - y0;
+	const float weights[4] = { (1.f - fx) * (1.f - fy), fx * (1.f - fy), (1.f - fx) * fy, fx * fy };
+	const size_t texels[4] = { static_cast<size_t>(y0) * m_width + x0, static_cast<size_t>(y0) * m_width + x0 + 1,
+		static_cast<size_t>(y0 + 1) * m_width + x0, static_cast<size_t>(y0 + 1) * m_width + x0 + 1 };
+
+	int frames = 0xffff;
+	for (int k = 0; k < 4; ++k)
+	{
+		frames = std::min(frames, static_cast<int>(m_history.count[texels[k]]));
+	}
+	if (frames == 0)
+	{
+		return false;
+	}
+
+	for (int c = 0; c < 4; ++c)
+	{
+		rgba[c] = 0.f;
+		for (int k = 0; k < 4; ++k)
+		{
+			rgba[c] += weights[k] * m_history.history[texels[k] * 4 + c];
+		}
+	}
+	count = frames;
+	return true;
+}
+
+void CpuVolumeRenderer::RenderTile(const Matrix4& invWVP, const RayCastContext& context, const RayCastPath path, const float stepScale, const RefinePass& pass, const int tile, uint64_t& rays, uint64_t& samples)
+{
+	const int tilesX = (m_width + kTileSize - 1) / kTileSize;
+	const int x0 = tile % tilesX * kTileSize;
+	const int y0 = tile / tilesX * kTileSize;
+	const int x1 = std::min(x0 + kTileSize, m_width);
+	const int y1 = std::min(y0 + kTileSize, m_height);
+
+	// rays that hit the cube are gathered into packets of the kernel's width
+	const int packetWidth = GetPacketWidth(path);
+	RayPacket packet;
+	int pixels[RayPacket::kMaxLanes];
+
+	// tiles are whole 4x4 blocks, so fill blocks stay inside them
+	auto flush = [&]() {
+		samples += RayCastPacket(path, context, packet);
+		for (int lane = 0; lane < packet.count; ++lane)
+		{
+			WritePixel(pixels[lane], packet.red[lane], packet.green[lane], packet.blue[lane], packet.alpha[lane]);
+			if (pass.fill > 1)
+			{
+				FillBlock(pixels[lane], pass.fill);
+			}
+		}
+		rays += packet.count;
+		packet.Clear();
+	};
+
+	packet.Clear();
+	for (int y = y0; y < y1; ++y)
+	{
+		// pixel centres, NDC y points up
+		float ndcY = 1.f - 2.f * (y + 0.5f) / m_height;
+
+		for (int x = x0; x < x1; ++x)
+		{
+			if ((pass.phases & (1 << ((y & 3) * 4 + (x & 3)))) == 0)
+			{
+				continue;
+			}
+			float ndcX = 2.f * (x + 0.5f) / m_width - 1.f;
+
+			Vec3 posFront, posBack;
+			if (!ComputeRayEntryExit(invWVP, ndcX, ndcY, posFront, posBack))
+			{
+				// a refinement pass overwrites what a coarser one filled in
+				if (!pass.clear)
+				{
+					WritePixel(y * m_width + x, 0.f, 0.f, 0.f, 0.f);
+				}
+				continue;
+			}
+
+			if (pass.entries)
+			{
+				m_history.entry[static_cast<size_t>(y) * m_width + x] = posFront;
+			}
+			const float jitter = pass.jitter ? GetBlueNoise(x, y, m_jitterFrame) : 0.f;
+			pixels[packet.Add(posFront, posBack, context.lod, stepScale, jitter)] = y * m_width + x;
+			if (packet.count == packetWidth)
+			{
+				flush();
+			}
+		}
+	}
+
+	// partial packet left at the end of the tile
+	flush();
+}
+
+void CpuVolumeRenderer::RenderBrickRows(const Matrix4& invWVP, const BrickedVolume& volume, const int begin, const int end, uint64_t& rays, uint64_t& samples)
+{
+	for (int y = begin; y < end; ++y)
+	{
+		float ndcY = 1.f - 2.f * (y + 0.5f) / m_height;
+
+		for (int x = 0; x < m_width; ++x)
+		{
+			float ndcX = 2.f * (x + 0.5f) / m_width - 1.f;
+
+			Vec3 posFront, posBack;
+			if (!ComputeRayEntryExit(invWVP, ndcX, ndcY, posFront, posBack))
+			{
+				continue;
+			}
+
+			// same ray set up as RayPacket::Add
+			Vec3 step = Normalize(posBack - posFront) * g_fStepSize;
+			float value = 0.f;
+			float alpha = 0.f;
+			samples += volume.March(posFront, step, ComputeStepCount(posFront, posBack), value, alpha);
+			WritePixel(y * m_width + x, value, value, value, alpha);
+			++rays;
+		}
+	}
+}
+
+void CpuVolumeRenderer::RenderCompressedRows(const Matrix4& invWVP, const CompressedVolume& volume, const VoxelWindow& window, CompressedVolume::DecodeCache& cache, const int begin, const int end, uint64_t& rays, uint64_t& samples)
+{
+	// square tiles, neighbouring rays march through the same bricks while
+	// they are still cached
+	const int tileSize = CompressedVolume::kBrickSize;
+	for (int tileY = begin; tileY < end; tileY += tileSize)
+	{
+		for (int tileX = 0; tileX < m_width; tileX += tileSize)
+		{
+			for (int y = tileY; y < std::min(tileY + tileSize, end); ++y)
+			{
+				float ndcY = 1.f - 2.f * (y + 0.5f) / m_height;
+
+				for (int x = tileX; x < std::min(tileX + tileSize, m_width); ++x)
+				{
+					float ndcX = 2.f * (x + 0.5f) / m_width - 1.f;
+
+					Vec3 posFront, posBack;
+					if (!ComputeRayEntryExit(invWVP, ndcX, ndcY, posFront, posBack))
+					{
+						continue;
+					}
+
+					Vec3 step = Normalize(posBack - posFront) * g_fStepSize;
+					float value = 0.f;
+					float alpha = 0.f;
+					samples += volume.March(cache, window, posFront, step, ComputeStepCount(posFront, posBack), value, alpha);
+					WritePixel(y * m_width + x, value, value, value, alpha);
+					++rays;
+				}
+			}
+		}
+	}
+}
+
+void CpuVolumeRenderer::FillBlock(const int index, const int size)
+{
+	// the pixel copied over the size x size block it's the top left of
+	const int x0 = index % m_width;
+	const int y0 = index / m_width;
+	const uint32_t value = reinterpret_cast<const uint32_t*>(m_frame.data())[index];
+	for (int y = y0; y < std::min(y0 + size, m_height); ++y)
+	{
+		uint32_t* row = reinterpret_cast<uint32_t*>(m_frame.data()) + static_cast<size_t>(y) * m_width;
+		std::fill(row + x0, row + std::min(x0 + size, m_width), value);
+	}
+}
+
+void CpuVolumeRenderer::WritePixel(const int index, const float red, const float green, const float blue, const float alpha)
+{
+	// SRC_ALPHA / INV_SRC_ALPHA blend over the black clear colour
+	float a = std::min(std::max(alpha, 0.f), 1.f);
+	float rgb[3] = { red, green, blue };
+	uint8_t* px = m_frame.data() + static_cast<size_t>(index) * 4;
+	for (int c = 0; c < 3; ++c)
+	{
+		float value = std::min(std::max(rgb[c] * a, 0.f), 1.f);
+		px[c] = static_cast<uint8_t>(value * 255.f + 0.5f);
+	}
+	px[3] = static_cast<uint8_t>(a * 255.f + 0.5f);
+}
@@ -0,0 +1,324 @@
+/// <summary>
+/// CpuVolumeRenderer.h
+///
+/// About:
+/// Headless, multi-threaded counterpart of VolumeRenderer.
+/// Renders RayCastPS on the CPU into an in-memory RGBA8
+/// buffer, composited over black exactly like the alpha
+/// blended back buffer. Uses the same VolumeCamera and
+/// Volume types as the D3D path, so either renderer can
+/// draw the other's state.
+/// </summary>
+#ifndef CpuVolumeRenderer_h__
+#define CpuVolumeRenderer_h__
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "BrickedVolume.h"
+#include "CompressedVolume.h"
+#include "RayCastKernel.h"
+#include "TileScheduler.h"
+#include "TransferFunction.h"
+#include "Volume.h"
+#include "VolumeCache.h"
+#include "VolumeCamera.h"
+#include "VolumeStats.h"
+
+class CpuVolumeRenderer
+{
+public:
+	struct FrameStats
+	{
+		double renderMs;
+		uint64_t rays;			// rays that hit the volume
+		uint64_t samples;		// volume samples taken
+		uint64_t samplesSaved;	// vs. GetMaxStepCount per ray (exact ray length, empty space skipping + early termination)
+		RayCastPath path;
+		int lod;				// mip level sampled
+		uint64_t bricksDecoded;	// compressed volumes, bricks decoded (decode cache misses)
+		// load balance across the workers, volumes only (bricked and compressed
+		// ones are drawn in bands of rows and leave these 0)
+		int tiles;				// tiles of kTileSize^2 pixels
+		int tilesStolen;		// of those, run by a worker other than the one they were given to
+		std::vector<double> workerIdleMs;	// per worker, not running tiles while the frame was
+		double maxIdleMs;		// the most of those
+		double meanIdleMs;
+		float imbalance;		// the busiest worker's tile time over the mean, 1 when even
+	};
+
+	// where progressive refinement has got to since the view last changed
+	struct ProgressiveStats
+	{
+		int tier;					// 0 coarse, 1 full quality, 2 on finer than that
+		float coverage;				// fraction of the pixels the tier has rendered
+		bool converged;				// nothing left to refine, frames render nothing
+		int frames;					// frames rendered since the change
+		double firstImageMs;		// from the change to the coarse image being done
+		double convergedMs;			// from the change to converged, -1 until then
+		double renderMs;			// of those, time spent rendering
+		double meanDiff;			// last finer tier against the one before, mean RGB (0-255)
+	};
+
+	// temporal accumulation since the history was last reset
+	struct TemporalStats
+	{
+		int frames;				// frames accumulated since the reset
+		float reprojected;		// fraction of the rays that hit whose history was reused
+		double accumulateMs;	// reprojecting and blending, on top of renderMs
+	};
+
+	// the frame is scheduled in square tiles of this many pixels, a multiple
+	// of the 4x4 blocks progressive refinement fills
+	static const int kTileSize = 32;
+
+	// refinement passes render this many of the 16 pixels of each 4x4 block
+	static const int kRefinePhases = 4;
+
+	CpuVolumeRenderer();
+
+	bool Initialize(const int width, const int height);
+	// defaults to the bundled 256^3 datasets, GetLoadError() has the reason on failure
+	bool LoadVolume(const std::string& file, const VolumeDesc& desc = VolumeDesc(256, 256, 256));
+	// optional, LoadVolume then reuses resident volumes and adds the ones it loads
+	void SetVolumeCache(VolumeCache* const cache) { m_cache = cache; }
+	const std::string& GetLoadError() const { return m_loadError; }
+	// a volume loaded elsewhere, e.g. by VolumeLoader or shared between renderers
+	// (with its macrocells and mips built, as LoadVolume does)
+	void SetVolume(const std::shared_ptr<Volume>& volume);
+	void Update(const float dt);
+	void Render();
+	// render any camera/volume, e.g. the state owned by the D3D VolumeRenderer
+	void Render(const VolumeCamera& camera, const Volume& volume);
+	// out-of-core volumes, pages in the bricks the camera sees first (scalar kernel,
+	// identity classification)
+	void Render(const VolumeCamera& camera, BrickedVolume& volume);
+	// block-compressed volumes, decoded brick by brick into a cache per band (scalar
+	// kernel, identity classification)
+	void Render(const VolumeCamera& camera, const CompressedVolume& volume);
+	void Shutdown();
+
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+	// RGBA8, top row first
+	const uint8_t* GetFrame() const { return m_frame.data(); }
+	const FrameStats& GetFrameStats() const { return m_stats; }
+
+	VolumeCamera& GetCamera() { return m_camera; }
+	Volume& GetVolume() { return *m_volume; }
+
+	// kernel selection, defaults to the widest SIMD path the CPU supports;
+	// forcing a path the CPU or volume can't use falls back to the best one
+	void SetRayCastPath(const RayCastPath path) { m_forcedPath = path; m_forcePath = true; }
+	void ClearRayCastPath() { m_forcePath = false; }
+
+	// skip the volume's empty macrocells, on by default (needs Volume::BuildMacrocells)
+	void SetEmptySpaceSkipping(const bool enable) { m_skipEmpty = enable; }
+	bool GetEmptySpaceSkipping() const { return m_skipEmpty; }
+
+	// sample the mip level matching the projected voxel size, on by default
+	// (needs Volume::BuildMips, which LoadVolume does)
+	void SetLevelOfDetail(const bool enable) { m_levelOfDetail = enable; }
+	bool GetLevelOfDetail() const { return m_levelOfDetail; }
+
+	// window/level applied to the voxels, by default the full range of the
+	// volume's type (VoxelWindow::GetDefault) like the D3D renderer
+	void SetWindow(const VoxelWindow& window) { m_window = window; m_customWindow = true; }
+	void ClearWindow() { m_customWindow = false; }
+
+	// how the windowed value becomes colour and opacity, by default Identity
+	// like RayCastPS; the others classify through the transfer function
+	void SetClassification(const Classification classification) { m_classification = classification; }
+	Classification GetClassification() const { return m_classification; }
+	// a grey ramp by default, its tables are brought up to date by the next frame
+	void SetTransferFunction(const TransferFunction& function) { m_transfer = function; }
+	const TransferFunction& GetTransferFunction() const { return m_transfer; }
+	const TransferTables& GetTransferTables() const { return m_transferTables; }
+
+	// step length in steps of the sampled mip level, 1 by default; only used
+	// with a transfer function, whose tables correct the opacity for it
+	void SetStepScale(const float scale) { m_stepScale = scale; }
+	float GetStepScale() const { return m_stepScale; }
+
+	// headlight shading from the gradient of the value, off by default
+	void SetShading(const bool enable) { m_shading = enable; }
+	bool GetShading() const { return m_shading; }
+
+	// whether LoadVolume builds a GradientVolume (for the volume and each mip
+	// level) with filter for shading to read, off by default; without one the
+	// gradients are taken on the fly
+	void SetGradientVolume(const bool enable, const GradientFilter filter = GradientFilter::Central) { m_gradientVolume = enable; m_gradientFilter = filter; }
+	bool GetGradientVolume() const { return m_gradientVolume; }
+	GradientFilter GetGradientFilter() const { return m_gradientFilter; }
+
+	// whether LoadVolume gathers the volume's histogram and statistics, for
+	// an automatic window (VolumeStats::GetAutoWindow) or transfer function
+	// defaults; on by default. They are read from the file's sidecar when it
+	// is current, otherwise computed and the sidecar written.
+	void SetComputeVolumeStats(const bool enable) { m_computeStats = enable; }
+	bool GetComputeVolumeStats() const { return m_computeStats; }
+	// of the volume LoadVolume last loaded, empty (not IsValid) without them
+	// or after SetVolume; cached if they came from the sidecar
+	const VolumeStats& GetVolumeStats() const { return m_volumeStats; }
+	bool IsVolumeStatsCached() const { return m_statsCached; }
+
+	// Progressive refinement, off by default. A frame whose view (camera,
+	// volume, window, classification, ...) differs from the last one's is a
+	// coarse image: a pixel of every 4x4 block, two mip levels further down.
+	// The frames after it refine while the view holds still, the full quality
+	// image kRefinePhases pixels of each block at a time, then finer mip levels
+	// or, with a transfer function, halved steps, until a finer tier changes
+	// the image by less than the threshold (or there's none left).
+	void SetProgressive(const bool enable) { m_progressive = enable; m_refine.valid = false; }
+	bool GetProgressive() const { return m_progressive; }
+	// mean absolute RGB difference (0-255) under which the image has converged, 0.5 by default
+	void SetConvergenceThreshold(const float threshold) { m_convergenceThreshold = threshold; }
+	float GetConvergenceThreshold() const { return m_convergenceThreshold; }
+	const ProgressiveStats& GetProgressiveStats() const { return m_progressiveStats; }
+
+	// Moves each ray's first sample in by a fraction of a step, off by default.
+	// The fraction is per pixel blue noise, shifted every frame, so the wood
+	// grain rings of a fixed step become fine noise that averages out.
+	void SetJitter(const bool enable) { m_jitter = enable; }
+	bool GetJitter() const { return m_jitter; }
+
+	// Blends each frame into a history of the frames before it, off by default
+	// and not applied while refining progressively. Each pixel's ray entry point
+	// is reprojected with last frame's world-view-projection to find where it
+	// was; that history, clamped to the colours around the pixel, is averaged
+	// with the new frame over up to length frames, or 2 while the camera moves.
+	// A pixel whose ray missed the volume last frame, or whose entry lands off
+	// screen, starts over; changing anything but the camera (volume, window,
+	// classification, ...) resets the whole history. With jitter, a few frames
+	// with longer steps converge to the image of short ones.
+	void SetTemporalAccumulation(const bool enable, const int length = 16) { m_temporal = enable; m_historyLength = std::max(length, 1); m_history.valid = false; }
+	bool GetTemporalAccumulation() const { return m_temporal; }
+	const TemporalStats& GetTemporalStats() const { return m_temporalStats; }
+
+	// work stealing across the tiles of a frame, with the tile times of the
+	// frame before as cost hints
+	TileScheduler& GetScheduler() { return m_scheduler; }
+
+private:
+	// the pixels and quality of one pass, the whole image by default
+	struct RefinePass
+	{
+		int lodBias = 0;			// added to the level picked for the view
+		float stepScale = 1.f;		// times the step scale, transfer functions only
+		uint16_t phases = 0xffff;	// pixels of each 4x4 block rendered, bit y % 4 * 4 + x % 4
+		int fill = 1;				// each rendered pixel copied over its fill x fill block
+		bool clear = true;			// the frame cleared first
+		bool jitter = false;		// ray starts jittered by the frame's blue noise
+		bool entries = false;		// each pixel's ray entry point kept for Accumulate
+	};
+
+	// what the image depends on besides the camera
+	struct ViewSettings
+	{
+		const Volume* volume = nullptr;
+		VoxelWindow window;
+		Classification classification = Classification::Identity;
+		std::vector<float> transfer;
+		float stepScale = 1.f;
+		bool shading = false;
+		bool levelOfDetail = true;
+	};
+
+	// refinement starts over when the camera or the settings change
+	struct RefineState
+	{
+		bool valid = false;
+		Matrix4 wvp;
+		ViewSettings settings;
+
+		int tier = 0;
+		int phase = 0;
+		int lodBias = 0;
+		float tierStepScale = 1.f;
+		std::chrono::high_resolution_clock::time_point start;
+		// the frame at the start of the tier, to measure what it changed
+		std::vector<uint8_t> previous;
+	};
+
+	// the accumulated frames, reset when the settings change
+	struct TemporalState
+	{
+		bool valid = false;
+		Matrix4 wvp;
+		ViewSettings settings;
+		// the frame's RGBA in [0,1] and the frames accumulated per pixel, 0
+		// where the ray missed; next is written while history is read
+		std::vector<float> history;
+		std::vector<float> next;
+		std::vector<uint16_t> count;
+		std::vector<uint16_t> nextCount;
+		// each pixel's ray entry point in texture space, as RenderTile found
+		// it, x = -1 where the ray missed (hits can sit a rounding error below 0)
+		std::vector<Vec3> entry;
+		// the frame's RGBA minimum and maximum over 3 pixels of each row, the
+		// rows above and below complete the neighbourhood history is clamped to
+		std::vector<uint8_t> rowMin;
+		std::vector<uint8_t> rowMax;
+	};
+
+	void RenderPass(const VolumeCamera& camera, const Volume& volume, const RefinePass& pass);
+	void RenderProgressive(const VolumeCamera& camera, const Volume& volume);
+	void GetViewSettings(const Volume& volume, ViewSettings& settings) const;
+	static bool IsSameSettings(const ViewSettings& a, const ViewSettings& b);
+	void Accumulate(const VolumeCamera& camera, const Volume& volume);
+	void AccumulateRows(const bool reproject, const int length, const int begin, const int end, uint64_t& rays, uint64_t& reprojected);
+	bool SampleHistory(const float x, const float y, float rgba[4], int& count) const;
+	int SelectLevel(const VolumeCamera& camera, const Volume& volume) const;
+
+	void RenderTile(const Matrix4& invWVP, const RayCastContext& context, const RayCastPath path, const float stepScale, const RefinePass& pass, const int tile, uint64_t& rays, uint64_t& samples);
+	void RenderBrickRows(const Matrix4& invWVP, const BrickedVolume& volume, const int begin, const int end, uint64_t& rays, uint64_t& samples);
+	void RenderCompressedRows(const Matrix4& invWVP, const CompressedVolume& volume, const VoxelWindow& window, CompressedVolume::DecodeCache& cache, const int begin, const int end, uint64_t& rays, uint64_t& samples);
+	void WritePixel(const int index, const float red, const float green, const float blue, const float alpha);
+	void FillBlock(const int index, const int size);
+
+	int m_width;
+	int m_height;
+	std::vector<uint8_t> m_frame;
+	FrameStats m_stats;
+	bool m_forcePath;
+	RayCastPath m_forcedPath;
+	bool m_skipEmpty;
+	bool m_levelOfDetail;
+	bool m_customWindow;
+	VoxelWindow m_window;
+	Classification m_classification;
+	TransferFunction m_transfer;
+	TransferTables m_transferTables;
+	float m_stepScale;
+	bool m_shading;
+	bool m_gradientVolume;
+	GradientFilter m_gradientFilter;
+	bool m_computeStats;
+	VolumeStats m_volumeStats;
+	bool m_statsCached;
+	// per frame macrocell classification
+	std::vector<uint8_t> m_occupancy;
+	// one per band of rows, kept across frames so static views hit
+	std::vector<std::unique_ptr<CompressedVolume::DecodeCache>> m_decodeCaches;
+	bool m_progressive;
+	float m_convergenceThreshold;
+	RefineState m_refine;
+	ProgressiveStats m_progressiveStats;
+	bool m_jitter;
+	uint32_t m_jitterFrame;
+	bool m_temporal;
+	int m_historyLength;
+	TemporalState m_history;
+	TemporalStats m_temporalStats;
+	TileScheduler m_scheduler;
+
+	VolumeCamera m_camera;
+	std::shared_ptr<Volume> m_volume;
+	VolumeCache* m_cache;
+	std::string m_loadError;
+};
+
+#endif // CpuVolumeRenderer_h__
@@ -0,0 +1,490 @@
+#include "DistributedRenderer.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+	const int kTileSize = 32;
+
+	// Steps [first, last) of a ray that sample the brick [lo, hi) (texture
+	// space, infinite on the volume's faces so nothing outside the cube is
+	// lost). Ranks either side of a plane compute the same t for it, one
+	// taking the steps below and the other the rest, so every step is taken
+	// by exactly one brick.
+	bool ClipSteps(const Vec3& front, const Vec3& step, const int numSteps, const double lo[3], const double hi[3], int& first, int& last)
+	{
+		const double f[3] = { front.x, front.y, front.z };
+		const double s[3] = { step.x, step.y, step.z };
+		double begin = 0.0;
+		double end = numSteps;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (s[axis] > 0.0)
+			{
+				begin = std::max(begin, std::ceil((lo[axis] - f[axis]) / s[axis]));
+				end = std::min(end, std::ceil((hi[axis] - f[axis]) / s[axis]));
+			}
+			else if (s[axis] < 0.0)
+			{
+				begin = std::max(begin, std::floor((hi[axis] - f[axis]) / s[axis]) + 1.0);
+				end = std::min(end, std::floor((lo[axis] - f[axis]) / s[axis]) + 1.0);
+			}
+			else if (f[axis] < lo[axis] || f[axis] >= hi[axis])
+			{
+				return false;
+			}
+		}
+		if (!(begin < end))
+		{
+			return false;
+		}
+		first = static_cast<int>(begin);
+		last = static_cast<int>(end);
+		return true;
+	}
+
+	// Whether the eye is below split (in voxels of dims). The eye is where clip
+	// space (0, 0, 1, 0) comes from; with an orthographic projection that is
+	// the view direction instead, and the rays cross the plane upwards if it
+	// points up.
+	bool IsEyeBelow(const Matrix4& invWVP, const DistributedRenderer::Split& split, const int dims[3])
+	{
+		Vec4 eye = Mul(invWVP, Vec4(0.f, 0.f, 1.f, 0.f));
+		const float e[3] = { eye.x, eye.y, eye.z };
+		// the model position shader: tex = 0.5 * (pos + 1)
+		const float plane = 2.f * split.plane / dims[split.axis] - 1.f;
+		if (std::fabs(eye.w) > 1e-6f * (std::fabs(eye.x) + std::fabs(eye.y) + std::fabs(eye.z)))
+		{
+			return e[split.axis] / eye.w < plane;
+		}
+		return e[split.axis] > 0.f;
+	}
+
+	// CpuVolumeRenderer::WritePixel: SRC_ALPHA / INV_SRC_ALPHA over black, of
+	// the colour RayCastPS outputs (divided by alpha when classified)
+	void WritePixel(const float* rgba, const bool premultiplied, uint8_t* px)
+	{
+		float a = std::min(std::max(rgba[3], 0.f), 1.f);
+		float invAlpha = premultiplied ? (rgba[3] > 0.f ? 1.f / rgba[3] : 0.f) : 1.f;
+		for (int c = 0; c < 3; ++c)
+		{
+			float value = std::min(std::max(rgba[c] * invAlpha * a, 0.f), 1.f);
+			px[c] = static_cast<uint8_t>(value * 255.f + 0.5f);
+		}
+		px[3] = static_cast<uint8_t>(a * 255.f + 0.5f);
+	}
+}
+
+DistributedRenderer::DistributedRenderer()
+{
+	m_transport = nullptr;
+	m_width = 0;
+	m_height = 0;
+	m_brick = Brick();
+	m_offset[0] = m_offset[1] = m_offset[2] = 0;
+	m_classification = Classification::Identity;
+	m_stepScale = 1.f;
+	m_shading = false;
+	m_skipEmpty = true;
+	m_stats = FrameStats();
+}
+
+bool DistributedRenderer::Initialize(Transport* transport, const int width, const int height)
+{
+	if (transport == nullptr || width <= 0 || height <= 0)
+	{
+		m_error = "Invalid transport or frame size";
+		return false;
+	}
+	const int size = transport->GetSize();
+	if (size <= 0 || (size & (size - 1)) != 0)
+	{
+		m_error = "Binary swap needs a power of two ranks, not " + std::to_string(size);
+		return false;
+	}
+
+	m_transport = transport;
+	m_width = width;
+	m_height = height;
+	m_camera.Initialize();
+	m_partial.assign(static_cast<size_t>(width) * height * 4, 0.f);
+	m_frame.assign(static_cast<size_t>(width) * height * 4, 0);
+	return true;
+}
+
+void DistributedRenderer::Shutdown()
+{
+	m_volume.Shutdown();
+	m_partial.clear();
+	m_incoming.clear();
+	m_frame.clear();
+	m_transport = nullptr;
+}
+
+void DistributedRenderer::SplitVolume(const VolumeDesc& desc, const int count, std::vector<Split>& splits, std::vector<Brick>& bricks)
+{
+	const Split none = { 0, 0 };
+	splits.assign(std::max(count, 1), none);
+	std::vector<Brick> nodes(2 * std::max(count, 1));
+	Brick& root = nodes[1];
+	const int dims[3] = { desc.width, desc.height, desc.depth };
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		root.begin[axis] = 0;
+		root.end[axis] = dims[axis];
+	}
+
+	// halve each node across its longest side (in voxels, so the ranks hold
+	// about as much)
+	for (int node = 1; node < count; ++node)
+	{
+		const Brick& box = nodes[node];
+		int axis = 0;
+		for (int a = 1; a < 3; ++a)
+		{
+			if (box.end[a] - box.begin[a] > box.end[axis] - box.begin[axis])
+			{
+				axis = a;
+			}
+		}
+		Split& split = splits[node];
+		split.axis = axis;
+		split.plane = (box.begin[axis] + box.end[axis]) / 2;
+
+		nodes[2 * node] = box;
+		nodes[2 * node].end[axis] = split.plane;
+		nodes[2 * node + 1] = box;
+		nodes[2 * node + 1].begin[axis] = split.plane;
+	}
+	bricks.assign(nodes.begin() + std::max(count, 1), nodes.end());
+}
+
+void DistributedRenderer::GetStripRows(const int rank, const int size, const int height, int& begin, int& end)
+{
+	begin = 0;
+	end = height;
+	for (int bit = 1; bit < size; bit <<= 1)
+	{
+		const int mid = (begin + end) / 2;
+		if ((rank & bit) == 0)
+		{
+			end = mid;
+		}
+		else
+		{
+			begin = mid;
+		}
+	}
+}
+
+bool DistributedRenderer::LoadBrick(const std::string& file, const VolumeDesc& desc)
+{
+	if (m_transport == nullptr)
+	{
+		m_error = "Not initialised";
+		return false;
+	}
+
+	Volume source;
+	if (!source.Load(file, desc))
+	{
+		m_error = source.GetError();
+		return false;
+	}
+	m_desc = source.GetDesc();
+
+	std::vector<Brick> bricks;
+	SplitVolume(m_desc, m_transport->GetSize(), m_splits, bricks);
+	m_brick = bricks[m_transport->GetRank()];
+
+	// the brick and a voxel either side, where there is one
+	const int dims[3] = { m_desc.width, m_desc.height, m_desc.depth };
+	int size[3];
+	bool empty = false;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		m_offset[axis] = std::max(m_brick.begin[axis] - 1, 0);
+		size[axis] = std::min(m_brick.end[axis] + 1, dims[axis]) - m_offset[axis];
+		empty = empty || m_brick.end[axis] <= m_brick.begin[axis];
+	}
+	m_camera.SetScale(m_desc.GetExtent());
+	m_volume.Shutdown();
+	if (empty)
+	{
+		// more ranks than voxels across, this one draws nothing
+		return true;
+	}
+
+	const size_t voxelSize = GetVoxelSize(m_desc.type);
+	const size_t rowBytes = size[0] * voxelSize;
+	VolumeDesc brickDesc(size[0], size[1], size[2], m_desc.type, m_desc.spacing);
+	std::vector<uint8_t> voxels(brickDesc.GetByteSize());
+	for (int z = 0; z < size[2]; ++z)
+	{
+		for (int y = 0; y < size[1]; ++y)
+		{
+			size_t from = ((static_cast<size_t>(z + m_offset[2]) * dims[1] + y + m_offset[1]) * dims[0] + m_offset[0]) * voxelSize;
+			memcpy(&voxels[(static_cast<size_t>(z) * size[1] + y) * rowBytes], source.GetData() + from, rowBytes);
+		}
+	}
+	source.Shutdown();
+
+	if (!m_volume.Create(brickDesc, voxels) || !m_volume.BuildMacrocells())
+	{
+		m_error = m_volume.GetError();
+		return false;
+	}
+	return true;
+}
+
+bool DistributedRenderer::Render()
+{
+	if (m_transport == nullptr)
+	{
+		m_error = "Not initialised";
+		return false;
+	}
+
+	const uint64_t start = GetClockNs();
+	const uint64_t bytesSent = m_transport->GetBytesSent();
+	m_stats = FrameStats();
+	std::fill(m_partial.begin(), m_partial.end(), 0.f);
+
+	Matrix4 invWVP;
+	const bool visible = Matrix4::Inverse(m_camera.GetWorldViewProj(), invWVP);
+	if (visible && m_volume.IsLoaded())
+	{
+		RayCastPath path = GetBestRayCastPath(m_volume);
+
+		// as CpuVolumeRenderer, on level 0 always
+		const bool classify = m_classification != Classification::Identity;
+		const float stepScale = classify ? m_stepScale : 1.f;
+		if (classify)
+		{
+			m_transferTables.Update(m_transfer, stepScale);
+		}
+		VoxelWindow window = VoxelWindow::GetDefault(m_desc.type);
+		RayCastContext context = { &m_volume, nullptr, nullptr, 0, window, m_classification, classify ? &m_transferTables : nullptr, m_shading, nullptr };
+		if (m_skipEmpty)
+		{
+			float opacity[256];
+			if (classify)
+			{
+				m_transfer.GetOpacity(opacity);
+			}
+			else
+			{
+				MacrocellGrid::GetIdentityOpacity(opacity);
+			}
+			m_volume.GetMacrocells().Classify(opacity, window, m_occupancy);
+			context.macrocells = &m_volume.GetMacrocells();
+			context.occupancy = m_occupancy.data();
+		}
+
+		std::atomic<uint64_t> rays(0);
+		std::atomic<uint64_t> samples(0);
+		const int tiles = ((m_width + kTileSize - 1) / kTileSize) * ((m_height + kTileSize - 1) / kTileSize);
+		m_scheduler.Run(tiles, [&](int tile) {
+			uint64_t tileRays = 0;
+			uint64_t tileSamples = 0;
+			RenderTile(invWVP, context, path, stepScale, tile, tileRays, tileSamples);
+			rays += tileRays;
+			samples += tileSamples;
+		});
+		m_stats.rays = rays;
+		m_stats.samples = samples;
+	}
+	const uint64_t rendered = GetClockNs();
+	m_stats.renderMs = NsToMs(rendered - start);
+
+	// every rank takes part whatever it drew
+	bool ok = Composite(invWVP);
+	const uint64_t composited = GetClockNs();
+	m_stats.compositeMs = NsToMs(composited - rendered);
+
+	ok = ok && Gather();
+	const uint64_t end = GetClockNs();
+	m_stats.gatherMs = NsToMs(end - composited);
+	m_stats.frameMs = NsToMs(end - start);
+	m_stats.bytesSent = m_transport->GetBytesSent() - bytesSent;
+	if (!ok)
+	{
+		m_error = m_transport->GetError();
+	}
+	return ok;
+}
+
+void DistributedRenderer::RenderTile(const Matrix4& invWVP, const RayCastContext& context, const RayCastPath path, const float stepScale, const int tile, uint64_t& rays, uint64_t& samples)
+{
+	const int tilesX = (m_width + kTileSize - 1) / kTileSize;
+	const int x0 = tile % tilesX * kTileSize;
+	const int y0 = tile / tilesX * kTileSize;
+	const int x1 = std::min(x0 + kTileSize, m_width);
+	const int y1 = std::min(y0 + kTileSize, m_height);
+
+	// the brick in the whole volume's texture space, open on the volume's faces,
+	// and the scale from that into the brick's own
+	const int dims[3] = { m_desc.width, m_desc.height, m_desc.depth };
+	const int size[3] = { m_volume.GetWidth(), m_volume.GetHeight(), m_volume.GetDepth() };
+	double lo[3], hi[3];
+	float scale[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		lo[axis] = m_brick.begin[axis] > 0 ? static_cast<double>(m_brick.begin[axis]) / dims[axis] : -std::numeric_limits<double>::infinity();
+		hi[axis] = m_brick.end[axis] < dims[axis] ? static_cast<double>(m_brick.end[axis]) / dims[axis] : std::numeric_limits<double>::infinity();
+		scale[axis] = static_cast<float>(dims[axis]) / size[axis];
+	}
+
+	const int packetWidth = GetPacketWidth(path);
+	RayPacket packet;
+	int pixels[RayPacket::kMaxLanes];
+
+	// classified colours come out divided by alpha, for the blend; composited
+	// they have to be weighted by it again, like the identity ones are
+	const bool premultiply = context.classification != Classification::Identity;
+	auto flush = [&]() {
+		samples += RayCastPacket(path, context, packet);
+		for (int lane = 0; lane < packet.count; ++lane)
+		{
+			float* px = &m_partial[static_cast<size_t>(pixels[lane]) * 4];
+			const float alpha = packet.alpha[lane];
+			const float weight = premultiply ? alpha : 1.f;
+			px[0] = packet.red[lane] * weight;
+			px[1] = packet.green[lane] * weight;
+			px[2] = packet.blue[lane] * weight;
+			px[3] = alpha;
+		}
+		rays += packet.count;
+		packet.Clear();
+	};
+
+	packet.Clear();
+	for (int y = y0; y < y1; ++y)
+	{
+		// pixel centres, NDC y points up
+		float ndcY = 1.f - 2.f * (y + 0.5f) / m_height;
+
+		for (int x = x0; x < x1; ++x)
+		{
+			float ndcX = 2.f * (x + 0.5f) / m_width - 1.f;
+
+			// the whole ray as RayPacket::Add sets it up, then the steps in the brick
+			Vec3 posFront, posBack;
+			if (!ComputeRayEntryExit(invWVP, ndcX, ndcY, posFront, posBack))
+			{
+				continue;
+			}
+			const Vec3 step = Normalize(posBack - posFront) * GetStepSize(0, stepScale);
+			int first, last;
+			if (!ClipSteps(posFront, step, ComputeStepCount(posFront, posBack, 0, stepScale), lo, hi, first, last))
+			{
+				continue;
+			}
+
+			const Vec3 start = posFront + step * static_cast<float>(first);
+			const int lane = packet.count++;
+			packet.posX[lane] = (start.x * dims[0] - m_offset[0]) / size[0];
+			packet.posY[lane] = (start.y * dims[1] - m_offset[1]) / size[1];
+			packet.posZ[lane] = (start.z * dims[2] - m_offset[2]) / size[2];
+			packet.stepX[lane] = step.x * scale[0];
+			packet.stepY[lane] = step.y * scale[1];
+			packet.stepZ[lane] = step.z * scale[2];
+			packet.numSteps[lane] = last - first;
+			pixels[lane] = y * m_width + x;
+			if (packet.count == packetWidth)
+			{
+				flush();
+			}
+		}
+	}
+	if (packet.count > 0)
+	{
+		flush();
+	}
+}
+
+bool DistributedRenderer::Composite(const Matrix4& invWVP)
+{
+	const int rank = m_transport->GetRank();
+	const int size = m_transport->GetSize();
+	const int dims[3] = { m_desc.width, m_desc.height, m_desc.depth };
+	const size_t rowFloats = static_cast<size_t>(m_width) * 4;
+
+	int begin = 0;
+	int end = m_height;
+	for (int bit = 1; bit < size; bit <<= 1)
+	{
+		// the rank with the bit clear keeps the first half of the rows
+		const int peer = rank ^ bit;
+		const int mid = (begin + end) / 2;
+		const bool lower = (rank & bit) == 0;
+		const int keepBegin = lower ? begin : mid;
+		const int keepEnd = lower ? mid : end;
+		const int sendBegin = lower ? mid : begin;
+		const int sendEnd = lower ? end : mid;
+
+		m_incoming.resize((keepEnd - keepBegin) * rowFloats);
+		if (!m_transport->Exchange(peer, &m_partial[sendBegin * rowFloats], (sendEnd - sendBegin) * rowFloats * sizeof(float),
+			m_incoming.data(), m_incoming.size() * sizeof(float)))
+		{
+			return false;
+		}
+
+		// the pair's subtree is the node above both leaves; the lower rank
+		// holds the part below its split
+		const Split& split = m_splits[(size + rank) / (bit * 2)];
+		const bool inFront = IsEyeBelow(invWVP, split, dims) == lower;
+		float* mine = &m_partial[keepBegin * rowFloats];
+		const float* theirs = m_incoming.data();
+		for (size_t i = 0; i < m_incoming.size(); i += 4)
+		{
+			const float* front = inFront ? mine + i : theirs + i;
+			const float* back = inFront ? theirs + i : mine + i;
+			const float transparency = 1.f - front[3];
+			float rgba[4];
+			for (int c = 0; c < 4; ++c)
+			{
+				rgba[c] = front[c] + transparency * back[c];
+			}
+			memcpy(mine + i, rgba, sizeof(rgba));
+		}
+
+		begin = keepBegin;
+		end = keepEnd;
+	}
+
+	// this rank's rows are final, blend them over the background
+	const bool premultiplied = m_classification != Classification::Identity;
+	for (size_t i = begin * rowFloats; i < end * rowFloats; i += 4)
+	{
+		WritePixel(&m_partial[i], premultiplied, &m_frame[i]);
+	}
+	return true;
+}
+
+bool DistributedRenderer::Gather()
+{
+	const int rank = m_transport->GetRank();
+	const int size = m_transport->GetSize();
+	const size_t rowBytes = static_cast<size_t>(m_width) * 4;
+
+	int begin, end;
+	if (rank != 0)
+	{
+		GetStripRows(rank, size, m_height, begin, end);
+		return m_transport->Send(0, &m_frame[begin * rowBytes], (end - begin) * rowBytes);
+	}
+	for (int peer = 1; peer < size; ++peer)
+	{
+		GetStripRows(peer, size, m_height, begin, end);
+		if (!m_transport->Receive(peer, &m_frame[begin * rowBytes], (end - begin) * rowBytes))
+		{
+			return false;
+		}
+	}
+	return true;
+}
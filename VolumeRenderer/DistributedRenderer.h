@@ -0,0 +1,150 @@
+/// <summary>
+/// DistributedRenderer.h
+///
+/// About:
+/// Sort-last rendering of one volume by a group of ranks,
+/// for volumes too big for one renderer to hold or draw in
+/// time. The volume is cut into a kd-tree of bricks, one per
+/// rank, each halving its parent across its longest axis,
+/// and a rank only ever loads its own brick (plus the voxel
+/// either side trilinear filtering reaches into).
+///
+/// Every rank marches the whole frame with the RayCastPS
+/// kernel, but only takes the samples of each ray that fall
+/// in its brick: the same samples a single renderer takes,
+/// numbered from the same entry point, so the partial colour
+/// and alpha of the bricks along a ray composite front to
+/// back into what the whole ray accumulates (apart from
+/// early termination, which each brick does by itself).
+///
+/// Partial images are composited by binary swap: in stage s
+/// each rank pairs up with the rank that differs in bit s,
+/// the sibling of its kd-tree subtree, keeps half of the
+/// rows it still holds and sends the other half, then puts
+/// what it receives in front or behind by which side of the
+/// split plane the eye is on. After log2(size) stages each
+/// rank holds 1/size of the final rows, which rank 0 gathers.
+/// Every rank sends about as much as every other and the
+/// stages halve the traffic, so compositing scales with the
+/// group; hence the group size must be a power of two.
+/// </summary>
+#ifndef DistributedRenderer_h__
+#define DistributedRenderer_h__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "RayCastKernel.h"
+#include "TileScheduler.h"
+#include "TransferFunction.h"
+#include "Transport.h"
+#include "Volume.h"
+#include "VolumeCamera.h"
+
+class DistributedRenderer
+{
+public:
+	// voxels [begin, end) of the whole volume along x, y and z
+	struct Brick
+	{
+		int begin[3];
+		int end[3];
+	};
+
+	// a node of the kd-tree: the lower child takes the voxels below plane
+	// along axis
+	struct Split
+	{
+		int axis;
+		int plane;
+	};
+
+	struct FrameStats
+	{
+		double renderMs;		// marching this rank's brick
+		double compositeMs;		// binary swap, waiting for the partners included
+		double gatherMs;		// the final rows to rank 0
+		double frameMs;
+		uint64_t rays;			// that crossed the brick
+		uint64_t samples;
+		uint64_t bytesSent;		// by this rank, compositing and gathering
+	};
+
+	DistributedRenderer();
+
+	// transport connects the group (its size a power of two) and must outlive
+	// the renderer; every rank renders width x height frames
+	bool Initialize(Transport* transport, const int width, const int height);
+	// Loads this rank's brick of a RAW or .pvol volume (raw files are mapped,
+	// so only the brick's pages are read). Every rank must load the same file.
+	bool LoadBrick(const std::string& file, const VolumeDesc& desc);
+	void Shutdown();
+
+	const std::string& GetError() const { return m_error; }
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+	VolumeCamera& GetCamera() { return m_camera; }
+	const VolumeDesc& GetDesc() const { return m_desc; }
+	const Brick& GetBrick() const { return m_brick; }
+	const Volume& GetBrickVolume() const { return m_volume; }
+
+	// as CpuVolumeRenderer, the same on every rank
+	void SetTransferFunction(const TransferFunction& function) { m_transfer = function; }
+	void SetClassification(const Classification classification) { m_classification = classification; }
+	void SetStepScale(const float scale) { m_stepScale = scale; }
+	void SetShading(const bool enable) { m_shading = enable; }
+	void SetSkipEmptySpace(const bool enable) { m_skipEmpty = enable; }
+
+	// Renders and composites a frame, every rank must call it with the same
+	// camera. Returns false if the transport broke.
+	bool Render();
+
+	// the composited frame, RGBA8 like CpuVolumeRenderer::GetFrame, on rank 0
+	const uint8_t* GetFrame() const { return m_frame.data(); }
+	const FrameStats& GetFrameStats() const { return m_stats; }
+	// runs this rank's tiles
+	TileScheduler& GetScheduler() { return m_scheduler; }
+
+	// The kd-tree of count (a power of two) bricks: splits in heap order
+	// (the root at 1, the children of n at 2n and 2n + 1, splits[0] unused),
+	// bricks by leaf, brick i being rank i.
+	static void SplitVolume(const VolumeDesc& desc, const int count, std::vector<Split>& splits, std::vector<Brick>& bricks);
+	// rows [begin, end) rank holds after binary swap of a group of size
+	static void GetStripRows(const int rank, const int size, const int height, int& begin, int& end);
+
+private:
+	void RenderTile(const Matrix4& invWVP, const RayCastContext& context, const RayCastPath path, const float stepScale, const int tile, uint64_t& rays, uint64_t& samples);
+	bool Composite(const Matrix4& invWVP);
+	bool Gather();
+
+	Transport* m_transport;
+	int m_width;
+	int m_height;
+	std::string m_error;
+	VolumeCamera m_camera;
+
+	VolumeDesc m_desc;
+	Brick m_brick;
+	std::vector<Split> m_splits;
+	// the brick with its apron, and where that starts in the whole volume
+	Volume m_volume;
+	int m_offset[3];
+
+	TransferFunction m_transfer;
+	TransferTables m_transferTables;
+	Classification m_classification;
+	float m_stepScale;
+	bool m_shading;
+	bool m_skipEmpty;
+	std::vector<uint8_t> m_occupancy;
+
+	// premultiplied colour and alpha of this rank's brick, then of the rows
+	// composited so far
+	std::vector<float> m_partial;
+	std::vector<float> m_incoming;
+	std::vector<uint8_t> m_frame;
+	TileScheduler m_scheduler;
+	FrameStats m_stats;
+};
+
+#endif // DistributedRenderer_h__
@@ -0,0 +1,281 @@
+#include "FrameStream.h"
+#include "LzCodec.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	const char kFrameMagic[4] = { 'V', 'F', 'R', 'M' };
+
+	void GetTileRect(const int tile, const int tileSize, const int width, const int height, int& x0, int& y0, int& w, int& h)
+	{
+		const int tilesX = (width + tileSize - 1) / tileSize;
+		x0 = tile % tilesX * tileSize;
+		y0 = tile / tilesX * tileSize;
+		w = std::min(tileSize, width - x0);
+		h = std::min(tileSize, height - y0);
+	}
+}
+
+uint64_t GetFrameChecksum(const uint8_t* rgba, const int width, const int height)
+{
+	// FNV-1a a pixel (4 bytes) at a time
+	uint64_t hash = 14695981039346656037ull;
+	const size_t pixels = static_cast<size_t>(width) * height;
+	for (size_t i = 0; i < pixels; ++i)
+	{
+		uint32_t pixel;
+		memcpy(&pixel, rgba + i * 4, 4);
+		hash = (hash ^ pixel) * 1099511628211ull;
+	}
+	return hash;
+}
+
+//---------------------------------------------------------------------------
+// FrameEncoder
+
+FrameEncoder::FrameEncoder()
+{
+	m_tileSize = kDefaultStreamTileSize;
+	m_delta = true;
+	m_frame = 0;
+	m_width = 0;
+	m_height = 0;
+	m_stats = Stats();
+}
+
+void FrameEncoder::Reset()
+{
+	std::fill(m_previous.begin(), m_previous.end(), 0);
+}
+
+void FrameEncoder::Encode(const uint8_t* rgba, const int width, const int height, std::vector<uint8_t>& packet)
+{
+	const uint64_t start = GetClockNs();
+	if (width != m_width || height != m_height)
+	{
+		m_width = width;
+		m_height = height;
+		m_previous.assign(static_cast<size_t>(width) * height * 4, 0);
+	}
+
+	const int tileSize = std::max(m_tileSize, 1);
+	const int tiles = ((width + tileSize - 1) / tileSize) * ((height + tileSize - 1) / tileSize);
+	m_tileData.resize(tiles);
+
+	// each tile compared, XORed and compressed on its own, into its own buffer
+	ParallelFor(tiles, [&](int begin, int end) {
+		std::vector<uint8_t> raw;
+		std::vector<uint8_t> delta;
+		std::vector<uint8_t> compressed;
+		std::vector<uint32_t> table;
+		for (int tile = begin; tile < end; ++tile)
+		{
+			std::vector<uint8_t>& data = m_tileData[tile];
+			data.clear();
+
+			int x0, y0, w, h;
+			GetTileRect(tile, tileSize, width, height, x0, y0, w, h);
+			const size_t rowBytes = static_cast<size_t>(w) * 4;
+			bool changed = !m_delta;
+			for (int y = y0; y < y0 + h && !changed; ++y)
+			{
+				const size_t offset = (static_cast<size_t>(y) * width + x0) * 4;
+				changed = memcmp(rgba + offset, &m_previous[offset], rowBytes) != 0;
+			}
+			if (!changed)
+			{
+				continue;
+			}
+
+			// the tile's rows one after the other, as they are and XORed with what
+			// the viewer has (which is then updated to this frame)
+			raw.resize(rowBytes * h);
+			delta.resize(rowBytes * h);
+			for (int y = 0; y < h; ++y)
+			{
+				const size_t offset = (static_cast<size_t>(y0 + y) * width + x0) * 4;
+				uint8_t* previous = &m_previous[offset];
+				memcpy(&raw[y * rowBytes], rgba + offset, rowBytes);
+				for (size_t i = 0; i < rowBytes; ++i)
+				{
+					delta[y * rowBytes + i] = rgba[offset + i] ^ previous[i];
+				}
+				memcpy(previous, rgba + offset, rowBytes);
+			}
+
+			// the smaller of the two: XOR wins where most pixels stayed, but
+			// where the content moved it is noisier than the tile itself
+			FrameTileEntry entry = FrameTileEntry();
+			entry.index = tile;
+			data.resize(sizeof(entry) + LzGetBound(raw.size()));
+			size_t size = LzCompress(raw.data(), raw.size(), &data[sizeof(entry)], table);
+			if (m_delta)
+			{
+				compressed.resize(LzGetBound(delta.size()));
+				size_t deltaSize = LzCompress(delta.data(), delta.size(), compressed.data(), table);
+				if (deltaSize < size)
+				{
+					memcpy(&data[sizeof(entry)], compressed.data(), deltaSize);
+					size = deltaSize;
+					entry.delta = 1;
+				}
+			}
+			if (size >= raw.size())
+			{
+				memcpy(&data[sizeof(entry)], raw.data(), raw.size());
+				size = raw.size();
+				entry.stored = 1;
+				entry.delta = 0;
+			}
+			entry.size = static_cast<uint32_t>(size);
+			memcpy(data.data(), &entry, sizeof(entry));
+			data.resize(sizeof(entry) + size);
+		}
+	});
+
+	FrameStreamHeader header = FrameStreamHeader();
+	memcpy(header.magic, kFrameMagic, 4);
+	header.frame = m_frame++;
+	header.width = static_cast<uint16_t>(width);
+	header.height = static_cast<uint16_t>(height);
+	header.tileSize = static_cast<uint16_t>(tileSize);
+	header.checksum = GetFrameChecksum(rgba, width, height);
+
+	size_t payload = 0;
+	for (const std::vector<uint8_t>& data : m_tileData)
+	{
+		payload += data.size();
+		header.tiles += data.empty() ? 0 : 1;
+	}
+	header.payloadBytes = static_cast<uint32_t>(payload);
+
+	packet.resize(sizeof(header) + payload);
+	memcpy(packet.data(), &header, sizeof(header));
+	size_t offset = sizeof(header);
+	for (const std::vector<uint8_t>& data : m_tileData)
+	{
+		if (!data.empty())
+		{
+			memcpy(&packet[offset], data.data(), data.size());
+			offset += data.size();
+		}
+	}
+
+	m_stats.tiles = tiles;
+	m_stats.changedTiles = static_cast<int>(header.tiles);
+	m_stats.rawBytes = static_cast<size_t>(width) * height * 4;
+	m_stats.packetBytes = packet.size();
+	m_stats.encodeMs = NsToMs(GetClockNs() - start);
+}
+
+void FrameEncoder::EncodeEnd(std::vector<uint8_t>& packet) const
+{
+	FrameStreamHeader header = FrameStreamHeader();
+	memcpy(header.magic, kFrameMagic, 4);
+	header.frame = m_frame;
+	header.flags = kFrameStreamEnd;
+	packet.resize(sizeof(header));
+	memcpy(packet.data(), &header, sizeof(header));
+}
+
+//---------------------------------------------------------------------------
+// FrameDecoder
+
+FrameDecoder::FrameDecoder()
+{
+	m_width = 0;
+	m_height = 0;
+	m_frameNumber = 0;
+	m_end = false;
+}
+
+bool FrameDecoder::Decode(const uint8_t* packet, const size_t size)
+{
+	FrameStreamHeader header;
+	if (size < sizeof(header))
+	{
+		m_error = "Truncated packet";
+		return false;
+	}
+	memcpy(&header, packet, sizeof(header));
+	if (memcmp(header.magic, kFrameMagic, 4) != 0 || header.payloadBytes != size - sizeof(header))
+	{
+		m_error = "Not a frame packet";
+		return false;
+	}
+	m_frameNumber = header.frame;
+	m_end = (header.flags & kFrameStreamEnd) != 0;
+	if (m_end)
+	{
+		return true;
+	}
+	if (header.tileSize == 0)
+	{
+		m_error = "Invalid tile size";
+		return false;
+	}
+
+	// a new size starts from black, as the encoder does
+	if (header.width != m_width || header.height != m_height)
+	{
+		m_width = header.width;
+		m_height = header.height;
+		m_frame.assign(static_cast<size_t>(m_width) * m_height * 4, 0);
+	}
+
+	const int tileSize = header.tileSize;
+	const uint32_t tiles = ((m_width + tileSize - 1) / tileSize) * ((m_height + tileSize - 1) / tileSize);
+	const uint8_t* p = packet + sizeof(header);
+	const uint8_t* end = packet + size;
+	for (uint32_t i = 0; i < header.tiles; ++i)
+	{
+		FrameTileEntry entry;
+		if (end - p < static_cast<ptrdiff_t>(sizeof(entry)))
+		{
+			m_error = "Truncated tile";
+			return false;
+		}
+		memcpy(&entry, p, sizeof(entry));
+		p += sizeof(entry);
+		if (entry.index >= tiles || static_cast<size_t>(end - p) < entry.size)
+		{
+			m_error = "Invalid tile";
+			return false;
+		}
+
+		int x0, y0, w, h;
+		GetTileRect(entry.index, tileSize, m_width, m_height, x0, y0, w, h);
+		const size_t rowBytes = static_cast<size_t>(w) * 4;
+		m_tile.resize(rowBytes * h);
+		if (entry.stored ? entry.size != m_tile.size() : !LzDecompress(p, entry.size, m_tile.data(), m_tile.size()))
+		{
+			m_error = "Corrupt tile";
+			return false;
+		}
+		if (entry.stored)
+		{
+			memcpy(m_tile.data(), p, m_tile.size());
+		}
+		p += entry.size;
+
+		for (int y = 0; y < h; ++y)
+		{
+			uint8_t* out = &m_frame[(static_cast<size_t>(y0 + y) * m_width + x0) * 4];
+			const uint8_t* in = &m_tile[y * rowBytes];
+			for (size_t k = 0; k < rowBytes; ++k)
+			{
+				out[k] = entry.delta ? out[k] ^ in[k] : in[k];
+			}
+		}
+	}
+
+	if (GetFrameChecksum(m_frame.data(), m_width, m_height) != header.checksum)
+	{
+		m_error = "Frame " + std::to_string(header.frame) + " doesn't match its checksum";
+		return false;
+	}
+	return true;
+}
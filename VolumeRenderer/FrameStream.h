@@ -0,0 +1,131 @@
+/// <summary>
+/// FrameStream.h
+///
+/// About:
+/// Encoding of rendered frames for viewers elsewhere, e.g.
+/// thin clients watching a CpuVolumeRenderer. The frame is
+/// cut into tiles and only the tiles that changed since the
+/// last frame are sent: a turning volume leaves the
+/// background alone and a still one sends nothing at all.
+///
+/// A changed tile is compressed with LzCodec both as it is
+/// and as its XOR with what the viewer already has, where
+/// the pixels that stayed the same become runs of zeros, and
+/// the smaller is sent. Both ends start from a black frame,
+/// so the first frame needs nothing special and tiles that
+/// are still black are never sent. Tiles are encoded in
+/// parallel.
+///
+/// Every packet carries a checksum of the whole frame, so
+/// the decoder can tell if its copy has drifted from the
+/// encoder's (a packet lost or applied twice).
+/// </summary>
+#ifndef FrameStream_h__
+#define FrameStream_h__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Packet layout, little endian: header, then a FrameTileEntry and its data
+// for each of header.tiles tiles
+struct FrameStreamHeader
+{
+	char magic[4];			// "VFRM"
+	uint32_t frame;			// counts up from 0 per encoder
+	uint16_t width;
+	uint16_t height;
+	uint16_t tileSize;		// pixels, the last row and column of tiles may be smaller
+	uint16_t flags;			// kFrameStreamEnd
+	uint32_t tiles;			// tiles that follow
+	uint32_t payloadBytes;	// after the header
+	uint64_t checksum;		// GetFrameChecksum of the whole frame
+};
+
+struct FrameTileEntry
+{
+	uint32_t index;			// row by row from the top left
+	uint32_t size;			// bytes of data that follow
+	uint8_t stored;			// 1 if kept uncompressed (LZ didn't shrink it)
+	uint8_t delta;			// 1 if XORed with the viewer's tile, 0 if replacing it
+	uint8_t reserved[2];
+};
+
+// the last packet of a stream, with no tiles
+const uint16_t kFrameStreamEnd = 1;
+const int kDefaultStreamTileSize = 32;
+
+// of width x height RGBA8 pixels
+uint64_t GetFrameChecksum(const uint8_t* rgba, const int width, const int height);
+
+class FrameEncoder
+{
+public:
+	struct Stats
+	{
+		int tiles;				// in the frame
+		int changedTiles;		// sent
+		size_t rawBytes;		// of the frame
+		size_t packetBytes;		// header included
+		double encodeMs;
+	};
+
+	FrameEncoder();
+
+	void SetTileSize(const int size) { m_tileSize = size; Reset(); }
+	int GetTileSize() const { return m_tileSize; }
+	// on by default; off every tile is sent every frame, as it is, which is
+	// what streaming costs without delta encoding
+	void SetDelta(const bool enable) { m_delta = enable; }
+	// start again from a black frame, for a new viewer
+	void Reset();
+
+	// Encodes a width x height RGBA8 frame into packet (replaced), against the
+	// last one encoded. A change of size starts again from black.
+	void Encode(const uint8_t* rgba, const int width, const int height, std::vector<uint8_t>& packet);
+	// the packet telling the viewer the stream ends
+	void EncodeEnd(std::vector<uint8_t>& packet) const;
+
+	const Stats& GetStats() const { return m_stats; }
+
+private:
+	int m_tileSize;
+	bool m_delta;
+	uint32_t m_frame;
+	int m_width;
+	int m_height;
+	// what the viewer has
+	std::vector<uint8_t> m_previous;
+	// per tile, the entry and data of the frame being encoded
+	std::vector<std::vector<uint8_t>> m_tileData;
+	Stats m_stats;
+};
+
+class FrameDecoder
+{
+public:
+	FrameDecoder();
+
+	// Applies one packet of at least sizeof(FrameStreamHeader) bytes. False if
+	// it is corrupt or the frame doesn't match its checksum, GetError() says why.
+	bool Decode(const uint8_t* packet, const size_t size);
+
+	bool IsEnd() const { return m_end; }
+	uint32_t GetFrameNumber() const { return m_frameNumber; }
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+	const uint8_t* GetFrame() const { return m_frame.data(); }
+	const std::string& GetError() const { return m_error; }
+
+private:
+	int m_width;
+	int m_height;
+	uint32_t m_frameNumber;
+	bool m_end;
+	std::vector<uint8_t> m_frame;
+	std::vector<uint8_t> m_tile;
+	std::string m_error;
+};
+
+#endif // FrameStream_h__
@@ -0,0 +1,197 @@
+#include "GradientVolume.h"
+#include "Parallel.h"
+#include "Volume.h"
+
+namespace
+{
+	// a block's rows plus the ones either side stay in L2 even for wide
+	// 16-bit and float volumes
+	const int kBlockSlices = 16;
+	const int kBlockRows = 32;
+
+	// Gradient at one voxel from fetch(dx, dy, dz), the raw value of the
+	// neighbour at that offset
+	template <GradientFilter F, typename Fetch>
+	Vec3 ComputeGradient(const Fetch& fetch)
+	{
+		if (F == GradientFilter::Central)
+		{
+			return Vec3(fetch(1, 0, 0) - fetch(-1, 0, 0), fetch(0, 1, 0) - fetch(0, -1, 0), fetch(0, 0, 1) - fetch(0, 0, -1)) * 0.5f;
+		}
+
+		// every neighbour read once, n[dz + 1][dy + 1][dx + 1]
+		float n[3][3][3];
+		for (int dz = -1; dz <= 1; ++dz)
+		{
+			for (int dy = -1; dy <= 1; ++dy)
+			{
+				for (int dx = -1; dx <= 1; ++dx)
+				{
+					n[dz + 1][dy + 1][dx + 1] = fetch(dx, dy, dz);
+				}
+			}
+		}
+
+		// the [1 2 1] weights of both other axes sum to 16
+		static const float kSmooth[3] = { 1.f, 2.f, 1.f };
+		Vec3 g;
+		for (int a = 0; a < 3; ++a)
+		{
+			for (int b = 0; b < 3; ++b)
+			{
+				const float w = kSmooth[a] * kSmooth[b];
+				g.x += w * (n[a][b][2] - n[a][b][0]);
+				g.y += w * (n[a][2][b] - n[a][0][b]);
+				g.z += w * (n[2][a][b] - n[0][a][b]);
+			}
+		}
+		return g * (1.f / 32.f);
+	}
+}
+
+const float GradientVolume::kMaxMagnitude = 0.8660254f;
+
+const char* GetGradientFilterName(const GradientFilter filter)
+{
+	return filter == GradientFilter::Sobel ? "sobel" : "central";
+}
+
+GradientVolume::GradientVolume()
+{
+	m_filter = GradientFilter::Central;
+	m_width = m_height = m_depth = 0;
+}
+
+bool GradientVolume::Build(const Volume& volume, const GradientFilter filter)
+{
+	if (!volume.IsLoaded())
+	{
+		return false;
+	}
+
+	m_filter = filter;
+	m_width = volume.GetWidth();
+	m_height = volume.GetHeight();
+	m_depth = volume.GetDepth();
+	m_data.resize(static_cast<size_t>(m_width) * m_height * m_depth);
+
+	// one job per block, consecutive jobs share slices so each worker's band
+	// of jobs reads mostly the same ones
+	const int rowBlocks = (m_height + kBlockRows - 1) / kBlockRows;
+	const int sliceBlocks = (m_depth + kBlockSlices - 1) / kBlockSlices;
+	DispatchVoxelType(volume.GetDesc().type, [&](auto voxel) {
+		typedef decltype(voxel) T;
+		ParallelFor(rowBlocks * sliceBlocks, [&](int begin, int end) {
+			for (int block = begin; block < end; ++block)
+			{
+				const int z0 = block / rowBlocks * kBlockSlices;
+				const int y0 = block % rowBlocks * kBlockRows;
+				BuildBlock<T>(volume, z0, std::min(z0 + kBlockSlices, m_depth), y0, std::min(y0 + kBlockRows, m_height));
+			}
+		});
+	});
+
+	return true;
+}
+
+void GradientVolume::Shutdown()
+{
+	m_data.clear();
+	m_data.shrink_to_fit();
+	m_width = m_height = m_depth = 0;
+}
+
+Vec3 GradientVolume::GetScale(const VolumeDesc& desc)
+{
+	const float window = VoxelWindow::GetDefault(desc.type).scale;
+	const float spacing = std::min(desc.spacing.x, std::min(desc.spacing.y, desc.spacing.z));
+	return Vec3(window * spacing / desc.spacing.x, window * spacing / desc.spacing.y, window * spacing / desc.spacing.z);
+}
+
+uint32_t GradientVolume::Encode(const Vec3& gradient)
+{
+	const uint32_t zero = kNormalBias | kNormalBias << 8 | kNormalBias << 16;
+	float magnitude = Length(gradient);
+	if (!(magnitude > 0.f))
+	{
+		return zero;
+	}
+
+	// components in [-1,1] onto [1,255], the magnitude's square root onto [0,255]
+	const float scale = (255 - kNormalBias) / magnitude;
+	const uint32_t x = static_cast<uint32_t>(gradient.x * scale + (kNormalBias + 0.5f));
+	const uint32_t y = static_cast<uint32_t>(gradient.y * scale + (kNormalBias + 0.5f));
+	const uint32_t z = static_cast<uint32_t>(gradient.z * scale + (kNormalBias + 0.5f));
+	const uint32_t m = static_cast<uint32_t>(std::sqrt(std::min(magnitude / kMaxMagnitude, 1.f)) * 255.f + 0.5f);
+	return x | y << 8 | z << 16 | m << 24;
+}
+
+template <typename T>
+void GradientVolume::BuildBlock(const Volume& volume, const int z0, const int z1, const int y0, const int y1)
+{
+	const T* data = volume.GetVoxels<T>();
+	const Vec3 scale = GetScale(volume.GetDesc());
+	const size_t slice = static_cast<size_t>(m_width) * m_height;
+
+	for (int z = z0; z < z1; ++z)
+	{
+		for (int y = y0; y < y1; ++y)
+		{
+			uint32_t* out = m_data.data() + (static_cast<size_t>(z) * m_height + y) * m_width;
+			auto encode = [&](const Vec3& g) {
+				return Encode(Vec3(g.x * scale.x, g.y * scale.y, g.z * scale.z));
+			};
+
+			// voxels whose neighbours may be outside the volume read the border
+			// colour (0) there, like the samples the gradients stand in for
+			auto border = [&](const int x) {
+				auto fetch = [&](const int dx, const int dy, const int dz) {
+					return volume.Load<T>(x + dx, y + dy, z + dz);
+				};
+				return m_filter == GradientFilter::Sobel ? encode(ComputeGradient<GradientFilter::Sobel>(fetch)) :
+					encode(ComputeGradient<GradientFilter::Central>(fetch));
+			};
+
+			if (y == 0 || z == 0 || y + 1 == m_height || z + 1 == m_depth || m_width < 3)
+			{
+				for (int x = 0; x < m_width; ++x)
+				{
+					out[x] = border(x);
+				}
+				continue;
+			}
+
+			// the nine rows around this one, rows[dz + 1][dy + 1]
+			const T* row = data + (static_cast<size_t>(z) * m_height + y) * m_width;
+			const T* rows[3][3];
+			for (int dz = -1; dz <= 1; ++dz)
+			{
+				for (int dy = -1; dy <= 1; ++dy)
+				{
+					rows[dz + 1][dy + 1] = row + dz * static_cast<ptrdiff_t>(slice) + dy * m_width;
+				}
+			}
+
+			out[0] = border(0);
+			if (m_filter == GradientFilter::Sobel)
+			{
+				for (int x = 1; x + 1 < m_width; ++x)
+				{
+					out[x] = encode(ComputeGradient<GradientFilter::Sobel>([&](const int dx, const int dy, const int dz) {
+						return VoxelTraits<T>::ToFloat(rows[dz + 1][dy + 1][x + dx]);
+					}));
+				}
+			}
+			else
+			{
+				for (int x = 1; x + 1 < m_width; ++x)
+				{
+					out[x] = encode(ComputeGradient<GradientFilter::Central>([&](const int dx, const int dy, const int dz) {
+						return VoxelTraits<T>::ToFloat(rows[dz + 1][dy + 1][x + dx]);
+					}));
+				}
+			}
+			out[m_width - 1] = border(m_width - 1);
+		}
+	}
+}
@@ -0,0 +1,139 @@
+/// <summary>
+/// GradientVolume.h
+///
+/// About:
+/// Precomputed gradients of a volume for shading, one
+/// packed 32-bit voxel per scalar voxel: the normal's three
+/// components biased into a byte each and the magnitude in
+/// the fourth. Looking one up costs a single trilinear fetch
+/// where central differences on the fly take six.
+///
+/// Gradients are taken of the raw voxels through the type's
+/// default window (VoxelWindow::GetDefault), per voxel of
+/// the smallest spacing, so they don't change with the
+/// window. The magnitude is stored square-root encoded over
+/// [0, kMaxMagnitude] so the weak gradients most surfaces
+/// have keep some precision.
+///
+/// Build sweeps the volume in blocks of slices and rows,
+/// small enough that the neighbouring rows a voxel reads are
+/// still cached, with the blocks split across all cores.
+/// </summary>
+#ifndef GradientVolume_h__
+#define GradientVolume_h__
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "VolumeMath.h"
+
+class Volume;
+struct VolumeDesc;
+
+enum class GradientFilter
+{
+	Central,	// (v[x+1] - v[x-1]) / 2 along each axis
+	Sobel		// 3x3x3, central differences smoothed by [1 2 1] / 4 across both other axes
+};
+
+const char* GetGradientFilterName(const GradientFilter filter);
+
+class GradientVolume
+{
+public:
+	// largest magnitude either filter gives for windowed values in [0,1]
+	static const float kMaxMagnitude;
+	// the bias of the normal components, a byte of 128 is 0
+	static const int kNormalBias = 128;
+
+	GradientVolume();
+
+	bool Build(const Volume& volume, const GradientFilter filter = GradientFilter::Central);
+	void Shutdown();
+
+	bool IsBuilt() const { return !m_data.empty(); }
+	GradientFilter GetFilter() const { return m_filter; }
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+	int GetDepth() const { return m_depth; }
+	// x fastest then y then z, like the scalar voxels
+	const uint32_t* GetData() const { return m_data.data(); }
+	size_t GetMemoryUsage() const { return m_data.size() * sizeof(uint32_t); }
+
+	// Per axis factor from raw voxel differences to the gradient units: the
+	// default window's scale, times the smallest spacing over the axis' spacing
+	static Vec3 GetScale(const VolumeDesc& desc);
+
+	// gradient in the units above; the magnitude decodes from the (filtered)
+	// fourth byte
+	static uint32_t Encode(const Vec3& gradient);
+	static float DecodeMagnitude(const float encoded);
+
+	// Trilinear fetch at normalised texture coordinates, clamped at the edges.
+	// The normal is the filtered one, shorter than 1 where normals disagree.
+	void Sample(const Vec3& uvw, Vec3& normal, float& magnitude) const;
+
+private:
+	template <typename T>
+	void BuildBlock(const Volume& volume, const int z0, const int z1, const int y0, const int y1);
+
+	GradientFilter m_filter;
+	int m_width;
+	int m_height;
+	int m_depth;
+	std::vector<uint32_t> m_data;
+};
+
+inline float GradientVolume::DecodeMagnitude(const float encoded)
+{
+	float root = encoded * (1.f / 255.f);
+	return root * root * kMaxMagnitude;
+}
+
+inline void GradientVolume::Sample(const Vec3& uvw, Vec3& normal, float& magnitude) const
+{
+	// texel centres sit at (i + 0.5) / size, like Volume::Sample
+	float fx = std::min(std::max(uvw.x * m_width - 0.5f, 0.f), static_cast<float>(m_width - 1));
+	float fy = std::min(std::max(uvw.y * m_height - 0.5f, 0.f), static_cast<float>(m_height - 1));
+	float fz = std::min(std::max(uvw.z * m_depth - 0.5f, 0.f), static_cast<float>(m_depth - 1));
+
+	int x0 = std::min(static_cast<int>(fx), m_width - 1);
+	int y0 = std::min(static_cast<int>(fy), m_height - 1);
+	int z0 = std::min(static_cast<int>(fz), m_depth - 1);
+	float tx = fx - x0;
+	float ty = fy - y0;
+	float tz = fz - z0;
+
+	const size_t dx = x0 + 1 < m_width ? 1 : 0;
+	const size_t dy = y0 + 1 < m_height ? m_width : 0;
+	const size_t dz = z0 + 1 < m_depth ? static_cast<size_t>(m_width) * m_height : 0;
+	const uint32_t* p = m_data.data() + (static_cast<size_t>(z0) * m_height + y0) * m_width + x0;
+	const uint32_t corners[8] = { p[0], p[dx], p[dy], p[dy + dx], p[dz], p[dz + dx], p[dz + dy], p[dz + dy + dx] };
+
+	// the four bytes filtered like an RGBA8 texture, then decoded
+	float channels[4];
+	for (int c = 0; c < 4; ++c)
+	{
+		const int shift = c * 8;
+		float v[8];
+		for (int i = 0; i < 8; ++i)
+		{
+			v[i] = static_cast<float>((corners[i] >> shift) & 0xff);
+		}
+		float c00 = v[0] + (v[1] - v[0]) * tx;
+		float c10 = v[2] + (v[3] - v[2]) * tx;
+		float c01 = v[4] + (v[5] - v[4]) * tx;
+		float c11 = v[6] + (v[7] - v[6]) * tx;
+		float c0 = c00 + (c10 - c00) * ty;
+		float c1 = c01 + (c11 - c01) * ty;
+		channels[c] = c0 + (c1 - c0) * tz;
+	}
+
+	const float scale = 1.f / (255 - kNormalBias);
+	normal = Vec3((channels[0] - kNormalBias) * scale, (channels[1] - kNormalBias) * scale, (channels[2] - kNormalBias) * scale);
+	magnitude = DecodeMagnitude(channels[3]);
+}
+
+#endif // GradientVolume_h__
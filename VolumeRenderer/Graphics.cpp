@@ -1,4 +1,5 @@
 #include "Graphics.h"
+#include "Profiler.h"
 
 Graphics::Graphics()
 {	
@@ -71,6 +72,7 @@ bool Graphics::Frame(float dt)
 
 void Graphics::Update(float dt)
 {
+	ProfileZone zone(ProfileStage::Update);
 	m_volumeRenderer->Update(m_D3D->GetDevice(), dt);
 }
 
@@ -79,11 +81,16 @@ bool Graphics::Render(float dt)
 	//Clear back buffer and depth stencil
 	m_D3D->BeginScene(m_clearBackBufferColor);
 
-	m_D3D->EnableAlphaBlending(true);
-	// let our volume renderer do it's thing :)
-	m_volumeRenderer->Render(m_D3D->GetDeviceContext(), m_D3D->m_backFaceCull, m_D3D->m_FrontFaceCull, m_D3D->m_renderTargetView);
-	m_D3D->EnableAlphaBlending(false);
+	{
+		ProfileZone zone(ProfileStage::Render);
+		m_D3D->EnableAlphaBlending(true);
+		// let our volume renderer do it's thing :)
+		m_volumeRenderer->Render(m_D3D->GetDeviceContext(), m_D3D->m_backFaceCull, m_D3D->m_FrontFaceCull, m_D3D->m_renderTargetView);
+		m_D3D->EnableAlphaBlending(false);
+	}
 
+	// presents, so this is where waiting for the GPU shows up
+	ProfileZone zone(ProfileStage::Present);
 	m_D3D->EndScene();
 	return true;
 }
\ No newline at end of file
@@ -0,0 +1,41 @@
+#include "ImageWriter.h"
+#include <cstdio>
+#include <vector>
+
+bool WriteTGA(const std::string& file, const uint8_t* pixels, const int width, const int height)
+{
+	FILE* fp = fopen(file.c_str(), "wb");
+	if (!fp)
+	{
+		return false;
+	}
+
+	uint8_t header[18] = {};
+	header[2] = 2;	// uncompressed true colour
+	header[12] = static_cast<uint8_t>(width & 0xff);
+	header[13] = static_cast<uint8_t>((width >> 8) & 0xff);
+	header[14] = static_cast<uint8_t>(height & 0xff);
+	header[15] = static_cast<uint8_t>((height >> 8) & 0xff);
+	header[16] = 32;	// bits per pixel
+	header[17] = 0x28;	// 8 alpha bits, top-left origin
+	fwrite(header, 1, sizeof(header), fp);
+
+	// TGA stores BGRA
+	std::vector<uint8_t> row(static_cast<size_t>(width) * 4);
+	for (int y = 0; y < height; ++y)
+	{
+		const uint8_t* src = pixels + static_cast<size_t>(y) * width * 4;
+		for (int x = 0; x < width; ++x)
+		{
+			row[x * 4 + 0] = src[x * 4 + 2];
+			row[x * 4 + 1] = src[x * 4 + 1];
+			row[x * 4 + 2] = src[x * 4 + 0];
+			row[x * 4 + 3] = src[x * 4 + 3];
+		}
+		fwrite(row.data(), 1, row.size(), fp);
+	}
+
+	bool ok = ferror(fp) == 0;
+	fclose(fp);
+	return ok;
+}
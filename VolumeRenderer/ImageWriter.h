@@ -0,0 +1,16 @@
+/// <summary>
+/// ImageWriter.h
+///
+/// About:
+/// Writes RGBA8 frames to disk (uncompressed 32-bit TGA).
+/// </summary>
+#ifndef ImageWriter_h__
+#define ImageWriter_h__
+
+#include <cstdint>
+#include <string>
+
+// pixels are tightly packed RGBA8, top row first
+bool WriteTGA(const std::string& file, const uint8_t* pixels, const int width, const int height);
+
+#endif // ImageWriter_h__
@@ -0,0 +1,212 @@
+#include "LzCodec.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	const size_t kMinMatch = 4;
+	const size_t kMaxOffset = 65535;
+	// the tail is always sent as literals, so the match finder's 4 byte reads stay inside
+	const size_t kLastLiterals = 8;
+	// the hash table has about an entry per input byte, clearing it costs less
+	// than compressing; small inputs get a small table
+	const int kMinHashBits = 8;
+	const int kMaxHashBits = 16;
+
+	uint32_t Read32(const uint8_t* const p)
+	{
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	uint32_t Hash(const uint32_t value, const int bits)
+	{
+		return (value * 2654435761u) >> (32 - bits);
+	}
+
+	int GetHashBits(const size_t size)
+	{
+		int bits = kMinHashBits;
+		while (bits < kMaxHashBits && (static_cast<size_t>(1) << bits) < size)
+		{
+			++bits;
+		}
+		return bits;
+	}
+
+	// the part of a length past its nibble
+	uint8_t* WriteLength(uint8_t* out, size_t length)
+	{
+		for (; length >= 255; length -= 255)
+		{
+			*out++ = 255;
+		}
+		*out++ = static_cast<uint8_t>(length);
+		return out;
+	}
+
+	bool ReadLength(const uint8_t*& in, const uint8_t* const end, size_t& length)
+	{
+		uint8_t byte;
+		do
+		{
+			if (in == end)
+			{
+				return false;
+			}
+			byte = *in++;
+			length += byte;
+		} while (byte == 255);
+		return true;
+	}
+
+	// matchLength 0 ends the stream: literals only, no offset
+	uint8_t* WriteSequence(uint8_t* out, const uint8_t* const literals, const size_t literalCount, const size_t offset, const size_t matchLength)
+	{
+		const size_t matchCode = matchLength > 0 ? matchLength - kMinMatch : 0;
+		*out++ = static_cast<uint8_t>((std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(matchCode, 15));
+		if (literalCount >= 15)
+		{
+			out = WriteLength(out, literalCount - 15);
+		}
+		memcpy(out, literals, literalCount);
+		out += literalCount;
+
+		if (matchLength > 0)
+		{
+			*out++ = static_cast<uint8_t>(offset);
+			*out++ = static_cast<uint8_t>(offset >> 8);
+			if (matchCode >= 15)
+			{
+				out = WriteLength(out, matchCode - 15);
+			}
+		}
+		return out;
+	}
+}
+
+size_t LzGetBound(const size_t size)
+{
+	// all literals: one token, the length bytes and the literals
+	return size + size / 255 + 16;
+}
+
+size_t LzCompress(const uint8_t* const src, const size_t size, uint8_t* const dst)
+{
+	std::vector<uint32_t> table;
+	return LzCompress(src, size, dst, table);
+}
+
+size_t LzCompress(const uint8_t* const src, const size_t size, uint8_t* const dst, std::vector<uint32_t>& table)
+{
+	// last position + 1 seen for each hash, 0 if none
+	const int hashBits = GetHashBits(size);
+	table.assign(static_cast<size_t>(1) << hashBits, 0);
+	uint8_t* out = dst;
+	size_t anchor = 0;
+
+	if (size > kLastLiterals + kMinMatch)
+	{
+		const size_t limit = size - kLastLiterals;
+		size_t i = 0;
+		while (i + kMinMatch <= limit)
+		{
+			const uint32_t sequence = Read32(src + i);
+			uint32_t& entry = table[Hash(sequence, hashBits)];
+			const size_t candidate = entry;
+			entry = static_cast<uint32_t>(i + 1);
+
+			if (candidate == 0 || i - (candidate - 1) > kMaxOffset || Read32(src + candidate - 1) != sequence)
+			{
+				// step further the longer nothing matches, incompressible data goes by quickly
+				i += 1 + ((i - anchor) >> 6);
+				continue;
+			}
+
+			const size_t match = candidate - 1;
+			size_t length = kMinMatch;
+			while (i + length < limit && src[match + length] == src[i + length])
+			{
+				++length;
+			}
+			out = WriteSequence(out, src + anchor, i - anchor, i - match, length);
+			i += length;
+			anchor = i;
+		}
+	}
+
+	out = WriteSequence(out, src + anchor, size - anchor, 0, 0);
+	return static_cast<size_t>(out - dst);
+}
+
+bool LzDecompress(const uint8_t* const src, const size_t srcSize, uint8_t* const dst, const size_t dstSize)
+{
+	const uint8_t* in = src;
+	const uint8_t* const inEnd = src + srcSize;
+	uint8_t* out = dst;
+	uint8_t* const outEnd = dst + dstSize;
+
+	while (in < inEnd)
+	{
+		const uint8_t token = *in++;
+
+		size_t literals = token >> 4;
+		if (literals == 15 && !ReadLength(in, inEnd, literals))
+		{
+			return false;
+		}
+		if (literals > static_cast<size_t>(inEnd - in) || literals > static_cast<size_t>(outEnd - out))
+		{
+			return false;
+		}
+		memcpy(out, in, literals);
+		in += literals;
+		out += literals;
+
+		// the last sequence has no match
+		if (in == inEnd)
+		{
+			break;
+		}
+
+		if (inEnd - in < 2)
+		{
+			return false;
+		}
+		const size_t offset = in[0] | (static_cast<size_t>(in[1]) << 8);
+		in += 2;
+		size_t length = token & 15;
+		if (length == 15 && !ReadLength(in, inEnd, length))
+		{
+			return false;
+		}
+		length += kMinMatch;
+		if (offset == 0 || offset > static_cast<size_t>(out - dst) || length > static_cast<size_t>(outEnd - out))
+		{
+			return false;
+		}
+
+		// overlapping matches repeat the last offset bytes
+		const uint8_t* match = out - offset;
+		if (offset >= length)
+		{
+			memcpy(out, match, length);
+		}
+		else if (offset == 1)
+		{
+			memset(out, *match, length);
+		}
+		else
+		{
+			for (size_t k = 0; k < length; ++k)
+			{
+				out[k] = match[k];
+			}
+		}
+		out += length;
+	}
+
+	return out == outEnd;
+}
@@ -0,0 +1,34 @@
+/// <summary>
+/// LzCodec.h
+///
+/// About:
+/// Small byte-oriented LZ77 codec in the spirit of LZ4, for
+/// the chunks of packed volume files. Each sequence is a
+/// token (literal count and match length nibbles, longer
+/// values continued in bytes of 255), the literals, and a
+/// 16-bit match offset. No entropy coding, so decoding is
+/// just copies and runs at memory speed; the compressor is
+/// a single hash probe per position.
+/// </summary>
+#ifndef LzCodec_h__
+#define LzCodec_h__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// largest compressed size of size bytes
+size_t LzGetBound(const size_t size);
+
+// Compresses src into dst, which must hold LzGetBound(size) bytes.
+// Returns the compressed size.
+size_t LzCompress(const uint8_t* const src, const size_t size, uint8_t* const dst);
+// Same, with the match finder's hash table kept in table between calls, so
+// compressing many small buffers (one per frame tile) doesn't allocate each time
+size_t LzCompress(const uint8_t* const src, const size_t size, uint8_t* const dst, std::vector<uint32_t>& table);
+
+// Decompresses exactly dstSize bytes, false if src is corrupt or
+// doesn't decode to dstSize bytes
+bool LzDecompress(const uint8_t* const src, const size_t srcSize, uint8_t* const dst, const size_t dstSize);
+
+#endif // LzCodec_h__
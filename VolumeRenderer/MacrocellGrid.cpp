@@ -0,0 +1,126 @@
+#include "MacrocellGrid.h"
+#include "Parallel.h"
+#include "Volume.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+MacrocellGrid::MacrocellGrid()
+{
+	m_cellSize = 0;
+	m_cellsX = m_cellsY = m_cellsZ = 0;
+}
+
+bool MacrocellGrid::Build(const Volume& volume, const int cellSize)
+{
+	if (!volume.IsLoaded() || cellSize <= 0)
+	{
+		return false;
+	}
+
+	m_cellSize = cellSize;
+	m_cellsX = (volume.GetWidth() + cellSize - 1) / cellSize;
+	m_cellsY = (volume.GetHeight() + cellSize - 1) / cellSize;
+	m_cellsZ = (volume.GetDepth() + cellSize - 1) / cellSize;
+	m_min.assign(GetCellCount(), 0.f);
+	m_max.assign(GetCellCount(), 0.f);
+
+	// one job per row of cells, every cell writes only its own entry
+	DispatchVoxelType(volume.GetDesc().type, [&](auto voxel) {
+		typedef decltype(voxel) T;
+		ParallelFor(m_cellsY * m_cellsZ, [&](int begin, int end) {
+			for (int row = begin; row < end; ++row)
+			{
+				for (int cx = 0; cx < m_cellsX; ++cx)
+				{
+					BuildCell<T>(volume, cx, row % m_cellsY, row / m_cellsY);
+				}
+			}
+		});
+	});
+
+	return true;
+}
+
+void MacrocellGrid::Shutdown()
+{
+	m_min.clear();
+	m_min.shrink_to_fit();
+	m_max.clear();
+	m_max.shrink_to_fit();
+	m_cellSize = 0;
+	m_cellsX = m_cellsY = m_cellsZ = 0;
+}
+
+template <typename T>
+void MacrocellGrid::BuildCell(const Volume& volume, const int cx, const int cy, const int cz)
+{
+	const int width = volume.GetWidth();
+	const int height = volume.GetHeight();
+	const int depth = volume.GetDepth();
+	const T* data = volume.GetVoxels<T>();
+
+	// the cell's voxels plus the one voxel apron a trilinear fetch can reach
+	int x0 = cx * m_cellSize - 1, x1 = (cx + 1) * m_cellSize;
+	int y0 = cy * m_cellSize - 1, y1 = (cy + 1) * m_cellSize;
+	int z0 = cz * m_cellSize - 1, z1 = (cz + 1) * m_cellSize;
+
+	// parts of the apron outside the volume read the border colour (0)
+	float lo = std::numeric_limits<float>::infinity();
+	float hi = -std::numeric_limits<float>::infinity();
+	if (x0 < 0 || y0 < 0 || z0 < 0 || x1 >= width || y1 >= height || z1 >= depth)
+	{
+		lo = hi = 0.f;
+	}
+	x0 = std::max(x0, 0); x1 = std::min(x1, width - 1);
+	y0 = std::max(y0, 0); y1 = std::min(y1, height - 1);
+	z0 = std::max(z0, 0); z1 = std::min(z1, depth - 1);
+
+	for (int z = z0; z <= z1; ++z)
+	{
+		for (int y = y0; y <= y1; ++y)
+		{
+			const T* row = data + (static_cast<size_t>(z) * height + y) * width;
+			for (int x = x0; x <= x1; ++x)
+			{
+				float value = VoxelTraits<T>::ToFloat(row[x]);
+				lo = std::min(lo, value);
+				hi = std::max(hi, value);
+			}
+		}
+	}
+
+	int index = GetIndex(cx, cy, cz);
+	m_min[index] = lo;
+	m_max[index] = hi;
+}
+
+void MacrocellGrid::Classify(const float* const opacity, const VoxelWindow& window, std::vector<uint8_t>& occupancy) const
+{
+	// visible[v] counts the values <= v with non-zero opacity, so a cell is
+	// empty when no value in [min, max] is visible
+	int visible[257];
+	visible[0] = 0;
+	for (int v = 0; v < 256; ++v)
+	{
+		visible[v + 1] = visible[v] + (opacity[v] > 0.f ? 1 : 0);
+	}
+
+	// the window is monotonic, so the cell's windowed range is that of its
+	// ends; rounded outwards to whole entries so no visible value is missed
+	occupancy.assign(GetCellCount() + 3, 0);
+	for (int i = 0; i < GetCellCount(); ++i)
+	{
+		int lo = static_cast<int>(std::floor(window.Apply(m_min[i]) * 255.f));
+		int hi = static_cast<int>(std::ceil(window.Apply(m_max[i]) * 255.f));
+		occupancy[i] = visible[hi + 1] - visible[lo] > 0 ? 1 : 0;
+	}
+}
+
+void MacrocellGrid::GetIdentityOpacity(float opacity[256])
+{
+	for (int v = 0; v < 256; ++v)
+	{
+		opacity[v] = v / 255.f;
+	}
+}
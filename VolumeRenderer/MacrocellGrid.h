@@ -0,0 +1,70 @@
+/// <summary>
+/// MacrocellGrid.h
+///
+/// About:
+/// Coarse min/max grid over a volume, one cell per
+/// cellSize^3 block of voxels. Ranges are kept as raw voxel
+/// values so the grid doesn't have to be rebuilt when the
+/// window changes. Each cell's range also covers
+/// the one voxel apron trilinear filtering reads around the
+/// block, so a cell whose whole range is transparent under
+/// the current classification can be skipped by the ray
+/// marcher without changing the image.
+/// </summary>
+#ifndef MacrocellGrid_h__
+#define MacrocellGrid_h__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "VoxelTypes.h"
+
+class Volume;
+
+class MacrocellGrid
+{
+public:
+	static const int kDefaultCellSize = 16;
+
+	MacrocellGrid();
+
+	// builds the grid with one band of cells per worker thread
+	bool Build(const Volume& volume, const int cellSize = kDefaultCellSize);
+	void Shutdown();
+
+	bool IsBuilt() const { return !m_min.empty(); }
+	int GetCellSize() const { return m_cellSize; }
+	int GetCellsX() const { return m_cellsX; }
+	int GetCellsY() const { return m_cellsY; }
+	int GetCellsZ() const { return m_cellsZ; }
+	int GetCellCount() const { return m_cellsX * m_cellsY * m_cellsZ; }
+	size_t GetMemoryUsage() const { return (m_min.size() + m_max.size()) * sizeof(float); }
+
+	int GetIndex(const int x, const int y, const int z) const { return (z * m_cellsY + y) * m_cellsX + x; }
+	// raw voxel values
+	float GetMin(const int index) const { return m_min[index]; }
+	float GetMax(const int index) const { return m_max[index]; }
+
+	// Marks each cell that holds any voxel value with a non-zero opacity.
+	// opacity has 256 entries over the windowed range [0,1], a cell is
+	// occupied if any entry its windowed range touches is visible. The
+	// result has one byte (0/1) per cell plus 3 bytes of padding so SIMD
+	// code can read it with 32-bit gathers.
+	void Classify(const float* const opacity, const VoxelWindow& window, std::vector<uint8_t>& occupancy) const;
+
+	// RayCastPS's classification: opacity is the voxel value itself
+	static void GetIdentityOpacity(float opacity[256]);
+
+private:
+	template <typename T>
+	void BuildCell(const Volume& volume, const int cx, const int cy, const int cz);
+
+	int m_cellSize;
+	int m_cellsX;
+	int m_cellsY;
+	int m_cellsZ;
+	std::vector<float> m_min;
+	std::vector<float> m_max;
+};
+
+#endif // MacrocellGrid_h__
@@ -0,0 +1,151 @@
+#include "MappedFile.h"
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+	m_data = nullptr;
+	m_size = 0;
+#ifdef _WIN32
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = NULL;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+void MappedFile::Swap(MappedFile& other)
+{
+	std::swap(m_data, other.m_data);
+	std::swap(m_size, other.m_size);
+#ifdef _WIN32
+	std::swap(m_file, other.m_file);
+	std::swap(m_mapping, other.m_mapping);
+#endif
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::string& file)
+{
+	Close();
+
+	m_file = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+
+	m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_mapping == NULL)
+	{
+		Close();
+		return false;
+	}
+
+	m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_data == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	m_size = static_cast<size_t>(size.QuadPart);
+
+	// a hint, the pages are still faulted in if it fails
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = const_cast<uint8_t*>(m_data);
+	range.NumberOfBytes = m_size;
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_data != nullptr)
+	{
+		UnmapViewOfFile(m_data);
+		m_data = nullptr;
+	}
+	if (m_mapping != NULL)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = NULL;
+	}
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+	}
+	m_size = 0;
+}
+
+#else
+
+bool MappedFile::Open(const std::string& file)
+{
+	Close();
+
+	int fd = open(file.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	// the mapping keeps the file referenced, the descriptor isn't needed
+	int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+	flags |= MAP_POPULATE;
+#endif
+	void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, flags, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+	{
+		return false;
+	}
+#ifndef MAP_POPULATE
+	madvise(data, static_cast<size_t>(info.st_size), MADV_WILLNEED);
+#endif
+
+	m_data = static_cast<const uint8_t*>(data);
+	m_size = static_cast<size_t>(info.st_size);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_data != nullptr)
+	{
+		munmap(const_cast<uint8_t*>(m_data), m_size);
+		m_data = nullptr;
+	}
+	m_size = 0;
+}
+
+#endif
@@ -0,0 +1,47 @@
+/// <summary>
+/// MappedFile.h
+///
+/// About:
+/// Read-only memory mapping of a whole file, so loading a
+/// volume for the texture upload doesn't copy it into a
+/// buffer of our own first. Open asks the OS to read the
+/// whole file in ahead (MAP_POPULATE, MADV_WILLNEED or
+/// PrefetchVirtualMemory), since every page is read anyway,
+/// rather than faulting pages in one at a time.
+/// </summary>
+#ifndef MappedFile_h__
+#define MappedFile_h__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	// returns false if the file can't be opened or mapped (empty files can't be)
+	bool Open(const std::string& file);
+	void Close();
+	void Swap(MappedFile& other);
+
+	bool IsOpen() const { return m_data != nullptr; }
+	const uint8_t* GetData() const { return m_data; }
+	size_t GetSize() const { return m_size; }
+
+private:
+	// owns the mapping
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	const uint8_t* m_data;
+	size_t m_size;
+#ifdef _WIN32
+	void* m_file;
+	void* m_mapping;
+#endif
+};
+
+#endif // MappedFile_h__
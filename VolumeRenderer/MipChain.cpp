@@ -0,0 +1,201 @@
+#include "MipChain.h"
+#include "Parallel.h"
+#include "Volume.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// one output slice of the 2x2x2 average, clamped at odd edges
+	template <typename T>
+	void BoxSlice(const Volume& src, const VolumeDesc& dst, const int z, T* const out)
+	{
+		typedef VoxelTraits<T> Traits;
+		const int width = src.GetWidth();
+		const int height = src.GetHeight();
+		const T* data = src.GetVoxels<T>();
+		const int z0 = 2 * z;
+		const int z1 = std::min(z0 + 1, src.GetDepth() - 1);
+
+		for (int y = 0; y < dst.height; ++y)
+		{
+			const int y0 = 2 * y;
+			const int y1 = std::min(y0 + 1, height - 1);
+			const T* rows[4] = {
+				data + (static_cast<size_t>(z0) * height + y0) * width,
+				data + (static_cast<size_t>(z0) * height + y1) * width,
+				data + (static_cast<size_t>(z1) * height + y0) * width,
+				data + (static_cast<size_t>(z1) * height + y1) * width };
+			T* row = out + static_cast<size_t>(y) * dst.width;
+
+			for (int x = 0; x < dst.width; ++x)
+			{
+				const int x0 = 2 * x;
+				const int x1 = std::min(x0 + 1, width - 1);
+				typename Traits::Sum sum = 0;
+				for (const T* r : rows)
+				{
+					sum += Traits::ToSum(r[x0]) + Traits::ToSum(r[x1]);
+				}
+				row[x] = Traits::FromSum(sum, 3);
+			}
+		}
+	}
+
+	// one output slice of the separable [1 3 3 1] / 8 filter, clamped at the edges
+	template <typename T>
+	void GaussianSlice(const Volume& src, const VolumeDesc& dst, const int z, T* const out)
+	{
+		typedef VoxelTraits<T> Traits;
+		typedef typename Traits::Sum Sum;
+		static const int kWeights[4] = { 1, 3, 3, 1 };
+		const int width = src.GetWidth();
+		const int height = src.GetHeight();
+		const int depth = src.GetDepth();
+		const T* data = src.GetVoxels<T>();
+
+		// taps 2i-1 .. 2i+2 around output voxel i
+		int zs[4];
+		for (int k = 0; k < 4; ++k)
+		{
+			zs[k] = std::min(std::max(2 * z - 1 + k, 0), depth - 1);
+		}
+
+		// the z and y passes summed into one row of the source width
+		std::vector<Sum> column(width);
+		for (int y = 0; y < dst.height; ++y)
+		{
+			std::fill(column.begin(), column.end(), Sum(0));
+			for (int kz = 0; kz < 4; ++kz)
+			{
+				for (int ky = 0; ky < 4; ++ky)
+				{
+					const int sy = std::min(std::max(2 * y - 1 + ky, 0), height - 1);
+					const Sum w = static_cast<Sum>(kWeights[kz] * kWeights[ky]);
+					const T* r = data + (static_cast<size_t>(zs[kz]) * height + sy) * width;
+					for (int x = 0; x < width; ++x)
+					{
+						column[x] += w * Traits::ToSum(r[x]);
+					}
+				}
+			}
+
+			T* row = out + static_cast<size_t>(y) * dst.width;
+			for (int x = 0; x < dst.width; ++x)
+			{
+				// the weights add up to 512
+				Sum sum = 0;
+				for (int kx = 0; kx < 4; ++kx)
+				{
+					sum += static_cast<Sum>(kWeights[kx]) * column[std::min(std::max(2 * x - 1 + kx, 0), width - 1)];
+				}
+				row[x] = Traits::FromSum(sum, 9);
+			}
+		}
+	}
+}
+
+const char* GetMipFilterName(const MipFilter filter)
+{
+	return filter == MipFilter::Gaussian ? "gaussian" : "box";
+}
+
+MipChain::MipChain()
+{
+	m_filter = MipFilter::Box;
+}
+
+MipChain::~MipChain()
+{
+}
+
+bool MipChain::Build(const Volume& volume, const MipFilter filter)
+{
+	Shutdown();
+	if (!volume.IsLoaded())
+	{
+		return false;
+	}
+
+	m_filter = filter;
+	const Volume* src = &volume;
+	while (src->GetWidth() > 1 || src->GetHeight() > 1 || src->GetDepth() > 1)
+	{
+		// same spacing ratios, the level covers the same box
+		VolumeDesc desc = src->GetDesc();
+		desc.width = (desc.width + 1) / 2;
+		desc.height = (desc.height + 1) / 2;
+		desc.depth = (desc.depth + 1) / 2;
+
+		std::vector<uint8_t> voxels(desc.GetByteSize());
+		const size_t slice = static_cast<size_t>(desc.width) * desc.height;
+		DispatchVoxelType(desc.type, [&](auto voxel) {
+			typedef decltype(voxel) T;
+			T* out = reinterpret_cast<T*>(voxels.data());
+			ParallelFor(desc.depth, [&](int begin, int end) {
+				for (int z = begin; z < end; ++z)
+				{
+					if (filter == MipFilter::Gaussian)
+					{
+						GaussianSlice(*src, desc, z, out + z * slice);
+					}
+					else
+					{
+						BoxSlice(*src, desc, z, out + z * slice);
+					}
+				}
+			});
+		});
+
+		std::unique_ptr<Volume> level(new Volume());
+		if (!level->Create(desc, voxels) || !level->BuildMacrocells())
+		{
+			Shutdown();
+			return false;
+		}
+		m_levels.push_back(std::move(level));
+		src = m_levels.back().get();
+	}
+	return true;
+}
+
+bool MipChain::BuildGradients(const GradientFilter filter)
+{
+	for (const std::unique_ptr<Volume>& level : m_levels)
+	{
+		if (!level->BuildGradients(filter))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void MipChain::Shutdown()
+{
+	m_levels.clear();
+}
+
+size_t MipChain::GetMemoryUsage() const
+{
+	size_t bytes = 0;
+	for (const std::unique_ptr<Volume>& level : m_levels)
+	{
+		bytes += level->GetMemoryUsage();
+	}
+	return bytes;
+}
+
+int MipChain::SelectLevel(const float footprint, const int levelCount)
+{
+	// level n voxels cover footprint * 2^n pixels
+	if (!(footprint < 1.f) || levelCount <= 0)
+	{
+		return 0;
+	}
+	if (!(footprint > 0.f))
+	{
+		return levelCount;
+	}
+	return std::min(static_cast<int>(std::floor(std::log2(1.f / footprint))), levelCount);
+}
@@ -0,0 +1,63 @@
+/// <summary>
+/// MipChain.h
+///
+/// About:
+/// Downsampled copies of a volume, each level half the
+/// size of the one above (rounded up) down to 1x1x1. Levels
+/// are built one after the other with every level's slices
+/// split across all cores, and each level gets its own
+/// macrocell grid so the coarse levels can still skip empty
+/// space. Minified views sample a coarser level with longer
+/// steps instead of the full resolution volume.
+/// </summary>
+#ifndef MipChain_h__
+#define MipChain_h__
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "GradientVolume.h"
+
+class Volume;
+
+enum class MipFilter
+{
+	Box,		// 2x2x2 average
+	Gaussian	// 4x4x4, [1 3 3 1] / 8 along each axis
+};
+
+const char* GetMipFilterName(const MipFilter filter);
+
+class MipChain
+{
+public:
+	MipChain();
+	~MipChain();
+
+	bool Build(const Volume& volume, const MipFilter filter = MipFilter::Box);
+	// every level's own GradientVolume, for shading the coarse levels
+	bool BuildGradients(const GradientFilter filter);
+	void Shutdown();
+
+	bool IsBuilt() const { return !m_levels.empty(); }
+	MipFilter GetFilter() const { return m_filter; }
+	// levels below the volume itself, GetLevel(1) is half its size
+	int GetLevelCount() const { return static_cast<int>(m_levels.size()); }
+	const Volume& GetLevel(const int level) const { return *m_levels[level - 1]; }
+	// voxels and macrocells of every level
+	size_t GetMemoryUsage() const;
+
+	// Picks the level for a view in which one voxel of the volume covers
+	// footprint pixels: the coarsest level whose voxels still cover at most
+	// a pixel, 0 (the volume) when voxels are larger than a pixel.
+	static int SelectLevel(const float footprint, const int levelCount);
+
+private:
+	MipChain(const MipChain&);
+	MipChain& operator=(const MipChain&);
+
+	std::vector<std::unique_ptr<Volume>> m_levels;
+	MipFilter m_filter;
+};
+
+#endif // MipChain_h__
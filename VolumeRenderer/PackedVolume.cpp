@@ -0,0 +1,367 @@
+#include "PackedVolume.h"
+#include "LzCodec.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	// chunks compressed per batch and worker, bounds the writer's memory
+	const int kChunksPerWorker = 4;
+
+	struct PackedChunk
+	{
+		std::vector<uint8_t> data;
+		PackedFilter filter;
+		bool stored;
+	};
+
+	// calls f(U()) with U the unsigned integer as wide as a voxel
+	template <typename Func>
+	void DispatchVoxelWord(const size_t voxelSize, Func&& f)
+	{
+		switch (voxelSize)
+		{
+		case 2:
+			f(uint16_t());
+			break;
+		case 4:
+			f(uint32_t());
+			break;
+		default:
+			f(uint8_t());
+			break;
+		}
+	}
+
+	// differences to the previous voxel (wrapping), optionally one plane per byte
+	template <typename U>
+	void DeltaEncode(const uint8_t* const src, const size_t count, uint8_t* const dst, const bool planes)
+	{
+		U previous = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			U value;
+			memcpy(&value, src + i * sizeof(U), sizeof(U));
+			U delta = static_cast<U>(value - previous);
+			previous = value;
+			if (planes)
+			{
+				for (size_t b = 0; b < sizeof(U); ++b)
+				{
+					dst[b * count + i] = static_cast<uint8_t>(delta >> (8 * b));
+				}
+			}
+			else
+			{
+				memcpy(dst + i * sizeof(U), &delta, sizeof(U));
+			}
+		}
+	}
+
+	// inverse of DeltaEncode, src may be dst unless planes
+	template <typename U>
+	void DeltaDecode(const uint8_t* const src, const size_t count, uint8_t* const dst, const bool planes)
+	{
+		U previous = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			U delta = 0;
+			if (planes)
+			{
+				for (size_t b = 0; b < sizeof(U); ++b)
+				{
+					delta = static_cast<U>(delta | (static_cast<U>(src[b * count + i]) << (8 * b)));
+				}
+			}
+			else
+			{
+				memcpy(&delta, src + i * sizeof(U), sizeof(U));
+			}
+			previous = static_cast<U>(previous + delta);
+			memcpy(dst + i * sizeof(U), &previous, sizeof(U));
+		}
+	}
+
+	void PackChunk(const uint8_t* const src, const size_t bytes, const size_t voxelSize, const PackedFilter filter,
+		std::vector<uint8_t>& filtered, std::vector<uint8_t>& compressed, PackedChunk& chunk)
+	{
+		// byte planes of single byte voxels are just the deltas
+		std::vector<PackedFilter> candidates;
+		if (filter == PackedFilter::Auto)
+		{
+			candidates.push_back(PackedFilter::None);
+			candidates.push_back(PackedFilter::Delta);
+			if (voxelSize > 1)
+			{
+				candidates.push_back(PackedFilter::DeltaPlanes);
+			}
+		}
+		else
+		{
+			candidates.push_back(filter == PackedFilter::DeltaPlanes && voxelSize == 1 ? PackedFilter::Delta : filter);
+		}
+
+		chunk.data.clear();
+		compressed.resize(LzGetBound(bytes));
+		for (size_t c = 0; c < candidates.size(); ++c)
+		{
+			const uint8_t* input = src;
+			if (candidates[c] != PackedFilter::None)
+			{
+				filtered.resize(bytes);
+				DispatchVoxelWord(voxelSize, [&](auto word) {
+					DeltaEncode<decltype(word)>(src, bytes / voxelSize, filtered.data(), candidates[c] == PackedFilter::DeltaPlanes);
+				});
+				input = filtered.data();
+			}
+
+			size_t size = LzCompress(input, bytes, compressed.data());
+			if (c == 0 || size < chunk.data.size())
+			{
+				chunk.data.assign(compressed.begin(), compressed.begin() + size);
+				chunk.filter = candidates[c];
+			}
+		}
+
+		chunk.stored = chunk.data.size() >= bytes;
+		if (chunk.stored)
+		{
+			chunk.data.assign(src, src + bytes);
+			chunk.filter = PackedFilter::None;
+		}
+	}
+
+	bool UnpackChunk(const uint8_t* const src, const PackedChunkEntry& entry, uint8_t* const dst, const size_t bytes,
+		const size_t voxelSize, std::vector<uint8_t>& scratch)
+	{
+		// planes are interleaved from a scratch copy, everything else decodes in place
+		const PackedFilter filter = static_cast<PackedFilter>(entry.filter);
+		uint8_t* target = dst;
+		if (filter == PackedFilter::DeltaPlanes)
+		{
+			scratch.resize(bytes);
+			target = scratch.data();
+		}
+
+		if (entry.stored)
+		{
+			memcpy(target, src, bytes);
+		}
+		else if (!LzDecompress(src, entry.size, target, bytes))
+		{
+			return false;
+		}
+
+		if (filter != PackedFilter::None)
+		{
+			DispatchVoxelWord(voxelSize, [&](auto word) {
+				DeltaDecode<decltype(word)>(target, bytes / voxelSize, dst, filter == PackedFilter::DeltaPlanes);
+			});
+		}
+		return true;
+	}
+}
+
+const char* GetPackedFilterName(const PackedFilter filter)
+{
+	switch (filter)
+	{
+	case PackedFilter::Delta:
+		return "delta";
+	case PackedFilter::DeltaPlanes:
+		return "planes";
+	case PackedFilter::Auto:
+		return "auto";
+	default:
+		return "none";
+	}
+}
+
+bool ParsePackedFilter(const std::string& text, PackedFilter& filter)
+{
+	const PackedFilter filters[] = { PackedFilter::None, PackedFilter::Delta, PackedFilter::DeltaPlanes, PackedFilter::Auto };
+	for (PackedFilter candidate : filters)
+	{
+		if (text == GetPackedFilterName(candidate))
+		{
+			filter = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool IsPackedVolumeFile(const std::string& file)
+{
+	const std::string extension = ".pvol";
+	return file.size() >= extension.size() && file.compare(file.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+bool WritePackedVolume(const Volume& volume, const std::string& file, const PackedFilter filter, const uint32_t chunkSize, std::string& error)
+{
+	if (!volume.IsLoaded())
+	{
+		error = "No volume to pack";
+		return false;
+	}
+
+	const VolumeDesc& desc = volume.GetDesc();
+	const size_t voxelSize = GetVoxelSize(desc.type);
+	if (chunkSize == 0 || chunkSize % voxelSize != 0)
+	{
+		error = "Chunk size must be a whole number of voxels";
+		return false;
+	}
+
+	const size_t totalBytes = desc.GetByteSize();
+	const size_t chunkCount = (totalBytes + chunkSize - 1) / chunkSize;
+	if (chunkCount > INT32_MAX)
+	{
+		error = "Too many chunks, use a larger chunk size";
+		return false;
+	}
+
+	PackedFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "PVOL", 4);
+	header.version = kPackedVersion;
+	header.width = desc.width;
+	header.height = desc.height;
+	header.depth = desc.depth;
+	header.voxelType = static_cast<uint32_t>(desc.type);
+	header.spacing[0] = desc.spacing.x;
+	header.spacing[1] = desc.spacing.y;
+	header.spacing[2] = desc.spacing.z;
+	header.chunkSize = chunkSize;
+	header.chunkCount = static_cast<uint32_t>(chunkCount);
+
+	std::ofstream out(file, std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		error = "Creating " + file + " failed";
+		return false;
+	}
+
+	// the chunk table is written again once the offsets are known
+	std::vector<PackedChunkEntry> table(chunkCount);
+	memset(table.data(), 0, table.size() * sizeof(PackedChunkEntry));
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(PackedChunkEntry));
+	uint64_t offset = sizeof(header) + table.size() * sizeof(PackedChunkEntry);
+
+	const size_t batchSize = static_cast<size_t>(GetWorkerCount()) * kChunksPerWorker;
+	std::vector<PackedChunk> batch(std::min(batchSize, chunkCount));
+	for (size_t first = 0; first < chunkCount && out; first += batchSize)
+	{
+		const int count = static_cast<int>(std::min(batchSize, chunkCount - first));
+		ParallelFor(count, [&](int begin, int end) {
+			std::vector<uint8_t> filtered;
+			std::vector<uint8_t> compressed;
+			for (int i = begin; i < end; ++i)
+			{
+				size_t start = (first + i) * chunkSize;
+				PackChunk(volume.GetData() + start, std::min<size_t>(chunkSize, totalBytes - start), voxelSize, filter, filtered, compressed, batch[i]);
+			}
+		});
+
+		for (int i = 0; i < count; ++i)
+		{
+			PackedChunkEntry& entry = table[first + i];
+			entry.offset = offset;
+			entry.size = static_cast<uint32_t>(batch[i].data.size());
+			entry.filter = static_cast<uint8_t>(batch[i].filter);
+			entry.stored = batch[i].stored ? 1 : 0;
+			out.write(reinterpret_cast<const char*>(batch[i].data.data()), batch[i].data.size());
+			offset += batch[i].data.size();
+		}
+	}
+
+	out.seekp(sizeof(header));
+	out.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(PackedChunkEntry));
+	out.close();
+	if (!out)
+	{
+		error = "Writing " + file + " failed";
+		return false;
+	}
+	return true;
+}
+
+bool ReadPackedVolume(const std::string& file, VolumeDesc& desc, std::vector<uint8_t>& voxels, std::string& error)
+{
+	MappedFile mapped;
+	if (!mapped.Open(file))
+	{
+		error = "Opening packed volume failed: " + file;
+		return false;
+	}
+
+	PackedFileHeader header;
+	if (mapped.GetSize() < sizeof(header) || memcmp(mapped.GetData(), "PVOL", 4) != 0)
+	{
+		error = file + " is not a packed volume";
+		return false;
+	}
+	memcpy(&header, mapped.GetData(), sizeof(header));
+	if (header.version != kPackedVersion)
+	{
+		error = file + " has an unsupported version";
+		return false;
+	}
+
+	VolumeDesc parsed(header.width, header.height, header.depth, static_cast<VoxelType>(header.voxelType),
+		Vec3(header.spacing[0], header.spacing[1], header.spacing[2]));
+	const size_t voxelSize = GetVoxelSize(parsed.type);
+	const size_t totalBytes = parsed.GetByteSize();
+	if (header.width <= 0 || header.height <= 0 || header.depth <= 0 || header.voxelType > static_cast<uint32_t>(VoxelType::Float32) ||
+		header.chunkSize == 0 || header.chunkSize % voxelSize != 0 || header.chunkCount > INT32_MAX ||
+		header.chunkCount != (totalBytes + header.chunkSize - 1) / header.chunkSize ||
+		mapped.GetSize() < sizeof(header) + static_cast<size_t>(header.chunkCount) * sizeof(PackedChunkEntry))
+	{
+		error = file + " has an invalid header";
+		return false;
+	}
+
+	std::vector<PackedChunkEntry> table(header.chunkCount);
+	memcpy(table.data(), mapped.GetData() + sizeof(header), table.size() * sizeof(PackedChunkEntry));
+	for (size_t i = 0; i < table.size(); ++i)
+	{
+		const PackedChunkEntry& entry = table[i];
+		size_t bytes = std::min<size_t>(header.chunkSize, totalBytes - i * header.chunkSize);
+		if (entry.offset > mapped.GetSize() || entry.size > mapped.GetSize() - entry.offset ||
+			entry.filter > static_cast<uint8_t>(PackedFilter::DeltaPlanes) || (entry.stored && entry.size != bytes))
+		{
+			error = file + " has an invalid chunk table";
+			return false;
+		}
+	}
+
+	// every chunk decompresses on its own, straight into the voxels
+	std::vector<uint8_t> out(totalBytes);
+	std::atomic<bool> corrupt(false);
+	ParallelFor(static_cast<int>(table.size()), [&](int begin, int end) {
+		std::vector<uint8_t> scratch;
+		for (int i = begin; i < end; ++i)
+		{
+			size_t start = static_cast<size_t>(i) * header.chunkSize;
+			size_t bytes = std::min<size_t>(header.chunkSize, totalBytes - start);
+			if (!UnpackChunk(mapped.GetData() + table[i].offset, table[i], out.data() + start, bytes, voxelSize, scratch))
+			{
+				corrupt = true;
+			}
+		}
+	});
+	if (corrupt)
+	{
+		error = file + " is corrupt";
+		return false;
+	}
+
+	desc = parsed;
+	voxels.swap(out);
+	return true;
+}
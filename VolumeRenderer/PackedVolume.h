@@ -0,0 +1,79 @@
+/// <summary>
+/// PackedVolume.h
+///
+/// About:
+/// Losslessly compressed volume files (.pvol). The voxels,
+/// in the same order as a RAW file, are cut into chunks of
+/// chunkSize bytes that are compressed independently with
+/// LzCodec, so loading decompresses every chunk on its own
+/// core straight into the voxel buffer.
+///
+/// Before compression a chunk can be filtered: Delta stores
+/// each voxel as its difference to the previous one, which
+/// turns the smooth gradients of CT data into runs of small
+/// values, and DeltaPlanes additionally splits the multi
+/// byte differences into one plane per byte so the mostly
+/// empty high bytes compress on their own. The writer tries
+/// each filter per chunk and keeps the smallest result
+/// unless told otherwise.
+/// </summary>
+#ifndef PackedVolume_h__
+#define PackedVolume_h__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Volume.h"
+
+enum class PackedFilter
+{
+	None,
+	Delta,
+	DeltaPlanes,
+	// writer only: the smallest of the above per chunk
+	Auto
+};
+
+const char* GetPackedFilterName(const PackedFilter filter);
+// "none", "delta", "planes" or "auto"
+bool ParsePackedFilter(const std::string& text, PackedFilter& filter);
+
+// On-disk layout, little endian: header, chunk table, chunks
+struct PackedFileHeader
+{
+	char magic[4];			// "PVOL"
+	uint32_t version;
+	int32_t width;
+	int32_t height;
+	int32_t depth;
+	uint32_t voxelType;		// VoxelType
+	float spacing[3];
+	uint32_t chunkSize;		// uncompressed bytes per chunk (whole voxels), the last one may be shorter
+	uint32_t chunkCount;
+	uint32_t reserved;
+};
+
+struct PackedChunkEntry
+{
+	uint64_t offset;		// from the start of the file
+	uint32_t size;			// bytes in the file
+	uint8_t filter;			// PackedFilter
+	uint8_t stored;			// 1 if kept uncompressed (LZ didn't shrink it)
+	uint8_t reserved[2];
+};
+
+const uint32_t kPackedVersion = 1;
+const uint32_t kDefaultPackedChunkSize = 1 << 20;
+
+// true for file names ending in .pvol
+bool IsPackedVolumeFile(const std::string& file);
+
+// Writes volume to file, chunks compressed in parallel a batch at a time.
+// error says why on failure.
+bool WritePackedVolume(const Volume& volume, const std::string& file, const PackedFilter filter, const uint32_t chunkSize, std::string& error);
+
+// Reads file's layout into desc and its voxels into voxels, chunks
+// decompressed in parallel. error says why on failure.
+bool ReadPackedVolume(const std::string& file, VolumeDesc& desc, std::vector<uint8_t>& voxels, std::string& error);
+
+#endif // PackedVolume_h__
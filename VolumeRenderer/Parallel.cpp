@@ -0,0 +1,40 @@
+#include "Parallel.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+int GetWorkerCount()
+{
+	return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+void ParallelFor(const int count, const std::function<void(int, int)>& func)
+{
+	if (count <= 0)
+	{
+		return;
+	}
+
+	int workers = std::min(GetWorkerCount(), count);
+	if (workers == 1)
+	{
+		func(0, count);
+		return;
+	}
+
+	// the calling thread takes the first band
+	std::vector<std::thread> threads;
+	threads.reserve(workers - 1);
+	for (int i = 1; i < workers; ++i)
+	{
+		int begin = static_cast<int>(static_cast<long long>(count) * i / workers);
+		int end = static_cast<int>(static_cast<long long>(count) * (i + 1) / workers);
+		threads.emplace_back(func, begin, end);
+	}
+	func(0, static_cast<int>(static_cast<long long>(count) / workers));
+
+	for (std::thread& t : threads)
+	{
+		t.join();
+	}
+}
@@ -0,0 +1,19 @@
+/// <summary>
+/// Parallel.h
+///
+/// About:
+/// Tiny helper for splitting a loop across all cores.
+/// </summary>
+#ifndef Parallel_h__
+#define Parallel_h__
+
+#include <functional>
+
+// number of worker threads used by ParallelFor (hardware threads, at least 1)
+int GetWorkerCount();
+
+// Splits [0, count) into one contiguous band per worker and runs
+// func(begin, end) for each band in parallel. Blocks until all are done.
+void ParallelFor(const int count, const std::function<void(int, int)>& func);
+
+#endif // Parallel_h__
@@ -0,0 +1,191 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+	// sums the samples of one stage per frame, in frame order
+	void SumPerFrame(const std::vector<ProfileSample>& samples, const ProfileStage stage, std::vector<double>& frameMs)
+	{
+		frameMs.clear();
+		bool any = false;
+		uint64_t frame = 0;
+		for (const ProfileSample& sample : samples)
+		{
+			if (sample.stage != stage)
+			{
+				continue;
+			}
+			if (!any || sample.frame != frame)
+			{
+				frameMs.push_back(0.0);
+				frame = sample.frame;
+				any = true;
+			}
+			frameMs.back() += NsToMs(sample.durationNs);
+		}
+	}
+
+	ProfileStats ComputeStats(std::vector<double>& frameMs)
+	{
+		ProfileStats stats = { 0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+		if (frameMs.empty())
+		{
+			return stats;
+		}
+
+		stats.frames = static_cast<int>(frameMs.size());
+		stats.lastMs = frameMs.back();
+		double sum = 0.0;
+		for (double ms : frameMs)
+		{
+			sum += ms;
+		}
+		stats.meanMs = sum / frameMs.size();
+
+		// nearest rank
+		std::sort(frameMs.begin(), frameMs.end());
+		stats.minMs = frameMs.front();
+		stats.maxMs = frameMs.back();
+		size_t rank = static_cast<size_t>(std::ceil(0.95 * frameMs.size()));
+		stats.p95Ms = frameMs[std::max<size_t>(rank, 1) - 1];
+		return stats;
+	}
+}
+
+uint64_t GetClockNs()
+{
+	// QueryPerformanceCounter on Windows, CLOCK_MONOTONIC elsewhere
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+const char* GetProfileStageName(const ProfileStage stage)
+{
+	switch (stage)
+	{
+	case ProfileStage::Frame:
+		return "frame";
+	case ProfileStage::Input:
+		return "input";
+	case ProfileStage::Update:
+		return "update";
+	case ProfileStage::Render:
+		return "render";
+	case ProfileStage::EntryExit:
+		return "entry/exit";
+	case ProfileStage::RayCast:
+		return "raycast";
+	case ProfileStage::Present:
+		return "present";
+	default:
+		return "unknown";
+	}
+}
+
+Profiler* Profiler::Instance()
+{
+	static Profiler profiler;
+	return &profiler;
+}
+
+Profiler::Profiler() : m_slots(kCapacity)
+{
+	m_enabled.store(true);
+	Reset();
+}
+
+void Profiler::Record(const ProfileStage stage, const uint64_t frame, const uint64_t durationNs)
+{
+	if (!IsEnabled())
+	{
+		return;
+	}
+
+	// claim the slot, mark it as being written, then publish it; a slot is
+	// only reused once kCapacity later samples have been claimed
+	const uint64_t ticket = m_head.fetch_add(1, std::memory_order_relaxed);
+	Slot& slot = m_slots[ticket & (kCapacity - 1)];
+	slot.sequence.store(2 * ticket + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.frame.store(frame, std::memory_order_relaxed);
+	slot.stage.store(static_cast<uint32_t>(stage), std::memory_order_relaxed);
+	slot.durationNs.store(durationNs, std::memory_order_relaxed);
+	slot.sequence.store(2 * ticket + 2, std::memory_order_release);
+}
+
+void Profiler::GetSamples(std::vector<ProfileSample>& samples, const int frames) const
+{
+	samples.clear();
+	const uint64_t current = GetFrame();
+	const uint64_t first = current > static_cast<uint64_t>(std::max(frames, 0)) ? current - frames : 0;
+
+	const uint64_t head = m_head.load(std::memory_order_acquire);
+	const uint64_t oldest = head > kCapacity ? head - kCapacity : 0;
+	for (uint64_t ticket = oldest; ticket < head; ++ticket)
+	{
+		const Slot& slot = m_slots[ticket & (kCapacity - 1)];
+		const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+		if (sequence != 2 * ticket + 2)
+		{
+			continue;	// still being written, or overwritten since
+		}
+
+		ProfileSample sample;
+		sample.frame = slot.frame.load(std::memory_order_relaxed);
+		sample.stage = static_cast<ProfileStage>(slot.stage.load(std::memory_order_relaxed));
+		sample.durationNs = slot.durationNs.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.sequence.load(std::memory_order_relaxed) != sequence)
+		{
+			continue;
+		}
+
+		if (sample.frame >= first && sample.frame < current)
+		{
+			samples.push_back(sample);
+		}
+	}
+
+	// late samples (GPU queries) are recorded out of frame order
+	std::stable_sort(samples.begin(), samples.end(), [](const ProfileSample& a, const ProfileSample& b) { return a.frame < b.frame; });
+}
+
+ProfileStats Profiler::GetStats(const ProfileStage stage, const int frames) const
+{
+	std::vector<ProfileSample> samples;
+	GetSamples(samples, frames);
+
+	std::vector<double> frameMs;
+	SumPerFrame(samples, stage, frameMs);
+	return ComputeStats(frameMs);
+}
+
+void Profiler::GetStats(std::vector<ProfileStats>& stats, const int frames) const
+{
+	std::vector<ProfileSample> samples;
+	GetSamples(samples, frames);
+
+	stats.resize(static_cast<size_t>(ProfileStage::Count));
+	std::vector<double> frameMs;
+	for (size_t i = 0; i < stats.size(); ++i)
+	{
+		SumPerFrame(samples, static_cast<ProfileStage>(i), frameMs);
+		stats[i] = ComputeStats(frameMs);
+	}
+}
+
+void Profiler::Reset()
+{
+	// not safe against concurrent Record, only between frames
+	for (Slot& slot : m_slots)
+	{
+		slot.sequence.store(0, std::memory_order_relaxed);
+		slot.frame.store(0, std::memory_order_relaxed);
+		slot.stage.store(0, std::memory_order_relaxed);
+		slot.durationNs.store(0, std::memory_order_relaxed);
+	}
+	m_head.store(0, std::memory_order_release);
+	m_frame.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,142 @@
+/// <summary>
+/// Profiler.h
+///
+/// About:
+/// A monotonic nanosecond clock, and a profiler that keeps
+/// how long each stage of the last few hundred frames took.
+/// Stages are recorded by ProfileZone, a scoped timer, into
+/// a fixed ring buffer that any thread can write without a
+/// lock: a writer claims a slot with one atomic increment and
+/// publishes it by bumping the slot's sequence, so a reader
+/// copying the ring skips the slots still being written or
+/// already overwritten rather than waiting for them.
+///
+/// The zones around D3D calls time their submission, not the
+/// GPU's work; VolumeRenderer records the GPU stages from
+/// timestamp queries a few frames later, against the frame
+/// they were issued in.
+/// </summary>
+#ifndef Profiler_h__
+#define Profiler_h__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// monotonic, in nanoseconds from an arbitrary start
+uint64_t GetClockNs();
+
+inline double NsToMs(const uint64_t ns)
+{
+	return ns * 1.0e-6;
+}
+
+enum class ProfileStage
+{
+	Frame,		// the whole frame, Time::Tick to Time::Tick
+	Input,		// DirectInput polling
+	Update,		// camera, key handling, swapping in loaded volumes
+	Render,		// CPU side of drawing, command submission
+	EntryExit,	// GPU, the back and front face passes
+	RayCast,	// GPU, the ray casting pass
+	Present,	// swap chain present, waits for the GPU and vsync
+	Count
+};
+
+const char* GetProfileStageName(const ProfileStage stage);
+
+struct ProfileSample
+{
+	uint64_t frame;
+	ProfileStage stage;
+	uint64_t durationNs;
+};
+
+// a stage over the frames asked for; a stage recorded more than once in a
+// frame counts as the sum
+struct ProfileStats
+{
+	int frames;			// frames the stage was recorded in
+	double lastMs;		// the most recent of them
+	double meanMs;
+	double minMs;
+	double maxMs;
+	double p95Ms;
+};
+
+class Profiler
+{
+public:
+	// samples kept, a power of two; enough for several hundred frames of every stage
+	static const size_t kCapacity = 4096;
+
+	// the application's profiler, the stages above all record into it
+	static Profiler* Instance();
+
+	Profiler();
+
+	// starts the next frame, zones record against it from then on
+	void BeginFrame() { m_frame.fetch_add(1, std::memory_order_relaxed); }
+	uint64_t GetFrame() const { return m_frame.load(std::memory_order_relaxed); }
+
+	// off stops recording, the samples already taken stay queryable
+	void SetEnabled(const bool enable) { m_enabled.store(enable, std::memory_order_relaxed); }
+	bool IsEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+	// from any thread
+	void Record(const ProfileStage stage, const uint64_t durationNs) { Record(stage, GetFrame(), durationNs); }
+	// against an earlier frame, for results that arrive late (GPU queries)
+	void Record(const ProfileStage stage, const uint64_t frame, const uint64_t durationNs);
+
+	// the samples of the last frames, oldest first; the current frame is
+	// left out as it's still being recorded
+	void GetSamples(std::vector<ProfileSample>& samples, const int frames) const;
+	// rolling statistics of a stage over the last frames
+	ProfileStats GetStats(const ProfileStage stage, const int frames = 120) const;
+	// all stages at once, indexed by ProfileStage
+	void GetStats(std::vector<ProfileStats>& stats, const int frames = 120) const;
+
+	void Reset();
+
+private:
+	// every field atomic so a reader racing a writer is only ever stale, the
+	// sequence tells it whether to keep what it read
+	struct Slot
+	{
+		std::atomic<uint64_t> sequence;	// 2 * ticket + 1 while written, 2 * ticket + 2 once published
+		std::atomic<uint64_t> frame;
+		std::atomic<uint32_t> stage;
+		std::atomic<uint64_t> durationNs;
+	};
+
+	std::vector<Slot> m_slots;
+	std::atomic<uint64_t> m_head;
+	std::atomic<uint64_t> m_frame;
+	std::atomic<bool> m_enabled;
+};
+
+// Times its scope and records it as a stage of the current frame
+class ProfileZone
+{
+public:
+	explicit ProfileZone(const ProfileStage stage, Profiler* const profiler = Profiler::Instance())
+		: m_profiler(profiler), m_stage(stage), m_begin(GetClockNs())
+	{
+	}
+
+	~ProfileZone()
+	{
+		m_profiler->Record(m_stage, GetClockNs() - m_begin);
+	}
+
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+	Profiler* m_profiler;
+	ProfileStage m_stage;
+	uint64_t m_begin;
+};
+
+#endif // Profiler_h__
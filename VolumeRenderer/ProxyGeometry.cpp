@@ -0,0 +1,256 @@
+#include "ProxyGeometry.h"
+#include "Volume.h"
+#include <algorithm>
+
+ProxyGeometry::ProxyGeometry()
+{
+	Shutdown();
+}
+
+void ProxyGeometry::Shutdown()
+{
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		m_cells[axis] = 0;
+		m_size[axis] = 0;
+		m_bounds[axis].clear();
+		m_quads[axis].clear();
+		m_faces[axis].clear();
+	}
+	m_cellSize = 0;
+	m_occupancy.clear();
+	m_faceCount = 0;
+	m_vertices.clear();
+	m_indices.clear();
+	m_min = Vec3(1.f, 1.f, 1.f);
+	m_max = Vec3(-1.f, -1.f, -1.f);
+}
+
+int ProxyGeometry::Update(const Volume& level, const std::vector<uint8_t>& occupancy)
+{
+	const MacrocellGrid& grid = level.GetMacrocells();
+	const int cells[3] = { grid.GetCellsX(), grid.GetCellsY(), grid.GetCellsZ() };
+	const int size[3] = { level.GetWidth(), level.GetHeight(), level.GetDepth() };
+	const size_t count = static_cast<size_t>(grid.GetCellCount());
+	if (!grid.IsBuilt() || occupancy.size() < count)
+	{
+		Shutdown();
+		return 0;
+	}
+
+	// planes to mesh per axis, all of them for a new grid
+	std::vector<uint8_t> dirty[3];
+	bool layout = m_cellSize == grid.GetCellSize() && m_occupancy.size() == count;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		layout = layout && m_cells[axis] == cells[axis] && m_size[axis] == size[axis];
+	}
+	if (!layout)
+	{
+		Shutdown();
+		m_cellSize = grid.GetCellSize();
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			m_cells[axis] = cells[axis];
+			m_size[axis] = size[axis];
+			m_quads[axis].resize(cells[axis] + 1);
+			m_faces[axis].assign(cells[axis] + 1, 0);
+			dirty[axis].assign(cells[axis] + 1, 1);
+
+			// cell k covers texture coordinates [k * cellSize, (k + 1) * cellSize) / size,
+			// as RayCastPS maps them, the last one clipped to the volume
+			for (int k = 0; k <= cells[axis]; ++k)
+			{
+				m_bounds[axis].push_back(2.f * std::min(k * m_cellSize, size[axis]) / size[axis] - 1.f);
+			}
+		}
+	}
+	else
+	{
+		// a cell that flipped changes the planes on either side of it
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			dirty[axis].assign(cells[axis] + 1, 0);
+		}
+		for (size_t i = 0; i < count; ++i)
+		{
+			if ((m_occupancy[i] != 0) != (occupancy[i] != 0))
+			{
+				const int c[3] = { static_cast<int>(i % cells[0]), static_cast<int>(i / cells[0] % cells[1]), static_cast<int>(i / cells[0] / cells[1]) };
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					dirty[axis][c[axis]] = 1;
+					dirty[axis][c[axis] + 1] = 1;
+				}
+			}
+		}
+	}
+	m_occupancy.assign(occupancy.begin(), occupancy.begin() + count);
+
+	int meshed = 0;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		for (int plane = 0; plane <= cells[axis]; ++plane)
+		{
+			if (dirty[axis][plane])
+			{
+				MeshPlane(axis, plane);
+				++meshed;
+			}
+		}
+	}
+
+	if (meshed > 0)
+	{
+		Assemble();
+	}
+	return meshed;
+}
+
+bool ProxyGeometry::IsOccupied(const int x, const int y, const int z) const
+{
+	if (x < 0 || y < 0 || z < 0 || x >= m_cells[0] || y >= m_cells[1] || z >= m_cells[2])
+	{
+		return false;
+	}
+	return m_occupancy[(static_cast<size_t>(z) * m_cells[1] + y) * m_cells[0] + x] != 0;
+}
+
+void ProxyGeometry::MeshPlane(const int axis, const int plane)
+{
+	// the plane's two axes, (u, v, axis) right handed so u x v points along +axis
+	const int u = (axis + 1) % 3;
+	const int v = (axis + 2) % 3;
+	const int nu = m_cells[u];
+	const int nv = m_cells[v];
+
+	// +1 where the cell before the plane is occupied and the one after isn't,
+	// -1 the other way round
+	std::vector<int> mask(static_cast<size_t>(nu) * nv);
+	int faces = 0;
+	for (int j = 0; j < nv; ++j)
+	{
+		for (int i = 0; i < nu; ++i)
+		{
+			int c[3];
+			c[u] = i;
+			c[v] = j;
+			c[axis] = plane - 1;
+			const bool before = IsOccupied(c[0], c[1], c[2]);
+			c[axis] = plane;
+			const bool after = IsOccupied(c[0], c[1], c[2]);
+			mask[j * nu + i] = before == after ? 0 : (before ? 1 : -1);
+			faces += before != after ? 1 : 0;
+		}
+	}
+
+	// greedy merge: grow each face along u as far as it goes, then along v
+	// while the whole run matches
+	std::vector<Quad>& quads = m_quads[axis][plane];
+	quads.clear();
+	for (int j = 0; j < nv; ++j)
+	{
+		for (int i = 0; i < nu;)
+		{
+			const int facing = mask[j * nu + i];
+			if (facing == 0)
+			{
+				++i;
+				continue;
+			}
+
+			int width = 1;
+			while (i + width < nu && mask[j * nu + i + width] == facing)
+			{
+				++width;
+			}
+			int height = 1;
+			for (bool grow = true; grow && j + height < nv;)
+			{
+				for (int k = 0; k < width && grow; ++k)
+				{
+					grow = mask[(j + height) * nu + i + k] == facing;
+				}
+				height += grow ? 1 : 0;
+			}
+
+			for (int h = 0; h < height; ++h)
+			{
+				std::fill_n(mask.begin() + (j + h) * nu + i, width, 0);
+			}
+			Quad quad = { i, j, i + width, j + height, facing };
+			quads.push_back(quad);
+			i += width;
+		}
+	}
+
+	m_faceCount += faces - m_faces[axis][plane];
+	m_faces[axis][plane] = faces;
+}
+
+void ProxyGeometry::Assemble()
+{
+	m_vertices.clear();
+	m_indices.clear();
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const int u = (axis + 1) % 3;
+		const int v = (axis + 2) % 3;
+		for (int plane = 0; plane <= m_cells[axis]; ++plane)
+		{
+			for (const Quad& quad : m_quads[axis][plane])
+			{
+				// corners counter-clockwise in (u, v)
+				const int corners[4][2] = { { quad.u0, quad.v0 }, { quad.u1, quad.v0 }, { quad.u1, quad.v1 }, { quad.u0, quad.v1 } };
+				const uint32_t base = static_cast<uint32_t>(m_vertices.size());
+				for (int k = 0; k < 4; ++k)
+				{
+					float p[3];
+					p[axis] = m_bounds[axis][plane];
+					p[u] = m_bounds[u][corners[k][0]];
+					p[v] = m_bounds[v][corners[k][1]];
+					m_vertices.push_back(Vec3(p[0], p[1], p[2]));
+				}
+
+				// like the cube, (p1 - p0) x (p2 - p0) points out of the hull
+				const uint32_t outward[6] = { 0, 1, 2, 0, 2, 3 };
+				const uint32_t inward[6] = { 0, 2, 1, 0, 3, 2 };
+				const uint32_t* order = quad.facing > 0 ? outward : inward;
+				for (int k = 0; k < 6; ++k)
+				{
+					m_indices.push_back(base + order[k]);
+				}
+			}
+		}
+	}
+
+	// occupied bounds, for the rays that miss the mesh at a crack
+	int lo[3] = { m_cells[0], m_cells[1], m_cells[2] };
+	int hi[3] = { -1, -1, -1 };
+	for (int z = 0; z < m_cells[2]; ++z)
+	{
+		for (int y = 0; y < m_cells[1]; ++y)
+		{
+			for (int x = 0; x < m_cells[0]; ++x)
+			{
+				if (IsOccupied(x, y, z))
+				{
+					const int c[3] = { x, y, z };
+					for (int axis = 0; axis < 3; ++axis)
+					{
+						lo[axis] = std::min(lo[axis], c[axis]);
+						hi[axis] = std::max(hi[axis], c[axis]);
+					}
+				}
+			}
+		}
+	}
+	if (hi[0] < 0)
+	{
+		m_min = Vec3(1.f, 1.f, 1.f);
+		m_max = Vec3(-1.f, -1.f, -1.f);
+		return;
+	}
+	m_min = Vec3(m_bounds[0][lo[0]], m_bounds[1][lo[1]], m_bounds[2][lo[2]]);
+	m_max = Vec3(m_bounds[0][hi[0] + 1], m_bounds[1][hi[1] + 1], m_bounds[2][hi[2] + 1]);
+}
@@ -0,0 +1,90 @@
+/// <summary>
+/// ProxyGeometry.h
+///
+/// About:
+/// A tight ray proxy around the visible part of a volume:
+/// the hull of its occupied macrocells (MacrocellGrid::Classify)
+/// as a triangle mesh, so the rays of the rasterized entry/exit
+/// passes start and end next to the data instead of on the
+/// volume's bounding cube. A cell is only empty if nothing
+/// in it, apron included, can be seen, so the hull never
+/// cuts off a visible sample.
+///
+/// Faces lie on the planes between layers of cells, one
+/// wherever an occupied cell meets an empty one (or the edge
+/// of the grid), and are merged greedily into rectangles per
+/// plane. Each plane's rectangles are kept, so when the
+/// classification changes only the planes beside the cells
+/// that flipped are meshed again.
+///
+/// The mesh isn't convex: the front and back passes need a
+/// depth test to find the nearest and farthest faces. Merged
+/// faces meet at T-junctions, which can leave the odd pixel
+/// uncovered; RayCastPS falls back to the occupied bounds
+/// (GetMin/GetMax) there.
+/// </summary>
+#ifndef ProxyGeometry_h__
+#define ProxyGeometry_h__
+
+#include <cstdint>
+#include <vector>
+#include "VolumeMath.h"
+
+class Volume;
+
+class ProxyGeometry
+{
+public:
+	ProxyGeometry();
+
+	// Meshes level's occupied cells, occupancy as MacrocellGrid::Classify
+	// gives it for the level's grid. Only the planes beside cells whose
+	// occupancy changed since the last call are meshed again, all of them
+	// if the grid is a different one. Returns the planes meshed, 0 when
+	// the mesh is unchanged.
+	int Update(const Volume& level, const std::vector<uint8_t>& occupancy);
+	void Shutdown();
+
+	bool IsEmpty() const { return m_indices.empty(); }
+	// model space, the [-1,1] cube the volume is drawn as
+	const std::vector<Vec3>& GetVertices() const { return m_vertices; }
+	// triangle list, wound like VolumeRenderer's cube (clockwise from outside)
+	const std::vector<uint32_t>& GetIndices() const { return m_indices; }
+	// merged rectangles, and the cell faces they cover
+	int GetQuadCount() const { return static_cast<int>(m_indices.size() / 6); }
+	int GetFaceCount() const { return m_faceCount; }
+
+	// bounds of the occupied cells in model space, min > max when none are
+	const Vec3& GetMin() const { return m_min; }
+	const Vec3& GetMax() const { return m_max; }
+
+private:
+	// [u0,u1) x [v0,v1) in cells on its plane, facing along +axis or -axis
+	struct Quad
+	{
+		int u0, v0, u1, v1;
+		int facing;
+	};
+
+	bool IsOccupied(const int x, const int y, const int z) const;
+	void MeshPlane(const int axis, const int plane);
+	void Assemble();
+
+	int m_cells[3];
+	int m_size[3];
+	int m_cellSize;
+	std::vector<uint8_t> m_occupancy;
+	// cell boundaries along each axis in model space
+	std::vector<float> m_bounds[3];
+	// per axis, the quads and cell faces on each plane between layers of cells
+	std::vector<std::vector<Quad>> m_quads[3];
+	std::vector<int> m_faces[3];
+	int m_faceCount;
+
+	std::vector<Vec3> m_vertices;
+	std::vector<uint32_t> m_indices;
+	Vec3 m_min;
+	Vec3 m_max;
+};
+
+#endif // ProxyGeometry_h__
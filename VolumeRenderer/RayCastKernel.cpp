@@ -0,0 +1,428 @@
+#include "RayCastKernel.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <limits>
+
+bool ComputeRayEntryExit(const Matrix4& invWVP, const float ndcX, const float ndcY, Vec3& posFront, Vec3& posBack)
+{
+	// un-project the pixel onto the near and far planes (model space)
+	Vec4 n = Mul(invWVP, Vec4(ndcX, ndcY, 0.f, 1.f));
+	Vec4 f = Mul(invWVP, Vec4(ndcX, ndcY, 1.f, 1.f));
+	Vec3 origin(n.x / n.w, n.y / n.w, n.z / n.w);
+	Vec3 dir = Vec3(f.x / f.w, f.y / f.w, f.z / f.w) - origin;
+
+	// slab test against the [-1,1] cube, t in [0,1] between the near and far plane
+	float tNear = 0.f;
+	float tFar = 1.f;
+	const float o[3] = { origin.x, origin.y, origin.z };
+	const float d[3] = { dir.x, dir.y, dir.z };
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		if (d[axis] == 0.f)
+		{
+			if (o[axis] < -1.f || o[axis] > 1.f)
+			{
+				return false;
+			}
+			continue;
+		}
+		float invD = 1.f / d[axis];
+		float t0 = (-1.f - o[axis]) * invD;
+		float t1 = (1.f - o[axis]) * invD;
+		if (t0 > t1)
+		{
+			std::swap(t0, t1);
+		}
+		tNear = std::max(tNear, t0);
+		tFar = std::min(tFar, t1);
+	}
+
+	if (tNear >= tFar)
+	{
+		return false;
+	}
+
+	// model position shader: tex = 0.5 * (pos + 1)
+	Vec3 pFront = origin + dir * tNear;
+	Vec3 pBack = origin + dir * tFar;
+	posFront = Vec3(0.5f * (pFront.x + 1.f), 0.5f * (pFront.y + 1.f), 0.5f * (pFront.z + 1.f));
+	posBack = Vec3(0.5f * (pBack.x + 1.f), 0.5f * (pBack.y + 1.f), 0.5f * (pBack.z + 1.f));
+	return true;
+}
+
+int ComputeStepCount(const Vec3& posFront, const Vec3& posBack, const int lod, const float stepScale)
+{
+	// samples at posFront + i * step up to and including posBack
+	const int maxSteps = GetMaxStepCount(lod, stepScale);
+	float steps = Length(posBack - posFront) / GetStepSize(lod, stepScale);
+	if (steps >= static_cast<float>(maxSteps - 1))
+	{
+		return maxSteps;
+	}
+	return static_cast<int>(steps) + 1;
+}
+
+int RayPacket::Add(const Vec3& posFront, const Vec3& posBack, const int lod, const float stepScale, const float jitter)
+{
+	Vec3 step = Normalize(posBack - posFront) * GetStepSize(lod, stepScale);
+	Vec3 start = posFront + step * jitter;
+	int lane = count++;
+	posX[lane] = start.x;
+	posY[lane] = start.y;
+	posZ[lane] = start.z;
+	stepX[lane] = step.x;
+	stepY[lane] = step.y;
+	stepZ[lane] = step.z;
+	numSteps[lane] = ComputeStepCount(start, posBack, lod, stepScale);
+	return lane;
+}
+
+bool IsBorderTransparent(const RayCastContext& context)
+{
+	if (context.classification == Classification::PreIntegrated)
+	{
+		return false;
+	}
+
+	float border = context.window.Apply(0.f);
+	if (context.classification == Classification::PostClassified)
+	{
+		float rgba[4];
+		context.transfer->Lookup(border, rgba);
+		return rgba[3] == 0.f;
+	}
+	return border == 0.f;
+}
+
+bool IsRayCastPathSupported(const RayCastPath path, const Volume& volume)
+{
+	if (path == RayCastPath::Scalar)
+	{
+		return true;
+	}
+
+	// the SIMD kernels use 32-bit gather offsets, which must also cover rays that
+	// step up to sqrt(3) past the volume, and read voxels four bytes at a time
+	size_t voxels = static_cast<size_t>(volume.GetWidth()) * volume.GetHeight() * volume.GetDepth();
+	if (voxels < 4 || voxels > (1u << 30))
+	{
+		return false;
+	}
+
+	const CpuFeatures& features = GetCpuFeatures();
+	return path == RayCastPath::AVX2 ? features.avx2 : features.avx512;
+}
+
+RayCastPath GetBestRayCastPath(const Volume& volume)
+{
+	if (IsRayCastPathSupported(RayCastPath::AVX512, volume))
+	{
+		return RayCastPath::AVX512;
+	}
+	if (IsRayCastPathSupported(RayCastPath::AVX2, volume))
+	{
+		return RayCastPath::AVX2;
+	}
+	return RayCastPath::Scalar;
+}
+
+const char* GetRayCastPathName(const RayCastPath path)
+{
+	switch (path)
+	{
+	case RayCastPath::AVX2:
+		return "avx2";
+	case RayCastPath::AVX512:
+		return "avx512";
+	default:
+		return "scalar";
+	}
+}
+
+int GetPacketWidth(const RayCastPath path)
+{
+	switch (path)
+	{
+	case RayCastPath::AVX2:
+		return 8;
+	case RayCastPath::AVX512:
+		return 16;
+	default:
+		return 1;
+	}
+}
+
+uint64_t RayCastPacket(const RayCastPath path, const RayCastContext& context, RayPacket& packet)
+{
+	if (packet.count == 0)
+	{
+		return 0;
+	}
+
+	// pad partial packets with zero-step rays outside the volume
+	int width = GetPacketWidth(path);
+	int padded = (packet.count + width - 1) / width * width;
+	for (int lane = packet.count; lane < padded; ++lane)
+	{
+		packet.posX[lane] = packet.posY[lane] = packet.posZ[lane] = -1.f;
+		packet.stepX[lane] = packet.stepY[lane] = packet.stepZ[lane] = 0.f;
+		packet.numSteps[lane] = 0;
+	}
+
+	switch (path)
+	{
+	case RayCastPath::AVX2:
+		return RayCastPacketAVX2(context, packet);
+	case RayCastPath::AVX512:
+		return RayCastPacketAVX512(context, packet);
+	default:
+		return RayCastPacketScalar(context, packet);
+	}
+}
+
+namespace
+{
+	// what a ray has accumulated so far
+	struct RayState
+	{
+		// RayCastPS's result.xy in red and alpha with the identity
+		// classification, otherwise the premultiplied colour and alpha
+		float red, green, blue, alpha;
+		// the last sample taken, pre-integration pairs it with the next one
+		int lastStep;
+		float lastValue;
+	};
+
+	// what lighting scales the colour of the sample at uvw by, 1 is unshaded;
+	// scale is GradientVolume::GetScale for the gradients taken on the fly
+	template <typename T>
+	float Shade(const RayCastContext& context, const Vec3& uvw, const Vec3& light, const Vec3& scale)
+	{
+		Vec3 normal;
+		float magnitude;
+		if (context.gradients != nullptr)
+		{
+			context.gradients->Sample(uvw, normal, magnitude);
+		}
+		else
+		{
+			// central differences one voxel either side through the same trilinear
+			// filter as the samples, which is what filtering precomputed ones gives
+			const Volume& volume = *context.volume;
+			const Vec3 dx(1.f / volume.GetWidth(), 0.f, 0.f);
+			const Vec3 dy(0.f, 1.f / volume.GetHeight(), 0.f);
+			const Vec3 dz(0.f, 0.f, 1.f / volume.GetDepth());
+			normal = Vec3((volume.Sample<T>(uvw + dx) - volume.Sample<T>(uvw - dx)) * 0.5f * scale.x,
+				(volume.Sample<T>(uvw + dy) - volume.Sample<T>(uvw - dy)) * 0.5f * scale.y,
+				(volume.Sample<T>(uvw + dz) - volume.Sample<T>(uvw - dz)) * 0.5f * scale.z);
+			magnitude = Length(normal);
+		}
+
+		float length = Length(normal);
+		float diffuse = length > 0.f ? std::fabs(Dot(normal, light)) / length : 0.f;
+		float lit = g_fAmbient + g_fDiffuse * diffuse;
+		return 1.f + (lit - 1.f) * std::min(magnitude / g_fShadingGradient, 1.f);
+	}
+
+	// marches steps [begin, end) of one ray, returns the steps taken
+	template <typename T>
+	int MarchSegment(const RayCastContext& context, const Vec3& front, const Vec3& step, const int begin, const int end, RayState& ray)
+	{
+		const Volume& volume = *context.volume;
+		const int lod = context.lod;
+
+		// the headlight looks down the ray, gradients are in physical units so the
+		// direction is too
+		Vec3 light, scale;
+		if (context.shading)
+		{
+			const Vec3 extent = volume.GetExtent();
+			light = Normalize(Vec3(step.x * extent.x, step.y * extent.y, step.z * extent.z));
+			scale = GradientVolume::GetScale(volume.GetDesc());
+		}
+
+		int i = begin;
+		for (; i < end && ray.alpha < g_fOpacityThreshold; ++i)
+		{
+			const Vec3 uvw = front + step * static_cast<float>(i);
+			float src = context.window.Apply(volume.Sample<T>(uvw));
+
+			// Front to back blending
+			if (context.classification != Classification::Identity)
+			{
+				float rgba[4];
+				if (context.classification == Classification::PreIntegrated)
+				{
+					float previous = ray.lastStep == i - 1 ? ray.lastValue : src;
+					context.transfer->LookupPreIntegrated(previous, src, rgba);
+					ray.lastStep = i;
+					ray.lastValue = src;
+				}
+				else
+				{
+					context.transfer->Lookup(src, rgba);
+				}
+				float weight = 1.f - ray.alpha;
+				float lit = context.shading && rgba[3] > 0.f ? Shade<T>(context, uvw, light, scale) : 1.f;
+				ray.red += weight * rgba[0] * lit;
+				ray.green += weight * rgba[1] * lit;
+				ray.blue += weight * rgba[2] * lit;
+				ray.alpha += weight * rgba[3];
+			}
+			else if (lod == 0)
+			{
+				float weight = (1.f - ray.alpha) * src;
+				float lit = context.shading && weight > 0.f ? Shade<T>(context, uvw, light, scale) : 1.f;
+				ray.red += weight * src * lit;
+				ray.alpha += weight * src;
+			}
+			else
+			{
+				float weight = (1.f - ray.alpha) * CorrectOpacity(src * src, lod);
+				float lit = context.shading && weight > 0.f ? Shade<T>(context, uvw, light, scale) : 1.f;
+				ray.red += weight * lit;
+				ray.alpha += weight;
+			}
+		}
+		return i - begin;
+	}
+
+	// Walks the ray through the macrocells with a 3D-DDA (Amanatides & Woo),
+	// with t measured in steps, and only marches the steps in occupied cells
+	template <typename T>
+	int MarchMacrocells(const RayCastContext& context, const Vec3& front, const Vec3& step, const int numSteps, RayState& ray)
+	{
+		const Volume& volume = *context.volume;
+		const MacrocellGrid& grid = *context.macrocells;
+		const int cellSize = grid.GetCellSize();
+		const int cells[3] = { grid.GetCellsX(), grid.GetCellsY(), grid.GetCellsZ() };
+		const float scale[3] = {
+			static_cast<float>(volume.GetWidth()) / cellSize,
+			static_cast<float>(volume.GetHeight()) / cellSize,
+			static_cast<float>(volume.GetDepth()) / cellSize };
+		const float origin[3] = { front.x * scale[0], front.y * scale[1], front.z * scale[2] };
+		const float dir[3] = { step.x * scale[0], step.y * scale[1], step.z * scale[2] };
+
+		int cell[3], cellStep[3];
+		float tMax[3], tDelta[3];
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			// the entry point may sit on the far face, rounding may put it just outside
+			cell[axis] = std::min(std::max(static_cast<int>(std::floor(origin[axis])), 0), cells[axis] - 1);
+			if (dir[axis] > 0.f)
+			{
+				cellStep[axis] = 1;
+				tMax[axis] = (cell[axis] + 1 - origin[axis]) / dir[axis];
+				tDelta[axis] = 1.f / dir[axis];
+			}
+			else if (dir[axis] < 0.f)
+			{
+				cellStep[axis] = -1;
+				tMax[axis] = (cell[axis] - origin[axis]) / dir[axis];
+				tDelta[axis] = -1.f / dir[axis];
+			}
+			else
+			{
+				cellStep[axis] = 0;
+				tMax[axis] = tDelta[axis] = std::numeric_limits<float>::infinity();
+			}
+		}
+
+		// pre-integrated segments into and out of an occupied cell can be visible,
+		// so the steps either side of one are taken too
+		const bool preIntegrate = context.classification == Classification::PreIntegrated;
+		bool lastOccupied = false;
+
+		int taken = 0;
+		int i = 0;
+		while (i < numSteps && ray.alpha < g_fOpacityThreshold)
+		{
+			// steps up to tExit sample this cell
+			int axis = tMax[0] < tMax[1] ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+			float tExit = tMax[axis];
+			int end = tExit >= static_cast<float>(numSteps) ? numSteps : static_cast<int>(std::floor(tExit)) + 1;
+
+			bool occupied = context.occupancy[grid.GetIndex(cell[0], cell[1], cell[2])] != 0;
+			if (occupied)
+			{
+				if (preIntegrate && i > 0 && i < end && ray.lastStep != i - 1)
+				{
+					taken += MarchSegment<T>(context, front, step, i - 1, i, ray);
+				}
+				taken += MarchSegment<T>(context, front, step, i, end, ray);
+			}
+			else if (preIntegrate && lastOccupied && i < end && ray.lastStep == i - 1)
+			{
+				taken += MarchSegment<T>(context, front, step, i, i + 1, ray);
+			}
+			if (i < end)
+			{
+				lastOccupied = occupied;
+			}
+			i = std::max(i, end);
+
+			cell[axis] += cellStep[axis];
+			if (cell[axis] < 0 || cell[axis] >= cells[axis])
+			{
+				// left the grid, any remaining step is right on the
+				// boundary so march it normally
+				taken += MarchSegment<T>(context, front, step, i, numSteps, ray);
+				break;
+			}
+			tMax[axis] += tDelta[axis];
+		}
+		return taken;
+	}
+
+	template <typename T>
+	uint64_t MarchPacket(const RayCastContext& context, RayPacket& packet)
+	{
+		const bool skipEmpty = context.macrocells != nullptr && context.occupancy != nullptr;
+		uint64_t stepsTaken = 0;
+
+		for (int lane = 0; lane < packet.count; ++lane)
+		{
+			// The start position - remember we start from the front
+			Vec3 front(packet.posX[lane], packet.posY[lane], packet.posZ[lane]);
+			// Single step: direction times delta step
+			Vec3 step(packet.stepX[lane], packet.stepY[lane], packet.stepZ[lane]);
+
+			// Accumulate result: value and transparency (alpha)
+			RayState ray = { 0.f, 0.f, 0.f, 0.f, -2, 0.f };
+
+			// iterate for the volume, sampling along the way at equidistant steps
+			// until the ray leaves the cube or is (almost) opaque
+			if (skipEmpty)
+			{
+				stepsTaken += MarchMacrocells<T>(context, front, step, packet.numSteps[lane], ray);
+			}
+			else
+			{
+				stepsTaken += MarchSegment<T>(context, front, step, 0, packet.numSteps[lane], ray);
+			}
+
+			if (context.classification == Classification::Identity)
+			{
+				packet.red[lane] = packet.green[lane] = packet.blue[lane] = ray.red;
+			}
+			else
+			{
+				// the colour RayCastPS outputs for the SRC_ALPHA blend
+				float invAlpha = ray.alpha > 0.f ? 1.f / ray.alpha : 0.f;
+				packet.red[lane] = ray.red * invAlpha;
+				packet.green[lane] = ray.green * invAlpha;
+				packet.blue[lane] = ray.blue * invAlpha;
+			}
+			packet.alpha[lane] = ray.alpha;
+		}
+
+		return stepsTaken;
+	}
+}
+
+uint64_t RayCastPacketScalar(const RayCastContext& context, RayPacket& packet)
+{
+	return DispatchVoxelType(context.volume->GetDesc().type, [&](auto voxel) {
+		return MarchPacket<decltype(voxel)>(context, packet);
+	});
+}
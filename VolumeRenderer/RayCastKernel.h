@@ -0,0 +1,171 @@
+/// <summary>
+/// RayCastKernel.h
+///
+/// About:
+/// CPU port of RayCastPS (raycast.hlsl). The front/back
+/// positions that the GPU gets from the two model position
+/// render targets are found here by intersecting the pixel
+/// ray with the [-1,1] cube, then the ray is marched and
+/// composited exactly like the pixel shader.
+///
+/// Rays are marched in packets: 8 (AVX2) or 16 (AVX-512)
+/// lanes at a time, picked at runtime, with a scalar
+/// fallback for other CPUs. Every kernel is instantiated
+/// per voxel type and picked once per packet. Samples are
+/// filtered from the raw voxels and only then put through
+/// the context's window; the UNORM normalisation the shader
+/// gets from the texture is linear, so that doesn't change
+/// the result.
+///
+/// Unlike the original shader a ray stops once it has left
+/// the cube (step count from the front-back distance) or
+/// once its alpha reaches g_fOpacityThreshold. Given a
+/// classified MacrocellGrid the steps that fall in empty
+/// cells are skipped as well. Coarser mip levels are
+/// marched with proportionally longer steps, with the
+/// opacity of each step corrected to match.
+///
+/// Given TransferTables the windowed value is classified
+/// through them instead, per sample or, pre-integrated, per
+/// pair of consecutive samples; the tables carry the
+/// opacity correction for whatever step they were built
+/// for. Segments are only looked up between two samples
+/// the ray actually took, so when skipping empty space the
+/// steps either side of an occupied cell are taken too.
+/// </summary>
+#ifndef RayCastKernel_h__
+#define RayCastKernel_h__
+
+#include <algorithm>
+#include <cmath>
+#include "TransferFunction.h"
+#include "Volume.h"
+#include "VolumeMath.h"
+
+// Constants - keep in sync with raycast.hlsl
+const unsigned int g_iMaxIterations = 128;
+
+// Diagonal of a unit cube has length sqrt(3)
+const float g_fStepSize = 1.7320508f / g_iMaxIterations;
+
+// Early ray termination: stop once the accumulated alpha reaches this
+const float g_fOpacityThreshold = 0.95f;
+
+// Headlight shading: ambient plus two-sided diffuse. Gradients shorter than
+// g_fShadingGradient (windowed value per voxel) are faded towards unshaded,
+// their direction is mostly noise.
+const float g_fAmbient = 0.3f;
+const float g_fDiffuse = 0.7f;
+const float g_fShadingGradient = 0.02f;
+
+// Step length on mip level lod: the step doubles with every level, like the voxels.
+// stepScale stretches it further, for classifications whose tables correct for it.
+inline float GetStepSize(const int lod, const float stepScale = 1.f) { return std::ldexp(g_fStepSize, lod) * stepScale; }
+
+// Most steps a ray can take: g_iMaxIterations, or more if the steps are shorter
+// than g_fStepSize so the diagonal is still covered
+inline int GetMaxStepCount(const int lod, const float stepScale = 1.f)
+{
+	return std::max(static_cast<int>(g_iMaxIterations), static_cast<int>(std::ceil(1.7320508f / GetStepSize(lod, stepScale))));
+}
+
+// Opacity of one step on mip level lod from the level 0 opacity of the sample:
+// 1 - (1 - alpha)^(2^lod), the step stands in for 2^lod level 0 steps
+inline float CorrectOpacity(const float alpha, const int lod)
+{
+	float transparency = 1.f - alpha;
+	for (int i = 0; i < lod; ++i)
+	{
+		transparency *= transparency;
+	}
+	return 1.f - transparency;
+}
+
+// Steps needed to march from posFront to posBack, at most GetMaxStepCount
+int ComputeStepCount(const Vec3& posFront, const Vec3& posBack, const int lod = 0, const float stepScale = 1.f);
+
+// Finds where the ray through a pixel (given in NDC) enters and leaves the volume
+// cube. Positions are returned in texture space [0,1], the same values the model
+// position pass writes to txPositionFront/txPositionBack. Returns false on a miss.
+bool ComputeRayEntryExit(const Matrix4& invWVP, const float ndcX, const float ndcY, Vec3& posFront, Vec3& posBack);
+
+// Rays marched together, structure of arrays
+struct RayPacket
+{
+	static const int kMaxLanes = 16;
+
+	// start position (posFront) and the per step offset (g_fStepSize * dir)
+	float posX[kMaxLanes], posY[kMaxLanes], posZ[kMaxLanes];
+	float stepX[kMaxLanes], stepY[kMaxLanes], stepZ[kMaxLanes];
+	// number of steps inside the cube
+	int numSteps[kMaxLanes];
+	// RayCastPS's output colour and alpha, written by the kernel
+	float red[kMaxLanes];
+	float green[kMaxLanes];
+	float blue[kMaxLanes];
+	float alpha[kMaxLanes];
+	int count;
+
+	void Clear() { count = 0; }
+	// adds the ray from posFront towards posBack with the steps of mip level lod
+	// (times stepScale), returns the lane index; jitter in [0,1) moves the first
+	// sample that fraction of a step in from posFront
+	int Add(const Vec3& posFront, const Vec3& posBack, const int lod = 0, const float stepScale = 1.f, const float jitter = 0.f);
+};
+
+// What a kernel marches through. Sample i of a ray is taken at posFront + i * step
+// (rather than by accumulating the step) so lanes can jump ahead over empty cells.
+struct RayCastContext
+{
+	// the mip level being marched (Volume::GetMip(lod)), packets must have been
+	// set up with the same lod
+	const Volume* volume;
+	// empty space skipping, both null to sample every step: the volume's
+	// macrocell grid and its occupancy from MacrocellGrid::Classify
+	const MacrocellGrid* macrocells;
+	const uint8_t* occupancy;
+	int lod;
+	// maps the filtered raw voxels onto [0,1], VoxelWindow::GetDefault for
+	// the volume's type matches RayCastPS
+	VoxelWindow window;
+	// what the windowed value is classified by; anything but Identity needs
+	// transfer, built for the step length the packets were set up with
+	Classification classification;
+	const TransferTables* transfer;
+	// headlight shading: gradients of the marched level
+	// (Volume::GetGradients) or null for central differences of the
+	// samples on the fly
+	bool shading;
+	const GradientVolume* gradients;
+};
+
+// Whether samples entirely outside the volume, raw 0 through border addressing,
+// add nothing to a ray. Not so for pre-integration, the segment leading out of
+// the volume still counts.
+bool IsBorderTransparent(const RayCastContext& context);
+
+enum class RayCastPath
+{
+	Scalar,
+	AVX2,
+	AVX512
+};
+
+// widest path supported by this CPU and volume
+RayCastPath GetBestRayCastPath(const Volume& volume);
+bool IsRayCastPathSupported(const RayCastPath path, const Volume& volume);
+const char* GetRayCastPathName(const RayCastPath path);
+// rays per packet the path processes at once
+int GetPacketWidth(const RayCastPath path);
+
+// Marches every ray in the packet, path must be supported for context.volume.
+// Returns the number of steps (volume samples) actually taken.
+uint64_t RayCastPacket(const RayCastPath path, const RayCastContext& context, RayPacket& packet);
+
+// the individual kernels, the SIMD ones live in their own translation units
+// so only they are compiled with /arch:AVX2 and /arch:AVX512
+uint64_t RayCastPacketScalar(const RayCastContext& context, RayPacket& packet);
+uint64_t RayCastPacketAVX2(const RayCastContext& context, RayPacket& packet);
+uint64_t RayCastPacketAVX512(const RayCastContext& context, RayPacket& packet);
+
+#endif // RayCastKernel_h__
@@ -0,0 +1,734 @@
+// AVX2 packet kernel, 8 rays per iteration. Compiled with /arch:AVX2 and
+// only called when GetCpuFeatures() reports AVX2.
+#include "RayCastKernel.h"
+#include <algorithm>
+#include <immintrin.h>
+
+namespace
+{
+	// Fetches the voxel pairs (x, x + 1) of one trilinear corner row for 8 lanes
+	// as raw values, one specialisation per voxel type. Pair takes border
+	// addressing into account, rowValid/valid0/valid1 saying which corners are
+	// inside the volume; PairInterior is the fast path for packets whose every
+	// corner is inside. kReach is the number of voxels the gather at idx reads,
+	// last the highest idx that keeps it inside the volume.
+	template <typename T> struct Fetch;
+
+	// A single unaligned 32-bit gather covers both voxels; the address is clamped
+	// into the volume (so no lane can read past the data) and the shift selects
+	// the voxels back out of the gathered word.
+	template <> struct Fetch<uint8_t>
+	{
+		static const int kReach = 4;
+
+		static void Pair(const uint8_t* data, const __m256i last, const __m256i idx,
+			const __m256 rowValid, const __m256 valid0, const __m256 valid1, __m256& c0, __m256& c1)
+		{
+			const __m256i byteMask = _mm256_set1_epi32(0xff);
+			__m256i addr = _mm256_max_epi32(_mm256_min_epi32(idx, last), _mm256_setzero_si256());
+			__m256i word = _mm256_i32gather_epi32(reinterpret_cast<const int*>(data), addr, 1);
+			__m256i shift = _mm256_slli_epi32(_mm256_sub_epi32(idx, addr), 3);
+
+			__m256i v0 = _mm256_and_si256(_mm256_srlv_epi32(word, shift), byteMask);
+			__m256i v1 = _mm256_and_si256(_mm256_srlv_epi32(word, _mm256_add_epi32(shift, _mm256_set1_epi32(8))), byteMask);
+
+			c0 = _mm256_and_ps(_mm256_cvtepi32_ps(v0), _mm256_and_ps(rowValid, valid0));
+			c1 = _mm256_and_ps(_mm256_cvtepi32_ps(v1), _mm256_and_ps(rowValid, valid1));
+		}
+
+		static void PairInterior(const uint8_t* data, const __m256i idx, __m256& c0, __m256& c1)
+		{
+			const __m256i byteMask = _mm256_set1_epi32(0xff);
+			__m256i word = _mm256_i32gather_epi32(reinterpret_cast<const int*>(data), idx, 1);
+			c0 = _mm256_cvtepi32_ps(_mm256_and_si256(word, byteMask));
+			c1 = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(word, 8), byteMask));
+		}
+	};
+
+	// the two 16-bit voxels of the 32-bit word at idx (scale 2), clamped like the 8-bit pair
+	inline void GatherWords(const uint16_t* data, const __m256i last, const __m256i idx, __m256i& v0, __m256i& v1)
+	{
+		const __m256i wordMask = _mm256_set1_epi32(0xffff);
+		__m256i addr = _mm256_max_epi32(_mm256_min_epi32(idx, last), _mm256_setzero_si256());
+		__m256i word = _mm256_i32gather_epi32(reinterpret_cast<const int*>(data), addr, 2);
+		__m256i shift = _mm256_slli_epi32(_mm256_sub_epi32(idx, addr), 4);
+		v0 = _mm256_and_si256(_mm256_srlv_epi32(word, shift), wordMask);
+		v1 = _mm256_and_si256(_mm256_srlv_epi32(word, _mm256_add_epi32(shift, _mm256_set1_epi32(16))), wordMask);
+	}
+
+	template <> struct Fetch<uint16_t>
+	{
+		static const int kReach = 2;
+
+		static void Pair(const uint16_t* data, const __m256i last, const __m256i idx,
+			const __m256 rowValid, const __m256 valid0, const __m256 valid1, __m256& c0, __m256& c1)
+		{
+			__m256i v0, v1;
+			GatherWords(data, last, idx, v0, v1);
+			c0 = _mm256_and_ps(_mm256_cvtepi32_ps(v0), _mm256_and_ps(rowValid, valid0));
+			c1 = _mm256_and_ps(_mm256_cvtepi32_ps(v1), _mm256_and_ps(rowValid, valid1));
+		}
+
+		static void PairInterior(const uint16_t* data, const __m256i idx, __m256& c0, __m256& c1)
+		{
+			__m256i word = _mm256_i32gather_epi32(reinterpret_cast<const int*>(data), idx, 2);
+			c0 = _mm256_cvtepi32_ps(_mm256_and_si256(word, _mm256_set1_epi32(0xffff)));
+			c1 = _mm256_cvtepi32_ps(_mm256_srli_epi32(word, 16));
+		}
+	};
+
+	// Same gather as uint16_t; the halves of both voxels are packed into one
+	// register (pack, then undo its lane interleave) and widened with F16C
+	template <> struct Fetch<Half>
+	{
+		static const int kReach = 2;
+
+		static void ToFloat(const __m256i v0, const __m256i v1, __m256& c0, __m256& c1)
+		{
+			__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(v0, v1), _MM_SHUFFLE(3, 1, 2, 0));
+			c0 = _mm256_cvtph_ps(_mm256_castsi256_si128(packed));
+			c1 = _mm256_cvtph_ps(_mm256_extracti128_si256(packed, 1));
+		}
+
+		static void Pair(const Half* data, const __m256i last, const __m256i idx,
+			const __m256 rowValid, const __m256 valid0, const __m256 valid1, __m256& c0, __m256& c1)
+		{
+			__m256i v0, v1;
+			GatherWords(reinterpret_cast<const uint16_t*>(data), last, idx, v0, v1);
+			ToFloat(v0, v1, c0, c1);
+			c0 = _mm256_and_ps(c0, _mm256_and_ps(rowValid, valid0));
+			c1 = _mm256_and_ps(c1, _mm256_and_ps(rowValid, valid1));
+		}
+
+		static void PairInterior(const Half* data, const __m256i idx, __m256& c0, __m256& c1)
+		{
+			__m256i word = _mm256_i32gather_epi32(reinterpret_cast<const int*>(data), idx, 2);
+			ToFloat(_mm256_and_si256(word, _mm256_set1_epi32(0xffff)), _mm256_srli_epi32(word, 16), c0, c1);
+		}
+	};
+
+	// One float gather per voxel. The border case masks the gathers instead of
+	// clamping: masked off lanes aren't read, the others are inside the volume.
+	template <> struct Fetch<float>
+	{
+		static const int kReach = 1;
+
+		static void Pair(const float* data, const __m256i, const __m256i idx,
+			const __m256 rowValid, const __m256 valid0, const __m256 valid1, __m256& c0, __m256& c1)
+		{
+			c0 = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), data, idx, _mm256_and_ps(rowValid, valid0), 4);
+			c1 = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), data, _mm256_add_epi32(idx, _mm256_set1_epi32(1)), _mm256_and_ps(rowValid, valid1), 4);
+		}
+
+		static void PairInterior(const float* data, const __m256i idx, __m256& c0, __m256& c1)
+		{
+			c0 = _mm256_i32gather_ps(data, idx, 4);
+			c1 = _mm256_i32gather_ps(data, _mm256_add_epi32(idx, _mm256_set1_epi32(1)), 4);
+		}
+	};
+
+	// lanes where 0 <= i < size
+	inline __m256 InRange(const __m256i i, const __m256i size)
+	{
+		__m256i ge = _mm256_cmpgt_epi32(i, _mm256_set1_epi32(-1));
+		__m256i lt = _mm256_cmpgt_epi32(size, i);
+		return _mm256_castsi256_ps(_mm256_and_si256(ge, lt));
+	}
+
+	// steps from the sample at c (cell space) until the ray leaves cell along
+	// one axis, d is the step in cell space. +inf if the ray runs parallel.
+	inline __m256 CellExitSteps(const __m256 c, const __m256 d, const __m256 cell)
+	{
+		__m256 positive = _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_GT_OQ);
+		__m256 bound = _mm256_add_ps(cell, _mm256_and_ps(positive, _mm256_set1_ps(1.f)));
+		__m256 t = _mm256_div_ps(_mm256_sub_ps(bound, c), d);
+		__m256 parallel = _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_EQ_OQ);
+		return _mm256_blendv_ps(t, _mm256_set1_ps(static_cast<float>(g_iMaxIterations)), parallel);
+	}
+
+	// cell coordinate clamped into the grid
+	inline __m256i CellCoord(const __m256 c, const __m256i lastCell)
+	{
+		__m256i i = _mm256_cvttps_epi32(_mm256_floor_ps(c));
+		return _mm256_max_epi32(_mm256_min_epi32(i, lastCell), _mm256_setzero_si256());
+	}
+
+	inline __m256 Lerp(const __m256 a, const __m256 b, const __m256 t)
+	{
+		return _mm256_fmadd_ps(_mm256_sub_ps(b, a), t, a);
+	}
+
+	// transfer table entry and the weight of the next one, see TransferTables::ToEntry
+	inline void ToEntry(const __m256 s, __m256i& i, __m256& t)
+	{
+		__m256 x = _mm256_mul_ps(s, _mm256_set1_ps(static_cast<float>(TransferTables::kSize - 1)));
+		i = _mm256_min_epi32(_mm256_cvttps_epi32(x), _mm256_set1_epi32(TransferTables::kSize - 2));
+		t = _mm256_sub_ps(x, _mm256_cvtepi32_ps(i));
+	}
+
+	// the RGBA entries at offset (in floats) and the one after, filtered by t
+	inline void LerpEntries(const float* table, const __m256i offset, const __m256 t, __m256 rgba[4])
+	{
+		for (int c = 0; c < 4; ++c)
+		{
+			rgba[c] = Lerp(_mm256_i32gather_ps(table + c, offset, 4), _mm256_i32gather_ps(table + 4 + c, offset, 4), t);
+		}
+	}
+
+	// Headlight shading for 8 lanes, see Shade in the scalar kernel. Gradients
+	// come from the level's GradientVolume, filtered per byte like an RGBA8
+	// texture with the edges clamped, or from central differences of six more
+	// samples of the raw voxels with border addressing.
+	template <typename T>
+	struct Shading
+	{
+		const T* data;
+		__m256 sizeX, sizeY, sizeZ;
+		__m256i sizeXi, sizeYi, sizeZi;
+		__m256i rowPitch, slicePitch, last;
+		// central differences: one voxel along each axis, GradientVolume::GetScale / 2
+		__m256 deltaX, deltaY, deltaZ;
+		__m256 scaleX, scaleY, scaleZ;
+		// precomputed gradients, null for central differences
+		const int* gradients;
+		__m256 gradientSizeX, gradientSizeY, gradientSizeZ;
+		__m256 maxX, maxY, maxZ;
+		__m256i lastX, lastY, lastZ;
+		__m256i gradientRowPitch, gradientSlicePitch;
+		__m256 maxMagnitude;
+
+		Shading(const Volume& volume, const GradientVolume* gradientVolume)
+		{
+			const int width = volume.GetWidth();
+			const int height = volume.GetHeight();
+			const int depth = volume.GetDepth();
+			data = volume.GetVoxels<T>();
+			sizeX = _mm256_set1_ps(static_cast<float>(width));
+			sizeY = _mm256_set1_ps(static_cast<float>(height));
+			sizeZ = _mm256_set1_ps(static_cast<float>(depth));
+			sizeXi = _mm256_set1_epi32(width);
+			sizeYi = _mm256_set1_epi32(height);
+			sizeZi = _mm256_set1_epi32(depth);
+			rowPitch = _mm256_set1_epi32(width);
+			slicePitch = _mm256_set1_epi32(width * height);
+			last = _mm256_set1_epi32(width * height * depth - Fetch<T>::kReach);
+			deltaX = _mm256_set1_ps(1.f / width);
+			deltaY = _mm256_set1_ps(1.f / height);
+			deltaZ = _mm256_set1_ps(1.f / depth);
+			const Vec3 scale = GradientVolume::GetScale(volume.GetDesc()) * 0.5f;
+			scaleX = _mm256_set1_ps(scale.x);
+			scaleY = _mm256_set1_ps(scale.y);
+			scaleZ = _mm256_set1_ps(scale.z);
+
+			gradients = gradientVolume != nullptr ? reinterpret_cast<const int*>(gradientVolume->GetData()) : nullptr;
+			const int gradientWidth = gradientVolume != nullptr ? gradientVolume->GetWidth() : 1;
+			const int gradientHeight = gradientVolume != nullptr ? gradientVolume->GetHeight() : 1;
+			const int gradientDepth = gradientVolume != nullptr ? gradientVolume->GetDepth() : 1;
+			gradientSizeX = _mm256_set1_ps(static_cast<float>(gradientWidth));
+			gradientSizeY = _mm256_set1_ps(static_cast<float>(gradientHeight));
+			gradientSizeZ = _mm256_set1_ps(static_cast<float>(gradientDepth));
+			maxX = _mm256_set1_ps(static_cast<float>(gradientWidth - 1));
+			maxY = _mm256_set1_ps(static_cast<float>(gradientHeight - 1));
+			maxZ = _mm256_set1_ps(static_cast<float>(gradientDepth - 1));
+			lastX = _mm256_set1_epi32(gradientWidth - 1);
+			lastY = _mm256_set1_epi32(gradientHeight - 1);
+			lastZ = _mm256_set1_epi32(gradientDepth - 1);
+			gradientRowPitch = _mm256_set1_epi32(gradientWidth);
+			gradientSlicePitch = _mm256_set1_epi32(gradientWidth * gradientHeight);
+			maxMagnitude = _mm256_set1_ps(GradientVolume::kMaxMagnitude);
+		}
+
+		// Volume::Sample, corners outside the volume read as 0
+		__m256 Sample(const __m256 vx, const __m256 vy, const __m256 vz) const
+		{
+			const __m256i one = _mm256_set1_epi32(1);
+			const __m256 half = _mm256_set1_ps(0.5f);
+			__m256 fx = _mm256_fmsub_ps(vx, sizeX, half);
+			__m256 fy = _mm256_fmsub_ps(vy, sizeY, half);
+			__m256 fz = _mm256_fmsub_ps(vz, sizeZ, half);
+			__m256 flx = _mm256_floor_ps(fx);
+			__m256 fly = _mm256_floor_ps(fy);
+			__m256 flz = _mm256_floor_ps(fz);
+			__m256i x0 = _mm256_cvttps_epi32(flx);
+			__m256i y0 = _mm256_cvttps_epi32(fly);
+			__m256i z0 = _mm256_cvttps_epi32(flz);
+			__m256i idx = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(z0, slicePitch), _mm256_mullo_epi32(y0, rowPitch)), x0);
+
+			__m256 validX0 = InRange(x0, sizeXi);
+			__m256 validX1 = InRange(_mm256_add_epi32(x0, one), sizeXi);
+			__m256 validY0 = InRange(y0, sizeYi);
+			__m256 validY1 = InRange(_mm256_add_epi32(y0, one), sizeYi);
+			__m256 validZ0 = InRange(z0, sizeZi);
+			__m256 validZ1 = InRange(_mm256_add_epi32(z0, one), sizeZi);
+
+			__m256 c000, c100, c010, c110, c001, c101, c011, c111;
+			Fetch<T>::Pair(data, last, idx, _mm256_and_ps(validY0, validZ0), validX0, validX1, c000, c100);
+			Fetch<T>::Pair(data, last, _mm256_add_epi32(idx, rowPitch), _mm256_and_ps(validY1, validZ0), validX0, validX1, c010, c110);
+			Fetch<T>::Pair(data, last, _mm256_add_epi32(idx, slicePitch), _mm256_and_ps(validY0, validZ1), validX0, validX1, c001, c101);
+			Fetch<T>::Pair(data, last, _mm256_add_epi32(_mm256_add_epi32(idx, slicePitch), rowPitch), _mm256_and_ps(validY1, validZ1), validX0, validX1, c011, c111);
+
+			__m256 tx = _mm256_sub_ps(fx, flx);
+			__m256 ty = _mm256_sub_ps(fy, fly);
+			__m256 tz = _mm256_sub_ps(fz, flz);
+			__m256 c0 = Lerp(Lerp(c000, c100, tx), Lerp(c010, c110, tx), ty);
+			__m256 c1 = Lerp(Lerp(c001, c101, tx), Lerp(c011, c111, tx), ty);
+			return Lerp(c0, c1, tz);
+		}
+
+		// GradientVolume::Sample
+		void SampleGradient(const __m256 vx, const __m256 vy, const __m256 vz, __m256& nx, __m256& ny, __m256& nz, __m256& magnitude) const
+		{
+			const __m256i one = _mm256_set1_epi32(1);
+			const __m256 half = _mm256_set1_ps(0.5f);
+			// the value first so that a NaN clamps to 0
+			__m256 fx = _mm256_min_ps(_mm256_max_ps(_mm256_fmsub_ps(vx, gradientSizeX, half), _mm256_setzero_ps()), maxX);
+			__m256 fy = _mm256_min_ps(_mm256_max_ps(_mm256_fmsub_ps(vy, gradientSizeY, half), _mm256_setzero_ps()), maxY);
+			__m256 fz = _mm256_min_ps(_mm256_max_ps(_mm256_fmsub_ps(vz, gradientSizeZ, half), _mm256_setzero_ps()), maxZ);
+			__m256i x0 = _mm256_min_epi32(_mm256_cvttps_epi32(fx), lastX);
+			__m256i y0 = _mm256_min_epi32(_mm256_cvttps_epi32(fy), lastY);
+			__m256i z0 = _mm256_min_epi32(_mm256_cvttps_epi32(fz), lastZ);
+			__m256 tx = _mm256_sub_ps(fx, _mm256_cvtepi32_ps(x0));
+			__m256 ty = _mm256_sub_ps(fy, _mm256_cvtepi32_ps(y0));
+			__m256 tz = _mm256_sub_ps(fz, _mm256_cvtepi32_ps(z0));
+
+			// the far corners fall back onto the near ones at the last voxel
+			__m256i dx = _mm256_sub_epi32(_mm256_min_epi32(_mm256_add_epi32(x0, one), lastX), x0);
+			__m256i dy = _mm256_mullo_epi32(_mm256_sub_epi32(_mm256_min_epi32(_mm256_add_epi32(y0, one), lastY), y0), gradientRowPitch);
+			__m256i dz = _mm256_mullo_epi32(_mm256_sub_epi32(_mm256_min_epi32(_mm256_add_epi32(z0, one), lastZ), z0), gradientSlicePitch);
+			__m256i idx = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(z0, gradientSlicePitch), _mm256_mullo_epi32(y0, gradientRowPitch)), x0);
+			__m256i idxY = _mm256_add_epi32(idx, dy);
+			__m256i idxZ = _mm256_add_epi32(idx, dz);
+			__m256i idxYZ = _mm256_add_epi32(idxY, dz);
+			const __m256i corners[8] = {
+				_mm256_i32gather_epi32(gradients, idx, 4), _mm256_i32gather_epi32(gradients, _mm256_add_epi32(idx, dx), 4),
+				_mm256_i32gather_epi32(gradients, idxY, 4), _mm256_i32gather_epi32(gradients, _mm256_add_epi32(idxY, dx), 4),
+				_mm256_i32gather_epi32(gradients, idxZ, 4), _mm256_i32gather_epi32(gradients, _mm256_add_epi32(idxZ, dx), 4),
+				_mm256_i32gather_epi32(gradients, idxYZ, 4), _mm256_i32gather_epi32(gradients, _mm256_add_epi32(idxYZ, dx), 4) };
+
+			__m256 channels[4];
+			const __m256i byteMask = _mm256_set1_epi32(0xff);
+			for (int c = 0; c < 4; ++c)
+			{
+				__m256 v[8];
+				for (int i = 0; i < 8; ++i)
+				{
+					v[i] = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(corners[i], c * 8), byteMask));
+				}
+				__m256 c0 = Lerp(Lerp(v[0], v[1], tx), Lerp(v[2], v[3], tx), ty);
+				__m256 c1 = Lerp(Lerp(v[4], v[5], tx), Lerp(v[6], v[7], tx), ty);
+				channels[c] = Lerp(c0, c1, tz);
+			}
+
+			const __m256 bias = _mm256_set1_ps(static_cast<float>(GradientVolume::kNormalBias));
+			const __m256 scale = _mm256_set1_ps(1.f / (255 - GradientVolume::kNormalBias));
+			nx = _mm256_mul_ps(_mm256_sub_ps(channels[0], bias), scale);
+			ny = _mm256_mul_ps(_mm256_sub_ps(channels[1], bias), scale);
+			nz = _mm256_mul_ps(_mm256_sub_ps(channels[2], bias), scale);
+			__m256 root = _mm256_mul_ps(channels[3], _mm256_set1_ps(1.f / 255.f));
+			magnitude = _mm256_mul_ps(_mm256_mul_ps(root, root), maxMagnitude);
+		}
+
+		// what lighting scales the colour of the samples at v by, 1 is unshaded;
+		// l is each lane's headlight direction
+		__m256 Shade(const __m256 vx, const __m256 vy, const __m256 vz, const __m256 lx, const __m256 ly, const __m256 lz) const
+		{
+			__m256 nx, ny, nz, magnitude;
+			if (gradients != nullptr)
+			{
+				SampleGradient(vx, vy, vz, nx, ny, nz, magnitude);
+			}
+			else
+			{
+				nx = _mm256_mul_ps(_mm256_sub_ps(Sample(_mm256_add_ps(vx, deltaX), vy, vz), Sample(_mm256_sub_ps(vx, deltaX), vy, vz)), scaleX);
+				ny = _mm256_mul_ps(_mm256_sub_ps(Sample(vx, _mm256_add_ps(vy, deltaY), vz), Sample(vx, _mm256_sub_ps(vy, deltaY), vz)), scaleY);
+				nz = _mm256_mul_ps(_mm256_sub_ps(Sample(vx, vy, _mm256_add_ps(vz, deltaZ)), Sample(vx, vy, _mm256_sub_ps(vz, deltaZ))), scaleZ);
+				magnitude = _mm256_sqrt_ps(_mm256_fmadd_ps(nx, nx, _mm256_fmadd_ps(ny, ny, _mm256_mul_ps(nz, nz))));
+			}
+
+			__m256 length = _mm256_sqrt_ps(_mm256_fmadd_ps(nx, nx, _mm256_fmadd_ps(ny, ny, _mm256_mul_ps(nz, nz))));
+			__m256 dot = _mm256_fmadd_ps(nx, lx, _mm256_fmadd_ps(ny, ly, _mm256_mul_ps(nz, lz)));
+			__m256 absDot = _mm256_andnot_ps(_mm256_set1_ps(-0.f), dot);
+			__m256 diffuse = _mm256_and_ps(_mm256_div_ps(absDot, length), _mm256_cmp_ps(length, _mm256_setzero_ps(), _CMP_GT_OQ));
+			__m256 lit = _mm256_fmadd_ps(_mm256_set1_ps(g_fDiffuse), diffuse, _mm256_set1_ps(g_fAmbient));
+			__m256 fade = _mm256_min_ps(_mm256_div_ps(magnitude, _mm256_set1_ps(g_fShadingGradient)), _mm256_set1_ps(1.f));
+			return _mm256_fmadd_ps(_mm256_sub_ps(lit, _mm256_set1_ps(1.f)), fade, _mm256_set1_ps(1.f));
+		}
+
+		// Shade for the lanes in mask, 1 for the others
+		__m256 ShadeLanes(const __m256 mask, const __m256 vx, const __m256 vy, const __m256 vz, const __m256 lx, const __m256 ly, const __m256 lz) const
+		{
+			const __m256 ones = _mm256_set1_ps(1.f);
+			if (_mm256_movemask_ps(mask) == 0)
+			{
+				return ones;
+			}
+			return _mm256_blendv_ps(ones, Shade(vx, vy, vz, lx, ly, lz), mask);
+		}
+	};
+
+	template <typename T>
+	uint64_t MarchPacket(const RayCastContext& context, RayPacket& packet)
+	{
+		const Volume& volume = *context.volume;
+		const int width = volume.GetWidth();
+		const int height = volume.GetHeight();
+		const int depth = volume.GetDepth();
+		const T* data = volume.GetVoxels<T>();
+
+		const __m256 sizeX = _mm256_set1_ps(static_cast<float>(width));
+		const __m256 sizeY = _mm256_set1_ps(static_cast<float>(height));
+		const __m256 sizeZ = _mm256_set1_ps(static_cast<float>(depth));
+		const __m256i sizeXi = _mm256_set1_epi32(width);
+		const __m256i sizeYi = _mm256_set1_epi32(height);
+		const __m256i sizeZi = _mm256_set1_epi32(depth);
+		const __m256i one = _mm256_set1_epi32(1);
+		const __m256i rowPitch = _mm256_set1_epi32(width);
+		const __m256i slicePitch = _mm256_set1_epi32(width * height);
+		const __m256i last = _mm256_set1_epi32(width * height * depth - Fetch<T>::kReach);
+		// interior test: x0 + 1 < width, and x0 + kReach - 1 < width so the read at
+		// idx stays inside the row (and the volume), y0 + 1 < height, z0 + 1 < depth
+		const __m256i interiorX = _mm256_set1_epi32(width - (Fetch<T>::kReach > 1 ? Fetch<T>::kReach - 1 : 1));
+		const __m256i interiorY = _mm256_set1_epi32(height - 1);
+		const __m256i interiorZ = _mm256_set1_epi32(depth - 1);
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 windowScale = _mm256_set1_ps(context.window.scale);
+		const __m256 windowBias = _mm256_set1_ps(context.window.bias);
+		// whether raw 0, the border colour, is transparent after classification
+		const bool borderEmpty = IsBorderTransparent(context);
+		const __m256 ones = _mm256_set1_ps(1.f);
+		const __m256 threshold = _mm256_set1_ps(g_fOpacityThreshold);
+
+		// macrocell grid, texture space to cell space is uvw * size / cellSize
+		const bool skipEmpty = context.macrocells != nullptr && context.occupancy != nullptr;
+		const int lod = context.lod;
+		const Classification classification = context.classification;
+		const float* lookup = classification != Classification::Identity ? context.transfer->GetLookup() : nullptr;
+		const float* preIntegrated = classification != Classification::Identity ? context.transfer->GetPreIntegrated() : nullptr;
+		const __m256i entryRow = _mm256_set1_epi32(TransferTables::kSize);
+		const MacrocellGrid* grid = context.macrocells;
+		const int cellSize = skipEmpty ? grid->GetCellSize() : 1;
+		const __m256 cellScaleX = _mm256_set1_ps(static_cast<float>(width) / cellSize);
+		const __m256 cellScaleY = _mm256_set1_ps(static_cast<float>(height) / cellSize);
+		const __m256 cellScaleZ = _mm256_set1_ps(static_cast<float>(depth) / cellSize);
+		const __m256i lastCellX = _mm256_set1_epi32(skipEmpty ? grid->GetCellsX() - 1 : 0);
+		const __m256i lastCellY = _mm256_set1_epi32(skipEmpty ? grid->GetCellsY() - 1 : 0);
+		const __m256i lastCellZ = _mm256_set1_epi32(skipEmpty ? grid->GetCellsZ() - 1 : 0);
+		const __m256i cellRowPitch = _mm256_set1_epi32(skipEmpty ? grid->GetCellsX() : 0);
+		const __m256i cellSlicePitch = _mm256_set1_epi32(skipEmpty ? grid->GetCellsX() * grid->GetCellsY() : 0);
+		// headlight shading
+		const bool shading = context.shading;
+		const Shading<T> shader(volume, context.gradients);
+		const Vec3 extent = volume.GetExtent();
+		const __m256 extentX = _mm256_set1_ps(extent.x);
+		const __m256 extentY = _mm256_set1_ps(extent.y);
+		const __m256 extentZ = _mm256_set1_ps(extent.z);
+		uint64_t stepsTaken = 0;
+
+		for (int base = 0; base < packet.count; base += 8)
+		{
+			const __m256 px = _mm256_loadu_ps(packet.posX + base);
+			const __m256 py = _mm256_loadu_ps(packet.posY + base);
+			const __m256 pz = _mm256_loadu_ps(packet.posZ + base);
+			const __m256 sx = _mm256_loadu_ps(packet.stepX + base);
+			const __m256 sy = _mm256_loadu_ps(packet.stepY + base);
+			const __m256 sz = _mm256_loadu_ps(packet.stepZ + base);
+			const __m256i numSteps = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(packet.numSteps + base));
+
+			// the headlight looks down the ray, gradients are in physical units so
+			// the direction is too
+			__m256 lx = _mm256_setzero_ps();
+			__m256 ly = _mm256_setzero_ps();
+			__m256 lz = _mm256_setzero_ps();
+			if (shading)
+			{
+				lx = _mm256_mul_ps(sx, extentX);
+				ly = _mm256_mul_ps(sy, extentY);
+				lz = _mm256_mul_ps(sz, extentZ);
+				__m256 length = _mm256_sqrt_ps(_mm256_fmadd_ps(lx, lx, _mm256_fmadd_ps(ly, ly, _mm256_mul_ps(lz, lz))));
+				__m256 scale = _mm256_blendv_ps(ones, _mm256_div_ps(ones, length), _mm256_cmp_ps(length, _mm256_setzero_ps(), _CMP_GT_OQ));
+				lx = _mm256_mul_ps(lx, scale);
+				ly = _mm256_mul_ps(ly, scale);
+				lz = _mm256_mul_ps(lz, scale);
+			}
+
+			// with the identity classification result.x and result.y see the same
+			// src, so one accumulator serves both unless shading puts the lit
+			// result.x in red; otherwise result is the alpha and red/green/blue
+			// the premultiplied colour
+			__m256 result = _mm256_setzero_ps();
+			__m256 red = _mm256_setzero_ps();
+			__m256 green = _mm256_setzero_ps();
+			__m256 blue = _mm256_setzero_ps();
+			// pre-integration: the step index and value of each lane's last sample,
+			// and whether it was in an occupied macrocell
+			__m256i lastStep = _mm256_set1_epi32(-2);
+			__m256 lastValue = _mm256_setzero_ps();
+			__m256 lastOccupied = _mm256_setzero_ps();
+			__m256i taken = _mm256_setzero_si256();
+			// per lane step index, lanes jump ahead independently over empty cells
+			__m256i step = _mm256_setzero_si256();
+			// sample position, posFront + step * dir: moved on a step while every
+			// lane takes one, rebuilt from step only after a lane has jumped
+			__m256 vx = px;
+			__m256 vy = py;
+			__m256 vz = pz;
+			bool jumped = false;
+
+			int maxSteps = 0;
+			for (int lane = base; lane < base + 8; ++lane)
+			{
+				maxSteps = std::max(maxSteps, packet.numSteps[lane]);
+			}
+			const __m256 maxSkip = _mm256_set1_ps(static_cast<float>(maxSteps));
+
+			// every iteration moves each active lane on by at least one step
+			for (int i = 0; i < maxSteps; ++i)
+			{
+				// lanes still inside the cube and not yet opaque
+				__m256 active = _mm256_and_ps(
+					_mm256_castsi256_ps(_mm256_cmpgt_epi32(numSteps, step)),
+					_mm256_cmp_ps(result, threshold, _CMP_LT_OQ));
+				if (_mm256_movemask_ps(active) == 0)
+				{
+					break;
+				}
+
+				if (jumped)
+				{
+					__m256 t = _mm256_cvtepi32_ps(step);
+					vx = _mm256_fmadd_ps(sx, t, px);
+					vy = _mm256_fmadd_ps(sy, t, py);
+					vz = _mm256_fmadd_ps(sz, t, pz);
+					jumped = false;
+				}
+				else if (i > 0)
+				{
+					vx = _mm256_add_ps(vx, sx);
+					vy = _mm256_add_ps(vy, sy);
+					vz = _mm256_add_ps(vz, sz);
+				}
+
+				// lanes whose previous step was sampled
+				const __m256 paired = _mm256_castsi256_ps(_mm256_cmpeq_epi32(lastStep, _mm256_sub_epi32(step, one)));
+				__m256 sample = active;
+				__m256 occupiedCell = active;
+				if (skipEmpty)
+				{
+					__m256 cx = _mm256_mul_ps(vx, cellScaleX);
+					__m256 cy = _mm256_mul_ps(vy, cellScaleY);
+					__m256 cz = _mm256_mul_ps(vz, cellScaleZ);
+					__m256i cellX = CellCoord(cx, lastCellX);
+					__m256i cellY = CellCoord(cy, lastCellY);
+					__m256i cellZ = CellCoord(cz, lastCellZ);
+					__m256i cell = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(cellZ, cellSlicePitch), _mm256_mullo_epi32(cellY, cellRowPitch)), cellX);
+					__m256i occupied = _mm256_and_si256(_mm256_i32gather_epi32(reinterpret_cast<const int*>(context.occupancy), cell, 1), _mm256_set1_epi32(0xff));
+					__m256 empty = _mm256_and_ps(active, _mm256_castsi256_ps(_mm256_cmpeq_epi32(occupied, _mm256_setzero_si256())));
+					occupiedCell = _mm256_andnot_ps(empty, active);
+
+					if (_mm256_movemask_ps(empty) != 0)
+					{
+						// jump to the first step past the cell's exit
+						__m256 exit = _mm256_min_ps(
+							_mm256_min_ps(CellExitSteps(cx, _mm256_mul_ps(sx, cellScaleX), _mm256_cvtepi32_ps(cellX)),
+								CellExitSteps(cy, _mm256_mul_ps(sy, cellScaleY), _mm256_cvtepi32_ps(cellY))),
+							CellExitSteps(cz, _mm256_mul_ps(sz, cellScaleZ), _mm256_cvtepi32_ps(cellZ)));
+						__m256i skip = _mm256_add_epi32(_mm256_cvttps_epi32(_mm256_floor_ps(_mm256_min_ps(exit, maxSkip))), one);
+						skip = _mm256_max_epi32(skip, one);
+						if (classification == Classification::PreIntegrated)
+						{
+							// the segments into and out of an occupied cell can be visible:
+							// the step after one is taken, and a jump that would land in one
+							// stops a step short so the segment into it has its front sample
+							__m256 tl = _mm256_cvtepi32_ps(_mm256_add_epi32(step, skip));
+							__m256i landX = CellCoord(_mm256_mul_ps(_mm256_fmadd_ps(sx, tl, px), cellScaleX), lastCellX);
+							__m256i landY = CellCoord(_mm256_mul_ps(_mm256_fmadd_ps(sy, tl, py), cellScaleY), lastCellY);
+							__m256i landZ = CellCoord(_mm256_mul_ps(_mm256_fmadd_ps(sz, tl, pz), cellScaleZ), lastCellZ);
+							__m256i land = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(landZ, cellSlicePitch), _mm256_mullo_epi32(landY, cellRowPitch)), landX);
+							__m256i landOccupied = _mm256_and_si256(_mm256_i32gather_epi32(reinterpret_cast<const int*>(context.occupancy), land, 1), _mm256_set1_epi32(0xff));
+							skip = _mm256_sub_epi32(skip, _mm256_andnot_si256(_mm256_cmpeq_epi32(landOccupied, _mm256_setzero_si256()), one));
+							__m256 stay = _mm256_or_ps(_mm256_and_ps(paired, lastOccupied), _mm256_castsi256_ps(_mm256_cmpeq_epi32(skip, _mm256_setzero_si256())));
+							empty = _mm256_andnot_ps(stay, empty);
+						}
+						step = _mm256_add_epi32(step, _mm256_and_si256(skip, _mm256_castps_si256(empty)));
+						jumped = _mm256_movemask_ps(empty) != 0;
+
+						sample = _mm256_andnot_ps(empty, active);
+						if (_mm256_movemask_ps(sample) == 0)
+						{
+							continue;
+						}
+					}
+				}
+				const __m256i index = step;
+				taken = _mm256_sub_epi32(taken, _mm256_castps_si256(sample));
+				step = _mm256_sub_epi32(step, _mm256_castps_si256(sample));
+
+				// texel space, centres at (i + 0.5) / size
+				__m256 fx = _mm256_fmsub_ps(vx, sizeX, half);
+				__m256 fy = _mm256_fmsub_ps(vy, sizeY, half);
+				__m256 fz = _mm256_fmsub_ps(vz, sizeZ, half);
+				__m256 flx = _mm256_floor_ps(fx);
+				__m256 fly = _mm256_floor_ps(fy);
+				__m256 flz = _mm256_floor_ps(fz);
+				__m256 tx = _mm256_sub_ps(fx, flx);
+				__m256 ty = _mm256_sub_ps(fy, fly);
+				__m256 tz = _mm256_sub_ps(fz, flz);
+				__m256i x0 = _mm256_cvttps_epi32(flx);
+				__m256i y0 = _mm256_cvttps_epi32(fly);
+				__m256i z0 = _mm256_cvttps_epi32(flz);
+
+				__m256i idx = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(z0, slicePitch), _mm256_mullo_epi32(y0, rowPitch)), x0);
+
+				__m256 c000, c100, c010, c110, c001, c101, c011, c111;
+				// lanes that aren't sampling don't hold the packet off the fast path,
+				// their address is zeroed instead (at least one lane is interior, so
+				// the volume is big enough for that to be safe)
+				__m256 interior = _mm256_and_ps(_mm256_and_ps(InRange(x0, interiorX), InRange(y0, interiorY)), InRange(z0, interiorZ));
+				if (_mm256_movemask_ps(_mm256_or_ps(interior, _mm256_xor_ps(sample, _mm256_castsi256_ps(_mm256_set1_epi32(-1))))) == 0xff)
+				{
+					idx = _mm256_and_si256(idx, _mm256_castps_si256(sample));
+					Fetch<T>::PairInterior(data, idx, c000, c100);
+					Fetch<T>::PairInterior(data, _mm256_add_epi32(idx, rowPitch), c010, c110);
+					Fetch<T>::PairInterior(data, _mm256_add_epi32(idx, slicePitch), c001, c101);
+					Fetch<T>::PairInterior(data, _mm256_add_epi32(_mm256_add_epi32(idx, slicePitch), rowPitch), c011, c111);
+				}
+				else
+				{
+					// border addressing: corners outside the volume read as 0
+					__m256 validX0 = InRange(x0, sizeXi);
+					__m256 validX1 = InRange(_mm256_add_epi32(x0, one), sizeXi);
+					__m256 validY0 = InRange(y0, sizeYi);
+					__m256 validY1 = InRange(_mm256_add_epi32(y0, one), sizeYi);
+					__m256 validZ0 = InRange(z0, sizeZi);
+					__m256 validZ1 = InRange(_mm256_add_epi32(z0, one), sizeZi);
+
+					// every sampling lane outside the volume (typically past the exit point): src is 0
+					__m256 any = _mm256_and_ps(_mm256_and_ps(_mm256_or_ps(validX0, validX1), _mm256_or_ps(validY0, validY1)), _mm256_or_ps(validZ0, validZ1));
+					if (borderEmpty && _mm256_movemask_ps(_mm256_and_ps(any, sample)) == 0)
+					{
+						continue;
+					}
+
+					Fetch<T>::Pair(data, last, idx, _mm256_and_ps(validY0, validZ0), validX0, validX1, c000, c100);
+					Fetch<T>::Pair(data, last, _mm256_add_epi32(idx, rowPitch), _mm256_and_ps(validY1, validZ0), validX0, validX1, c010, c110);
+					Fetch<T>::Pair(data, last, _mm256_add_epi32(idx, slicePitch), _mm256_and_ps(validY0, validZ1), validX0, validX1, c001, c101);
+					Fetch<T>::Pair(data, last, _mm256_add_epi32(_mm256_add_epi32(idx, slicePitch), rowPitch), _mm256_and_ps(validY1, validZ1), validX0, validX1, c011, c111);
+				}
+
+				__m256 c00 = Lerp(c000, c100, tx);
+				__m256 c10 = Lerp(c010, c110, tx);
+				__m256 c01 = Lerp(c001, c101, tx);
+				__m256 c11 = Lerp(c011, c111, tx);
+				__m256 c0 = Lerp(c00, c10, ty);
+				__m256 c1 = Lerp(c01, c11, ty);
+				// window/level: clamp(value * scale + bias, 0, 1)
+				__m256 src = _mm256_fmadd_ps(Lerp(c0, c1, tz), windowScale, windowBias);
+				src = _mm256_min_ps(_mm256_max_ps(src, _mm256_setzero_ps()), ones);
+
+				if (classification != Classification::Identity)
+				{
+					// Front to back blending of the classified sample or segment
+					__m256 rgba[4];
+					__m256i entry;
+					__m256 t0;
+					ToEntry(src, entry, t0);
+					if (classification == Classification::PreIntegrated)
+					{
+						// paired with the previous sample if the lane took that step
+						__m256i front;
+						__m256 t1;
+						ToEntry(_mm256_blendv_ps(src, lastValue, paired), front, t1);
+						__m256i offset = _mm256_slli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(entry, entryRow), front), 2);
+						__m256 row0[4], row1[4];
+						LerpEntries(preIntegrated, offset, t1, row0);
+						LerpEntries(preIntegrated + TransferTables::kSize * 4, offset, t1, row1);
+						for (int c = 0; c < 4; ++c)
+						{
+							rgba[c] = Lerp(row0[c], row1[c], t0);
+						}
+						lastStep = _mm256_blendv_epi8(lastStep, index, _mm256_castps_si256(sample));
+						lastValue = _mm256_blendv_ps(lastValue, src, sample);
+						lastOccupied = _mm256_blendv_ps(lastOccupied, occupiedCell, sample);
+					}
+					else
+					{
+						LerpEntries(lookup, _mm256_slli_epi32(entry, 2), t0, rgba);
+					}
+					__m256 weight = _mm256_and_ps(_mm256_sub_ps(ones, result), sample);
+					__m256 colourWeight = weight;
+					if (shading)
+					{
+						__m256 visible = _mm256_and_ps(sample, _mm256_cmp_ps(rgba[3], _mm256_setzero_ps(), _CMP_GT_OQ));
+						colourWeight = _mm256_mul_ps(weight, shader.ShadeLanes(visible, vx, vy, vz, lx, ly, lz));
+					}
+					red = _mm256_fmadd_ps(colourWeight, rgba[0], red);
+					green = _mm256_fmadd_ps(colourWeight, rgba[1], green);
+					blue = _mm256_fmadd_ps(colourWeight, rgba[2], blue);
+					result = _mm256_fmadd_ps(weight, rgba[3], result);
+				}
+				// Front to back blending: result += (1 - result.y) * src.y * src
+				else if (lod == 0)
+				{
+					__m256 weight = _mm256_and_ps(_mm256_mul_ps(_mm256_sub_ps(ones, result), src), sample);
+					if (shading)
+					{
+						__m256 lit = shader.ShadeLanes(_mm256_cmp_ps(weight, _mm256_setzero_ps(), _CMP_GT_OQ), vx, vy, vz, lx, ly, lz);
+						red = _mm256_fmadd_ps(_mm256_mul_ps(weight, lit), src, red);
+					}
+					result = _mm256_fmadd_ps(weight, src, result);
+				}
+				else
+				{
+					// longer steps: the opacity src.y * src through CorrectOpacity
+					__m256 transparency = _mm256_fnmadd_ps(src, src, ones);
+					for (int l = 0; l < lod; ++l)
+					{
+						transparency = _mm256_mul_ps(transparency, transparency);
+					}
+					__m256 weight = _mm256_and_ps(_mm256_sub_ps(ones, result), sample);
+					__m256 opacity = _mm256_sub_ps(ones, transparency);
+					if (shading)
+					{
+						__m256 added = _mm256_mul_ps(weight, opacity);
+						__m256 lit = shader.ShadeLanes(_mm256_cmp_ps(added, _mm256_setzero_ps(), _CMP_GT_OQ), vx, vy, vz, lx, ly, lz);
+						red = _mm256_fmadd_ps(added, lit, red);
+					}
+					result = _mm256_fmadd_ps(weight, opacity, result);
+				}
+			}
+
+			int counts[8];
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(counts), taken);
+			for (int lane = 0; lane < 8; ++lane)
+			{
+				stepsTaken += counts[lane];
+			}
+
+			if (classification != Classification::Identity)
+			{
+				// the colour RayCastPS outputs for the SRC_ALPHA blend
+				__m256 visible = _mm256_cmp_ps(result, _mm256_setzero_ps(), _CMP_GT_OQ);
+				red = _mm256_and_ps(_mm256_div_ps(red, result), visible);
+				green = _mm256_and_ps(_mm256_div_ps(green, result), visible);
+				blue = _mm256_and_ps(_mm256_div_ps(blue, result), visible);
+			}
+			else
+			{
+				red = green = blue = shading ? red : result;
+			}
+			_mm256_storeu_ps(packet.red + base, red);
+			_mm256_storeu_ps(packet.green + base, green);
+			_mm256_storeu_ps(packet.blue + base, blue);
+			_mm256_storeu_ps(packet.alpha + base, result);
+		}
+
+		return stepsTaken;
+	}
+}
+
+uint64_t RayCastPacketAVX2(const RayCastContext& context, RayPacket& packet)
+{
+	return DispatchVoxelType(context.volume->GetDesc().type, [&](auto voxel) {
+		return MarchPacket<decltype(voxel)>(context, packet);
+	});
+}
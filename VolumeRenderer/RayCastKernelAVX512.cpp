@@ -0,0 +1,660 @@
+// AVX-512 packet kernel, 16 rays per iteration. Compiled with /arch:AVX512 and
+// only called when GetCpuFeatures() reports AVX-512 F/BW. Same scheme as the
+// AVX2 kernel, with opmasks for the border tests.
+#include "RayCastKernel.h"
+#include <immintrin.h>
+
+namespace
+{
+	// see the AVX2 kernel for the per type fetches
+	template <typename T> struct Fetch;
+
+	template <> struct Fetch<uint8_t>
+	{
+		static const int kReach = 4;
+
+		static void Pair(const uint8_t* data, const __m512i last, const __m512i idx,
+			const __mmask16 rowValid, const __mmask16 valid0, const __mmask16 valid1, __m512& c0, __m512& c1)
+		{
+			const __m512i byteMask = _mm512_set1_epi32(0xff);
+			__m512i addr = _mm512_max_epi32(_mm512_min_epi32(idx, last), _mm512_setzero_si512());
+			__m512i word = _mm512_i32gather_epi32(addr, data, 1);
+			__m512i shift = _mm512_slli_epi32(_mm512_sub_epi32(idx, addr), 3);
+
+			__m512i v0 = _mm512_and_si512(_mm512_srlv_epi32(word, shift), byteMask);
+			__m512i v1 = _mm512_and_si512(_mm512_srlv_epi32(word, _mm512_add_epi32(shift, _mm512_set1_epi32(8))), byteMask);
+
+			c0 = _mm512_maskz_cvtepi32_ps(rowValid & valid0, v0);
+			c1 = _mm512_maskz_cvtepi32_ps(rowValid & valid1, v1);
+		}
+
+		static void PairInterior(const uint8_t* data, const __m512i idx, __m512& c0, __m512& c1)
+		{
+			const __m512i byteMask = _mm512_set1_epi32(0xff);
+			__m512i word = _mm512_i32gather_epi32(idx, data, 1);
+			c0 = _mm512_cvtepi32_ps(_mm512_and_si512(word, byteMask));
+			c1 = _mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(word, 8), byteMask));
+		}
+	};
+
+	inline void GatherWords(const void* data, const __m512i last, const __m512i idx, __m512i& v0, __m512i& v1)
+	{
+		const __m512i wordMask = _mm512_set1_epi32(0xffff);
+		__m512i addr = _mm512_max_epi32(_mm512_min_epi32(idx, last), _mm512_setzero_si512());
+		__m512i word = _mm512_i32gather_epi32(addr, data, 2);
+		__m512i shift = _mm512_slli_epi32(_mm512_sub_epi32(idx, addr), 4);
+		v0 = _mm512_and_si512(_mm512_srlv_epi32(word, shift), wordMask);
+		v1 = _mm512_and_si512(_mm512_srlv_epi32(word, _mm512_add_epi32(shift, _mm512_set1_epi32(16))), wordMask);
+	}
+
+	template <> struct Fetch<uint16_t>
+	{
+		static const int kReach = 2;
+
+		static void Pair(const uint16_t* data, const __m512i last, const __m512i idx,
+			const __mmask16 rowValid, const __mmask16 valid0, const __mmask16 valid1, __m512& c0, __m512& c1)
+		{
+			__m512i v0, v1;
+			GatherWords(data, last, idx, v0, v1);
+			c0 = _mm512_maskz_cvtepi32_ps(rowValid & valid0, v0);
+			c1 = _mm512_maskz_cvtepi32_ps(rowValid & valid1, v1);
+		}
+
+		static void PairInterior(const uint16_t* data, const __m512i idx, __m512& c0, __m512& c1)
+		{
+			__m512i word = _mm512_i32gather_epi32(idx, data, 2);
+			c0 = _mm512_cvtepi32_ps(_mm512_and_si512(word, _mm512_set1_epi32(0xffff)));
+			c1 = _mm512_cvtepi32_ps(_mm512_srli_epi32(word, 16));
+		}
+	};
+
+	// the halves are narrowed back to 16 bits and widened to float
+	template <> struct Fetch<Half>
+	{
+		static const int kReach = 2;
+
+		static void Pair(const Half* data, const __m512i last, const __m512i idx,
+			const __mmask16 rowValid, const __mmask16 valid0, const __mmask16 valid1, __m512& c0, __m512& c1)
+		{
+			__m512i v0, v1;
+			GatherWords(data, last, idx, v0, v1);
+			c0 = _mm512_maskz_mov_ps(rowValid & valid0, _mm512_cvtph_ps(_mm512_cvtepi32_epi16(v0)));
+			c1 = _mm512_maskz_mov_ps(rowValid & valid1, _mm512_cvtph_ps(_mm512_cvtepi32_epi16(v1)));
+		}
+
+		static void PairInterior(const Half* data, const __m512i idx, __m512& c0, __m512& c1)
+		{
+			__m512i word = _mm512_i32gather_epi32(idx, data, 2);
+			c0 = _mm512_cvtph_ps(_mm512_cvtepi32_epi16(word));
+			c1 = _mm512_cvtph_ps(_mm512_cvtepi32_epi16(_mm512_srli_epi32(word, 16)));
+		}
+	};
+
+	template <> struct Fetch<float>
+	{
+		static const int kReach = 1;
+
+		static void Pair(const float* data, const __m512i, const __m512i idx,
+			const __mmask16 rowValid, const __mmask16 valid0, const __mmask16 valid1, __m512& c0, __m512& c1)
+		{
+			c0 = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), rowValid & valid0, idx, data, 4);
+			c1 = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), rowValid & valid1, _mm512_add_epi32(idx, _mm512_set1_epi32(1)), data, 4);
+		}
+
+		static void PairInterior(const float* data, const __m512i idx, __m512& c0, __m512& c1)
+		{
+			c0 = _mm512_i32gather_ps(idx, data, 4);
+			c1 = _mm512_i32gather_ps(_mm512_add_epi32(idx, _mm512_set1_epi32(1)), data, 4);
+		}
+	};
+
+	inline __mmask16 InRange(const __m512i i, const __m512i size)
+	{
+		return _mm512_cmpge_epi32_mask(i, _mm512_setzero_si512()) & _mm512_cmplt_epi32_mask(i, size);
+	}
+
+	inline __m512 Lerp(const __m512 a, const __m512 b, const __m512 t)
+	{
+		return _mm512_fmadd_ps(_mm512_sub_ps(b, a), t, a);
+	}
+
+	inline void ToEntry(const __m512 s, __m512i& i, __m512& t)
+	{
+		__m512 x = _mm512_mul_ps(s, _mm512_set1_ps(static_cast<float>(TransferTables::kSize - 1)));
+		i = _mm512_min_epi32(_mm512_cvttps_epi32(x), _mm512_set1_epi32(TransferTables::kSize - 2));
+		t = _mm512_sub_ps(x, _mm512_cvtepi32_ps(i));
+	}
+
+	inline void LerpEntries(const float* table, const __m512i offset, const __m512 t, __m512 rgba[4])
+	{
+		for (int c = 0; c < 4; ++c)
+		{
+			rgba[c] = Lerp(_mm512_i32gather_ps(offset, table + c, 4), _mm512_i32gather_ps(offset, table + 4 + c, 4), t);
+		}
+	}
+
+	inline __m512 Floor(const __m512 v)
+	{
+		return _mm512_roundscale_ps(v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+	}
+	// see the AVX2 kernel
+	inline __m512 CellExitSteps(const __m512 c, const __m512 d, const __m512 cell)
+	{
+		__mmask16 positive = _mm512_cmp_ps_mask(d, _mm512_setzero_ps(), _CMP_GT_OQ);
+		__m512 bound = _mm512_mask_add_ps(cell, positive, cell, _mm512_set1_ps(1.f));
+		__m512 t = _mm512_div_ps(_mm512_sub_ps(bound, c), d);
+		__mmask16 parallel = _mm512_cmp_ps_mask(d, _mm512_setzero_ps(), _CMP_EQ_OQ);
+		return _mm512_mask_mov_ps(t, parallel, _mm512_set1_ps(static_cast<float>(g_iMaxIterations)));
+	}
+
+	inline __m512i CellCoord(const __m512 c, const __m512i lastCell)
+	{
+		__m512i i = _mm512_cvttps_epi32(Floor(c));
+		return _mm512_max_epi32(_mm512_min_epi32(i, lastCell), _mm512_setzero_si512());
+	}
+
+	// see the AVX2 kernel, the fetches here only read the lanes in mask
+	template <typename T>
+	struct Shading
+	{
+		const T* data;
+		__m512 sizeX, sizeY, sizeZ;
+		__m512i sizeXi, sizeYi, sizeZi;
+		__m512i rowPitch, slicePitch, last;
+		__m512 deltaX, deltaY, deltaZ;
+		__m512 scaleX, scaleY, scaleZ;
+		const int* gradients;
+		__m512 gradientSizeX, gradientSizeY, gradientSizeZ;
+		__m512 maxX, maxY, maxZ;
+		__m512i lastX, lastY, lastZ;
+		__m512i gradientRowPitch, gradientSlicePitch;
+		__m512 maxMagnitude;
+
+		Shading(const Volume& volume, const GradientVolume* gradientVolume)
+		{
+			const int width = volume.GetWidth();
+			const int height = volume.GetHeight();
+			const int depth = volume.GetDepth();
+			data = volume.GetVoxels<T>();
+			sizeX = _mm512_set1_ps(static_cast<float>(width));
+			sizeY = _mm512_set1_ps(static_cast<float>(height));
+			sizeZ = _mm512_set1_ps(static_cast<float>(depth));
+			sizeXi = _mm512_set1_epi32(width);
+			sizeYi = _mm512_set1_epi32(height);
+			sizeZi = _mm512_set1_epi32(depth);
+			rowPitch = _mm512_set1_epi32(width);
+			slicePitch = _mm512_set1_epi32(width * height);
+			last = _mm512_set1_epi32(width * height * depth - Fetch<T>::kReach);
+			deltaX = _mm512_set1_ps(1.f / width);
+			deltaY = _mm512_set1_ps(1.f / height);
+			deltaZ = _mm512_set1_ps(1.f / depth);
+			const Vec3 scale = GradientVolume::GetScale(volume.GetDesc()) * 0.5f;
+			scaleX = _mm512_set1_ps(scale.x);
+			scaleY = _mm512_set1_ps(scale.y);
+			scaleZ = _mm512_set1_ps(scale.z);
+
+			gradients = gradientVolume != nullptr ? reinterpret_cast<const int*>(gradientVolume->GetData()) : nullptr;
+			const int gradientWidth = gradientVolume != nullptr ? gradientVolume->GetWidth() : 1;
+			const int gradientHeight = gradientVolume != nullptr ? gradientVolume->GetHeight() : 1;
+			const int gradientDepth = gradientVolume != nullptr ? gradientVolume->GetDepth() : 1;
+			gradientSizeX = _mm512_set1_ps(static_cast<float>(gradientWidth));
+			gradientSizeY = _mm512_set1_ps(static_cast<float>(gradientHeight));
+			gradientSizeZ = _mm512_set1_ps(static_cast<float>(gradientDepth));
+			maxX = _mm512_set1_ps(static_cast<float>(gradientWidth - 1));
+			maxY = _mm512_set1_ps(static_cast<float>(gradientHeight - 1));
+			maxZ = _mm512_set1_ps(static_cast<float>(gradientDepth - 1));
+			lastX = _mm512_set1_epi32(gradientWidth - 1);
+			lastY = _mm512_set1_epi32(gradientHeight - 1);
+			lastZ = _mm512_set1_epi32(gradientDepth - 1);
+			gradientRowPitch = _mm512_set1_epi32(gradientWidth);
+			gradientSlicePitch = _mm512_set1_epi32(gradientWidth * gradientHeight);
+			maxMagnitude = _mm512_set1_ps(GradientVolume::kMaxMagnitude);
+		}
+
+		__m512 Sample(const __mmask16 mask, const __m512 vx, const __m512 vy, const __m512 vz) const
+		{
+			const __m512i one = _mm512_set1_epi32(1);
+			const __m512 half = _mm512_set1_ps(0.5f);
+			__m512 fx = _mm512_fmsub_ps(vx, sizeX, half);
+			__m512 fy = _mm512_fmsub_ps(vy, sizeY, half);
+			__m512 fz = _mm512_fmsub_ps(vz, sizeZ, half);
+			__m512 flx = Floor(fx);
+			__m512 fly = Floor(fy);
+			__m512 flz = Floor(fz);
+			__m512i x0 = _mm512_cvttps_epi32(flx);
+			__m512i y0 = _mm512_cvttps_epi32(fly);
+			__m512i z0 = _mm512_cvttps_epi32(flz);
+			__m512i idx = _mm512_add_epi32(_mm512_add_epi32(_mm512_mullo_epi32(z0, slicePitch), _mm512_mullo_epi32(y0, rowPitch)), x0);
+
+			__mmask16 validX0 = InRange(x0, sizeXi);
+			__mmask16 validX1 = InRange(_mm512_add_epi32(x0, one), sizeXi);
+			__mmask16 validY0 = InRange(y0, sizeYi) & mask;
+			__mmask16 validY1 = InRange(_mm512_add_epi32(y0, one), sizeYi) & mask;
+			__mmask16 validZ0 = InRange(z0, sizeZi);
+			__mmask16 validZ1 = InRange(_mm512_add_epi32(z0, one), sizeZi);
+
+			__m512 c000, c100, c010, c110, c001, c101, c011, c111;
+			Fetch<T>::Pair(data, last, idx, validY0 & validZ0, validX0, validX1, c000, c100);
+			Fetch<T>::Pair(data, last, _mm512_add_epi32(idx, rowPitch), validY1 & validZ0, validX0, validX1, c010, c110);
+			Fetch<T>::Pair(data, last, _mm512_add_epi32(idx, slicePitch), validY0 & validZ1, validX0, validX1, c001, c101);
+			Fetch<T>::Pair(data, last, _mm512_add_epi32(_mm512_add_epi32(idx, slicePitch), rowPitch), validY1 & validZ1, validX0, validX1, c011, c111);
+
+			__m512 tx = _mm512_sub_ps(fx, flx);
+			__m512 ty = _mm512_sub_ps(fy, fly);
+			__m512 tz = _mm512_sub_ps(fz, flz);
+			__m512 c0 = Lerp(Lerp(c000, c100, tx), Lerp(c010, c110, tx), ty);
+			__m512 c1 = Lerp(Lerp(c001, c101, tx), Lerp(c011, c111, tx), ty);
+			return Lerp(c0, c1, tz);
+		}
+
+		void SampleGradient(const __mmask16 mask, const __m512 vx, const __m512 vy, const __m512 vz, __m512& nx, __m512& ny, __m512& nz, __m512& magnitude) const
+		{
+			const __m512i one = _mm512_set1_epi32(1);
+			const __m512 half = _mm512_set1_ps(0.5f);
+			__m512 fx = _mm512_min_ps(_mm512_max_ps(_mm512_fmsub_ps(vx, gradientSizeX, half), _mm512_setzero_ps()), maxX);
+			__m512 fy = _mm512_min_ps(_mm512_max_ps(_mm512_fmsub_ps(vy, gradientSizeY, half), _mm512_setzero_ps()), maxY);
+			__m512 fz = _mm512_min_ps(_mm512_max_ps(_mm512_fmsub_ps(vz, gradientSizeZ, half), _mm512_setzero_ps()), maxZ);
+			__m512i x0 = _mm512_min_epi32(_mm512_cvttps_epi32(fx), lastX);
+			__m512i y0 = _mm512_min_epi32(_mm512_cvttps_epi32(fy), lastY);
+			__m512i z0 = _mm512_min_epi32(_mm512_cvttps_epi32(fz), lastZ);
+			__m512 tx = _mm512_sub_ps(fx, _mm512_cvtepi32_ps(x0));
+			__m512 ty = _mm512_sub_ps(fy, _mm512_cvtepi32_ps(y0));
+			__m512 tz = _mm512_sub_ps(fz, _mm512_cvtepi32_ps(z0));
+
+			__m512i dx = _mm512_sub_epi32(_mm512_min_epi32(_mm512_add_epi32(x0, one), lastX), x0);
+			__m512i dy = _mm512_mullo_epi32(_mm512_sub_epi32(_mm512_min_epi32(_mm512_add_epi32(y0, one), lastY), y0), gradientRowPitch);
+			__m512i dz = _mm512_mullo_epi32(_mm512_sub_epi32(_mm512_min_epi32(_mm512_add_epi32(z0, one), lastZ), z0), gradientSlicePitch);
+			__m512i idx = _mm512_add_epi32(_mm512_add_epi32(_mm512_mullo_epi32(z0, gradientSlicePitch), _mm512_mullo_epi32(y0, gradientRowPitch)), x0);
+			__m512i idxY = _mm512_add_epi32(idx, dy);
+			__m512i idxZ = _mm512_add_epi32(idx, dz);
+			__m512i idxYZ = _mm512_add_epi32(idxY, dz);
+			const __m512i zero = _mm512_setzero_si512();
+			const __m512i corners[8] = {
+				_mm512_mask_i32gather_epi32(zero, mask, idx, gradients, 4), _mm512_mask_i32gather_epi32(zero, mask, _mm512_add_epi32(idx, dx), gradients, 4),
+				_mm512_mask_i32gather_epi32(zero, mask, idxY, gradients, 4), _mm512_mask_i32gather_epi32(zero, mask, _mm512_add_epi32(idxY, dx), gradients, 4),
+				_mm512_mask_i32gather_epi32(zero, mask, idxZ, gradients, 4), _mm512_mask_i32gather_epi32(zero, mask, _mm512_add_epi32(idxZ, dx), gradients, 4),
+				_mm512_mask_i32gather_epi32(zero, mask, idxYZ, gradients, 4), _mm512_mask_i32gather_epi32(zero, mask, _mm512_add_epi32(idxYZ, dx), gradients, 4) };
+
+			__m512 channels[4];
+			const __m512i byteMask = _mm512_set1_epi32(0xff);
+			for (int c = 0; c < 4; ++c)
+			{
+				__m512 v[8];
+				for (int i = 0; i < 8; ++i)
+				{
+					v[i] = _mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(corners[i], c * 8), byteMask));
+				}
+				__m512 c0 = Lerp(Lerp(v[0], v[1], tx), Lerp(v[2], v[3], tx), ty);
+				__m512 c1 = Lerp(Lerp(v[4], v[5], tx), Lerp(v[6], v[7], tx), ty);
+				channels[c] = Lerp(c0, c1, tz);
+			}
+
+			const __m512 bias = _mm512_set1_ps(static_cast<float>(GradientVolume::kNormalBias));
+			const __m512 scale = _mm512_set1_ps(1.f / (255 - GradientVolume::kNormalBias));
+			nx = _mm512_mul_ps(_mm512_sub_ps(channels[0], bias), scale);
+			ny = _mm512_mul_ps(_mm512_sub_ps(channels[1], bias), scale);
+			nz = _mm512_mul_ps(_mm512_sub_ps(channels[2], bias), scale);
+			__m512 root = _mm512_mul_ps(channels[3], _mm512_set1_ps(1.f / 255.f));
+			magnitude = _mm512_mul_ps(_mm512_mul_ps(root, root), maxMagnitude);
+		}
+
+		// the lit factor for the lanes in mask, 1 for the others
+		__m512 ShadeLanes(const __mmask16 mask, const __m512 vx, const __m512 vy, const __m512 vz, const __m512 lx, const __m512 ly, const __m512 lz) const
+		{
+			const __m512 ones = _mm512_set1_ps(1.f);
+			if (mask == 0)
+			{
+				return ones;
+			}
+
+			__m512 nx, ny, nz, magnitude;
+			if (gradients != nullptr)
+			{
+				SampleGradient(mask, vx, vy, vz, nx, ny, nz, magnitude);
+			}
+			else
+			{
+				nx = _mm512_mul_ps(_mm512_sub_ps(Sample(mask, _mm512_add_ps(vx, deltaX), vy, vz), Sample(mask, _mm512_sub_ps(vx, deltaX), vy, vz)), scaleX);
+				ny = _mm512_mul_ps(_mm512_sub_ps(Sample(mask, vx, _mm512_add_ps(vy, deltaY), vz), Sample(mask, vx, _mm512_sub_ps(vy, deltaY), vz)), scaleY);
+				nz = _mm512_mul_ps(_mm512_sub_ps(Sample(mask, vx, vy, _mm512_add_ps(vz, deltaZ)), Sample(mask, vx, vy, _mm512_sub_ps(vz, deltaZ))), scaleZ);
+				magnitude = _mm512_sqrt_ps(_mm512_fmadd_ps(nx, nx, _mm512_fmadd_ps(ny, ny, _mm512_mul_ps(nz, nz))));
+			}
+
+			__m512 length = _mm512_sqrt_ps(_mm512_fmadd_ps(nx, nx, _mm512_fmadd_ps(ny, ny, _mm512_mul_ps(nz, nz))));
+			__m512 dot = _mm512_fmadd_ps(nx, lx, _mm512_fmadd_ps(ny, ly, _mm512_mul_ps(nz, lz)));
+			__mmask16 lengthy = _mm512_cmp_ps_mask(length, _mm512_setzero_ps(), _CMP_GT_OQ);
+			__m512 diffuse = _mm512_maskz_div_ps(lengthy, _mm512_abs_ps(dot), length);
+			__m512 lit = _mm512_fmadd_ps(_mm512_set1_ps(g_fDiffuse), diffuse, _mm512_set1_ps(g_fAmbient));
+			__m512 fade = _mm512_min_ps(_mm512_div_ps(magnitude, _mm512_set1_ps(g_fShadingGradient)), ones);
+			return _mm512_mask_blend_ps(mask, ones, _mm512_fmadd_ps(_mm512_sub_ps(lit, ones), fade, ones));
+		}
+	};
+
+	template <typename T>
+	uint64_t MarchPacket(const RayCastContext& context, RayPacket& packet)
+	{
+		const Volume& volume = *context.volume;
+		const int width = volume.GetWidth();
+		const int height = volume.GetHeight();
+		const int depth = volume.GetDepth();
+		const T* data = volume.GetVoxels<T>();
+
+		const __m512 sizeX = _mm512_set1_ps(static_cast<float>(width));
+		const __m512 sizeY = _mm512_set1_ps(static_cast<float>(height));
+		const __m512 sizeZ = _mm512_set1_ps(static_cast<float>(depth));
+		const __m512i sizeXi = _mm512_set1_epi32(width);
+		const __m512i sizeYi = _mm512_set1_epi32(height);
+		const __m512i sizeZi = _mm512_set1_epi32(depth);
+		const __m512i one = _mm512_set1_epi32(1);
+		const __m512i rowPitch = _mm512_set1_epi32(width);
+		const __m512i slicePitch = _mm512_set1_epi32(width * height);
+		const __m512i last = _mm512_set1_epi32(width * height * depth - Fetch<T>::kReach);
+		// see the AVX2 kernel, x0 + kReach - 1 < width keeps the read inside the row
+		const __m512i interiorX = _mm512_set1_epi32(width - (Fetch<T>::kReach > 1 ? Fetch<T>::kReach - 1 : 1));
+		const __m512i interiorY = _mm512_set1_epi32(height - 1);
+		const __m512i interiorZ = _mm512_set1_epi32(depth - 1);
+		const __m512 half = _mm512_set1_ps(0.5f);
+		const __m512 windowScale = _mm512_set1_ps(context.window.scale);
+		const __m512 windowBias = _mm512_set1_ps(context.window.bias);
+		const bool borderEmpty = IsBorderTransparent(context);
+		const __m512 ones = _mm512_set1_ps(1.f);
+		const __m512 threshold = _mm512_set1_ps(g_fOpacityThreshold);
+
+		const bool skipEmpty = context.macrocells != nullptr && context.occupancy != nullptr;
+		const int lod = context.lod;
+		const Classification classification = context.classification;
+		const float* lookup = classification != Classification::Identity ? context.transfer->GetLookup() : nullptr;
+		const float* preIntegrated = classification != Classification::Identity ? context.transfer->GetPreIntegrated() : nullptr;
+		const __m512i entryRow = _mm512_set1_epi32(TransferTables::kSize);
+		const MacrocellGrid* grid = context.macrocells;
+		const int cellSize = skipEmpty ? grid->GetCellSize() : 1;
+		const __m512 cellScaleX = _mm512_set1_ps(static_cast<float>(width) / cellSize);
+		const __m512 cellScaleY = _mm512_set1_ps(static_cast<float>(height) / cellSize);
+		const __m512 cellScaleZ = _mm512_set1_ps(static_cast<float>(depth) / cellSize);
+		const __m512i lastCellX = _mm512_set1_epi32(skipEmpty ? grid->GetCellsX() - 1 : 0);
+		const __m512i lastCellY = _mm512_set1_epi32(skipEmpty ? grid->GetCellsY() - 1 : 0);
+		const __m512i lastCellZ = _mm512_set1_epi32(skipEmpty ? grid->GetCellsZ() - 1 : 0);
+		const __m512i cellRowPitch = _mm512_set1_epi32(skipEmpty ? grid->GetCellsX() : 0);
+		const __m512i cellSlicePitch = _mm512_set1_epi32(skipEmpty ? grid->GetCellsX() * grid->GetCellsY() : 0);
+		const bool shading = context.shading;
+		const Shading<T> shader(volume, context.gradients);
+		const Vec3 extent = volume.GetExtent();
+		const __m512 extentX = _mm512_set1_ps(extent.x);
+		const __m512 extentY = _mm512_set1_ps(extent.y);
+		const __m512 extentZ = _mm512_set1_ps(extent.z);
+		uint64_t stepsTaken = 0;
+
+		for (int base = 0; base < packet.count; base += 16)
+		{
+			const __m512 px = _mm512_loadu_ps(packet.posX + base);
+			const __m512 py = _mm512_loadu_ps(packet.posY + base);
+			const __m512 pz = _mm512_loadu_ps(packet.posZ + base);
+			const __m512 sx = _mm512_loadu_ps(packet.stepX + base);
+			const __m512 sy = _mm512_loadu_ps(packet.stepY + base);
+			const __m512 sz = _mm512_loadu_ps(packet.stepZ + base);
+			const __m512i numSteps = _mm512_loadu_si512(packet.numSteps + base);
+
+			// see the AVX2 kernel for the headlight
+			__m512 lx = _mm512_setzero_ps();
+			__m512 ly = _mm512_setzero_ps();
+			__m512 lz = _mm512_setzero_ps();
+			if (shading)
+			{
+				lx = _mm512_mul_ps(sx, extentX);
+				ly = _mm512_mul_ps(sy, extentY);
+				lz = _mm512_mul_ps(sz, extentZ);
+				__m512 length = _mm512_sqrt_ps(_mm512_fmadd_ps(lx, lx, _mm512_fmadd_ps(ly, ly, _mm512_mul_ps(lz, lz))));
+				__m512 scale = _mm512_mask_div_ps(ones, _mm512_cmp_ps_mask(length, _mm512_setzero_ps(), _CMP_GT_OQ), ones, length);
+				lx = _mm512_mul_ps(lx, scale);
+				ly = _mm512_mul_ps(ly, scale);
+				lz = _mm512_mul_ps(lz, scale);
+			}
+
+			// see the AVX2 kernel for the accumulators
+			__m512 result = _mm512_setzero_ps();
+			__m512 red = _mm512_setzero_ps();
+			__m512 green = _mm512_setzero_ps();
+			__m512 blue = _mm512_setzero_ps();
+			__m512i lastStep = _mm512_set1_epi32(-2);
+			__m512 lastValue = _mm512_setzero_ps();
+			__mmask16 lastOccupied = 0;
+			__m512i taken = _mm512_setzero_si512();
+			__m512i step = _mm512_setzero_si512();
+			// stepped on, and rebuilt from step after a jump, as in the AVX2 kernel
+			__m512 vx = px;
+			__m512 vy = py;
+			__m512 vz = pz;
+			bool jumped = false;
+
+			const int maxSteps = _mm512_reduce_max_epi32(numSteps);
+			const __m512 maxSkip = _mm512_set1_ps(static_cast<float>(maxSteps));
+
+			for (int i = 0; i < maxSteps; ++i)
+			{
+				// lanes still inside the cube and not yet opaque
+				__mmask16 active = _mm512_cmpgt_epi32_mask(numSteps, step)
+					& _mm512_cmp_ps_mask(result, threshold, _CMP_LT_OQ);
+				if (active == 0)
+				{
+					break;
+				}
+
+				if (jumped)
+				{
+					__m512 t = _mm512_cvtepi32_ps(step);
+					vx = _mm512_fmadd_ps(sx, t, px);
+					vy = _mm512_fmadd_ps(sy, t, py);
+					vz = _mm512_fmadd_ps(sz, t, pz);
+					jumped = false;
+				}
+				else if (i > 0)
+				{
+					vx = _mm512_add_ps(vx, sx);
+					vy = _mm512_add_ps(vy, sy);
+					vz = _mm512_add_ps(vz, sz);
+				}
+
+				const __mmask16 paired = _mm512_cmpeq_epi32_mask(lastStep, _mm512_sub_epi32(step, one));
+				__mmask16 sample = active;
+				__mmask16 occupiedCell = active;
+				if (skipEmpty)
+				{
+					__m512 cx = _mm512_mul_ps(vx, cellScaleX);
+					__m512 cy = _mm512_mul_ps(vy, cellScaleY);
+					__m512 cz = _mm512_mul_ps(vz, cellScaleZ);
+					__m512i cellX = CellCoord(cx, lastCellX);
+					__m512i cellY = CellCoord(cy, lastCellY);
+					__m512i cellZ = CellCoord(cz, lastCellZ);
+					__m512i cell = _mm512_add_epi32(_mm512_add_epi32(_mm512_mullo_epi32(cellZ, cellSlicePitch), _mm512_mullo_epi32(cellY, cellRowPitch)), cellX);
+					__m512i occupied = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), active, cell, context.occupancy, 1);
+					__mmask16 empty = _mm512_mask_testn_epi32_mask(active, occupied, _mm512_set1_epi32(0xff));
+					occupiedCell = static_cast<__mmask16>(active & ~empty);
+
+					if (empty != 0)
+					{
+						__m512 exit = _mm512_min_ps(
+							_mm512_min_ps(CellExitSteps(cx, _mm512_mul_ps(sx, cellScaleX), _mm512_cvtepi32_ps(cellX)),
+								CellExitSteps(cy, _mm512_mul_ps(sy, cellScaleY), _mm512_cvtepi32_ps(cellY))),
+							CellExitSteps(cz, _mm512_mul_ps(sz, cellScaleZ), _mm512_cvtepi32_ps(cellZ)));
+						__m512i skip = _mm512_add_epi32(_mm512_cvttps_epi32(Floor(_mm512_min_ps(exit, maxSkip))), one);
+						skip = _mm512_max_epi32(skip, one);
+						if (classification == Classification::PreIntegrated)
+						{
+							// see the AVX2 kernel: take the step out of an occupied cell
+							// and stop a step short of one
+							__m512 tl = _mm512_cvtepi32_ps(_mm512_add_epi32(step, skip));
+							__m512i landX = CellCoord(_mm512_mul_ps(_mm512_fmadd_ps(sx, tl, px), cellScaleX), lastCellX);
+							__m512i landY = CellCoord(_mm512_mul_ps(_mm512_fmadd_ps(sy, tl, py), cellScaleY), lastCellY);
+							__m512i landZ = CellCoord(_mm512_mul_ps(_mm512_fmadd_ps(sz, tl, pz), cellScaleZ), lastCellZ);
+							__m512i land = _mm512_add_epi32(_mm512_add_epi32(_mm512_mullo_epi32(landZ, cellSlicePitch), _mm512_mullo_epi32(landY, cellRowPitch)), landX);
+							__m512i landOccupied = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), empty, land, context.occupancy, 1);
+							skip = _mm512_mask_sub_epi32(skip, _mm512_test_epi32_mask(landOccupied, _mm512_set1_epi32(0xff)), skip, one);
+							__mmask16 stay = static_cast<__mmask16>((paired & lastOccupied) | _mm512_cmpeq_epi32_mask(skip, _mm512_setzero_si512()));
+							empty = static_cast<__mmask16>(empty & ~stay);
+						}
+						step = _mm512_mask_add_epi32(step, empty, step, skip);
+						jumped = empty != 0;
+
+						sample = static_cast<__mmask16>(active & ~empty);
+						if (sample == 0)
+						{
+							continue;
+						}
+					}
+				}
+				const __m512i index = step;
+				taken = _mm512_mask_add_epi32(taken, sample, taken, one);
+				step = _mm512_mask_add_epi32(step, sample, step, one);
+
+				__m512 fx = _mm512_fmsub_ps(vx, sizeX, half);
+				__m512 fy = _mm512_fmsub_ps(vy, sizeY, half);
+				__m512 fz = _mm512_fmsub_ps(vz, sizeZ, half);
+				__m512 flx = Floor(fx);
+				__m512 fly = Floor(fy);
+				__m512 flz = Floor(fz);
+				__m512 tx = _mm512_sub_ps(fx, flx);
+				__m512 ty = _mm512_sub_ps(fy, fly);
+				__m512 tz = _mm512_sub_ps(fz, flz);
+				__m512i x0 = _mm512_cvttps_epi32(flx);
+				__m512i y0 = _mm512_cvttps_epi32(fly);
+				__m512i z0 = _mm512_cvttps_epi32(flz);
+
+				__m512i idx = _mm512_add_epi32(_mm512_add_epi32(_mm512_mullo_epi32(z0, slicePitch), _mm512_mullo_epi32(y0, rowPitch)), x0);
+
+				__m512 c000, c100, c010, c110, c001, c101, c011, c111;
+				if (static_cast<__mmask16>((InRange(x0, interiorX) & InRange(y0, interiorY) & InRange(z0, interiorZ)) | ~sample) == 0xffff)
+				{
+					idx = _mm512_maskz_mov_epi32(sample, idx);
+					Fetch<T>::PairInterior(data, idx, c000, c100);
+					Fetch<T>::PairInterior(data, _mm512_add_epi32(idx, rowPitch), c010, c110);
+					Fetch<T>::PairInterior(data, _mm512_add_epi32(idx, slicePitch), c001, c101);
+					Fetch<T>::PairInterior(data, _mm512_add_epi32(_mm512_add_epi32(idx, slicePitch), rowPitch), c011, c111);
+				}
+				else
+				{
+					__mmask16 validX0 = InRange(x0, sizeXi);
+					__mmask16 validX1 = InRange(_mm512_add_epi32(x0, one), sizeXi);
+					__mmask16 validY0 = InRange(y0, sizeYi);
+					__mmask16 validY1 = InRange(_mm512_add_epi32(y0, one), sizeYi);
+					__mmask16 validZ0 = InRange(z0, sizeZi);
+					__mmask16 validZ1 = InRange(_mm512_add_epi32(z0, one), sizeZi);
+
+					if (borderEmpty && ((validX0 | validX1) & (validY0 | validY1) & (validZ0 | validZ1) & sample) == 0)
+					{
+						continue;
+					}
+
+					Fetch<T>::Pair(data, last, idx, validY0 & validZ0, validX0, validX1, c000, c100);
+					Fetch<T>::Pair(data, last, _mm512_add_epi32(idx, rowPitch), validY1 & validZ0, validX0, validX1, c010, c110);
+					Fetch<T>::Pair(data, last, _mm512_add_epi32(idx, slicePitch), validY0 & validZ1, validX0, validX1, c001, c101);
+					Fetch<T>::Pair(data, last, _mm512_add_epi32(_mm512_add_epi32(idx, slicePitch), rowPitch), validY1 & validZ1, validX0, validX1, c011, c111);
+				}
+
+				__m512 c00 = Lerp(c000, c100, tx);
+				__m512 c10 = Lerp(c010, c110, tx);
+				__m512 c01 = Lerp(c001, c101, tx);
+				__m512 c11 = Lerp(c011, c111, tx);
+				__m512 c0 = Lerp(c00, c10, ty);
+				__m512 c1 = Lerp(c01, c11, ty);
+				__m512 src = _mm512_fmadd_ps(Lerp(c0, c1, tz), windowScale, windowBias);
+				src = _mm512_min_ps(_mm512_max_ps(src, _mm512_setzero_ps()), ones);
+
+				if (classification != Classification::Identity)
+				{
+					__m512 rgba[4];
+					__m512i entry;
+					__m512 t0;
+					ToEntry(src, entry, t0);
+					if (classification == Classification::PreIntegrated)
+					{
+						__m512i front;
+						__m512 t1;
+						ToEntry(_mm512_mask_mov_ps(src, paired, lastValue), front, t1);
+						__m512i offset = _mm512_slli_epi32(_mm512_add_epi32(_mm512_mullo_epi32(entry, entryRow), front), 2);
+						__m512 row0[4], row1[4];
+						LerpEntries(preIntegrated, offset, t1, row0);
+						LerpEntries(preIntegrated + TransferTables::kSize * 4, offset, t1, row1);
+						for (int c = 0; c < 4; ++c)
+						{
+							rgba[c] = Lerp(row0[c], row1[c], t0);
+						}
+						lastStep = _mm512_mask_mov_epi32(lastStep, sample, index);
+						lastValue = _mm512_mask_mov_ps(lastValue, sample, src);
+						lastOccupied = static_cast<__mmask16>((lastOccupied & ~sample) | (occupiedCell & sample));
+					}
+					else
+					{
+						LerpEntries(lookup, _mm512_slli_epi32(entry, 2), t0, rgba);
+					}
+					__m512 weight = _mm512_maskz_sub_ps(sample, ones, result);
+					__m512 colourWeight = weight;
+					if (shading)
+					{
+						__mmask16 visible = _mm512_mask_cmp_ps_mask(sample, rgba[3], _mm512_setzero_ps(), _CMP_GT_OQ);
+						colourWeight = _mm512_mul_ps(weight, shader.ShadeLanes(visible, vx, vy, vz, lx, ly, lz));
+					}
+					red = _mm512_fmadd_ps(colourWeight, rgba[0], red);
+					green = _mm512_fmadd_ps(colourWeight, rgba[1], green);
+					blue = _mm512_fmadd_ps(colourWeight, rgba[2], blue);
+					result = _mm512_fmadd_ps(weight, rgba[3], result);
+				}
+				// Front to back blending: result += (1 - result.y) * src.y * src
+				else if (lod == 0)
+				{
+					__m512 weight = _mm512_maskz_mul_ps(sample, _mm512_sub_ps(ones, result), src);
+					if (shading)
+					{
+						__m512 lit = shader.ShadeLanes(_mm512_cmp_ps_mask(weight, _mm512_setzero_ps(), _CMP_GT_OQ), vx, vy, vz, lx, ly, lz);
+						red = _mm512_fmadd_ps(_mm512_mul_ps(weight, lit), src, red);
+					}
+					result = _mm512_fmadd_ps(weight, src, result);
+				}
+				else
+				{
+					// longer steps: the opacity src.y * src through CorrectOpacity
+					__m512 transparency = _mm512_fnmadd_ps(src, src, ones);
+					for (int l = 0; l < lod; ++l)
+					{
+						transparency = _mm512_mul_ps(transparency, transparency);
+					}
+					__m512 weight = _mm512_maskz_sub_ps(sample, ones, result);
+					__m512 opacity = _mm512_sub_ps(ones, transparency);
+					if (shading)
+					{
+						__m512 added = _mm512_mul_ps(weight, opacity);
+						__m512 lit = shader.ShadeLanes(_mm512_cmp_ps_mask(added, _mm512_setzero_ps(), _CMP_GT_OQ), vx, vy, vz, lx, ly, lz);
+						red = _mm512_fmadd_ps(added, lit, red);
+					}
+					result = _mm512_fmadd_ps(weight, opacity, result);
+				}
+			}
+
+			stepsTaken += static_cast<uint32_t>(_mm512_reduce_add_epi32(taken));
+
+			if (classification != Classification::Identity)
+			{
+				__mmask16 visible = _mm512_cmp_ps_mask(result, _mm512_setzero_ps(), _CMP_GT_OQ);
+				red = _mm512_maskz_div_ps(visible, red, result);
+				green = _mm512_maskz_div_ps(visible, green, result);
+				blue = _mm512_maskz_div_ps(visible, blue, result);
+			}
+			else
+			{
+				red = green = blue = shading ? red : result;
+			}
+			_mm512_storeu_ps(packet.red + base, red);
+			_mm512_storeu_ps(packet.green + base, green);
+			_mm512_storeu_ps(packet.blue + base, blue);
+			_mm512_storeu_ps(packet.alpha + base, result);
+		}
+
+		return stepsTaken;
+	}
+}
+
+uint64_t RayCastPacketAVX512(const RayCastContext& context, RayPacket& packet)
+{
+	return DispatchVoxelType(context.volume->GetDesc().type, [&](auto voxel) {
+		return MarchPacket<decltype(voxel)>(context, packet);
+	});
+}
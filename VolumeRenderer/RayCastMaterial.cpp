@@ -3,6 +3,16 @@
 RayCastMaterial::RayCastMaterial()
 {
 	m_WindowSizeCB = nullptr;
+	m_LevelOfDetailCB = nullptr;
+	m_VoxelWindowCB = nullptr;
+	m_TransferCB = nullptr;
+	m_EntryExitCB = nullptr;
+	m_StepsSavedBuffer = nullptr;
+	m_StepsSavedUAV = nullptr;
+	for (int i = 0; i < kStepsSavedLatency; ++i)
+	{
+		m_StepsSavedStaging[i] = nullptr;
+	}
 }
 RayCastMaterial::RayCastMaterial(const RayCastMaterial& other) {}
 RayCastMaterial::~RayCastMaterial() {};
@@ -58,6 +68,64 @@ HRESULT RayCastMaterial::Initialize(ID3D11Device* _device, HWND _hwn, int _windo
 	bd.CPUAccessFlags = 0;
 	BufferInitData.pSysMem = &m_windowCB;
 	result = _device->CreateBuffer(&bd, &BufferInitData, &m_WindowSizeCB);
+
+	// full resolution until the first frame picks a level
+	LevelOfDetailBuffer m_lodCB;
+	ZeroMemory(&m_lodCB, sizeof(m_lodCB));
+	m_lodCB.stepScale = 1.f;
+	bd.ByteWidth = sizeof(LevelOfDetailBuffer);
+	BufferInitData.pSysMem = &m_lodCB;
+	result = _device->CreateBuffer(&bd, &BufferInitData, &m_LevelOfDetailCB);
+
+	// the identity until a volume is drawn
+	VoxelWindowBuffer m_voxelWindowCB;
+	ZeroMemory(&m_voxelWindowCB, sizeof(m_voxelWindowCB));
+	m_voxelWindowCB.scale = 1.f;
+	bd.ByteWidth = sizeof(VoxelWindowBuffer);
+	BufferInitData.pSysMem = &m_voxelWindowCB;
+	result = _device->CreateBuffer(&bd, &BufferInitData, &m_VoxelWindowCB);
+
+	// RayCastPS's own classification until a transfer function is picked
+	TransferBuffer m_transferCB;
+	ZeroMemory(&m_transferCB, sizeof(m_transferCB));
+	bd.ByteWidth = sizeof(TransferBuffer);
+	BufferInitData.pSysMem = &m_transferCB;
+	result = _device->CreateBuffer(&bd, &BufferInitData, &m_TransferCB);
+
+	// analytic entry/exit, the inverse is filled in every frame
+	EntryExitBuffer m_entryExitCB;
+	ZeroMemory(&m_entryExitCB, sizeof(m_entryExitCB));
+	bd.ByteWidth = sizeof(EntryExitBuffer);
+	BufferInitData.pSysMem = &m_entryExitCB;
+	result = _device->CreateBuffer(&bd, &BufferInitData, &m_EntryExitCB);
+#pragma endregion
+
+#pragma region Steps Saved Counter
+	// single uint, raw so the shader can InterlockedAdd into it
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_DEFAULT;
+	bd.ByteWidth = sizeof(UINT);
+	bd.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+	bd.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+	result = _device->CreateBuffer(&bd, NULL, &m_StepsSavedBuffer);
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+	ZeroMemory(&uavDesc, sizeof(uavDesc));
+	uavDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	uavDesc.Buffer.FirstElement = 0;
+	uavDesc.Buffer.NumElements = 1;
+	uavDesc.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_RAW;
+	result = _device->CreateUnorderedAccessView(m_StepsSavedBuffer, &uavDesc, &m_StepsSavedUAV);
+
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_STAGING;
+	bd.ByteWidth = sizeof(UINT);
+	bd.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	for (int i = 0; i < kStepsSavedLatency; ++i)
+	{
+		result = _device->CreateBuffer(&bd, NULL, &m_StepsSavedStaging[i]);
+	}
 #pragma endregion
 
 	return result;
@@ -68,6 +136,44 @@ void RayCastMaterial::Shutdown()
 	m_WindowSizeCB->Release();
 	m_WindowSizeCB = nullptr;
 
+	if (m_LevelOfDetailCB != nullptr) {
+		m_LevelOfDetailCB->Release();
+		m_LevelOfDetailCB = nullptr;
+	}
+
+	if (m_VoxelWindowCB != nullptr) {
+		m_VoxelWindowCB->Release();
+		m_VoxelWindowCB = nullptr;
+	}
+
+	if (m_TransferCB != nullptr) {
+		m_TransferCB->Release();
+		m_TransferCB = nullptr;
+	}
+
+	if (m_EntryExitCB != nullptr) {
+		m_EntryExitCB->Release();
+		m_EntryExitCB = nullptr;
+	}
+
+	for (int i = 0; i < kStepsSavedLatency; ++i)
+	{
+		if (m_StepsSavedStaging[i] != nullptr) {
+			m_StepsSavedStaging[i]->Release();
+			m_StepsSavedStaging[i] = nullptr;
+		}
+	}
+
+	if (m_StepsSavedUAV != nullptr) {
+		m_StepsSavedUAV->Release();
+		m_StepsSavedUAV = nullptr;
+	}
+
+	if (m_StepsSavedBuffer != nullptr) {
+		m_StepsSavedBuffer->Release();
+		m_StepsSavedBuffer = nullptr;
+	}
+
 	Shader::Shutdown();
 }
 
@@ -13,6 +13,44 @@ protected:
 	};
 
 public:
+	// cbLevelOfDetail in raycast.hlsl
+	struct LevelOfDetailBuffer
+	{
+		float lod;
+		float stepScale;
+		float dummy[2];
+	};
+
+	// cbVoxelWindow in raycast.hlsl, the window/level applied to the sampled
+	// texture value: saturate(value * scale + bias)
+	struct VoxelWindowBuffer
+	{
+		float scale;
+		float bias;
+		float dummy[2];
+	};
+
+	// cbTransfer in raycast.hlsl, the Classification of the windowed value
+	// and whether the steps saved are counted
+	struct TransferBuffer
+	{
+		UINT classification;
+		UINT countSteps;
+		float dummy[2];
+	};
+
+	// cbEntryExit in raycast.hlsl, the EntryExit mode, the inverse of the
+	// WVP the analytic one un-projects the pixel with and the model space
+	// box its rays are clipped to
+	struct EntryExitBuffer
+	{
+		float invWVP[4][4];
+		float boxMin[3];
+		UINT entryExit;
+		float boxMax[3];
+		float dummy;
+	};
+
 	RayCastMaterial();
 	RayCastMaterial(const RayCastMaterial&);
 	~RayCastMaterial();
@@ -21,6 +59,21 @@ public:
 	virtual void Shutdown();
 
 	ID3D11Buffer* m_WindowSizeCB;
+	// mip level and step scale, updated every frame (PS b1)
+	ID3D11Buffer* m_LevelOfDetailCB;
+	// window/level of the volume drawn (PS b2)
+	ID3D11Buffer* m_VoxelWindowCB;
+	// classification of the volume drawn (PS b3)
+	ID3D11Buffer* m_TransferCB;
+	// how the rays find the volume, updated every frame (PS b4)
+	ID3D11Buffer* m_EntryExitCB;
+
+	// steps saved counter written by RayCastPS (u1), copied to a ring
+	// of staging buffers and read back a few frames later
+	static const int kStepsSavedLatency = 3;
+	ID3D11Buffer* m_StepsSavedBuffer;
+	ID3D11UnorderedAccessView* m_StepsSavedUAV;
+	ID3D11Buffer* m_StepsSavedStaging[kStepsSavedLatency];
 };
 
 #endif // VolumeRaycastShader_h__
@@ -1,5 +1,7 @@
 #include "System.h"
+#include <cstdio>
 #include <iostream>
+#include <vector>
 
 
 System::System()
@@ -82,6 +84,11 @@ void System::Run()
 			// Otherwise do the frame processing.
 			//Update time
 			m_Time->Tick();
+
+			// close the profiler's frame and start the next
+			Profiler::Instance()->Record(ProfileStage::Frame, m_Time->FrameTimeNs());
+			Profiler::Instance()->BeginFrame();
+			ShowProfile();
 			
 			if (!result)
 			{
@@ -101,7 +108,10 @@ bool System::Frame()
 	bool result;
 
 	// Do the input frame processing.
-	result = InputManager::Instance()->Frame();
+	{
+		ProfileZone zone(ProfileStage::Input);
+		result = InputManager::Instance()->Frame();
+	}
 	if (!result)
 	{
 		return false;
@@ -123,6 +133,33 @@ bool System::Frame()
 	return true;
 }
 
+//Puts the frame time and each stage's mean over the last second in the
+//title, about once a second
+void System::ShowProfile()
+{
+	if (m_Time->PlayTime() - m_profileShownTime < 1.0f)
+	{
+		return;
+	}
+	m_profileShownTime = m_Time->PlayTime();
+
+	std::vector<ProfileStats> stats;
+	Profiler::Instance()->GetStats(stats, 60);
+	const ProfileStats& frame = stats[static_cast<int>(ProfileStage::Frame)];
+	if (frame.frames == 0)
+	{
+		return;
+	}
+
+	wchar_t title[256];
+	int length = swprintf_s(title, L"%s - %.2f ms (%.0f fps, p95 %.2f ms)", m_applicationName, frame.meanMs, 1000.0 / frame.meanMs, frame.p95Ms);
+	for (int i = static_cast<int>(ProfileStage::Input); i < static_cast<int>(ProfileStage::Count) && length > 0; ++i)
+	{
+		length += swprintf_s(title + length, 256 - length, L" | %S %.2f", GetProfileStageName(static_cast<ProfileStage>(i)), stats[i].meanMs);
+	}
+	SetWindowTextW(m_hwnd, title);
+}
+
 //Where windows system messages are directed
 LRESULT CALLBACK System::MessageHandler(HWND hwnd, UINT umsg, WPARAM wparam, LPARAM lparam)
 {
@@ -13,6 +13,7 @@
 #include <windows.h>
 #include "Graphics.h"
 #include "InputManager.h"
+#include "Profiler.h"
 #include "Time.h"
 
 class System
@@ -38,6 +39,7 @@ public:
 
 private:
 	bool Frame();
+	void ShowProfile();
 	void InitializeWindows(int&, int&);
 	void ShutdownWindows();
 
@@ -48,6 +50,7 @@ private:
 
 	Graphics* m_Graphics;	
 	Time* m_Time;
+	float m_profileShownTime = 0.0f;
 };
 static LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
 
@@ -0,0 +1,211 @@
+#include "TileScheduler.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <deque>
+#include <memory>
+
+namespace
+{
+	struct TileQueue
+	{
+		std::mutex mutex;
+		std::deque<int> tiles;
+	};
+}
+
+TileScheduler::TileScheduler()
+{
+	m_workers = 0;
+	m_stealing = true;
+	m_costHints = true;
+	m_wallMs = 0.0;
+	m_work = nullptr;
+	m_run = 0;
+	m_runWorkers = 0;
+	m_running = 0;
+	m_stop = false;
+}
+
+TileScheduler::~TileScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (std::thread& thread : m_threads)
+	{
+		thread.join();
+	}
+}
+
+int TileScheduler::GetWorkerCount() const
+{
+	return m_workers > 0 ? m_workers : ::GetWorkerCount();
+}
+
+void TileScheduler::Split(const int count, const int workers, std::vector<int>& begins) const
+{
+	begins.assign(workers + 1, count);
+	begins[0] = 0;
+	if (!m_costHints || static_cast<int>(m_tileMs.size()) != count)
+	{
+		for (int i = 1; i < workers; ++i)
+		{
+			begins[i] = static_cast<int>(static_cast<long long>(count) * i / workers);
+		}
+		return;
+	}
+
+	// equal shares of the hinted cost; tiles that took no time still count a
+	// little, so no run is all of them
+	double total = 0.0;
+	for (double ms : m_tileMs)
+	{
+		total += ms;
+	}
+	const double floor = std::max(total, 1e-6) * 0.01 / count;
+	total += floor * count;
+
+	double sum = 0.0;
+	int worker = 1;
+	for (int tile = 0; tile < count && worker < workers; ++tile)
+	{
+		sum += m_tileMs[tile] + floor;
+		while (worker < workers && sum >= total * worker / workers)
+		{
+			begins[worker++] = tile + 1;
+		}
+	}
+}
+
+void TileScheduler::Run(const int count, const std::function<void(int)>& func)
+{
+	if (count <= 0)
+	{
+		m_tileMs.clear();
+		m_workerStats.clear();
+		m_wallMs = 0.0;
+		return;
+	}
+
+	// the pool grows before the clock starts, so creating threads is never
+	// counted as a run's time
+	const int workers = std::min(GetWorkerCount(), count);
+	for (int i = static_cast<int>(m_threads.size()) + 1; i < workers; ++i)
+	{
+		m_threads.emplace_back(&TileScheduler::WorkerMain, this, i);
+	}
+
+	const uint64_t start = GetClockNs();
+
+	std::vector<std::unique_ptr<TileQueue>> queues;
+	std::vector<int> begins;
+	Split(count, workers, begins);
+	for (int i = 0; i < workers; ++i)
+	{
+		queues.emplace_back(new TileQueue());
+		for (int tile = begins[i]; tile < begins[i + 1]; ++tile)
+		{
+			queues[i]->tiles.push_back(tile);
+		}
+	}
+
+	m_tileMs.assign(count, 0.0);
+	m_workerStats.assign(workers, WorkerStats());
+
+	auto work = [&](const int worker) {
+		WorkerStats& stats = m_workerStats[worker];
+		for (;;)
+		{
+			// own queue from the front
+			int tile = -1;
+			{
+				std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+				if (!queues[worker]->tiles.empty())
+				{
+					tile = queues[worker]->tiles.front();
+					queues[worker]->tiles.pop_front();
+				}
+			}
+
+			// then the others from the back, starting with the next worker
+			for (int k = 1; tile < 0 && m_stealing && k < workers; ++k)
+			{
+				TileQueue& victim = *queues[(worker + k) % workers];
+				std::lock_guard<std::mutex> lock(victim.mutex);
+				if (!victim.tiles.empty())
+				{
+					tile = victim.tiles.back();
+					victim.tiles.pop_back();
+					++stats.stolen;
+				}
+			}
+
+			// no tiles are ever added, so empty queues stay empty
+			if (tile < 0)
+			{
+				return;
+			}
+
+			const uint64_t begin = GetClockNs();
+			func(tile);
+			const double ms = NsToMs(GetClockNs() - begin);
+			m_tileMs[tile] = ms;
+			stats.busyMs += ms;
+			++stats.tiles;
+		}
+	};
+
+	// the calling thread is worker 0, the pool's threads the rest
+	const std::function<void(int)> job = work;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_work = &job;
+		m_runWorkers = workers;
+		m_running = workers - 1;
+		++m_run;
+	}
+	m_wake.notify_all();
+	work(0);
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_done.wait(lock, [this] { return m_running == 0; });
+		m_work = nullptr;
+	}
+
+	m_wallMs = NsToMs(GetClockNs() - start);
+	for (WorkerStats& stats : m_workerStats)
+	{
+		stats.idleMs = std::max(m_wallMs - stats.busyMs, 0.0);
+	}
+}
+
+void TileScheduler::WorkerMain(const int worker)
+{
+	// the first run it's part of is the one after it was started
+	uint64_t run = 0;
+	for (;;)
+	{
+		const std::function<void(int)>* work;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [&] { return m_stop || (m_run != run && worker < m_runWorkers); });
+			if (m_stop)
+			{
+				return;
+			}
+			run = m_run;
+			work = m_work;
+		}
+
+		(*work)(worker);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (--m_running == 0)
+		{
+			m_done.notify_one();
+		}
+	}
+}
@@ -0,0 +1,105 @@
+/// <summary>
+/// TileScheduler.h
+///
+/// About:
+/// Runs the tiles of a frame across all cores with work
+/// stealing. Rays differ wildly in cost (air is skipped,
+/// bone terminates early, grazing rays run long), so equal
+/// bands of rows leave the workers that drew the cheap ones
+/// idle. Each worker gets a contiguous run of tiles in its
+/// own queue, takes them from the front and, once it runs
+/// dry, steals from the back of another worker's queue, so
+/// the tiles moved are the ones furthest from where their
+/// owner is working.
+///
+/// Runs are split by cost rather than count: every tile's
+/// time is measured, and the next run with the same number
+/// of tiles uses those times as hints, so each worker starts
+/// with about the same amount of work. Frames change little
+/// from one to the next, stealing picks up the rest.
+///
+/// Queues are guarded by a mutex each. Tiles take far longer
+/// than a lock, which is only ever contended while stealing.
+///
+/// The worker threads are started on first use and kept for
+/// later runs, so neither a frame's time nor its workers'
+/// idle time includes creating threads. The calling thread
+/// is always worker 0.
+/// </summary>
+#ifndef TileScheduler_h__
+#define TileScheduler_h__
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TileScheduler
+{
+public:
+	struct WorkerStats
+	{
+		double busyMs;		// running tiles
+		double idleMs;		// the rest of the run: waking up, stealing, waiting for the others
+		int tiles;			// tiles run
+		int stolen;			// of those, taken from another worker's queue
+	};
+
+	TileScheduler();
+	// stops and joins the worker threads
+	~TileScheduler();
+
+	// threads per run, 0 (the default) for GetWorkerCount(); threads beyond
+	// it started for an earlier run wait out the runs they aren't part of
+	void SetWorkerCount(const int workers) { m_workers = workers; }
+	int GetWorkerCount() const;
+	// steal from other workers once out of tiles, on by default; off each
+	// worker only runs its own
+	void SetStealing(const bool enable) { m_stealing = enable; }
+	bool GetStealing() const { return m_stealing; }
+	// split the tiles by last run's times rather than evenly, on by default
+	void SetCostHints(const bool enable) { m_costHints = enable; }
+	bool GetCostHints() const { return m_costHints; }
+
+	// Runs func(tile) for every tile in [0, count), blocks until all are done.
+	void Run(const int count, const std::function<void(int)>& func);
+
+	// of the last run, per worker
+	const std::vector<WorkerStats>& GetWorkerStats() const { return m_workerStats; }
+	double GetWallMs() const { return m_wallMs; }
+	// of the last run, per tile; the hints for the next
+	const std::vector<double>& GetTileMs() const { return m_tileMs; }
+
+private:
+	// owns the threads
+	TileScheduler(const TileScheduler&);
+	TileScheduler& operator=(const TileScheduler&);
+
+	// first tile of each worker's run, and the end
+	void Split(const int count, const int workers, std::vector<int>& begins) const;
+	// worker's thread: runs its part of every run it's part of until stopped
+	void WorkerMain(const int worker);
+
+	int m_workers;
+	bool m_stealing;
+	bool m_costHints;
+	std::vector<WorkerStats> m_workerStats;
+	std::vector<double> m_tileMs;
+	double m_wallMs;
+
+	// m_threads[i] is worker i + 1. Run bumps m_run to start one: workers
+	// below m_runWorkers call m_work, the last to finish wakes Run.
+	std::vector<std::thread> m_threads;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	const std::function<void(int)>* m_work;
+	uint64_t m_run;
+	int m_runWorkers;
+	int m_running;
+	bool m_stop;
+};
+
+#endif // TileScheduler_h__
@@ -1,30 +1,45 @@
 #include "Time.h"
+#include "Profiler.h"
+#include <algorithm>
 
-Time::Time() :m_PlayTime(0)
+Time::Time() :m_FrameTimeNs(0)
 {
 	m_DeltaTime = 0.0f;
+	m_StartTime = GetClockNs();
+	m_LastTime = m_StartTime;
 }
 Time::~Time()
 {
 }
 
 //Tick works out the current Delta Time and Play Time for the application 
+//from the high resolution clock (GetTickCount only moves every 10-16ms)
 void Time::Tick()
 {
-	DWORD currentTime = GetTickCount();
-	m_DeltaTime = min((float)(currentTime - m_PlayTime) / 1000.0f, 0.1f);
-	m_PlayTime = currentTime;
+	uint64_t currentTime = GetClockNs();
+	m_FrameTimeNs = currentTime - m_LastTime;
+	m_DeltaTime = std::min(static_cast<float>(m_FrameTimeNs * 1.0e-9), 0.1f);
+	m_LastTime = currentTime;
 }
 
-//Returns the elapsed time between each frame
+//Returns the elapsed time between each frame, capped at 0.1s so a stall
+//doesn't make the animation jump
 float Time::DeltaTime()const
 {
 	return m_DeltaTime;
 }
-//returns the current total application play time
+//Returns the real elapsed time between each frame in seconds, uncapped
+float Time::FrameTime()const
+{
+	return static_cast<float>(m_FrameTimeNs * 1.0e-9);
+}
+//and in nanoseconds
+uint64_t Time::FrameTimeNs()const
+{
+	return m_FrameTimeNs;
+}
+//returns the total application play time in seconds
 float Time::PlayTime()const
 {
-	return (float)m_PlayTime;
+	return static_cast<float>((m_LastTime - m_StartTime) * 1.0e-9);
 }
-
-
@@ -1,17 +1,21 @@
 #ifndef Time_h__
 #define Time_h__
-#include <windows.h>
+#include <cstdint>
 class Time
 {
 public:
 	Time();
 	~Time();
 	float DeltaTime()const;
+	float FrameTime()const;
+	uint64_t FrameTimeNs()const;
 	float PlayTime()const;
 
 	void Tick();
 private:
 	float m_DeltaTime;
-	DWORD m_PlayTime;
+	uint64_t m_FrameTimeNs;
+	uint64_t m_StartTime;
+	uint64_t m_LastTime;
 };
 #endif // Time_h__
@@ -0,0 +1,252 @@
+#include "TransferFunction.h"
+#include <cmath>
+#include <cstdlib>
+
+namespace
+{
+	// opacities are clamped below 1 so the extinction stays finite
+	const float kMaxOpacity = 0.9999f;
+
+	float GetExtinction(const float alpha)
+	{
+		return -std::log(1.f - std::min(std::max(alpha, 0.f), kMaxOpacity));
+	}
+}
+
+const char* GetClassificationName(const Classification classification)
+{
+	switch (classification)
+	{
+	case Classification::PostClassified:
+		return "post-classified";
+	case Classification::PreIntegrated:
+		return "pre-integrated";
+	default:
+		return "identity";
+	}
+}
+
+bool ParseClassification(const std::string& text, Classification& classification)
+{
+	const Classification all[] = { Classification::Identity, Classification::PostClassified, Classification::PreIntegrated };
+	for (Classification c : all)
+	{
+		if (text == GetClassificationName(c))
+		{
+			classification = c;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ParseTransferFunction(const std::string& text, TransferFunction& function)
+{
+	std::vector<TransferPoint> points;
+	const char* p = text.c_str();
+	while (*p != '\0')
+	{
+		// value:r,g,b,a then ; or the end
+		float channels[5];
+		const char separators[5] = { ':', ',', ',', ',', ';' };
+		for (int i = 0; i < 5; ++i)
+		{
+			char* end = nullptr;
+			channels[i] = strtof(p, &end);
+			if (end == p || !(channels[i] >= 0.f && channels[i] <= 1.f) || (*end != separators[i] && (i < 4 || *end != '\0')))
+			{
+				return false;
+			}
+			p = *end != '\0' ? end + 1 : end;
+		}
+		TransferPoint point = { channels[0], channels[1], channels[2], channels[3], channels[4] };
+		points.push_back(point);
+	}
+	if (points.empty())
+	{
+		return false;
+	}
+	function.SetPoints(points);
+	return true;
+}
+
+TransferFunction::TransferFunction()
+{
+	TransferPoint black = { 0.f, 0.f, 0.f, 0.f, 0.f };
+	TransferPoint white = { 1.f, 1.f, 1.f, 1.f, 1.f };
+	SetPoints({ black, white });
+}
+
+TransferFunction::TransferFunction(const std::vector<TransferPoint>& points)
+{
+	SetPoints(points);
+}
+
+void TransferFunction::SetPoints(const std::vector<TransferPoint>& points)
+{
+	m_points = points;
+	std::stable_sort(m_points.begin(), m_points.end(), [](const TransferPoint& a, const TransferPoint& b) {
+		return a.value < b.value;
+	});
+	Sample();
+}
+
+void TransferFunction::GetOpacity(float opacity[kSize]) const
+{
+	for (int i = 0; i < kSize; ++i)
+	{
+		opacity[i] = m_table[i * 4 + 3];
+	}
+}
+
+void TransferFunction::Sample()
+{
+	m_table.assign(kSize * 4, 0.f);
+	if (m_points.empty())
+	{
+		return;
+	}
+
+	size_t next = 0;
+	for (int i = 0; i < kSize; ++i)
+	{
+		float value = static_cast<float>(i) / (kSize - 1);
+		while (next < m_points.size() && m_points[next].value < value)
+		{
+			++next;
+		}
+
+		// the points either side of value, the same one past the ends
+		const TransferPoint& b = m_points[std::min(next, m_points.size() - 1)];
+		const TransferPoint& a = m_points[next > 0 ? next - 1 : 0];
+		float t = b.value > a.value ? (value - a.value) / (b.value - a.value) : 1.f;
+		t = std::min(std::max(t, 0.f), 1.f);
+
+		float* entry = &m_table[i * 4];
+		entry[0] = a.red + (b.red - a.red) * t;
+		entry[1] = a.green + (b.green - a.green) * t;
+		entry[2] = a.blue + (b.blue - a.blue) * t;
+		entry[3] = a.alpha + (b.alpha - a.alpha) * t;
+	}
+}
+
+TransferTables::TransferTables()
+{
+	m_stepScale = 0.f;
+	m_updated = 0;
+}
+
+bool TransferTables::Update(const TransferFunction& function, const float stepScale)
+{
+	// the range of entries that differ from the ones the tables were built from
+	int lo = kSize;
+	int hi = -1;
+	const bool rebuild = !IsBuilt() || stepScale != m_stepScale;
+	for (int i = 0; i < kSize; ++i)
+	{
+		const float* entry = function.GetEntry(i);
+		if (rebuild || !std::equal(entry, entry + 4, &m_source[i * 4]))
+		{
+			lo = std::min(lo, i);
+			hi = i;
+		}
+	}
+
+	m_updated = 0;
+	if (hi < lo)
+	{
+		return false;
+	}
+
+	m_source.assign(function.GetEntry(0), function.GetEntry(0) + kSize * 4);
+	m_stepScale = stepScale;
+	m_lookup.resize(kSize * 4);
+	m_preIntegrated.resize(kSize * kSize * 4);
+	UpdateLookup(lo, hi);
+	UpdatePreIntegrated(lo, hi);
+	return true;
+}
+
+void TransferTables::UpdateLookup(const int lo, const int hi)
+{
+	// a step of stepScale full resolution steps: alpha = 1 - (1 - a)^stepScale
+	for (int i = lo; i <= hi; ++i)
+	{
+		const float* source = &m_source[i * 4];
+		float* entry = &m_lookup[i * 4];
+		float alpha = 1.f - std::exp(-m_stepScale * GetExtinction(source[3]));
+		entry[0] = source[0] * alpha;
+		entry[1] = source[1] * alpha;
+		entry[2] = source[2] * alpha;
+		entry[3] = alpha;
+		++m_updated;
+	}
+}
+
+void TransferTables::UpdatePreIntegrated(const int lo, const int hi)
+{
+	// prefix integrals over the entries (trapezoids) of the extinction and
+	// of the extinction weighted colour
+	std::vector<double> extinction(kSize);
+	std::vector<double> integral(kSize * 4, 0.0);
+	for (int i = 0; i < kSize; ++i)
+	{
+		extinction[i] = GetExtinction(m_source[i * 4 + 3]);
+	}
+	for (int i = 1; i < kSize; ++i)
+	{
+		const double e0 = extinction[i - 1];
+		const double e1 = extinction[i];
+		for (int c = 0; c < 3; ++c)
+		{
+			integral[i * 4 + c] = integral[(i - 1) * 4 + c] + 0.5 * (m_source[(i - 1) * 4 + c] * e0 + m_source[i * 4 + c] * e1);
+		}
+		integral[i * 4 + 3] = integral[(i - 1) * 4 + 3] + 0.5 * (e0 + e1);
+	}
+
+	// only segments that span a changed entry change
+	for (int back = 0; back < kSize; ++back)
+	{
+		for (int front = 0; front < kSize; ++front)
+		{
+			const int first = std::min(front, back);
+			const int last = std::max(front, back);
+			if (last < lo || first > hi)
+			{
+				continue;
+			}
+
+			// The segment's optical depth is its length times the mean extinction
+			// over the values it passes through. Its colour is the extinction
+			// weighted mean, times the opacity: self-attenuation within the
+			// segment is left out, as in Engel et al., but scaling by the
+			// opacity rather than the depth keeps the colour from exceeding it.
+			float* entry = &m_preIntegrated[(back * kSize + front) * 4];
+			double depth, colour[3];
+			if (first == last)
+			{
+				depth = extinction[first];
+				for (int c = 0; c < 3; ++c)
+				{
+					colour[c] = m_source[first * 4 + c];
+				}
+			}
+			else
+			{
+				const double sum = integral[last * 4 + 3] - integral[first * 4 + 3];
+				depth = sum / (last - first);
+				for (int c = 0; c < 3; ++c)
+				{
+					colour[c] = sum > 0.0 ? (integral[last * 4 + c] - integral[first * 4 + c]) / sum : 0.0;
+				}
+			}
+
+			const double alpha = 1.0 - std::exp(-m_stepScale * depth);
+			entry[0] = static_cast<float>(colour[0] * alpha);
+			entry[1] = static_cast<float>(colour[1] * alpha);
+			entry[2] = static_cast<float>(colour[2] * alpha);
+			entry[3] = static_cast<float>(alpha);
+			++m_updated;
+		}
+	}
+}
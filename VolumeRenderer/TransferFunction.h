@@ -0,0 +1,161 @@
+/// <summary>
+/// TransferFunction.h
+///
+/// About:
+/// Maps the windowed voxel value onto colour and opacity.
+/// The function is given as control points, linear in
+/// between, and sampled into a 1D table of kSize entries.
+///
+/// TransferTables turns that table into what the ray
+/// marchers look up, for a given step length: the 1D table
+/// with the opacity corrected for the step and the colour
+/// premultiplied (post-classification, one lookup per
+/// sample), and the pre-integrated 2D table (Engel et al.
+/// 2001) holding the colour and opacity of a whole ray
+/// segment whose value goes linearly from a front to a back
+/// sample. Looking up segments rather than samples catches
+/// the thin features a sharp transfer function produces
+/// between two samples, so the step can grow without the
+/// slicing artifacts post-classification gets.
+///
+/// The segment table comes from prefix integrals of the
+/// extinction and the extinction weighted colour, so an
+/// entry costs O(1). When the function changes only the
+/// entries whose segment spans a changed value are redone.
+/// </summary>
+#ifndef TransferFunction_h__
+#define TransferFunction_h__
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class Classification
+{
+	Identity,		// RayCastPS's own: the windowed value is the opacity, the colour white
+	PostClassified,	// the 1D table per sample
+	PreIntegrated	// the 2D table per pair of samples
+};
+
+const char* GetClassificationName(const Classification classification);
+// the inverse of GetClassificationName
+bool ParseClassification(const std::string& text, Classification& classification);
+
+struct TransferPoint
+{
+	float value;	// windowed voxel value, [0,1]
+	float red;
+	float green;
+	float blue;
+	float alpha;	// opacity of one full resolution step (g_fStepSize)
+};
+
+class TransferFunction;
+
+// Parses control points "value:r,g,b,a;value:r,g,b,a;...", e.g.
+// "0:0,0,0,0;0.3:1,0.5,0.2,0.4;1:1,1,1,0.9"; at least one point, all in [0,1].
+bool ParseTransferFunction(const std::string& text, TransferFunction& function);
+
+class TransferFunction
+{
+public:
+	static const int kSize = 256;
+
+	// a grey ramp, colour and opacity rising with the value
+	TransferFunction();
+	explicit TransferFunction(const std::vector<TransferPoint>& points);
+
+	// sorted by value; flat past the first and last point
+	void SetPoints(const std::vector<TransferPoint>& points);
+	const std::vector<TransferPoint>& GetPoints() const { return m_points; }
+
+	// RGBA of entry i, at value i / (kSize - 1), straight alpha
+	const float* GetEntry(const int i) const { return &m_table[i * 4]; }
+	// the opacity of each entry, for MacrocellGrid::Classify
+	void GetOpacity(float opacity[kSize]) const;
+
+private:
+	void Sample();
+
+	std::vector<TransferPoint> m_points;
+	std::vector<float> m_table;
+};
+
+class TransferTables
+{
+public:
+	static const int kSize = TransferFunction::kSize;
+
+	TransferTables();
+
+	// Brings the tables up to date with function for steps of stepScale
+	// full resolution steps. Only the entries affected by what changed since
+	// the last update are recomputed, all of them when the step changes.
+	// Returns false if the tables were already up to date.
+	bool Update(const TransferFunction& function, const float stepScale);
+
+	bool IsBuilt() const { return !m_lookup.empty(); }
+	float GetStepScale() const { return m_stepScale; }
+	// 1D and 2D entries the last Update recomputed
+	int GetUpdatedEntries() const { return m_updated; }
+
+	// kSize RGBA entries, premultiplied and corrected for the step
+	const float* GetLookup() const { return m_lookup.data(); }
+	// kSize x kSize RGBA entries, premultiplied, row back * kSize + front
+	const float* GetPreIntegrated() const { return m_preIntegrated.data(); }
+
+	// linearly filtered 1D entry at windowed value s
+	void Lookup(const float s, float rgba[4]) const
+	{
+		int i;
+		float t;
+		ToEntry(s, i, t);
+		const float* e0 = &m_lookup[i * 4];
+		const float* e1 = e0 + 4;
+		for (int c = 0; c < 4; ++c)
+		{
+			rgba[c] = e0[c] + (e1[c] - e0[c]) * t;
+		}
+	}
+
+	// bilinearly filtered segment from windowed value front to back
+	void LookupPreIntegrated(const float front, const float back, float rgba[4]) const
+	{
+		int f, b;
+		float tf, tb;
+		ToEntry(front, f, tf);
+		ToEntry(back, b, tb);
+		const float* e00 = &m_preIntegrated[(b * kSize + f) * 4];
+		const float* e10 = e00 + 4;
+		const float* e01 = e00 + kSize * 4;
+		const float* e11 = e01 + 4;
+		for (int c = 0; c < 4; ++c)
+		{
+			float v0 = e00[c] + (e10[c] - e00[c]) * tf;
+			float v1 = e01[c] + (e11[c] - e01[c]) * tf;
+			rgba[c] = v0 + (v1 - v0) * tb;
+		}
+	}
+
+	// entry i and the weight of entry i + 1 for s in [0,1]
+	static void ToEntry(const float s, int& i, float& t)
+	{
+		float x = s * (kSize - 1);
+		i = std::min(static_cast<int>(x), kSize - 2);
+		t = x - i;
+	}
+
+private:
+	void UpdateLookup(const int lo, const int hi);
+	void UpdatePreIntegrated(const int lo, const int hi);
+
+	float m_stepScale;
+	int m_updated;
+	// the function's table the current tables were built from
+	std::vector<float> m_source;
+	std::vector<float> m_lookup;
+	std::vector<float> m_preIntegrated;
+};
+
+#endif // TransferFunction_h__
@@ -0,0 +1,423 @@
+#include "Transport.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+Transport::Transport()
+{
+	m_bytesSent = 0;
+}
+
+std::string Transport::GetError() const
+{
+	std::lock_guard<std::mutex> lock(m_errorMutex);
+	return m_error;
+}
+
+void Transport::SetError(const std::string& error)
+{
+	std::lock_guard<std::mutex> lock(m_errorMutex);
+	m_error = error;
+}
+
+bool Transport::Exchange(const int peer, const void* sendData, const size_t sendBytes, void* receiveData, const size_t receiveBytes)
+{
+	bool sent = false;
+	std::thread sender([&]() { sent = Send(peer, sendData, sendBytes); });
+	bool received = Receive(peer, receiveData, receiveBytes);
+	sender.join();
+	return sent && received;
+}
+
+//---------------------------------------------------------------------------
+// LocalTransport
+
+namespace
+{
+	// one direction between two ranks
+	struct Channel
+	{
+		std::mutex mutex;
+		std::condition_variable ready;
+		std::deque<std::vector<uint8_t>> messages;
+		// bytes of the front message already received
+		size_t offset;
+
+		Channel() : offset(0) {}
+	};
+}
+
+struct LocalTransport::Group
+{
+	int size;
+	// from * size + to
+	std::vector<std::unique_ptr<Channel>> channels;
+};
+
+std::vector<std::unique_ptr<Transport>> LocalTransport::CreateGroup(const int size)
+{
+	std::shared_ptr<Group> group = std::make_shared<Group>();
+	group->size = std::max(size, 0);
+	for (int i = 0; i < group->size * group->size; ++i)
+	{
+		group->channels.emplace_back(new Channel());
+	}
+
+	std::vector<std::unique_ptr<Transport>> transports;
+	for (int rank = 0; rank < group->size; ++rank)
+	{
+		transports.emplace_back(new LocalTransport(group, rank));
+	}
+	return transports;
+}
+
+LocalTransport::LocalTransport(const std::shared_ptr<Group>& group, const int rank)
+	: m_group(group), m_rank(rank)
+{
+}
+
+int LocalTransport::GetSize() const
+{
+	return m_group->size;
+}
+
+bool LocalTransport::Send(const int peer, const void* data, const size_t bytes)
+{
+	if (peer < 0 || peer >= m_group->size || peer == m_rank)
+	{
+		SetError("Invalid peer " + std::to_string(peer));
+		return false;
+	}
+
+	Channel& channel = *m_group->channels[m_rank * m_group->size + peer];
+	const uint8_t* begin = static_cast<const uint8_t*>(data);
+	std::vector<uint8_t> message(begin, begin + bytes);
+	{
+		std::lock_guard<std::mutex> lock(channel.mutex);
+		channel.messages.push_back(std::move(message));
+	}
+	channel.ready.notify_one();
+	m_bytesSent += bytes;
+	return true;
+}
+
+bool LocalTransport::Receive(const int peer, void* data, const size_t bytes)
+{
+	if (peer < 0 || peer >= m_group->size || peer == m_rank)
+	{
+		SetError("Invalid peer " + std::to_string(peer));
+		return false;
+	}
+
+	// a stream: the bytes asked for may span messages or end inside one
+	Channel& channel = *m_group->channels[peer * m_group->size + m_rank];
+	uint8_t* out = static_cast<uint8_t*>(data);
+	size_t received = 0;
+	std::unique_lock<std::mutex> lock(channel.mutex);
+	while (received < bytes)
+	{
+		channel.ready.wait(lock, [&]() { return !channel.messages.empty(); });
+		std::vector<uint8_t>& message = channel.messages.front();
+		size_t count = std::min(bytes - received, message.size() - channel.offset);
+		memcpy(out + received, message.data() + channel.offset, count);
+		received += count;
+		channel.offset += count;
+		if (channel.offset == message.size())
+		{
+			channel.messages.pop_front();
+			channel.offset = 0;
+		}
+	}
+	return true;
+}
+
+bool LocalTransport::Exchange(const int peer, const void* sendData, const size_t sendBytes, void* receiveData, const size_t receiveBytes)
+{
+	return Send(peer, sendData, sendBytes) && Receive(peer, receiveData, receiveBytes);
+}
+
+//---------------------------------------------------------------------------
+// SocketTransport
+
+namespace
+{
+#ifdef _WIN32
+	const SocketHandle kInvalidSocket = INVALID_SOCKET;
+
+	void CloseSocket(const SocketHandle socket)
+	{
+		closesocket(socket);
+	}
+
+	std::string GetSocketError()
+	{
+		return "socket error " + std::to_string(WSAGetLastError());
+	}
+#else
+	const SocketHandle kInvalidSocket = -1;
+
+	void CloseSocket(const SocketHandle socket)
+	{
+		close(socket);
+	}
+
+	std::string GetSocketError()
+	{
+		return strerror(errno);
+	}
+#endif
+
+	sockaddr_in GetLoopbackAddress(const int port)
+	{
+		sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		address.sin_port = htons(static_cast<uint16_t>(port));
+		return address;
+	}
+
+	// partial images go out as soon as they're written, not when a segment fills
+	void SetNoDelay(const SocketHandle socket)
+	{
+		int enable = 1;
+		setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&enable), sizeof(enable));
+	}
+
+	bool SendAll(const SocketHandle socket, const void* data, const size_t bytes)
+	{
+		const char* p = static_cast<const char*>(data);
+		size_t left = bytes;
+		while (left > 0)
+		{
+			int chunk = static_cast<int>(std::min(left, static_cast<size_t>(1) << 30));
+#ifdef _WIN32
+			int sent = send(socket, p, chunk, 0);
+#else
+			int sent = static_cast<int>(send(socket, p, chunk, MSG_NOSIGNAL));
+#endif
+			if (sent <= 0)
+			{
+				return false;
+			}
+			p += sent;
+			left -= sent;
+		}
+		return true;
+	}
+
+	bool ReceiveAll(const SocketHandle socket, void* data, const size_t bytes)
+	{
+		char* p = static_cast<char*>(data);
+		size_t left = bytes;
+		while (left > 0)
+		{
+			int chunk = static_cast<int>(std::min(left, static_cast<size_t>(1) << 30));
+			int received = static_cast<int>(recv(socket, p, chunk, 0));
+			if (received <= 0)
+			{
+				return false;
+			}
+			p += received;
+			left -= received;
+		}
+		return true;
+	}
+}
+
+SocketTransport::SocketTransport()
+{
+	m_rank = 0;
+	m_size = 0;
+	m_started = false;
+}
+
+SocketTransport::~SocketTransport()
+{
+	Close();
+}
+
+bool SocketTransport::Connect(const int rank, const int size, const int basePort, const int timeoutMs)
+{
+	Close();
+	if (size <= 0 || rank < 0 || rank >= size || basePort <= 0 || basePort + size > 65536)
+	{
+		SetError("Invalid rank, size or port");
+		return false;
+	}
+
+#ifdef _WIN32
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+	{
+		SetError("WSAStartup failed");
+		return false;
+	}
+	m_started = true;
+#endif
+	m_rank = rank;
+	m_size = size;
+	m_sockets.assign(size, kInvalidSocket);
+
+	// listen first, so the ranks above can connect while this one is still
+	// connecting to the ones below
+	SocketHandle listener = kInvalidSocket;
+	if (rank < size - 1)
+	{
+		listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		int reuse = 1;
+		setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+		sockaddr_in address = GetLoopbackAddress(basePort + rank);
+		if (listener == kInvalidSocket || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, size) != 0)
+		{
+			SetError("Can't listen on port " + std::to_string(basePort + rank) + ": " + GetSocketError());
+			if (listener != kInvalidSocket)
+			{
+				CloseSocket(listener);
+			}
+			Close();
+			return false;
+		}
+	}
+
+	// each connection starts with the connecting rank
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+	for (int peer = 0; peer < rank; ++peer)
+	{
+		sockaddr_in address = GetLoopbackAddress(basePort + peer);
+		for (;;)
+		{
+			SocketHandle s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+			if (s != kInvalidSocket && connect(s, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0)
+			{
+				m_sockets[peer] = s;
+				break;
+			}
+			if (s != kInvalidSocket)
+			{
+				CloseSocket(s);
+			}
+			if (std::chrono::steady_clock::now() > deadline)
+			{
+				SetError("Can't connect to rank " + std::to_string(peer) + ": " + GetSocketError());
+				if (listener != kInvalidSocket)
+				{
+					CloseSocket(listener);
+				}
+				Close();
+				return false;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		}
+		SetNoDelay(m_sockets[peer]);
+		int32_t from = rank;
+		if (!SendAll(m_sockets[peer], &from, sizeof(from)))
+		{
+			SetError("Lost rank " + std::to_string(peer) + " while connecting");
+			if (listener != kInvalidSocket)
+			{
+				CloseSocket(listener);
+			}
+			Close();
+			return false;
+		}
+	}
+
+	// the ranks above, in whatever order they come
+	bool ok = true;
+	for (int i = rank + 1; i < size && ok; ++i)
+	{
+		SocketHandle s = accept(listener, nullptr, nullptr);
+		int32_t from = -1;
+		ok = s != kInvalidSocket && ReceiveAll(s, &from, sizeof(from)) && from > rank && from < size && m_sockets[from] == kInvalidSocket;
+		if (ok)
+		{
+			SetNoDelay(s);
+			m_sockets[from] = s;
+		}
+		else
+		{
+			SetError("Bad connection on port " + std::to_string(basePort + rank));
+			if (s != kInvalidSocket)
+			{
+				CloseSocket(s);
+			}
+		}
+	}
+	if (listener != kInvalidSocket)
+	{
+		CloseSocket(listener);
+	}
+	if (!ok)
+	{
+		Close();
+	}
+	return ok;
+}
+
+void SocketTransport::Close()
+{
+	for (SocketHandle s : m_sockets)
+	{
+		if (s != kInvalidSocket)
+		{
+			CloseSocket(s);
+		}
+	}
+	m_sockets.clear();
+#ifdef _WIN32
+	if (m_started)
+	{
+		WSACleanup();
+	}
+#endif
+	m_started = false;
+}
+
+bool SocketTransport::Send(const int peer, const void* data, const size_t bytes)
+{
+	if (peer < 0 || peer >= static_cast<int>(m_sockets.size()) || m_sockets[peer] == kInvalidSocket)
+	{
+		SetError("Not connected to rank " + std::to_string(peer));
+		return false;
+	}
+	if (!SendAll(m_sockets[peer], data, bytes))
+	{
+		SetError("Lost rank " + std::to_string(peer) + ": " + GetSocketError());
+		return false;
+	}
+	m_bytesSent += bytes;
+	return true;
+}
+
+bool SocketTransport::Receive(const int peer, void* data, const size_t bytes)
+{
+	if (peer < 0 || peer >= static_cast<int>(m_sockets.size()) || m_sockets[peer] == kInvalidSocket)
+	{
+		SetError("Not connected to rank " + std::to_string(peer));
+		return false;
+	}
+	if (!ReceiveAll(m_sockets[peer], data, bytes))
+	{
+		SetError("Lost rank " + std::to_string(peer));
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,120 @@
+/// <summary>
+/// Transport.h
+///
+/// About:
+/// Byte streams between the ranks of a group of renderers,
+/// what DistributedRenderer sends its partial images over.
+/// Every pair of ranks has a stream each way, Send hands a
+/// buffer to one and Receive blocks until as many bytes as
+/// asked for have come out of the other, so messages need no
+/// framing as long as both sides agree on their sizes.
+///
+/// LocalTransport connects threads of one process through
+/// shared queues, SocketTransport connects processes on one
+/// machine through TCP on the loopback interface, which both
+/// Winsock and POSIX sockets have. Anything else (MPI, a
+/// network) only needs Send and Receive.
+/// </summary>
+#ifndef Transport_h__
+#define Transport_h__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Transport
+{
+public:
+	Transport();
+	virtual ~Transport() {}
+
+	virtual int GetRank() const = 0;
+	virtual int GetSize() const = 0;
+
+	// Sends bytes to peer, may block until the peer receives them. Returns
+	// false once the stream is broken, GetError() says why.
+	virtual bool Send(const int peer, const void* data, const size_t bytes) = 0;
+	// Blocks until bytes have arrived from peer.
+	virtual bool Receive(const int peer, void* data, const size_t bytes) = 0;
+	// Send and Receive with the same peer at once, so two ranks can swap
+	// buffers larger than the transport holds without waiting on each other.
+	// By default the send runs on a thread of its own.
+	virtual bool Exchange(const int peer, const void* sendData, const size_t sendBytes, void* receiveData, const size_t receiveBytes);
+
+	// sent since the transport was set up, by Send and Exchange
+	uint64_t GetBytesSent() const { return m_bytesSent; }
+	std::string GetError() const;
+
+protected:
+	void SetError(const std::string& error);
+
+	uint64_t m_bytesSent;
+
+private:
+	mutable std::mutex m_errorMutex;
+	std::string m_error;
+};
+
+class LocalTransport : public Transport
+{
+public:
+	// size transports connected to each other, rank i at index i, one for
+	// each thread of the group
+	static std::vector<std::unique_ptr<Transport>> CreateGroup(const int size);
+
+	int GetRank() const override { return m_rank; }
+	int GetSize() const override;
+	// copies the buffer into the peer's queue, never blocks
+	bool Send(const int peer, const void* data, const size_t bytes) override;
+	bool Receive(const int peer, void* data, const size_t bytes) override;
+	// a Send that doesn't block needs no thread
+	bool Exchange(const int peer, const void* sendData, const size_t sendBytes, void* receiveData, const size_t receiveBytes) override;
+
+private:
+	struct Group;
+
+	LocalTransport(const std::shared_ptr<Group>& group, const int rank);
+
+	std::shared_ptr<Group> m_group;
+	int m_rank;
+};
+
+#ifdef _WIN32
+typedef uintptr_t SocketHandle;
+#else
+typedef int SocketHandle;
+#endif
+
+class SocketTransport : public Transport
+{
+public:
+	SocketTransport();
+	~SocketTransport();
+
+	// Connects rank to the other size - 1 ranks on the loopback interface.
+	// Rank r listens on basePort + r for the ranks above it and connects to
+	// the ones below, retrying until they listen, so the processes can start
+	// in any order. Gives up after timeoutMs.
+	bool Connect(const int rank, const int size, const int basePort, const int timeoutMs = 10000);
+	void Close();
+
+	int GetRank() const override { return m_rank; }
+	int GetSize() const override { return m_size; }
+	bool Send(const int peer, const void* data, const size_t bytes) override;
+	bool Receive(const int peer, void* data, const size_t bytes) override;
+
+private:
+	SocketTransport(const SocketTransport&);
+	SocketTransport& operator=(const SocketTransport&);
+
+	int m_rank;
+	int m_size;
+	// one per rank, invalid for this one
+	std::vector<SocketHandle> m_sockets;
+	bool m_started;
+};
+
+#endif // Transport_h__
@@ -0,0 +1,244 @@
+#include "Volume.h"
+#include "PackedVolume.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+size_t GetVoxelSize(const VoxelType type)
+{
+	switch (type)
+	{
+	case VoxelType::UInt16:
+	case VoxelType::Float16:
+		return 2;
+	case VoxelType::Float32:
+		return 4;
+	default:
+		return 1;
+	}
+}
+
+const char* GetVoxelTypeName(const VoxelType type)
+{
+	switch (type)
+	{
+	case VoxelType::UInt16:
+		return "uint16";
+	case VoxelType::Float16:
+		return "float16";
+	case VoxelType::Float32:
+		return "float32";
+	default:
+		return "uint8";
+	}
+}
+
+bool ParseVolumeDesc(const std::string& text, VolumeDesc& desc)
+{
+	VolumeDesc parsed;
+	const char* p = text.c_str();
+	char* end = nullptr;
+
+	// WxHxD
+	int* dims[3] = { &parsed.width, &parsed.height, &parsed.depth };
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		long value = strtol(p, &end, 10);
+		if (end == p || value <= 0 || value > (1 << 20) || (axis < 2 && *end != 'x'))
+		{
+			return false;
+		}
+		*dims[axis] = static_cast<int>(value);
+		p = axis < 2 ? end + 1 : end;
+	}
+
+	// :type
+	if (*p == ':')
+	{
+		++p;
+		size_t length = strcspn(p, ":");
+		const VoxelType types[] = { VoxelType::UInt8, VoxelType::UInt16, VoxelType::Float16, VoxelType::Float32 };
+		bool known = false;
+		for (VoxelType type : types)
+		{
+			const char* name = GetVoxelTypeName(type);
+			if (strlen(name) == length && strncmp(p, name, length) == 0)
+			{
+				parsed.type = type;
+				known = true;
+			}
+		}
+		if (!known)
+		{
+			return false;
+		}
+		p += length;
+	}
+
+	// :sx,sy,sz
+	if (*p == ':')
+	{
+		++p;
+		float* spacing[3] = { &parsed.spacing.x, &parsed.spacing.y, &parsed.spacing.z };
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			float value = strtof(p, &end);
+			if (end == p || !(value > 0.f) || (axis < 2 && *end != ','))
+			{
+				return false;
+			}
+			*spacing[axis] = value;
+			p = axis < 2 ? end + 1 : end;
+		}
+	}
+
+	if (*p != '\0')
+	{
+		return false;
+	}
+
+	desc = parsed;
+	return true;
+}
+
+std::string GetVolumeKey(const std::string& file, const VolumeDesc& desc)
+{
+	char layout[96];
+	snprintf(layout, sizeof(layout), "|%dx%dx%d:%s:%g,%g,%g", desc.width, desc.height, desc.depth,
+		GetVoxelTypeName(desc.type), desc.spacing.x, desc.spacing.y, desc.spacing.z);
+	return file + layout;
+}
+
+Volume::Volume()
+{
+	m_data = nullptr;
+}
+
+//---------------------------------------------------------------//
+// Map RAW volume file (x fastest then y then z)
+//---------------------------------------------------------------//
+bool Volume::LoadRaw(const std::string& file, const VolumeDesc& desc)
+{
+	if (desc.width <= 0 || desc.height <= 0 || desc.depth <= 0)
+	{
+		m_error = "Invalid volume dimensions";
+		return false;
+	}
+
+	MappedFile mapped;
+	if (!mapped.Open(file))
+	{
+		m_error = "Opening volume data file failed: " + file;
+		return false;
+	}
+
+	if (mapped.GetSize() != desc.GetByteSize())
+	{
+		char sizes[128];
+		snprintf(sizes, sizeof(sizes), " is %llu bytes, %dx%dx%d %s needs %llu", static_cast<unsigned long long>(mapped.GetSize()),
+			desc.width, desc.height, desc.depth, GetVoxelTypeName(desc.type), static_cast<unsigned long long>(desc.GetByteSize()));
+		m_error = file + sizes;
+		return false;
+	}
+
+	// the old mapping is released when mapped goes out of scope
+	m_file.Swap(mapped);
+	m_voxels.clear();
+	m_voxels.shrink_to_fit();
+	m_data = m_file.GetData();
+	m_desc = desc;
+	m_macrocells.Shutdown();
+	m_gradients.Shutdown();
+	m_mips.Shutdown();
+	m_stats = VolumeStats();
+	m_error.clear();
+	return true;
+}
+
+bool Volume::LoadPacked(const std::string& file)
+{
+	VolumeDesc desc;
+	std::vector<uint8_t> voxels;
+	if (!ReadPackedVolume(file, desc, voxels, m_error))
+	{
+		return false;
+	}
+	return Create(desc, voxels);
+}
+
+bool Volume::Load(const std::string& file, const VolumeDesc& desc)
+{
+	return IsPackedVolumeFile(file) ? LoadPacked(file) : LoadRaw(file, desc);
+}
+
+bool Volume::Create(const VolumeDesc& desc, std::vector<uint8_t>& voxels)
+{
+	if (desc.width <= 0 || desc.height <= 0 || desc.depth <= 0 || voxels.size() != desc.GetByteSize())
+	{
+		m_error = "Invalid volume layout";
+		return false;
+	}
+
+	m_file.Close();
+	m_voxels.swap(voxels);
+	m_data = m_voxels.data();
+	m_desc = desc;
+	m_macrocells.Shutdown();
+	m_gradients.Shutdown();
+	m_mips.Shutdown();
+	m_stats = VolumeStats();
+	m_error.clear();
+	return true;
+}
+
+bool Volume::CopyToMemory()
+{
+	if (m_file.IsOpen())
+	{
+		m_voxels.assign(m_data, m_data + m_desc.GetByteSize());
+		m_data = m_voxels.data();
+		m_file.Close();
+	}
+	if (!IsLoaded())
+	{
+		m_error = "No volume loaded";
+		return false;
+	}
+	return true;
+}
+
+void Volume::Shutdown()
+{
+	m_file.Close();
+	m_voxels.clear();
+	m_voxels.shrink_to_fit();
+	m_data = nullptr;
+	m_macrocells.Shutdown();
+	m_gradients.Shutdown();
+	m_mips.Shutdown();
+	m_stats = VolumeStats();
+	m_desc = VolumeDesc();
+	m_error.clear();
+}
+
+const Volume& Volume::GetMip(const int level) const
+{
+	if (level <= 0 || !m_mips.IsBuilt())
+	{
+		return *this;
+	}
+	return m_mips.GetLevel(std::min(level, m_mips.GetLevelCount()));
+}
+
+bool Volume::BuildGradients(const GradientFilter filter)
+{
+	return m_gradients.Build(*this, filter) && m_mips.BuildGradients(filter);
+}
+
+Vec3 VolumeDesc::GetExtent() const
+{
+	Vec3 size(width * spacing.x, height * spacing.y, depth * spacing.z);
+	float longest = std::max(size.x, std::max(size.y, size.z));
+	return longest > 0.f ? size * (1.f / longest) : Vec3(1.f, 1.f, 1.f);
+}
@@ -0,0 +1,188 @@
+/// <summary>
+/// Volume.h
+///
+/// About:
+/// CPU copy of a RAW volume of any VoxelType. The D3D renderer
+/// uploads it to a Texture3D and the CPU renderer samples it
+/// directly, so both work from the same voxels.
+///
+/// The file is memory mapped rather than read, so GetData()
+/// points straight into the mapping and the only copy made is
+/// the texture upload. Volumes that aren't read from a file
+/// (the levels of a MipChain) own their voxels instead.
+/// </summary>
+#ifndef Volume_h__
+#define Volume_h__
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "GradientVolume.h"
+#include "MacrocellGrid.h"
+#include "MappedFile.h"
+#include "MipChain.h"
+#include "VolumeMath.h"
+#include "VolumeStats.h"
+#include "VoxelTypes.h"
+
+size_t GetVoxelSize(const VoxelType type);
+const char* GetVoxelTypeName(const VoxelType type);
+
+// What the caller knows about a RAW file: the files carry no header
+struct VolumeDesc
+{
+	int width;
+	int height;
+	int depth;
+	VoxelType type;
+	// voxel size along each axis, only the ratios matter
+	Vec3 spacing;
+
+	VolumeDesc() : width(0), height(0), depth(0), type(VoxelType::UInt8), spacing(1.f, 1.f, 1.f) {}
+	VolumeDesc(const int w, const int h, const int d, const VoxelType t = VoxelType::UInt8, const Vec3& s = Vec3(1.f, 1.f, 1.f))
+		: width(w), height(h), depth(d), type(t), spacing(s) {}
+
+	size_t GetByteSize() const { return static_cast<size_t>(width) * height * depth * GetVoxelSize(type); }
+	// physical size (voxels times spacing) scaled so the longest side is 1
+	Vec3 GetExtent() const;
+};
+
+// Parses "WxHxD[:type][:sx,sy,sz]", e.g. "512x512x256:uint8:1,1,2".
+// Types are uint8, uint16, float16 and float32.
+bool ParseVolumeDesc(const std::string& text, VolumeDesc& desc);
+
+// identifies a file read with a given layout, e.g. "foot.raw|256x256x256:uint8:1,1,1"
+std::string GetVolumeKey(const std::string& file, const VolumeDesc& desc);
+
+class Volume
+{
+public:
+	Volume();
+
+	// maps file, which must be exactly desc.GetByteSize() bytes;
+	// on failure GetError() says why and the previous volume is kept
+	bool LoadRaw(const std::string& file, const VolumeDesc& desc);
+	// decompresses a .pvol file (PackedVolume.h), which carries its own layout
+	bool LoadPacked(const std::string& file);
+	// LoadPacked for .pvol files (desc is ignored), LoadRaw for anything else
+	bool Load(const std::string& file, const VolumeDesc& desc);
+	// takes over voxels (swapped out, must be desc.GetByteSize() bytes)
+	bool Create(const VolumeDesc& desc, std::vector<uint8_t>& voxels);
+	// Copies mapped voxels into a buffer of the volume's own and closes the
+	// file, for the CPU sampler: its gathers from the mapping's file pages run
+	// about half as fast as from anonymous memory. The texture upload is best
+	// left on the mapping. Call it before building the macrocells and mips;
+	// false if nothing is loaded.
+	bool CopyToMemory();
+	void Shutdown();
+
+	const VolumeDesc& GetDesc() const { return m_desc; }
+	int GetWidth() const { return m_desc.width; }
+	int GetHeight() const { return m_desc.height; }
+	int GetDepth() const { return m_desc.depth; }
+	const uint8_t* GetData() const { return m_data; }
+	// T must be the C++ type of GetDesc().type
+	template <typename T> const T* GetVoxels() const { return reinterpret_cast<const T*>(m_data); }
+	bool IsLoaded() const { return m_data != nullptr; }
+	const std::string& GetError() const { return m_error; }
+	// voxels plus the macrocell grid, gradients and mip chain
+	size_t GetMemoryUsage() const { return (IsLoaded() ? m_desc.GetByteSize() : 0) + m_macrocells.GetMemoryUsage() + m_gradients.GetMemoryUsage() + m_mips.GetMemoryUsage(); }
+
+	// physical size (voxels times spacing) scaled so the longest side is 1,
+	// the scale to give the [-1,1] proxy cube
+	Vec3 GetExtent() const { return m_desc.GetExtent(); }
+
+	// raw voxel fetch, returns 0 outside the volume (D3D11_TEXTURE_ADDRESS_BORDER)
+	template <typename T> float Load(const int x, const int y, const int z) const;
+
+	// Trilinear sample of the raw voxels at normalised texture coordinates. Put
+	// through the volume's VoxelWindow::GetDefault this matches
+	// txVolume.Sample(samplerLinear, uvw) on the UNORM/FLOAT texture.
+	template <typename T> float Sample(const Vec3& uvw) const;
+
+	// min/max grid for empty space skipping, LoadRaw drops the old one
+	bool BuildMacrocells(const int cellSize = MacrocellGrid::kDefaultCellSize) { return m_macrocells.Build(*this, cellSize); }
+	const MacrocellGrid& GetMacrocells() const { return m_macrocells; }
+
+	// downsampled levels for minified views, LoadRaw drops the old ones
+	bool BuildMips(const MipFilter filter = MipFilter::Box) { return m_mips.Build(*this, filter); }
+	// 1 (just this volume) until BuildMips
+	int GetMipCount() const { return 1 + m_mips.GetLevelCount(); }
+	// level 0 is this volume, levels past the last one return the last one
+	const Volume& GetMip(const int level) const;
+
+	// packed gradients for shading, of this volume and of every mip level
+	// built so far (so BuildMips first), LoadRaw drops them
+	bool BuildGradients(const GradientFilter filter = GradientFilter::Central);
+	const GradientVolume& GetGradients() const { return m_gradients; }
+
+	// statistics of the voxels (VolumeStats.h), set by whoever loaded them
+	// (VolumeLoader does); invalid until then, LoadRaw drops them
+	void SetStats(const VolumeStats& stats) { m_stats = stats; }
+	const VolumeStats& GetStats() const { return m_stats; }
+
+private:
+	VolumeDesc m_desc;
+	// the mapping or m_voxels
+	const uint8_t* m_data;
+	MappedFile m_file;
+	std::vector<uint8_t> m_voxels;
+	std::string m_error;
+	MacrocellGrid m_macrocells;
+	GradientVolume m_gradients;
+	MipChain m_mips;
+	VolumeStats m_stats;
+};
+
+template <typename T>
+inline float Volume::Load(const int x, const int y, const int z) const
+{
+	if (x < 0 || y < 0 || z < 0 || x >= m_desc.width || y >= m_desc.height || z >= m_desc.depth)
+	{
+		return 0.f;
+	}
+	return VoxelTraits<T>::ToFloat(GetVoxels<T>()[(static_cast<size_t>(z) * m_desc.height + y) * m_desc.width + x]);
+}
+
+template <typename T>
+inline float Volume::Sample(const Vec3& uvw) const
+{
+	// texel centres sit at (i + 0.5) / size
+	float fx = uvw.x * m_desc.width - 0.5f;
+	float fy = uvw.y * m_desc.height - 0.5f;
+	float fz = uvw.z * m_desc.depth - 0.5f;
+
+	float flx = std::floor(fx);
+	float fly = std::floor(fy);
+	float flz = std::floor(fz);
+
+	int x0 = static_cast<int>(flx);
+	int y0 = static_cast<int>(fly);
+	int z0 = static_cast<int>(flz);
+
+	float tx = fx - flx;
+	float ty = fy - fly;
+	float tz = fz - flz;
+
+	float c000 = Load<T>(x0, y0, z0);
+	float c100 = Load<T>(x0 + 1, y0, z0);
+	float c010 = Load<T>(x0, y0 + 1, z0);
+	float c110 = Load<T>(x0 + 1, y0 + 1, z0);
+	float c001 = Load<T>(x0, y0, z0 + 1);
+	float c101 = Load<T>(x0 + 1, y0, z0 + 1);
+	float c011 = Load<T>(x0, y0 + 1, z0 + 1);
+	float c111 = Load<T>(x0 + 1, y0 + 1, z0 + 1);
+
+	float c00 = c000 + (c100 - c000) * tx;
+	float c10 = c010 + (c110 - c010) * tx;
+	float c01 = c001 + (c101 - c001) * tx;
+	float c11 = c011 + (c111 - c011) * tx;
+
+	float c0 = c00 + (c10 - c00) * ty;
+	float c1 = c01 + (c11 - c01) * ty;
+
+	return c0 + (c1 - c0) * tz;
+}
+
+#endif // Volume_h__
@@ -0,0 +1,90 @@
+#include "VolumeCache.h"
+
+VolumeCache::VolumeCache(const size_t budget)
+{
+	m_budget = budget;
+	m_bytes = 0;
+	m_hits = 0;
+	m_misses = 0;
+	m_evictions = 0;
+}
+
+void VolumeCache::SetBudget(const size_t budget)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_budget = budget;
+	Evict();
+}
+
+std::shared_ptr<Volume> VolumeCache::Find(const std::string& file, const VolumeDesc& desc)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto found = m_index.find(GetVolumeKey(file, desc));
+	if (found == m_index.end())
+	{
+		++m_misses;
+		return nullptr;
+	}
+
+	++m_hits;
+	m_lru.splice(m_lru.begin(), m_lru, found->second);
+	return found->second->volume;
+}
+
+void VolumeCache::Insert(const std::string& file, const VolumeDesc& desc, const std::shared_ptr<Volume>& volume)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::string key = GetVolumeKey(file, desc);
+
+	auto found = m_index.find(key);
+	if (found != m_index.end())
+	{
+		m_bytes -= found->second->bytes;
+		m_lru.erase(found->second);
+		m_index.erase(found);
+	}
+
+	Entry entry;
+	entry.key = key;
+	entry.volume = volume;
+	entry.bytes = volume->GetMemoryUsage();
+	m_lru.push_front(entry);
+	m_index[key] = m_lru.begin();
+	m_bytes += entry.bytes;
+
+	Evict();
+}
+
+void VolumeCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_lru.clear();
+	m_index.clear();
+	m_bytes = 0;
+}
+
+VolumeCache::Stats VolumeCache::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Stats stats;
+	stats.hits = m_hits;
+	stats.misses = m_misses;
+	stats.evictions = m_evictions;
+	stats.bytes = m_bytes;
+	stats.budget = m_budget;
+	stats.entries = static_cast<int>(m_lru.size());
+	return stats;
+}
+
+void VolumeCache::Evict()
+{
+	// never the most recent entry, that's the one just used
+	while (m_bytes > m_budget && m_lru.size() > 1)
+	{
+		Entry& oldest = m_lru.back();
+		m_bytes -= oldest.bytes;
+		m_index.erase(oldest.key);
+		m_lru.pop_back();
+		++m_evictions;
+	}
+}
@@ -0,0 +1,73 @@
+/// <summary>
+/// VolumeCache.h
+///
+/// About:
+/// Keeps recently used volumes resident, keyed by file and
+/// layout (GetVolumeKey), up to a byte budget. The least
+/// recently used volumes are dropped first when the budget
+/// is exceeded. Volumes are shared, so one dropped while a
+/// renderer still draws it stays alive until that renderer
+/// lets go of it. Thread safe, the loader workers fill it.
+/// </summary>
+#ifndef VolumeCache_h__
+#define VolumeCache_h__
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "Volume.h"
+
+class VolumeCache
+{
+public:
+	struct Stats
+	{
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t evictions;
+		size_t bytes;		// resident, Volume::GetMemoryUsage of every entry
+		size_t budget;
+		int entries;
+	};
+
+	explicit VolumeCache(const size_t budget = static_cast<size_t>(1) << 30);
+
+	// shrinking the budget evicts straight away
+	void SetBudget(const size_t budget);
+
+	// null on a miss, a hit becomes the most recently used entry
+	std::shared_ptr<Volume> Find(const std::string& file, const VolumeDesc& desc);
+	// adds or replaces the entry, then evicts down to the budget (a volume
+	// bigger than the whole budget is still kept until the next insert)
+	void Insert(const std::string& file, const VolumeDesc& desc, const std::shared_ptr<Volume>& volume);
+	void Clear();
+
+	Stats GetStats() const;
+
+private:
+	struct Entry
+	{
+		std::string key;
+		std::shared_ptr<Volume> volume;
+		size_t bytes;
+	};
+
+	// with m_mutex held
+	void Evict();
+
+	size_t m_budget;
+	size_t m_bytes;
+	uint64_t m_hits;
+	uint64_t m_misses;
+	uint64_t m_evictions;
+	// most recently used first
+	std::list<Entry> m_lru;
+	std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+	mutable std::mutex m_mutex;
+};
+
+#endif // VolumeCache_h__
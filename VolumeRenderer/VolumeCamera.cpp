@@ -0,0 +1,82 @@
+#include "VolumeCamera.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// where Initialize() puts the eye by default
+const Vec3 g_defaultEye(0.f, 1.5f, -5.0f);
+const float g_fFovY = 3.141592654f / 4.f;
+
+VolumeCamera::VolumeCamera()
+{
+	m_rot = 1;
+	m_distance = Length(g_defaultEye);
+	m_focalScale = 1.f / std::tan(0.5f * g_fFovY);
+	m_scale = Vec3(1.f, 1.f, 1.f);
+	m_viewProj = Matrix4::Identity();
+}
+
+void VolumeCamera::Initialize()
+{
+	// Initialize the view matrix, looking at the volume from m_distance away
+	Vec3 eye = g_defaultEye * (m_distance / Length(g_defaultEye));
+	Vec3 at(0.f, 0.0f, 0.f);
+	Vec3 up(0.f, 1.f, 0.f);
+	Matrix4 mView = Matrix4::Transpose(Matrix4::LookAtLH(eye, at, up));
+
+	// Initialize the projection matrix
+	// (pushed back for far views, so the far plane doesn't cut the cube)
+	float farZ = std::max(10.f, m_distance + 2.f);
+	Matrix4 mProjection = Matrix4::Transpose(Matrix4::PerspectiveFovLH(g_fFovY, 1.f, 0.1f, farZ));
+
+	// View-projection matrix	
+	m_viewProj = Matrix4::Multiply(mProjection, mView);
+}
+
+void VolumeCamera::SetDistance(const float distance)
+{
+	m_distance = distance;
+	Initialize();
+}
+
+void VolumeCamera::Update(const float dt)
+{
+	// rotate rendered volume around y-axis (oo so fancy :P)
+	m_rot += 1.2f * dt;
+}
+
+Matrix4 VolumeCamera::GetWorld() const
+{
+	Matrix4 scale = Matrix4::Identity();
+	scale.m[0][0] = m_scale.x;
+	scale.m[1][1] = m_scale.y;
+	scale.m[2][2] = m_scale.z;
+	return Matrix4::Multiply(Matrix4::RotationY(m_rot), scale);
+}
+
+Matrix4 VolumeCamera::GetWorldViewProj() const
+{
+	return Matrix4::Multiply(m_viewProj, GetWorld());
+}
+
+float VolumeCamera::GetVoxelFootprint(const int width, const int height, const int depth, const int viewportHeight) const
+{
+	// the longest voxel edge in world space, the [-1,1] cube is scaled by m_scale
+	float voxel = std::max(2.f * m_scale.x / width, std::max(2.f * m_scale.y / height, 2.f * m_scale.z / depth));
+
+	// nearest corner, clip w is the view depth
+	Matrix4 wvp = GetWorldViewProj();
+	float nearest = std::numeric_limits<float>::infinity();
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		Vec4 c = Mul(wvp, Vec4(corner & 1 ? 1.f : -1.f, corner & 2 ? 1.f : -1.f, corner & 4 ? 1.f : -1.f, 1.f));
+		nearest = std::min(nearest, c.w);
+	}
+	if (!(nearest > 0.f))
+	{
+		// eye inside the volume's bounds
+		return std::numeric_limits<float>::infinity();
+	}
+
+	return voxel * m_focalScale * 0.5f * viewportHeight / nearest;
+}
@@ -0,0 +1,53 @@
+/// <summary>
+/// VolumeCamera.h
+///
+/// About:
+/// Holds the view/projection set up and the spinning
+/// rotation of the volume. Shared by the D3D renderer
+/// and the CPU renderer so both draw the same frame.
+/// </summary>
+#ifndef VolumeCamera_h__
+#define VolumeCamera_h__
+
+#include "VolumeMath.h"
+
+class VolumeCamera
+{
+public:
+	VolumeCamera();
+
+	void Initialize();
+	void Update(const float dt);
+
+	// rotation (radians) around the y-axis
+	float GetRotation() const { return m_rot; }
+	void SetRotation(const float rot) { m_rot = rot; }
+
+	// distance from the eye to the volume's centre, Initialize() sets up the default
+	float GetDistance() const { return m_distance; }
+	void SetDistance(const float distance);
+
+	// size of the proxy cube along each axis, e.g. Volume::GetExtent()
+	const Vec3& GetScale() const { return m_scale; }
+	void SetScale(const Vec3& scale) { m_scale = scale; }
+
+	// matrices are laid out for the shaders, mul(M, v)
+	const Matrix4& GetViewProj() const { return m_viewProj; }
+	Matrix4 GetWorld() const;
+	Matrix4 GetWorldViewProj() const;
+
+	// Pixels covered by one voxel of a width x height x depth volume where the
+	// proxy cube comes closest to the eye, for a viewport viewportHeight pixels
+	// high (the level of detail input, see MipChain::SelectLevel)
+	float GetVoxelFootprint(const int width, const int height, const int depth, const int viewportHeight) const;
+
+private:
+	float m_rot;
+	float m_distance;
+	// cot(fovY / 2), projected size of a unit at unit depth in NDC
+	float m_focalScale;
+	Vec3 m_scale;
+	Matrix4 m_viewProj;
+};
+
+#endif // VolumeCamera_h__
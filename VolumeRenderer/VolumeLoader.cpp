@@ -0,0 +1,178 @@
+#include "VolumeLoader.h"
+#include "VolumeStats.h"
+#include <algorithm>
+
+namespace
+{
+	double MsBetween(const VolumeLoader::Clock::time_point& from, const VolumeLoader::Clock::time_point& to)
+	{
+		return std::chrono::duration<double, std::milli>(to - from).count();
+	}
+}
+
+VolumeLoader::VolumeLoader()
+{
+	m_stop = false;
+	m_stats = Stats();
+	m_cache = nullptr;
+}
+
+VolumeLoader::~VolumeLoader()
+{
+	Shutdown();
+}
+
+void VolumeLoader::Initialize(const int threads)
+{
+	Shutdown();
+
+	m_stop = false;
+	for (int i = 0; i < std::max(threads, 1); ++i)
+	{
+		m_workers.emplace_back(&VolumeLoader::WorkerMain, this);
+	}
+}
+
+void VolumeLoader::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+		m_queue.clear();
+	}
+	m_wake.notify_all();
+
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+	m_workers.clear();
+
+	m_finished.clear();
+	m_pending.clear();
+}
+
+bool VolumeLoader::Request(const std::string& file, const VolumeDesc& desc)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_stats.requests;
+		if (!m_pending.insert(GetVolumeKey(file, desc)).second)
+		{
+			++m_stats.deduplicated;
+			return false;
+		}
+
+		// resident already: finished straight away, still handed out by Poll
+		std::shared_ptr<Volume> cached = m_cache != nullptr ? m_cache->Find(file, desc) : nullptr;
+		if (cached)
+		{
+			Result result;
+			result.file = file;
+			result.desc = desc;
+			result.volume = cached;
+			result.requested = Clock::now();
+			result.queuedMs = 0.0;
+			result.loadMs = 0.0;
+			++m_stats.cached;
+			m_finished.push_back(result);
+			return true;
+		}
+
+		Job job;
+		job.file = file;
+		job.desc = desc;
+		job.requested = Clock::now();
+		m_queue.push_back(job);
+	}
+	m_wake.notify_one();
+	return true;
+}
+
+bool VolumeLoader::Poll(Result& result)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_finished.empty())
+	{
+		return false;
+	}
+
+	result = m_finished.front();
+	m_finished.pop_front();
+	m_pending.erase(GetVolumeKey(result.file, result.desc));
+	return true;
+}
+
+bool VolumeLoader::IsBusy() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return !m_pending.empty();
+}
+
+VolumeLoader::Stats VolumeLoader::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+void VolumeLoader::WorkerMain()
+{
+	for (;;)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+			if (m_stop)
+			{
+				return;
+			}
+			job = m_queue.front();
+			m_queue.pop_front();
+		}
+
+		Result result;
+		result.file = job.file;
+		result.desc = job.desc;
+		result.requested = job.requested;
+		Clock::time_point start = Clock::now();
+		result.queuedMs = MsBetween(job.requested, start);
+
+		std::shared_ptr<Volume> volume = std::make_shared<Volume>();
+		if (volume->Load(job.file, job.desc) && volume->BuildMacrocells() && volume->BuildMips())
+		{
+			// without them the volume is still drawn, with the default window
+			VolumeStats stats;
+			bool cached = false;
+			if (LoadVolumeStats(job.file, *volume, stats, cached))
+			{
+				volume->SetStats(stats);
+			}
+			result.volume = volume;
+			if (m_cache != nullptr)
+			{
+				m_cache->Insert(job.file, job.desc, volume);
+			}
+		}
+		else
+		{
+			result.error = volume->GetError();
+		}
+		result.loadMs = MsBetween(start, Clock::now());
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (result.volume)
+		{
+			++m_stats.completed;
+		}
+		else
+		{
+			++m_stats.failed;
+		}
+		m_stats.totalQueuedMs += result.queuedMs;
+		m_stats.maxQueuedMs = std::max(m_stats.maxQueuedMs, result.queuedMs);
+		m_stats.totalLoadMs += result.loadMs;
+		m_stats.maxLoadMs = std::max(m_stats.maxLoadMs, result.loadMs);
+		m_finished.push_back(result);
+	}
+}
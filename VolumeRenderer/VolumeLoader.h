@@ -0,0 +1,104 @@
+/// <summary>
+/// VolumeLoader.h
+///
+/// About:
+/// Loads volumes on a small pool of worker threads so the
+/// render thread never waits on the disk. A worker maps and
+/// validates the file, builds the macrocell grid (which also
+/// pages every voxel in) and the mip chain, and gathers the
+/// voxel statistics (Volume::GetStats, from the sidecar when
+/// it is current) the automatic window starts from; the render
+/// thread polls for finished volumes at the start of a frame
+/// and swaps them in. Asking for a volume that is already queued, loading
+/// or waiting to be polled is a no-op. With a VolumeCache
+/// set, resident volumes are handed out without a load and
+/// every load is added to the cache.
+/// </summary>
+#ifndef VolumeLoader_h__
+#define VolumeLoader_h__
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Volume.h"
+#include "VolumeCache.h"
+
+class VolumeLoader
+{
+public:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	struct Result
+	{
+		std::string file;
+		VolumeDesc desc;
+		// null if the load failed, see error
+		std::shared_ptr<Volume> volume;
+		std::string error;
+		Clock::time_point requested;
+		double queuedMs;	// request until a worker picked it up
+		double loadMs;		// map, validate, build the macrocells and mips, gather the stats
+	};
+
+	struct Stats
+	{
+		uint64_t requests;
+		uint64_t deduplicated;	// requests dropped as already pending
+		uint64_t cached;		// requests served by the cache
+		uint64_t completed;
+		uint64_t failed;
+		double totalQueuedMs;
+		double maxQueuedMs;
+		double totalLoadMs;
+		double maxLoadMs;
+	};
+
+	VolumeLoader();
+	~VolumeLoader();
+
+	void Initialize(const int threads = 2);
+	// waits for the loads in progress, queued ones are dropped
+	void Shutdown();
+
+	// optional, must outlive the loader; set before the first request
+	void SetCache(VolumeCache* const cache) { m_cache = cache; }
+
+	// queues file, returns false if the same file and layout is already pending
+	bool Request(const std::string& file, const VolumeDesc& desc);
+	// hands out one finished load, never blocks
+	bool Poll(Result& result);
+	// anything queued, loading or not yet polled
+	bool IsBusy() const;
+	Stats GetStats() const;
+
+private:
+	struct Job
+	{
+		std::string file;
+		VolumeDesc desc;
+		Clock::time_point requested;
+	};
+
+	void WorkerMain();
+
+	std::vector<std::thread> m_workers;
+	std::deque<Job> m_queue;
+	std::deque<Result> m_finished;
+	// keys of every job from Request until Poll
+	std::set<std::string> m_pending;
+	bool m_stop;
+	Stats m_stats;
+	VolumeCache* m_cache;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_wake;
+};
+
+#endif // VolumeLoader_h__
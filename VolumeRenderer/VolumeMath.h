@@ -0,0 +1,206 @@
+/// <summary>
+/// VolumeMath.h
+///
+/// About:
+/// Minimal vector/matrix maths for the CPU side of the
+/// renderer. DirectXMath is Windows only, so the headless
+/// path uses these instead. Matrices follow the same layout
+/// as the HLSL (row_major, mul(M, v)) so a matrix built here
+/// can be copied straight into a constant buffer.
+/// </summary>
+#ifndef VolumeMath_h__
+#define VolumeMath_h__
+
+#include <cmath>
+
+struct Vec3
+{
+	float x, y, z;
+
+	Vec3() : x(0.f), y(0.f), z(0.f) {}
+	Vec3(const float _x, const float _y, const float _z) : x(_x), y(_y), z(_z) {}
+
+	Vec3 operator+(const Vec3& o) const { return Vec3(x + o.x, y + o.y, z + o.z); }
+	Vec3 operator-(const Vec3& o) const { return Vec3(x - o.x, y - o.y, z - o.z); }
+	Vec3 operator*(const float s) const { return Vec3(x * s, y * s, z * s); }
+	Vec3& operator+=(const Vec3& o) { x += o.x; y += o.y; z += o.z; return *this; }
+};
+
+struct Vec4
+{
+	float x, y, z, w;
+
+	Vec4() : x(0.f), y(0.f), z(0.f), w(0.f) {}
+	Vec4(const float _x, const float _y, const float _z, const float _w) : x(_x), y(_y), z(_z), w(_w) {}
+};
+
+inline float Dot(const Vec3& a, const Vec3& b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+inline Vec3 Cross(const Vec3& a, const Vec3& b)
+{
+	return Vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+inline float Length(const Vec3& v)
+{
+	return std::sqrt(Dot(v, v));
+}
+
+inline Vec3 Normalize(const Vec3& v)
+{
+	float len = Length(v);
+	return len > 0.f ? v * (1.f / len) : v;
+}
+
+struct Matrix4
+{
+	float m[4][4];
+
+	static Matrix4 Identity();
+	static Matrix4 Transpose(const Matrix4& a);
+	static Matrix4 Multiply(const Matrix4& a, const Matrix4& b);
+	// general 4x4 inverse, returns false if the matrix is singular
+	static bool Inverse(const Matrix4& a, Matrix4& out);
+
+	// the following match their DirectXMath namesakes (row vector convention)
+	static Matrix4 RotationY(const float angle);
+	static Matrix4 LookAtLH(const Vec3& eye, const Vec3& at, const Vec3& up);
+	static Matrix4 PerspectiveFovLH(const float fovY, const float aspect, const float nearZ, const float farZ);
+};
+
+// mul(M, v) as in HLSL with pack_matrix(row_major)
+inline Vec4 Mul(const Matrix4& a, const Vec4& v)
+{
+	return Vec4(
+		a.m[0][0] * v.x + a.m[0][1] * v.y + a.m[0][2] * v.z + a.m[0][3] * v.w,
+		a.m[1][0] * v.x + a.m[1][1] * v.y + a.m[1][2] * v.z + a.m[1][3] * v.w,
+		a.m[2][0] * v.x + a.m[2][1] * v.y + a.m[2][2] * v.z + a.m[2][3] * v.w,
+		a.m[3][0] * v.x + a.m[3][1] * v.y + a.m[3][2] * v.z + a.m[3][3] * v.w);
+}
+
+inline Matrix4 Matrix4::Identity()
+{
+	Matrix4 r = {};
+	r.m[0][0] = r.m[1][1] = r.m[2][2] = r.m[3][3] = 1.f;
+	return r;
+}
+
+inline Matrix4 Matrix4::Transpose(const Matrix4& a)
+{
+	Matrix4 r;
+	for (int i = 0; i < 4; ++i)
+		for (int j = 0; j < 4; ++j)
+			r.m[i][j] = a.m[j][i];
+	return r;
+}
+
+inline Matrix4 Matrix4::Multiply(const Matrix4& a, const Matrix4& b)
+{
+	Matrix4 r;
+	for (int i = 0; i < 4; ++i)
+		for (int j = 0; j < 4; ++j)
+			r.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j] + a.m[i][3] * b.m[3][j];
+	return r;
+}
+
+inline Matrix4 Matrix4::RotationY(const float angle)
+{
+	float s = std::sin(angle);
+	float c = std::cos(angle);
+	Matrix4 r = Identity();
+	r.m[0][0] = c;
+	r.m[0][2] = -s;
+	r.m[2][0] = s;
+	r.m[2][2] = c;
+	return r;
+}
+
+inline Matrix4 Matrix4::LookAtLH(const Vec3& eye, const Vec3& at, const Vec3& up)
+{
+	Vec3 zaxis = Normalize(at - eye);
+	Vec3 xaxis = Normalize(Cross(up, zaxis));
+	Vec3 yaxis = Cross(zaxis, xaxis);
+
+	Matrix4 r = Identity();
+	r.m[0][0] = xaxis.x; r.m[0][1] = yaxis.x; r.m[0][2] = zaxis.x;
+	r.m[1][0] = xaxis.y; r.m[1][1] = yaxis.y; r.m[1][2] = zaxis.y;
+	r.m[2][0] = xaxis.z; r.m[2][1] = yaxis.z; r.m[2][2] = zaxis.z;
+	r.m[3][0] = -Dot(xaxis, eye);
+	r.m[3][1] = -Dot(yaxis, eye);
+	r.m[3][2] = -Dot(zaxis, eye);
+	return r;
+}
+
+inline Matrix4 Matrix4::PerspectiveFovLH(const float fovY, const float aspect, const float nearZ, const float farZ)
+{
+	float h = 1.f / std::tan(fovY * 0.5f);
+	float w = h / aspect;
+	float range = farZ / (farZ - nearZ);
+
+	Matrix4 r = {};
+	r.m[0][0] = w;
+	r.m[1][1] = h;
+	r.m[2][2] = range;
+	r.m[2][3] = 1.f;
+	r.m[3][2] = -range * nearZ;
+	return r;
+}
+
+inline bool Matrix4::Inverse(const Matrix4& a, Matrix4& out)
+{
+	// Gauss-Jordan elimination with partial pivoting
+	float t[4][8];
+	for (int i = 0; i < 4; ++i)
+	{
+		for (int j = 0; j < 4; ++j)
+		{
+			t[i][j] = a.m[i][j];
+			t[i][j + 4] = (i == j) ? 1.f : 0.f;
+		}
+	}
+
+	for (int col = 0; col < 4; ++col)
+	{
+		int pivot = col;
+		for (int row = col + 1; row < 4; ++row)
+		{
+			if (std::fabs(t[row][col]) > std::fabs(t[pivot][col]))
+				pivot = row;
+		}
+		if (t[pivot][col] == 0.f)
+			return false;
+
+		if (pivot != col)
+		{
+			for (int j = 0; j < 8; ++j)
+			{
+				float tmp = t[col][j];
+				t[col][j] = t[pivot][j];
+				t[pivot][j] = tmp;
+			}
+		}
+
+		float inv = 1.f / t[col][col];
+		for (int j = 0; j < 8; ++j)
+			t[col][j] *= inv;
+
+		for (int row = 0; row < 4; ++row)
+		{
+			if (row == col)
+				continue;
+			float f = t[row][col];
+			for (int j = 0; j < 8; ++j)
+				t[row][j] -= f * t[col][j];
+		}
+	}
+
+	for (int i = 0; i < 4; ++i)
+		for (int j = 0; j < 4; ++j)
+			out.m[i][j] = t[i][j + 4];
+	return true;
+}
+
+#endif // VolumeMath_h__
@@ -1,10 +1,50 @@
 #include "InputManager.h"
+#include "Profiler.h"
 #include "VolumeRenderer.h"
 #include <DirectXMath.h>
+#include <cmath>
+#include <cstring>
 #include <d3d11.h>
 
-const UINT g_iVolumeSize = 256;	// voxel volume width, height and depth
-const UINT g_vol = 178;
+const VolumeDesc g_sampleVolumeDesc(256, 256, 256);	// the bundled datasets are all 256^3 8-bit voxels
+const size_t g_iVolumeCacheBytes = 512u << 20;			// resident volumes kept for switching back
+
+namespace
+{
+	// texture format for each voxel type, and the raw value it samples as 1
+	DXGI_FORMAT GetTextureFormat(const VoxelType type, float& range)
+	{
+		switch (type)
+		{
+		case VoxelType::UInt16:
+			range = 65535.f;
+			return DXGI_FORMAT_R16_UNORM;
+		case VoxelType::Float16:
+			range = 1.f;
+			return DXGI_FORMAT_R16_FLOAT;
+		case VoxelType::Float32:
+			range = 1.f;
+			return DXGI_FORMAT_R32_FLOAT;
+		default:
+			range = 255.f;
+			return DXGI_FORMAT_R8_UNORM;
+		}
+	}
+
+	// soft tissue and bone of the bundled CT datasets
+	TransferFunction GetTissueTransfer()
+	{
+		std::vector<TransferPoint> points = {
+			{ 0.f, 0.f, 0.f, 0.f, 0.f },
+			{ 0.12f, 0.9f, 0.5f, 0.3f, 0.f },
+			{ 0.2f, 0.9f, 0.5f, 0.3f, 0.05f },
+			{ 0.3f, 0.9f, 0.6f, 0.4f, 0.f },
+			{ 0.38f, 1.f, 1.f, 0.9f, 0.f },
+			{ 0.45f, 1.f, 1.f, 0.95f, 0.8f },
+			{ 1.f, 1.f, 1.f, 1.f, 0.9f } };
+		return TransferFunction(points);
+	}
+}
 
 void VolumeRenderer::Initialize(ID3D11Device* const device, const HWND hwnd, const int width, const int height)
 {
@@ -16,64 +56,99 @@ void VolumeRenderer::Initialize(ID3D11Device* const device, const HWND hwnd, con
 	m_volumeRaycastShader = new RayCastMaterial;
 	m_volumeRaycastShader->Initialize(device, hwnd, width, height);
 
-	// create a resource view (RT) for the front and back of the volume
-	CreateRenderTexture(device, width, height);
+	// the resource views (RT) for the front and back of the volume are
+	// created once EntryExit::Rasterized needs them
+	m_viewportWidth = width;
+	m_viewportHeight = height;
+	UpdateRenderTexture(device);
 
 	// set up simple linear sampler for use within our PS
 	CreateSampler(device);
 
-	// load of the raw textures into a D3D11_TEXTURE3D_DESC 
-	LoadVolume(device, L"../VolumeRenderer/foot.raw");	
+	// the transfer function's tables are filled in once it's first used
+	m_transfer = GetTissueTransfer();
+	CreateTransferTextures(device);
+
+	// start loading the first volume, it's drawn once it has arrived
+	m_cache.SetBudget(g_iVolumeCacheBytes);
+	m_loader.SetCache(&m_cache);
+	m_loader.Initialize();
+	RequestVolume("../VolumeRenderer/foot.raw");
 
 	// create the volume/cube primitive
 	CreateCube(device);
 
-	// Initialize the view matrix
-	DirectX::XMVECTOR eye = DirectX::XMVectorSet(0.f, 1.5f, -5.0f, 0.f);
-	DirectX::XMVECTOR at = DirectX::XMVectorSet(0.f, 0.0f, 0.f, 0.f);
-	DirectX::XMVECTOR up = DirectX::XMVectorSet(0.f, 1.f, 0.f, 0.f);
-	DirectX::XMMATRIX mView = DirectX::XMMatrixTranspose(DirectX::XMMatrixLookAtLH(eye, at, up));
-
-	// Initialize the projection matrix
-	DirectX::XMMATRIX mProjection = DirectX::XMMatrixTranspose(DirectX::XMMatrixPerspectiveFovLH(DirectX::XM_PIDIV4, 1.f, 0.1f, 10.f));
+	// timestamps around the passes for the profiler
+	CreateGpuTimers(device);
 
-	// View-projection matrix	
-	XMStoreFloat4x4(&viewProj, XMMatrixMultiply(mProjection, mView));
+	// Initialize the view and projection matrices
+	m_camera.Initialize();
 }
 
 void VolumeRenderer::Update(ID3D11Device* const device, const float dt)
 {
 	// rotate rendered volume around y-axis (oo so fancy :P)
-	rot += 1.2f * dt;
-
-	DirectX::XMStoreFloat4(&m_Rot, DirectX::XMQuaternionRotationRollPitchYaw(0, rot, 0));
+	m_camera.Update(dt);
 
 	// Note: this *does* really suck and please forgive me 
+	// (the loads happen in the background, holding a key only asks once)
 	if (InputManager::Instance()->IsKeyDown(DIK_1))
 	{
-		LoadVolume(device, L"../VolumeRenderer/aneurism.raw");
+		RequestVolume("../VolumeRenderer/aneurism.raw");
 	}
 
 	if (InputManager::Instance()->IsKeyDown(DIK_2))
 	{
-		LoadVolume(device, L"../VolumeRenderer/skull.raw");
+		RequestVolume("../VolumeRenderer/skull.raw");
 	}
 
 	if (InputManager::Instance()->IsKeyDown(DIK_3))
 	{
-		LoadVolume(device, L"../VolumeRenderer/bonsai.raw");
+		RequestVolume("../VolumeRenderer/bonsai.raw");
 	}
 
 	if (InputManager::Instance()->IsKeyDown(DIK_4))
 	{
-		LoadVolume(device, L"../VolumeRenderer/foot.raw");
+		RequestVolume("../VolumeRenderer/foot.raw");
 	}
 
+	// identity -> post-classified -> pre-integrated
+	if (InputManager::Instance()->IsKeyPressed(DIK_T))
+	{
+		SetClassification(static_cast<Classification>((static_cast<int>(m_classification) + 1) % 3));
+	}
+
+	// 1 -> 2 -> 4 steps, pre-integration keeps thin features at the longer ones
+	if (InputManager::Instance()->IsKeyPressed(DIK_S))
+	{
+		m_stepScale = m_stepScale >= 4.f ? 1.f : m_stepScale * 2.f;
+	}
+
+	// analytic <-> rasterized entry/exit points
+	if (InputManager::Instance()->IsKeyPressed(DIK_E))
+	{
+		m_entryExit = m_entryExit == EntryExit::Analytic ? EntryExit::Rasterized : EntryExit::Analytic;
+	}
+	UpdateRenderTexture(device);
+
+	// swap in whatever has finished loading, before this frame draws
+	SwapLoadedVolume(device);
+	UpdateLevelOfDetail(device);
 }
 
 void VolumeRenderer::Render(ID3D11DeviceContext* const deviceContext, ID3D11RasterizerState* const back, ID3D11RasterizerState* const front, ID3D11RenderTargetView* const rtView)
 {
-	float clearColor[4] = { 0.f, 0.f, 0.f, 1.f };
+	// alpha 0 where the proxy doesn't cover the pixel, the model position shader writes 1
+	float clearColor[4] = { 0.f, 0.f, 0.f, 0.f };
+
+	// time this frame's passes in the oldest timer, read back by now or given up on
+	GpuTimer& timer = m_gpuTimers[m_timerIndex % kGpuTimerLatency];
+	const bool timed = timer.disjoint != nullptr;
+	if (timed)
+	{
+		deviceContext->Begin(timer.disjoint);
+		deviceContext->End(timer.begin);
+	}
 
 	// Set vertex buffer
 	UINT stride = sizeof(DirectX::XMFLOAT3);
@@ -91,39 +166,86 @@ void VolumeRenderer::Render(ID3D11DeviceContext* const deviceContext, ID3D11Rast
 	//----------------------------------------------------------------------------//
 	// Create our MVP transforms 
 	//-----------------------------------------------------------------------------//
-	DirectX::XMMATRIX scaleMat = DirectX::XMMatrixScaling(1, 1, 1);
-	DirectX::XMMATRIX m_rotationMatrix = DirectX::XMMatrixRotationQuaternion(DirectX::XMLoadFloat4(&m_Rot)); //DirectX::XMMatrixRotationRollPitchYaw(0, rot, 0);
-	DirectX::XMMATRIX transMat = DirectX::XMMatrixTranslation(0, 0, 0);
-
-	DirectX::XMMATRIX m_newWorld = scaleMat*m_rotationMatrix*transMat;
-
-	DirectX::XMMATRIX m_worldMatrix = m_newWorld;
+	// VolumeCamera builds the matrix already laid out for the shaders
+	Matrix4 wvp = m_camera.GetWorldViewProj();
+	DirectX::XMFLOAT4X4 mWVP(&wvp.m[0][0]);
 
 	MatrixBuffer cb;
-	cb.mWVP = XMMatrixMultiply(XMLoadFloat4x4(&viewProj), m_worldMatrix);
+	cb.mWVP = DirectX::XMLoadFloat4x4(&mWVP);
 	deviceContext->UpdateSubresource(m_modelShader->m_MatrixBuffer, 0, NULL, &cb, 0, 0);
-		
+
+	// the analytic entry/exit un-projects each pixel like the CPU renderer does
+	// (ComputeRayEntryExit), the rasterized one reads the passes below
+	const bool analytic = m_entryExit == EntryExit::Analytic || m_modelRTVFront == nullptr;
+	RayCastMaterial::EntryExitBuffer entryExitCB;
+	ZeroMemory(&entryExitCB, sizeof(entryExitCB));
+	entryExitCB.entryExit = static_cast<UINT>(analytic ? EntryExit::Analytic : EntryExit::Rasterized);
+	const Vec3& boxMin = m_proxy.GetMin();
+	const Vec3& boxMax = m_proxy.GetMax();
+	entryExitCB.boxMin[0] = boxMin.x;
+	entryExitCB.boxMin[1] = boxMin.y;
+	entryExitCB.boxMin[2] = boxMin.z;
+	entryExitCB.boxMax[0] = boxMax.x;
+	entryExitCB.boxMax[1] = boxMax.y;
+	entryExitCB.boxMax[2] = boxMax.z;
+	Matrix4 invWVP;
+	if (Matrix4::Inverse(wvp, invWVP))
+	{
+		memcpy(entryExitCB.invWVP, invWVP.m, sizeof(entryExitCB.invWVP));
+	}
+	deviceContext->UpdateSubresource(m_volumeRaycastShader->m_EntryExitCB, 0, NULL, &entryExitCB, 0, 0);
+
 	//-----------------------------------------------------------------------------//
 	// Back and front buffer for faces of the volume
 	//-----------------------------------------------------------------------------//
 
-	// Set the vertex shader ~ simple model shader
-	deviceContext->VSSetShader(m_modelShader->GetVertexShader(), NULL, 0);
-	deviceContext->VSSetConstantBuffers(0, 1, &m_modelShader->m_MatrixBuffer);
-
-	// Set the pixel shader ~ simple model shader
-	deviceContext->PSSetShader(m_modelShader->GetPixelShader(), NULL, 0);
-
-	deviceContext->RSSetState(back);
-	deviceContext->ClearRenderTargetView(m_ModelRTVBack, clearColor);
-	deviceContext->OMSetRenderTargets(1, &m_ModelRTVBack, NULL);
-	deviceContext->DrawIndexed(36, 0, 0);		// Draw back faces
+	if (!analytic)
+	{
+		// the proxy around the occupied cells rather than the cube
+		deviceContext->IASetVertexBuffers(0, 1, &m_proxyVB, &stride, &offset);
+		deviceContext->IASetIndexBuffer(m_proxyIB, DXGI_FORMAT_R32_UINT, 0);
+
+		// Set the vertex shader ~ simple model shader
+		deviceContext->VSSetShader(m_modelShader->GetVertexShader(), NULL, 0);
+		deviceContext->VSSetConstantBuffers(0, 1, &m_modelShader->m_MatrixBuffer);
+
+		// Set the pixel shader ~ simple model shader
+		deviceContext->PSSetShader(m_modelShader->GetPixelShader(), NULL, 0);
+
+		// the proxy isn't convex, keep the farthest back and nearest front face
+		ID3D11DepthStencilState* depthState = nullptr;
+		UINT stencilRef = 0;
+		deviceContext->OMGetDepthStencilState(&depthState, &stencilRef);
+
+		// Front-face culling (the cube is wound clockwise, so this leaves the far faces)
+		deviceContext->RSSetState(front);
+		deviceContext->ClearRenderTargetView(m_ModelRTVBack, clearColor);
+		deviceContext->ClearDepthStencilView(m_proxyDSV, D3D11_CLEAR_DEPTH, 0.f, 0);
+		deviceContext->OMSetDepthStencilState(m_farthestDepth, 0);
+		deviceContext->OMSetRenderTargets(1, &m_ModelRTVBack, m_proxyDSV);
+		deviceContext->DrawIndexed(m_proxyIndexCount, 0, 0);		// Draw back faces
+
+		// Back-face culling
+		deviceContext->RSSetState(back);
+		deviceContext->ClearRenderTargetView(m_modelRTVFront, clearColor);
+		deviceContext->ClearDepthStencilView(m_proxyDSV, D3D11_CLEAR_DEPTH, 1.f, 0);
+		deviceContext->OMSetDepthStencilState(m_nearestDepth, 0);
+		deviceContext->OMSetRenderTargets(1, &m_modelRTVFront, m_proxyDSV);
+		deviceContext->DrawIndexed(m_proxyIndexCount, 0, 0);		// Draw front faces
+
+		deviceContext->OMSetDepthStencilState(depthState, stencilRef);
+		if (depthState != nullptr) {
+			depthState->Release();
+		}
+
+		deviceContext->IASetVertexBuffers(0, 1, &m_cubeVB, &stride, &offset);
+		deviceContext->IASetIndexBuffer(m_cubeIB, DXGI_FORMAT_R16_UINT, 0);
+	}
 
-	// Back-face culling
-	deviceContext->RSSetState(front);
-	deviceContext->ClearRenderTargetView(m_modelRTVFront, clearColor);
-	deviceContext->OMSetRenderTargets(1, &m_modelRTVFront, NULL);
-	deviceContext->DrawIndexed(36, 0, 0);		// Draw front faces
+	if (timed)
+	{
+		deviceContext->End(timer.entryExit);
+	}
 
 	//-----------------------------------------------------------------------------//
 	// Ray-casting / Volume Rendering 
@@ -132,8 +254,21 @@ void VolumeRenderer::Render(ID3D11DeviceContext* const deviceContext, ID3D11Rast
 	// Set the input layout
 	deviceContext->IASetInputLayout(m_modelShader->GetInputLayout());
 
-	// Render to standard render target
-	deviceContext->OMSetRenderTargets(1, &rtView, NULL);
+	// Every pixel a ray could hit is covered once by the cube's far faces,
+	// also with the camera inside it (the entry is then on the near plane)
+	deviceContext->RSSetState(front);
+
+	// Render to standard render target, with the steps saved counter in u1 if it's counted
+	if (m_countStepsSaved)
+	{
+		UINT clearCounter[4] = { 0, 0, 0, 0 };
+		deviceContext->ClearUnorderedAccessViewUint(m_volumeRaycastShader->m_StepsSavedUAV, clearCounter);
+		deviceContext->OMSetRenderTargetsAndUnorderedAccessViews(1, &rtView, NULL, 1, 1, &m_volumeRaycastShader->m_StepsSavedUAV, NULL);
+	}
+	else
+	{
+		deviceContext->OMSetRenderTargets(1, &rtView, NULL);
+	}
 
 	// Set the vertex shader to the Volume Renderer vertex program
 	deviceContext->VSSetShader(m_volumeRaycastShader->GetVertexShader(), NULL, 0);
@@ -143,6 +278,38 @@ void VolumeRenderer::Render(ID3D11DeviceContext* const deviceContext, ID3D11Rast
 	deviceContext->PSSetShader(m_volumeRaycastShader->GetPixelShader(), NULL, 0);
 	deviceContext->PSSetConstantBuffers(0, 1, &m_volumeRaycastShader->m_WindowSizeCB);
 
+	// mip level to sample, the steps grow with it (and with the step scale
+	// when there's a transfer function to correct for it)
+	int lod = m_lod > 0 ? m_lod : 0;
+	const bool classify = m_classification != Classification::Identity;
+	RayCastMaterial::LevelOfDetailBuffer lodCB;
+	ZeroMemory(&lodCB, sizeof(lodCB));
+	lodCB.lod = static_cast<float>(lod);
+	lodCB.stepScale = std::ldexp(classify ? m_stepScale : 1.f, lod);
+	deviceContext->UpdateSubresource(m_volumeRaycastShader->m_LevelOfDetailCB, 0, NULL, &lodCB, 0, 0);
+	deviceContext->PSSetConstantBuffers(1, 1, &m_volumeRaycastShader->m_LevelOfDetailCB);
+
+	// window/level, on the texture's normalised values rather than the raw voxels
+	RayCastMaterial::VoxelWindowBuffer windowCB;
+	ZeroMemory(&windowCB, sizeof(windowCB));
+	windowCB.scale = m_window.scale * m_textureRange;
+	windowCB.bias = m_window.bias;
+	deviceContext->UpdateSubresource(m_volumeRaycastShader->m_VoxelWindowCB, 0, NULL, &windowCB, 0, 0);
+	deviceContext->PSSetConstantBuffers(2, 1, &m_volumeRaycastShader->m_VoxelWindowCB);
+
+	// the transfer function's tables for this step, only redone where something changed
+	if (classify && m_transferTables.Update(m_transfer, lodCB.stepScale))
+	{
+		UploadTransferTables(deviceContext);
+	}
+	RayCastMaterial::TransferBuffer transferCB;
+	ZeroMemory(&transferCB, sizeof(transferCB));
+	transferCB.classification = static_cast<UINT>(m_classification);
+	transferCB.countSteps = m_countStepsSaved ? 1 : 0;
+	deviceContext->UpdateSubresource(m_volumeRaycastShader->m_TransferCB, 0, NULL, &transferCB, 0, 0);
+	deviceContext->PSSetConstantBuffers(3, 1, &m_volumeRaycastShader->m_TransferCB);
+	deviceContext->PSSetConstantBuffers(4, 1, &m_volumeRaycastShader->m_EntryExitCB);
+
 	// Set texture sampler
 	deviceContext->PSSetSamplers(0, 1, &m_samplerLinear);
 
@@ -150,61 +317,70 @@ void VolumeRenderer::Render(ID3D11DeviceContext* const deviceContext, ID3D11Rast
 	deviceContext->PSSetShaderResources(0, 1, &m_volRSV); // the loaded RAW file
 	deviceContext->PSSetShaderResources(1, 1, &m_modelSRVFront); // the front facing RT 
 	deviceContext->PSSetShaderResources(2, 1, &m_modelRSVBack); // the back facing RT
+	deviceContext->PSSetShaderResources(3, 1, &m_occupancyRSV); // the non-empty macrocells
+	deviceContext->PSSetShaderResources(4, 1, &m_transferRSV); // the transfer function per value
+	deviceContext->PSSetShaderResources(5, 1, &m_preIntegratedRSV); // and per segment
 
 	// Draw the cube
 	deviceContext->DrawIndexed(36, 0, 0);
 
+	if (timed)
+	{
+		deviceContext->End(timer.end);
+		deviceContext->End(timer.disjoint);
+		timer.frame = Profiler::Instance()->GetFrame();
+		timer.issued = true;
+		++m_timerIndex;
+		ReadGpuTimers(deviceContext);
+	}
+
 	// Un-bind textures
-	ID3D11ShaderResourceView *nullRV[3] = { NULL, NULL, NULL };
-	deviceContext->PSSetShaderResources(0, 3, nullRV);
+	ID3D11ShaderResourceView *nullRV[6] = { NULL, NULL, NULL, NULL, NULL, NULL };
+	deviceContext->PSSetShaderResources(0, 6, nullRV);
+
+	// Un-bind the counter and queue its read back
+	if (m_countStepsSaved)
+	{
+		ID3D11UnorderedAccessView* nullUAV = NULL;
+		deviceContext->OMSetRenderTargetsAndUnorderedAccessViews(1, &rtView, NULL, 1, 1, &nullUAV, NULL);
+		ReadStepsSaved(deviceContext);
+	}
 }
 
 void VolumeRenderer::Shutdown()
 {
-	// release all our resources
-	if (m_modelTex2DFront != nullptr) {
-		m_modelTex2DFront->Release();
-		m_modelTex2DFront = nullptr;
-	}
+	// stop loading before releasing anything
+	m_loader.Shutdown();
+	m_cache.Clear();
 
-	if (m_modelSRVFront != nullptr) {
-		m_modelSRVFront->Release();
-		m_modelSRVFront = nullptr;
-	}
-
-	if (m_modelRTVFront != nullptr) {
-		m_modelRTVFront->Release();
-		m_modelRTVFront = nullptr;
-	}
+	// release all our resources
+	ReleaseRenderTexture();
 
-	if (m_modelText2DBack != nullptr) {
-		m_modelText2DBack->Release();
-		m_modelText2DBack = nullptr;
+	if (m_samplerLinear != nullptr) {
+		m_samplerLinear->Release();
+		m_samplerLinear = nullptr;
 	}
 
-	if (m_modelRSVBack != nullptr) {
-		m_modelRSVBack->Release();
-		m_modelRSVBack = nullptr;
-	}
+	ReleaseVolumeTextures();
 
-	if (m_ModelRTVBack != nullptr) {
-		m_ModelRTVBack->Release();
-		m_ModelRTVBack = nullptr;
+	if (m_transferTex1D != nullptr) {
+		m_transferTex1D->Release();
+		m_transferTex1D = nullptr;
 	}
 
-	if (m_samplerLinear != nullptr) {
-		m_samplerLinear->Release();
-		m_samplerLinear = nullptr;
+	if (m_transferRSV != nullptr) {
+		m_transferRSV->Release();
+		m_transferRSV = nullptr;
 	}
 
-	if (m_volumeTex3D != nullptr) {
-		m_volumeTex3D->Release();
-		m_volumeTex3D = nullptr;
+	if (m_preIntegratedTex2D != nullptr) {
+		m_preIntegratedTex2D->Release();
+		m_preIntegratedTex2D = nullptr;
 	}
 
-	if (m_volRSV != nullptr) {
-		m_volRSV->Release();
-		m_volRSV = nullptr;
+	if (m_preIntegratedRSV != nullptr) {
+		m_preIntegratedRSV->Release();
+		m_preIntegratedRSV = nullptr;
 	}
 
 	if (m_cubeVB != nullptr) {
@@ -216,6 +392,14 @@ void VolumeRenderer::Shutdown()
 		m_cubeIB->Release();
 		m_cubeIB = nullptr;
 	}
+
+	ReleaseGpuTimers();
+	ReleaseProxyBuffers();
+	m_proxy.Shutdown();
+
+	m_volume = std::make_shared<Volume>();
+	m_volumeFile.clear();
+	m_requestedFile.clear();
 }
 
 //---------------------------------------------------------------//
@@ -311,6 +495,137 @@ void VolumeRenderer::CreateRenderTexture(ID3D11Device * const device, const int
 	hr = device->CreateShaderResourceView(m_modelText2DBack, NULL, &m_modelRSVBack);
 	// Create render target view
 	hr = device->CreateRenderTargetView(m_modelText2DBack, NULL, &m_ModelRTVBack);
+
+	// depth shared by both, the proxy's faces can overlap
+	descTex.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+	descTex.Format = DXGI_FORMAT_D32_FLOAT;
+	hr = device->CreateTexture2D(&descTex, NULL, &m_proxyDepthTex2D);
+	hr = device->CreateDepthStencilView(m_proxyDepthTex2D, NULL, &m_proxyDSV);
+
+	D3D11_DEPTH_STENCIL_DESC depthDesc;
+	ZeroMemory(&depthDesc, sizeof(depthDesc));
+	depthDesc.DepthEnable = TRUE;
+	depthDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+	depthDesc.DepthFunc = D3D11_COMPARISON_LESS;
+	hr = device->CreateDepthStencilState(&depthDesc, &m_nearestDepth);
+	depthDesc.DepthFunc = D3D11_COMPARISON_GREATER;
+	hr = device->CreateDepthStencilState(&depthDesc, &m_farthestDepth);
+}
+
+void VolumeRenderer::ReleaseRenderTexture()
+{
+	if (m_modelTex2DFront != nullptr) {
+		m_modelTex2DFront->Release();
+		m_modelTex2DFront = nullptr;
+	}
+
+	if (m_modelSRVFront != nullptr) {
+		m_modelSRVFront->Release();
+		m_modelSRVFront = nullptr;
+	}
+
+	if (m_modelRTVFront != nullptr) {
+		m_modelRTVFront->Release();
+		m_modelRTVFront = nullptr;
+	}
+
+	if (m_modelText2DBack != nullptr) {
+		m_modelText2DBack->Release();
+		m_modelText2DBack = nullptr;
+	}
+
+	if (m_modelRSVBack != nullptr) {
+		m_modelRSVBack->Release();
+		m_modelRSVBack = nullptr;
+	}
+
+	if (m_ModelRTVBack != nullptr) {
+		m_ModelRTVBack->Release();
+		m_ModelRTVBack = nullptr;
+	}
+
+	if (m_proxyDepthTex2D != nullptr) {
+		m_proxyDepthTex2D->Release();
+		m_proxyDepthTex2D = nullptr;
+	}
+
+	if (m_proxyDSV != nullptr) {
+		m_proxyDSV->Release();
+		m_proxyDSV = nullptr;
+	}
+
+	if (m_nearestDepth != nullptr) {
+		m_nearestDepth->Release();
+		m_nearestDepth = nullptr;
+	}
+
+	if (m_farthestDepth != nullptr) {
+		m_farthestDepth->Release();
+		m_farthestDepth = nullptr;
+	}
+}
+
+//---------------------------------------------------------------//
+// The model position RTs exist while EntryExit::Rasterized is
+// picked, 64 bytes a pixel the analytic rays don't need
+//---------------------------------------------------------------//
+void VolumeRenderer::UpdateRenderTexture(ID3D11Device* const device)
+{
+	if (m_entryExit == EntryExit::Rasterized && m_modelTex2DFront == nullptr)
+	{
+		CreateRenderTexture(device, m_viewportWidth, m_viewportHeight);
+	}
+	else if (m_entryExit == EntryExit::Analytic && m_modelTex2DFront != nullptr)
+	{
+		ReleaseRenderTexture();
+	}
+}
+
+//---------------------------------------------------------------//
+// Upload the proxy mesh, whenever the occupancy changed it
+//---------------------------------------------------------------//
+void VolumeRenderer::CreateProxyBuffers(ID3D11Device* const device)
+{
+	HRESULT hr;
+	ReleaseProxyBuffers();
+	if (m_proxy.IsEmpty())
+	{
+		return;
+	}
+
+	const std::vector<Vec3>& vertices = m_proxy.GetVertices();
+	const std::vector<uint32_t>& indices = m_proxy.GetIndices();
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_IMMUTABLE;
+	bd.ByteWidth = static_cast<UINT>(vertices.size() * sizeof(Vec3));
+	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	D3D11_SUBRESOURCE_DATA initData;
+	ZeroMemory(&initData, sizeof(initData));
+	initData.pSysMem = vertices.data();
+	hr = device->CreateBuffer(&bd, &initData, &m_proxyVB);
+
+	bd.ByteWidth = static_cast<UINT>(indices.size() * sizeof(uint32_t));
+	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	initData.pSysMem = indices.data();
+	hr = device->CreateBuffer(&bd, &initData, &m_proxyIB);
+
+	m_proxyIndexCount = SUCCEEDED(hr) ? static_cast<UINT>(indices.size()) : 0;
+}
+
+void VolumeRenderer::ReleaseProxyBuffers()
+{
+	if (m_proxyVB != nullptr) {
+		m_proxyVB->Release();
+		m_proxyVB = nullptr;
+	}
+
+	if (m_proxyIB != nullptr) {
+		m_proxyIB->Release();
+		m_proxyIB = nullptr;
+	}
+
+	m_proxyIndexCount = 0;
 }
 
 //---------------------------------------------------------------//
@@ -331,48 +646,358 @@ void VolumeRenderer::CreateSampler(ID3D11Device * const device)
 	hr = device->CreateSamplerState(&sampDesc, &m_samplerLinear);
 }
 
+void VolumeRenderer::SetCountStepsSaved(const bool enable)
+{
+	// the staging copies are stale, read back only once refilled
+	m_countStepsSaved = enable;
+	m_frameIndex = 0;
+	m_stepsSaved = 0;
+}
+
+//---------------------------------------------------------------//
+// Copy this frame's steps saved counter to staging and read the
+// oldest copy, skipping it if the GPU hasn't got there yet
+//---------------------------------------------------------------//
+void VolumeRenderer::ReadStepsSaved(ID3D11DeviceContext* const deviceContext)
+{
+	const UINT latency = RayCastMaterial::kStepsSavedLatency;
+	deviceContext->CopyResource(m_volumeRaycastShader->m_StepsSavedStaging[m_frameIndex % latency], m_volumeRaycastShader->m_StepsSavedBuffer);
+	++m_frameIndex;
+
+	if (m_frameIndex < latency)
+	{
+		return;
+	}
+
+	ID3D11Buffer* staging = m_volumeRaycastShader->m_StepsSavedStaging[m_frameIndex % latency];
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (SUCCEEDED(deviceContext->Map(staging, 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped)))
+	{
+		m_stepsSaved = *static_cast<const UINT*>(mapped.pData);
+		deviceContext->Unmap(staging, 0);
+	}
+}
+
 //---------------------------------------------------------------//
-// Load RAW texture files 
+// Timestamp queries for the profiler, left out (and the passes
+// untimed) if the device can't make them
 //---------------------------------------------------------------//
-void VolumeRenderer::LoadVolume(ID3D11Device * const device, const LPCWSTR file)
+void VolumeRenderer::CreateGpuTimers(ID3D11Device* const device)
+{
+	D3D11_QUERY_DESC disjointDesc = { D3D11_QUERY_TIMESTAMP_DISJOINT, 0 };
+	D3D11_QUERY_DESC timestampDesc = { D3D11_QUERY_TIMESTAMP, 0 };
+	for (GpuTimer& timer : m_gpuTimers)
+	{
+		if (FAILED(device->CreateQuery(&disjointDesc, &timer.disjoint)) ||
+			FAILED(device->CreateQuery(&timestampDesc, &timer.begin)) ||
+			FAILED(device->CreateQuery(&timestampDesc, &timer.entryExit)) ||
+			FAILED(device->CreateQuery(&timestampDesc, &timer.end)))
+		{
+			ReleaseGpuTimers();
+			return;
+		}
+	}
+}
+
+void VolumeRenderer::ReleaseGpuTimers()
+{
+	for (GpuTimer& timer : m_gpuTimers)
+	{
+		ID3D11Query* queries[4] = { timer.disjoint, timer.begin, timer.entryExit, timer.end };
+		for (ID3D11Query* query : queries)
+		{
+			if (query != nullptr) {
+				query->Release();
+			}
+		}
+		timer = GpuTimer();
+	}
+}
+
+//---------------------------------------------------------------//
+// Record the oldest frame's pass timings, like the steps saved
+// they're dropped if the GPU hasn't finished it yet
+//---------------------------------------------------------------//
+void VolumeRenderer::ReadGpuTimers(ID3D11DeviceContext* const deviceContext)
+{
+	GpuTimer& timer = m_gpuTimers[m_timerIndex % kGpuTimerLatency];
+	if (!timer.issued)
+	{
+		return;
+	}
+	timer.issued = false;
+
+	D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+	UINT64 begin, entryExit, end;
+	const UINT flags = D3D11_ASYNC_GETDATA_DONOTFLUSH;
+	if (deviceContext->GetData(timer.disjoint, &disjoint, sizeof(disjoint), flags) != S_OK || disjoint.Disjoint ||
+		deviceContext->GetData(timer.begin, &begin, sizeof(begin), flags) != S_OK ||
+		deviceContext->GetData(timer.entryExit, &entryExit, sizeof(entryExit), flags) != S_OK ||
+		deviceContext->GetData(timer.end, &end, sizeof(end), flags) != S_OK)
+	{
+		return;
+	}
+
+	const double nsPerTick = 1.0e9 / disjoint.Frequency;
+	Profiler::Instance()->Record(ProfileStage::EntryExit, timer.frame, static_cast<uint64_t>((entryExit - begin) * nsPerTick));
+	Profiler::Instance()->Record(ProfileStage::RayCast, timer.frame, static_cast<uint64_t>((end - entryExit) * nsPerTick));
+}
+
+//---------------------------------------------------------------//
+// Queue a RAW volume for loading unless it's already the one
+// being shown or loaded
+//---------------------------------------------------------------//
+void VolumeRenderer::RequestVolume(const char* const file)
+{
+	if (m_requestedFile == file)
+	{
+		return;
+	}
+
+	m_requestedFile = file;
+	m_loader.Request(file, g_sampleVolumeDesc);
+}
+
+//---------------------------------------------------------------//
+// Upload finished loads. Only the most recent request is shown,
+// anything it overtook is dropped.
+//---------------------------------------------------------------//
+void VolumeRenderer::SwapLoadedVolume(ID3D11Device* const device)
+{
+	VolumeLoader::Result result;
+	while (m_loader.Poll(result))
+	{
+		if (result.file != m_requestedFile)
+		{
+			continue;
+		}
+
+		if (!result.volume)
+		{
+			// keep showing the current volume, and let it be asked for again
+			m_requestedFile = m_volumeFile;
+			MessageBoxA(NULL, result.error.c_str(), "Error", MB_ICONERROR | MB_OK);
+			continue;
+		}
+
+		UploadVolume(device, result.volume);
+		m_volumeFile = result.file;
+		m_loadLatencyMs = std::chrono::duration<double, std::milli>(VolumeLoader::Clock::now() - result.requested).count();
+	}
+}
+
+//---------------------------------------------------------------//
+// Create the volume textures, straight from the file mapping
+//---------------------------------------------------------------//
+void VolumeRenderer::UploadVolume(ID3D11Device * const device, const std::shared_ptr<Volume>& volume)
 {
 	HRESULT hr;
-	HANDLE hFile = CreateFileW(file, GENERIC_READ, 0, NULL, OPEN_EXISTING, OPEN_EXISTING, NULL);
-	if (hFile == INVALID_HANDLE_VALUE) {
-		MessageBox(NULL, L"Opening volume data file failed.", L"Error", MB_ICONERROR | MB_OK);
+	const VolumeDesc& desc = volume->GetDesc();
+
+	// the old textures go with the old volume
+	ReleaseVolumeTextures();
+	m_volume = volume;
+
+	// stretch the proxy cube to the volume's physical proportions
+	m_camera.SetScale(m_volume->GetExtent());
 
+	D3D11_TEXTURE3D_DESC descTex;
+	ZeroMemory(&descTex, sizeof(descTex));
+	descTex.Height = desc.height;
+	descTex.Width = desc.width;
+	descTex.Depth = desc.depth;
+	descTex.MipLevels = m_volume->GetMipCount();
+	descTex.Format = GetTextureFormat(desc.type, m_textureRange);
+	descTex.Usage = D3D11_USAGE_DEFAULT;
+	descTex.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_SHADER_RESOURCE;
+	descTex.CPUAccessFlags = 0;
+	// Initial data, one per level of the mip chain the loader has built
+	std::vector<D3D11_SUBRESOURCE_DATA> initData(descTex.MipLevels);
+	const UINT voxelSize = static_cast<UINT>(GetVoxelSize(desc.type));
+	for (UINT level = 0; level < descTex.MipLevels; ++level)
+	{
+		const Volume& mip = m_volume->GetMip(level);
+		initData[level].pSysMem = mip.GetData();
+		initData[level].SysMemPitch = mip.GetWidth() * voxelSize;
+		initData[level].SysMemSlicePitch = mip.GetWidth() * mip.GetHeight() * voxelSize;
+	}
+	// Create texture
+	hr = (device->CreateTexture3D(&descTex, initData.data(), &m_volumeTex3D));
+
+	// Create a resource view of the texture
+	hr = (device->CreateShaderResourceView(m_volumeTex3D, NULL, &m_volRSV));
+
+	// UpdateLevelOfDetail picks the level and uploads its occupancy; the window
+	// spans the bulk of the voxels where the loader gathered their statistics
+	m_window = volume->GetStats().IsValid() ? volume->GetStats().GetAutoWindow() : VoxelWindow::GetDefault(desc.type);
+	m_lod = -1;
+}
+
+void VolumeRenderer::SetWindow(const VoxelWindow& window)
+{
+	// the occupancy depends on the window, have the next Update classify again
+	m_window = window;
+	m_lod = -1;
+}
+
+void VolumeRenderer::SetClassification(const Classification classification)
+{
+	// the occupancy depends on the classification, as for the window
+	m_classification = classification;
+	m_lod = -1;
+}
+
+void VolumeRenderer::SetTransferFunction(const TransferFunction& function)
+{
+	m_transfer = function;
+	if (m_classification != Classification::Identity)
+	{
+		m_lod = -1;
+	}
+}
+
+void VolumeRenderer::ReleaseVolumeTextures()
+{
+	if (m_volumeTex3D != nullptr) {
+		m_volumeTex3D->Release();
+		m_volumeTex3D = nullptr;
+	}
+
+	if (m_volRSV != nullptr) {
+		m_volRSV->Release();
+		m_volRSV = nullptr;
+	}
+
+	if (m_occupancyTex3D != nullptr) {
+		m_occupancyTex3D->Release();
+		m_occupancyTex3D = nullptr;
 	}
-	BYTE *buffer = (BYTE *)malloc(g_iVolumeSize*g_iVolumeSize*g_iVolumeSize * sizeof(BYTE));
 
-	DWORD numberOfBytesRead = 0;
-	if (ReadFile(hFile, buffer, g_iVolumeSize*g_iVolumeSize*g_iVolumeSize, &numberOfBytesRead, NULL) == 0)
+	if (m_occupancyRSV != nullptr) {
+		m_occupancyRSV->Release();
+		m_occupancyRSV = nullptr;
+	}
+}
+
+//---------------------------------------------------------------//
+// Pick the mip level whose voxels cover about a pixel where the
+// volume is closest, and switch the occupancy over when it changes
+//---------------------------------------------------------------//
+void VolumeRenderer::UpdateLevelOfDetail(ID3D11Device* const device)
+{
+	if (!m_volume->IsLoaded())
+	{
+		return;
+	}
+
+	float footprint = m_camera.GetVoxelFootprint(m_volume->GetWidth(), m_volume->GetHeight(), m_volume->GetDepth(), m_viewportHeight);
+	int lod = MipChain::SelectLevel(footprint, m_volume->GetMipCount() - 1);
+	if (lod == m_lod)
+	{
+		return;
+	}
+
+	m_lod = lod;
+	CreateOccupancy(device);
+}
+
+//---------------------------------------------------------------//
+// Upload which macrocells of mip level m_lod RayCastPS has to
+// sample, one R8_UINT texel per cell, under the identity on the
+// windowed value or the transfer function's opacity, and the
+// proxy geometry around the occupied ones
+//---------------------------------------------------------------//
+void VolumeRenderer::CreateOccupancy(ID3D11Device* const device)
+{
+	HRESULT hr;
+	if (m_occupancyTex3D != nullptr) {
+		m_occupancyTex3D->Release();
+		m_occupancyTex3D = nullptr;
+	}
+
+	if (m_occupancyRSV != nullptr) {
+		m_occupancyRSV->Release();
+		m_occupancyRSV = nullptr;
+	}
+
+	const MacrocellGrid& grid = m_volume->GetMip(m_lod).GetMacrocells();
+	float opacity[256];
+	if (m_classification != Classification::Identity)
 	{
-		MessageBox(NULL, L"Reading volume data failed.", L"Error", MB_ICONERROR | MB_OK);
+		m_transfer.GetOpacity(opacity);
 	}
+	else
+	{
+		MacrocellGrid::GetIdentityOpacity(opacity);
+	}
+	std::vector<uint8_t> occupancy;
+	grid.Classify(opacity, m_window, occupancy);
 
-	CloseHandle(hFile);
+	// the proxy follows, only the planes next to cells that flipped are meshed again
+	if (m_proxy.Update(m_volume->GetMip(m_lod), occupancy) > 0 || m_proxy.IsEmpty())
+	{
+		CreateProxyBuffers(device);
+	}
 
 	D3D11_TEXTURE3D_DESC descTex;
 	ZeroMemory(&descTex, sizeof(descTex));
-	descTex.Height = g_iVolumeSize;
-	descTex.Width = g_iVolumeSize;
-	descTex.Depth = g_iVolumeSize;
+	descTex.Width = grid.GetCellsX();
+	descTex.Height = grid.GetCellsY();
+	descTex.Depth = grid.GetCellsZ();
 	descTex.MipLevels = 1;
-	descTex.Format = DXGI_FORMAT_R8_UNORM;
+	descTex.Format = DXGI_FORMAT_R8_UINT;
 	descTex.Usage = D3D11_USAGE_DEFAULT;
-	descTex.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_SHADER_RESOURCE;
+	descTex.BindFlags = D3D11_BIND_SHADER_RESOURCE;
 	descTex.CPUAccessFlags = 0;
 	// Initial data
 	D3D11_SUBRESOURCE_DATA initData;
 	ZeroMemory(&initData, sizeof(initData));
-	initData.pSysMem = buffer;
-	initData.SysMemPitch = g_iVolumeSize;
-	initData.SysMemSlicePitch = g_iVolumeSize * g_iVolumeSize;
+	initData.pSysMem = occupancy.data();
+	initData.SysMemPitch = grid.GetCellsX();
+	initData.SysMemSlicePitch = grid.GetCellsX() * grid.GetCellsY();
 	// Create texture
-	hr = (device->CreateTexture3D(&descTex, &initData, &m_volumeTex3D));
+	hr = (device->CreateTexture3D(&descTex, &initData, &m_occupancyTex3D));
 
 	// Create a resource view of the texture
-	hr = (device->CreateShaderResourceView(m_volumeTex3D, NULL, &m_volRSV));
+	hr = (device->CreateShaderResourceView(m_occupancyTex3D, NULL, &m_occupancyRSV));
+}
 
-	free(buffer);
+//---------------------------------------------------------------//
+// Create the transfer function textures, float RGBA so the
+// premultiplied tables are filtered as they are
+//---------------------------------------------------------------//
+void VolumeRenderer::CreateTransferTextures(ID3D11Device* const device)
+{
+	HRESULT hr;
+	D3D11_TEXTURE1D_DESC desc1D;
+	ZeroMemory(&desc1D, sizeof(desc1D));
+	desc1D.Width = TransferTables::kSize;
+	desc1D.MipLevels = 1;
+	desc1D.ArraySize = 1;
+	desc1D.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	desc1D.Usage = D3D11_USAGE_DEFAULT;
+	desc1D.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	hr = device->CreateTexture1D(&desc1D, NULL, &m_transferTex1D);
+	hr = device->CreateShaderResourceView(m_transferTex1D, NULL, &m_transferRSV);
+
+	// columns front value, rows back value
+	D3D11_TEXTURE2D_DESC desc2D;
+	ZeroMemory(&desc2D, sizeof(desc2D));
+	desc2D.Width = TransferTables::kSize;
+	desc2D.Height = TransferTables::kSize;
+	desc2D.MipLevels = 1;
+	desc2D.ArraySize = 1;
+	desc2D.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	desc2D.SampleDesc.Count = 1;
+	desc2D.Usage = D3D11_USAGE_DEFAULT;
+	desc2D.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	hr = device->CreateTexture2D(&desc2D, NULL, &m_preIntegratedTex2D);
+	hr = device->CreateShaderResourceView(m_preIntegratedTex2D, NULL, &m_preIntegratedRSV);
+}
+
+void VolumeRenderer::UploadTransferTables(ID3D11DeviceContext* const deviceContext)
+{
+	const UINT rowPitch = TransferTables::kSize * 4 * sizeof(float);
+	deviceContext->UpdateSubresource(m_transferTex1D, 0, NULL, m_transferTables.GetLookup(), rowPitch, 0);
+	deviceContext->UpdateSubresource(m_preIntegratedTex2D, 0, NULL, m_transferTables.GetPreIntegrated(), rowPitch, 0);
 }
@@ -2,8 +2,23 @@
 #define VOLUMERENDERER_H_
 
 #include <d3d11.h>
+#include <cstdint>
+#include <memory>
+#include <string>
 #include "Model.h"
+#include "ProxyGeometry.h"
 #include "RayCastMaterial.h"
+#include "TransferFunction.h"
+#include "Volume.h"
+#include "VolumeCamera.h"
+#include "VolumeLoader.h"
+
+// how RayCastPS finds where a pixel's ray enters and leaves the volume
+enum class EntryExit
+{
+	Analytic,	// slab test against the occupied cells' bounds from the inverse WVP, no extra passes
+	Rasterized	// the model positions of the proxy's back and front faces drawn to two RGBA32F targets
+};
 
 class VolumeRenderer
 {
@@ -12,6 +27,60 @@ public:
 	void Update(ID3D11Device* const device, const float dt);
 	void Render(ID3D11DeviceContext* const deviceContext, ID3D11RasterizerState* const back, ID3D11RasterizerState* const front, ID3D11RenderTargetView* const rtView);
 	void Shutdown();
+
+	// shared with CpuVolumeRenderer so the headless path can draw the same state
+	const VolumeCamera& GetCamera() const { return m_camera; }
+	const Volume& GetVolume() const { return *m_volume; }
+
+	// background loading, and how long the last dataset switch took from
+	// request to being drawn
+	const VolumeLoader& GetLoader() const { return m_loader; }
+	// recently shown datasets, switching back to one of them doesn't touch the disk
+	const VolumeCache& GetVolumeCache() const { return m_cache; }
+	double GetLoadLatencyMs() const { return m_loadLatencyMs; }
+
+	// mip level RayCastPS samples, picked from the projected voxel size
+	int GetLevelOfDetail() const { return m_lod; }
+
+	// window/level of the drawn volume, reset whenever a new volume is uploaded
+	// to VolumeStats::GetAutoWindow of its voxels, or to the full range of the
+	// voxel type (VoxelWindow::GetDefault) if they have no statistics
+	void SetWindow(const VoxelWindow& window);
+	const VoxelWindow& GetWindow() const { return m_window; }
+
+	// how the windowed value becomes colour and opacity, by default Identity
+	// (RayCastPS's own); T cycles through them
+	void SetClassification(const Classification classification);
+	Classification GetClassification() const { return m_classification; }
+	// what PostClassified/PreIntegrated classify with, soft tissue and bone by default
+	void SetTransferFunction(const TransferFunction& function);
+	const TransferFunction& GetTransferFunction() const { return m_transfer; }
+	// step length with a transfer function, in steps of the sampled mip level;
+	// S cycles through 1, 2 and 4
+	void SetStepScale(const float scale) { m_stepScale = scale; }
+	float GetStepScale() const { return m_stepScale; }
+
+	// Analytic by default; Rasterized draws the proxy geometry's faces first,
+	// the fallback for proxies other than the box (their targets are only
+	// allocated while it's used); E toggles
+	void SetEntryExit(const EntryExit entryExit) { m_entryExit = entryExit; }
+	EntryExit GetEntryExit() const { return m_entryExit; }
+	// hull of the occupied macrocells of the drawn level, the Rasterized
+	// proxy; updated with the occupancy
+	const ProxyGeometry& GetProxy() const { return m_proxy; }
+
+	// ray steps skipped by early termination/exact ray length, from a frame
+	// or two ago (the GPU counter is read back without stalling). Off by
+	// default: every pixel adds to the one counter, so it costs an atomic per
+	// pixel while on; 0 while off.
+	void SetCountStepsSaved(const bool enable);
+	bool GetCountStepsSaved() const { return m_countStepsSaved; }
+	UINT GetStepsSaved() const { return m_stepsSaved; }
+
+	// the GPU time of the entry/exit and ray casting passes goes to the
+	// Profiler as ProfileStage::EntryExit and RayCast, from timestamp queries
+	// read back a few frames later against the frame they timed
+	static const int kGpuTimerLatency = 3;
 	   
 private:
 	struct MatrixBuffer
@@ -19,37 +88,105 @@ private:
 		DirectX::XMMATRIX mWVP;
 	};
 
+	// one frame's timestamps, the passes are between begin, entryExit and end
+	struct GpuTimer
+	{
+		ID3D11Query* disjoint = nullptr;
+		ID3D11Query* begin = nullptr;
+		ID3D11Query* entryExit = nullptr;
+		ID3D11Query* end = nullptr;
+		uint64_t frame = 0;
+		bool issued = false;
+	};
+
 	void CreateRenderTexture(ID3D11Device* const device, const int width, const int height);
+	void ReleaseRenderTexture();
+	void UpdateRenderTexture(ID3D11Device* const device);
+	void CreateProxyBuffers(ID3D11Device* const device);
+	void ReleaseProxyBuffers();
 	void CreateSampler(ID3D11Device* const device);
 	void CreateCube(ID3D11Device* const device);
-	void LoadVolume(ID3D11Device * const device, const LPCWSTR file);
+	void RequestVolume(const char* const file);
+	void SwapLoadedVolume(ID3D11Device* const device);
+	void UploadVolume(ID3D11Device * const device, const std::shared_ptr<Volume>& volume);
+	void ReleaseVolumeTextures();
+	void UpdateLevelOfDetail(ID3D11Device* const device);
+	void CreateOccupancy(ID3D11Device* const device);
+	void CreateTransferTextures(ID3D11Device* const device);
+	void UploadTransferTables(ID3D11DeviceContext* const deviceContext);
+	void ReadStepsSaved(ID3D11DeviceContext* const deviceContext);
+	void CreateGpuTimers(ID3D11Device* const device);
+	void ReleaseGpuTimers();
+	void ReadGpuTimers(ID3D11DeviceContext* const deviceContext);
 
-	// rotation - y-axis (super lazy but I only want to rotate it on this :P)
-	float rot = 1;
-	DirectX::XMFLOAT4 m_Rot;
+	// view/projection and the y-axis rotation (super lazy but I only want to rotate it on this :P)
+	VolumeCamera m_camera;
+	// CPU copy of the loaded voxels, replaced wholesale when a load finishes
+	std::shared_ptr<Volume> m_volume = std::make_shared<Volume>();
+	VolumeCache m_cache;
+	VolumeLoader m_loader;
+	std::string m_volumeFile;		// drawn now
+	std::string m_requestedFile;	// drawn once loaded
+	double m_loadLatencyMs = 0.0;
+	int m_viewportWidth = 0;
+	int m_viewportHeight = 0;
+	// mip level drawn, -1 until picked for a newly uploaded volume
+	int m_lod = 0;
+	VoxelWindow m_window;
+	// raw value the texture format samples as 1 (255 for R8_UNORM)
+	float m_textureRange = 1.f;
+	Classification m_classification = Classification::Identity;
+	TransferFunction m_transfer;
+	// built for the step drawn, re-uploaded whenever they change
+	TransferTables m_transferTables;
+	float m_stepScale = 1.f;
+	EntryExit m_entryExit = EntryExit::Analytic;
 
 	// "materials"
 	Model* m_modelShader;
 	RayCastMaterial* m_volumeRaycastShader;
 
-	//render textures
-	ID3D11Texture2D* m_modelTex2DFront;
-	ID3D11ShaderResourceView* m_modelSRVFront;
-	ID3D11RenderTargetView*	m_modelRTVFront;
-	ID3D11Texture2D* m_modelText2DBack;
-	ID3D11ShaderResourceView* m_modelRSVBack;
-	ID3D11RenderTargetView*	m_ModelRTVBack;
+	//render textures, EntryExit::Rasterized only
+	ID3D11Texture2D* m_modelTex2DFront = nullptr;
+	ID3D11ShaderResourceView* m_modelSRVFront = nullptr;
+	ID3D11RenderTargetView*	m_modelRTVFront = nullptr;
+	ID3D11Texture2D* m_modelText2DBack = nullptr;
+	ID3D11ShaderResourceView* m_modelRSVBack = nullptr;
+	ID3D11RenderTargetView*	m_ModelRTVBack = nullptr;
+	//depth for the proxy's nearest front and farthest back faces
+	ID3D11Texture2D* m_proxyDepthTex2D = nullptr;
+	ID3D11DepthStencilView* m_proxyDSV = nullptr;
+	ID3D11DepthStencilState* m_nearestDepth = nullptr;
+	ID3D11DepthStencilState* m_farthestDepth = nullptr;
 	//sampler 
 	ID3D11SamplerState* m_samplerLinear;
 	//volume texture
-	ID3D11Texture3D* m_volumeTex3D;
-	ID3D11ShaderResourceView* m_volRSV;
+	ID3D11Texture3D* m_volumeTex3D = nullptr;
+	ID3D11ShaderResourceView* m_volRSV = nullptr;
+	//macrocell occupancy texture of mip level m_lod (empty space skipping)
+	ID3D11Texture3D* m_occupancyTex3D = nullptr;
+	ID3D11ShaderResourceView* m_occupancyRSV = nullptr;
+	//transfer function lookup and pre-integrated tables
+	ID3D11Texture1D* m_transferTex1D = nullptr;
+	ID3D11ShaderResourceView* m_transferRSV = nullptr;
+	ID3D11Texture2D* m_preIntegratedTex2D = nullptr;
+	ID3D11ShaderResourceView* m_preIntegratedRSV = nullptr;
 	//vertex and index buffers
 	ID3D11Buffer* m_cubeVB;
 	ID3D11Buffer* m_cubeIB;
+	//tight proxy around the occupied cells
+	ProxyGeometry m_proxy;
+	ID3D11Buffer* m_proxyVB = nullptr;
+	ID3D11Buffer* m_proxyIB = nullptr;
+	UINT m_proxyIndexCount = 0;
 
-	// project matrix for render
-	DirectX::XMFLOAT4X4 viewProj;
+	// steps saved read back
+	bool m_countStepsSaved = false;
+	UINT m_frameIndex = 0;
+	UINT m_stepsSaved = 0;
+	// pass timings, m_timerIndex counts the frames timed
+	GpuTimer m_gpuTimers[kGpuTimerLatency];
+	UINT m_timerIndex = 0;
 };
 
 #endif
\ No newline at end of file
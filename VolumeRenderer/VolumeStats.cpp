@@ -0,0 +1,528 @@
+#include "VolumeStats.h"
+#include "CpuFeatures.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+#include "Volume.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <sys/stat.h>
+
+namespace
+{
+	const char kStatsMagic[4] = { 'V', 'S', 'T', 'S' };
+	const uint32_t kStatsVersion = 1;
+
+	// voxels per ParallelFor item, and per count in 32 bits before it is
+	// added to the band's 64-bit totals
+	const size_t kStatsBlock = size_t(1) << 18;
+	const size_t kFlushVoxels = size_t(1) << 30;
+
+	// the file's hash reads this many blocks, the first and last included
+	const int kHashBlocks = 64;
+	const size_t kHashBlockSize = 4096;
+
+	// Counts of every value of an integer type. 8-bit voxels go round four
+	// tables, as the float bins do, so runs of the same value don't wait on
+	// each other's increments.
+	template <typename T> struct ValueCounter;
+
+	template <> struct ValueCounter<uint8_t>
+	{
+		static const int kValues = 256;
+		static const int kTables = 4;
+
+		static void Count(const uint8_t* data, const size_t count, uint32_t* counts)
+		{
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				++counts[data[i]];
+				++counts[kValues + data[i + 1]];
+				++counts[2 * kValues + data[i + 2]];
+				++counts[3 * kValues + data[i + 3]];
+			}
+			for (; i < count; ++i)
+			{
+				++counts[data[i]];
+			}
+		}
+	};
+
+	template <> struct ValueCounter<uint16_t>
+	{
+		static const int kValues = 65536;
+		static const int kTables = 1;
+
+		static void Count(const uint16_t* data, const size_t count, uint32_t* counts)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				++counts[data[i]];
+			}
+		}
+	};
+
+	template <typename T>
+	void CountValues(const Volume& volume, std::vector<uint64_t>& totals)
+	{
+		typedef ValueCounter<T> Counter;
+		const T* data = volume.GetVoxels<T>();
+		const size_t voxels = volume.GetDesc().GetByteSize() / sizeof(T);
+		const int blocks = static_cast<int>((voxels + kStatsBlock - 1) / kStatsBlock);
+		totals.assign(Counter::kValues, 0);
+		std::mutex mutex;
+
+		ParallelFor(blocks, [&](int begin, int end) {
+			const size_t first = begin * kStatsBlock;
+			const size_t last = std::min(end * kStatsBlock, voxels);
+			std::vector<uint32_t> counts(Counter::kValues * Counter::kTables);
+			std::vector<uint64_t> band(Counter::kValues, 0);
+			for (size_t start = first; start < last; start += kFlushVoxels)
+			{
+				std::fill(counts.begin(), counts.end(), 0);
+				Counter::Count(data + start, std::min(kFlushVoxels, last - start), counts.data());
+				for (int table = 0; table < Counter::kTables; ++table)
+				{
+					for (int v = 0; v < Counter::kValues; ++v)
+					{
+						band[v] += counts[table * Counter::kValues + v];
+					}
+				}
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			for (int v = 0; v < Counter::kValues; ++v)
+			{
+				totals[v] += band[v];
+			}
+		});
+	}
+
+	// Integer types: every value counted, then folded into the fewest
+	// whole-value bins (at most kVolumeStatsBins) covering [min, max]
+	template <typename T>
+	void ComputeIntegerStats(const Volume& volume, VolumeStats& stats)
+	{
+		std::vector<uint64_t> totals;
+		CountValues<T>(volume, totals);
+
+		int lo = -1, hi = -1;
+		double sum = 0.0, sumSquares = 0.0;
+		for (int v = 0; v < static_cast<int>(totals.size()); ++v)
+		{
+			if (totals[v] == 0)
+			{
+				continue;
+			}
+			lo = lo < 0 ? v : lo;
+			hi = v;
+			stats.count += totals[v];
+			sum += static_cast<double>(totals[v]) * v;
+			sumSquares += static_cast<double>(totals[v]) * v * v;
+		}
+		if (stats.count == 0)
+		{
+			return;
+		}
+
+		const int range = hi - lo + 1;
+		const int width = (range + kVolumeStatsBins - 1) / kVolumeStatsBins;
+		stats.min = static_cast<float>(lo);
+		stats.max = static_cast<float>(hi);
+		stats.mean = sum / stats.count;
+		stats.deviation = std::sqrt(std::max(sumSquares / stats.count - stats.mean * stats.mean, 0.0));
+		stats.binStart = static_cast<float>(lo);
+		stats.binWidth = static_cast<float>(width);
+		stats.histogram.assign((range + width - 1) / width, 0);
+		for (int v = lo; v <= hi; ++v)
+		{
+			stats.histogram[(v - lo) / width] += totals[v];
+		}
+	}
+
+	// the scalar float passes, matching the AVX2 ones bin for bin
+	inline bool IsFinite(const float value)
+	{
+		return std::fabs(value) <= std::numeric_limits<float>::max();
+	}
+
+	template <typename T>
+	void GetVoxelRange(const T* data, const size_t count, float& lo, float& hi)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			float value = VoxelTraits<T>::ToFloat(data[i]);
+			if (IsFinite(value))
+			{
+				lo = std::min(lo, value);
+				hi = std::max(hi, value);
+			}
+		}
+	}
+
+	template <typename T>
+	void BinVoxels(const T* data, const size_t count, const float lo, const float scale, const int bins, uint32_t* counts, double& sum, double& sumSquares)
+	{
+		const float last = static_cast<float>(bins - 1);
+		for (size_t i = 0; i < count; ++i)
+		{
+			uint32_t* table = counts + i % kVolumeStatsTables * (bins + 1);
+			float value = VoxelTraits<T>::ToFloat(data[i]);
+			if (!IsFinite(value))
+			{
+				// the extra bin past the last, not counted
+				++table[bins];
+				continue;
+			}
+			float bin = std::min(std::max((value - lo) * scale, 0.f), last);
+			++table[static_cast<int>(bin)];
+			sum += value;
+			sumSquares += static_cast<double>(value) * value;
+		}
+	}
+
+	// Float types: the range first, then kVolumeStatsBins bins across it.
+	// NaNs and infinities are left out of everything.
+	template <typename T>
+	void ComputeFloatStats(const Volume& volume, VolumeStats& stats, const bool vectorized)
+	{
+		const uint8_t* data = volume.GetData();
+		const VoxelType type = volume.GetDesc().type;
+		const size_t voxels = volume.GetDesc().GetByteSize() / sizeof(T);
+		const int blocks = static_cast<int>((voxels + kStatsBlock - 1) / kStatsBlock);
+		const bool avx2 = vectorized && GetCpuFeatures().avx2;
+		std::mutex mutex;
+
+		float lo = std::numeric_limits<float>::infinity();
+		float hi = -std::numeric_limits<float>::infinity();
+		ParallelFor(blocks, [&](int begin, int end) {
+			const size_t first = begin * kStatsBlock;
+			const size_t count = std::min(end * kStatsBlock, voxels) - first;
+			float bandLo = std::numeric_limits<float>::infinity();
+			float bandHi = -std::numeric_limits<float>::infinity();
+			if (avx2)
+			{
+				GetVoxelRangeAVX2(type, data + first * sizeof(T), count, bandLo, bandHi);
+			}
+			else
+			{
+				GetVoxelRange(reinterpret_cast<const T*>(data) + first, count, bandLo, bandHi);
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			lo = std::min(lo, bandLo);
+			hi = std::max(hi, bandHi);
+		});
+		if (!(lo <= hi))
+		{
+			// nothing finite
+			return;
+		}
+
+		// a single value gets a single bin
+		const int bins = hi > lo ? kVolumeStatsBins : 1;
+		const float scale = hi > lo ? bins / (hi - lo) : 0.f;
+		std::vector<uint64_t> totals(bins + 1, 0);
+		double sum = 0.0, sumSquares = 0.0;
+		ParallelFor(blocks, [&](int begin, int end) {
+			const size_t first = begin * kStatsBlock;
+			const size_t last = std::min(end * kStatsBlock, voxels);
+			std::vector<uint32_t> counts((bins + 1) * kVolumeStatsTables);
+			std::vector<uint64_t> band(bins + 1, 0);
+			double bandSum = 0.0, bandSquares = 0.0;
+			for (size_t start = first; start < last; start += kFlushVoxels)
+			{
+				const size_t count = std::min(kFlushVoxels, last - start);
+				std::fill(counts.begin(), counts.end(), 0);
+				if (avx2)
+				{
+					BinVoxelsAVX2(type, data + start * sizeof(T), count, lo, scale, bins, counts.data(), bandSum, bandSquares);
+				}
+				else
+				{
+					BinVoxels(reinterpret_cast<const T*>(data) + start, count, lo, scale, bins, counts.data(), bandSum, bandSquares);
+				}
+				for (size_t bin = 0; bin < counts.size(); ++bin)
+				{
+					band[bin % (bins + 1)] += counts[bin];
+				}
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			for (int bin = 0; bin <= bins; ++bin)
+			{
+				totals[bin] += band[bin];
+			}
+			sum += bandSum;
+			sumSquares += bandSquares;
+		});
+
+		stats.count = voxels - totals[bins];
+		stats.min = lo;
+		stats.max = hi;
+		stats.mean = sum / stats.count;
+		stats.deviation = std::sqrt(std::max(sumSquares / stats.count - stats.mean * stats.mean, 0.0));
+		stats.binStart = lo;
+		stats.binWidth = hi > lo ? (hi - lo) / bins : 1.f;
+		stats.histogram.assign(totals.begin(), totals.end() - 1);
+	}
+
+	// integer counts gain nothing from SIMD, lanes would collide on the counters
+	void ComputeStats(const Volume& volume, VolumeStats& stats, const bool, uint8_t)
+	{
+		ComputeIntegerStats<uint8_t>(volume, stats);
+	}
+
+	void ComputeStats(const Volume& volume, VolumeStats& stats, const bool, uint16_t)
+	{
+		ComputeIntegerStats<uint16_t>(volume, stats);
+	}
+
+	void ComputeStats(const Volume& volume, VolumeStats& stats, const bool vectorized, Half)
+	{
+		ComputeFloatStats<Half>(volume, stats, vectorized);
+	}
+
+	void ComputeStats(const Volume& volume, VolumeStats& stats, const bool vectorized, float)
+	{
+		ComputeFloatStats<float>(volume, stats, vectorized);
+	}
+
+	bool IsIntegerType(const VoxelType type)
+	{
+		return type == VoxelType::UInt8 || type == VoxelType::UInt16;
+	}
+
+	// size and modification time (seconds) of file
+	bool GetFileStamp(const std::string& file, uint64_t& size, int64_t& time)
+	{
+#ifdef _WIN32
+		struct _stat64 status;
+		if (_stat64(file.c_str(), &status) != 0)
+		{
+			return false;
+		}
+#else
+		struct stat status;
+		if (stat(file.c_str(), &status) != 0)
+		{
+			return false;
+		}
+#endif
+		size = static_cast<uint64_t>(status.st_size);
+		time = static_cast<int64_t>(status.st_mtime);
+		return true;
+	}
+
+	// FNV-1a over kHashBlocks blocks spread evenly over the file, so checking
+	// a sidecar reads a few hundred KB however large the volume is
+	bool GetFileHash(const std::string& file, uint64_t& hash)
+	{
+		MappedFile mapped;
+		if (!mapped.Open(file))
+		{
+			return false;
+		}
+		const uint8_t* data = mapped.GetData();
+		const size_t size = mapped.GetSize();
+		const size_t blockSize = std::min(kHashBlockSize, size);
+		hash = 14695981039346656037ull;
+		for (int block = 0; block < kHashBlocks; ++block)
+		{
+			const size_t offset = (size - blockSize) / (kHashBlocks - 1) * block;
+			for (size_t i = 0; i < blockSize; ++i)
+			{
+				hash = (hash ^ data[offset + i]) * 1099511628211ull;
+			}
+		}
+		hash = (hash ^ size) * 1099511628211ull;
+		return true;
+	}
+
+	// the part of the header that says which file and layout it is of
+	bool GetFileKey(const std::string& file, const VolumeDesc& desc, VolumeStatsFileHeader& header)
+	{
+		memcpy(header.magic, kStatsMagic, 4);
+		header.version = kStatsVersion;
+		header.width = desc.width;
+		header.height = desc.height;
+		header.depth = desc.depth;
+		header.voxelType = static_cast<uint32_t>(desc.type);
+		return GetFileStamp(file, header.fileSize, header.fileTime) && GetFileHash(file, header.fileHash);
+	}
+}
+
+float VolumeStats::GetPercentile(const double fraction) const
+{
+	if (!IsValid())
+	{
+		return 0.f;
+	}
+
+	const double target = std::min(std::max(fraction, 0.0), 1.0) * count;
+	double below = 0.0;
+	size_t bin = 0;
+	for (; bin + 1 < histogram.size(); ++bin)
+	{
+		if (histogram[bin] > 0 && below + histogram[bin] >= target)
+		{
+			break;
+		}
+		below += histogram[bin];
+	}
+
+	// spread evenly over the bin, or whole values of it for integer types
+	const double within = histogram[bin] > 0 ? (target - below) / histogram[bin] : 0.0;
+	double value = binStart + (bin + within) * binWidth;
+	if (IsIntegerType(type))
+	{
+		value = std::min(binStart + bin * binWidth + std::floor(within * binWidth), binStart + (bin + 1) * binWidth - 1.0);
+	}
+	return std::min(std::max(static_cast<float>(value), min), max);
+}
+
+double VolumeStats::GetOccupancy(const float threshold) const
+{
+	if (!IsValid())
+	{
+		return 0.0;
+	}
+
+	const double bin = std::floor((threshold - binStart) / binWidth);
+	const size_t first = bin < 0.0 ? 0 : static_cast<size_t>(std::min(bin, static_cast<double>(histogram.size())));
+	uint64_t above = 0;
+	for (size_t i = first; i < histogram.size(); ++i)
+	{
+		above += histogram[i];
+	}
+	return static_cast<double>(above) / count;
+}
+
+double VolumeStats::GetOccupancy() const
+{
+	return IsValid() ? 1.0 - static_cast<double>(histogram[0]) / count : 0.0;
+}
+
+VoxelWindow VolumeStats::GetAutoWindow(const double low, const double high) const
+{
+	const float lo = GetPercentile(low);
+	const float hi = GetPercentile(high);
+	if (!(hi > lo))
+	{
+		return VoxelWindow::GetDefault(type);
+	}
+	return VoxelWindow(0.5f * (lo + hi), hi - lo);
+}
+
+bool ComputeVolumeStats(const Volume& volume, VolumeStats& stats, const bool vectorized)
+{
+	stats = VolumeStats();
+	if (!volume.IsLoaded())
+	{
+		return false;
+	}
+
+	stats.type = volume.GetDesc().type;
+	DispatchVoxelType(stats.type, [&](auto voxel) {
+		ComputeStats(volume, stats, vectorized, voxel);
+	});
+	return true;
+}
+
+std::string GetVolumeStatsFile(const std::string& file)
+{
+	return file + ".stats";
+}
+
+bool ReadVolumeStats(const std::string& file, const VolumeDesc& desc, VolumeStats& stats)
+{
+	FILE* in = fopen(GetVolumeStatsFile(file).c_str(), "rb");
+	if (in == nullptr)
+	{
+		return false;
+	}
+
+	// the file itself is only looked at once there's a sidecar to check
+	VolumeStatsFileHeader header;
+	VolumeStatsFileHeader key = VolumeStatsFileHeader();
+	std::vector<uint64_t> histogram;
+	bool ok = fread(&header, sizeof(header), 1, in) == 1 && GetFileKey(file, desc, key) && memcmp(header.magic, key.magic, 4) == 0 &&
+		header.version == key.version && header.fileSize == key.fileSize && header.fileTime == key.fileTime && header.fileHash == key.fileHash &&
+		header.width == key.width && header.height == key.height && header.depth == key.depth && header.voxelType == key.voxelType &&
+		header.count > 0 && header.bins > 0 && header.bins <= static_cast<uint32_t>(kVolumeStatsBins);
+	if (ok)
+	{
+		histogram.resize(header.bins);
+		ok = fread(histogram.data(), sizeof(uint64_t), header.bins, in) == header.bins;
+	}
+	fclose(in);
+	if (!ok)
+	{
+		return false;
+	}
+
+	stats = VolumeStats();
+	stats.type = desc.type;
+	stats.count = header.count;
+	stats.min = header.min;
+	stats.max = header.max;
+	stats.mean = header.mean;
+	stats.deviation = header.deviation;
+	stats.binStart = header.binStart;
+	stats.binWidth = header.binWidth;
+	stats.histogram.swap(histogram);
+	return true;
+}
+
+bool WriteVolumeStats(const std::string& file, const VolumeDesc& desc, const VolumeStats& stats, std::string& error)
+{
+	VolumeStatsFileHeader header = VolumeStatsFileHeader();
+	if (!stats.IsValid() || !GetFileKey(file, desc, header))
+	{
+		error = "No statistics of " + file + " to write";
+		return false;
+	}
+	header.count = stats.count;
+	header.min = stats.min;
+	header.max = stats.max;
+	header.mean = stats.mean;
+	header.deviation = stats.deviation;
+	header.binStart = stats.binStart;
+	header.binWidth = stats.binWidth;
+	header.bins = static_cast<uint32_t>(stats.histogram.size());
+
+	const std::string statsFile = GetVolumeStatsFile(file);
+	FILE* out = fopen(statsFile.c_str(), "wb");
+	if (out == nullptr)
+	{
+		error = "Can't create " + statsFile;
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+		fwrite(stats.histogram.data(), sizeof(uint64_t), stats.histogram.size(), out) == stats.histogram.size();
+	ok = fclose(out) == 0 && ok;
+	if (!ok)
+	{
+		// a partial sidecar would only be rejected, better none at all
+		remove(statsFile.c_str());
+		error = "Writing " + statsFile + " failed";
+	}
+	return ok;
+}
+
+bool LoadVolumeStats(const std::string& file, const Volume& volume, VolumeStats& stats, bool& cached)
+{
+	cached = ReadVolumeStats(file, volume.GetDesc(), stats);
+	if (cached)
+	{
+		return true;
+	}
+	if (!ComputeVolumeStats(volume, stats))
+	{
+		return false;
+	}
+	std::string error;
+	WriteVolumeStats(file, volume.GetDesc(), stats, error);
+	return true;
+}
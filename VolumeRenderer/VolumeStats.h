@@ -0,0 +1,121 @@
+/// <summary>
+/// VolumeStats.h
+///
+/// About:
+/// Histogram, range, mean and percentiles of a volume's
+/// voxels, the numbers an automatic window/level or a
+/// default transfer function starts from. Computed in one
+/// parallel pass per band of voxels (two for the float
+/// types, which need their range before they can be binned);
+/// the float types are converted and binned 8 voxels at a
+/// time with AVX2 where the CPU has it. Integer voxels are
+/// counted one count per value, then folded into bins of
+/// whole values, so 8-bit percentiles are exact.
+///
+/// A pass over every voxel costs about as much as loading
+/// them, so the results are kept in a sidecar file next to
+/// the volume (volume.raw.stats). It is keyed by the file's
+/// size, modification time and a hash of blocks sampled
+/// across it, plus the layout it was read with, and a later
+/// load with a matching sidecar skips the pass.
+/// </summary>
+#ifndef VolumeStats_h__
+#define VolumeStats_h__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "VoxelTypes.h"
+
+class Volume;
+struct VolumeDesc;
+
+const int kVolumeStatsBins = 1024;
+const int kVolumeStatsTables = 4;
+
+struct VolumeStats
+{
+	VoxelType type;
+	uint64_t count;			// voxels
+	float min;				// raw values (before any window)
+	float max;
+	double mean;
+	double deviation;		// standard
+	// bin i counts the voxels in [binStart + i * binWidth, binStart + (i + 1) * binWidth),
+	// the last bin includes max; integer types have whole-value bins
+	float binStart;
+	float binWidth;
+	std::vector<uint64_t> histogram;
+
+	VolumeStats() : type(VoxelType::UInt8), count(0), min(0.f), max(0.f), mean(0.0), deviation(0.0), binStart(0.f), binWidth(1.f) {}
+
+	bool IsValid() const { return count > 0 && !histogram.empty(); }
+	// the value below which fraction (0-1) of the voxels lie, interpolated
+	// within its bin for the float types
+	float GetPercentile(const double fraction) const;
+	// fraction of the voxels at or above threshold, to the bin
+	double GetOccupancy(const float threshold) const;
+	// fraction of the voxels outside the lowest bin, i.e. not background
+	double GetOccupancy() const;
+	// the window spanning the low to high percentiles, e.g. for CT the
+	// tissue between the air and the brightest outliers
+	VoxelWindow GetAutoWindow(const double low = 0.01, const double high = 0.99) const;
+};
+
+// Sidecar layout, little endian: header, then bins uint64_t counts
+struct VolumeStatsFileHeader
+{
+	char magic[4];			// "VSTS"
+	uint32_t version;
+	// the file the statistics are of, as it was when they were computed
+	uint64_t fileSize;
+	int64_t fileTime;		// modification time, seconds since 1970
+	uint64_t fileHash;		// of blocks sampled across the file
+	// the layout it was read with
+	int32_t width;
+	int32_t height;
+	int32_t depth;
+	uint32_t voxelType;		// VoxelType
+	// VolumeStats
+	uint64_t count;
+	float min;
+	float max;
+	double mean;
+	double deviation;
+	float binStart;
+	float binWidth;
+	uint32_t bins;
+	uint32_t reserved;
+};
+
+// One pass (two for float types) over every voxel, on every core.
+// vectorized false keeps to the scalar loops, for comparison.
+bool ComputeVolumeStats(const Volume& volume, VolumeStats& stats, const bool vectorized = true);
+
+// file's sidecar, file + ".stats"
+std::string GetVolumeStatsFile(const std::string& file);
+// Reads file's sidecar into stats if it was written for the file as it is
+// now and for the layout desc; false if there's none or it is stale.
+bool ReadVolumeStats(const std::string& file, const VolumeDesc& desc, VolumeStats& stats);
+// Writes stats of file read with layout desc to its sidecar, error says why on failure.
+bool WriteVolumeStats(const std::string& file, const VolumeDesc& desc, const VolumeStats& stats, std::string& error);
+// ReadVolumeStats of volume loaded from file, or ComputeVolumeStats and
+// then WriteVolumeStats when the sidecar is missing or stale. A sidecar
+// that can't be written (e.g. a read-only directory) isn't an error, the
+// pass just runs again next time. cached says which it was.
+bool LoadVolumeStats(const std::string& file, const Volume& volume, VolumeStats& stats, bool& cached);
+
+// The float type passes, compiled with /arch:AVX2 and only called when
+// GetCpuFeatures() reports AVX2. data holds count voxels of type (Float16
+// or Float32). GetVoxelRangeAVX2 widens lo/hi by the finite ones.
+// BinVoxelsAVX2 counts each finite voxel in bin (v - lo) * scale (clamped
+// to [0, bins)) and adds it and its square to sum/sumSquares; NaNs and
+// infinities are counted in bin bins. counts is kVolumeStatsTables tables
+// of bins + 1 entries, voxel i counted in table i % kVolumeStatsTables so
+// runs of the same bin don't wait on each other's increments.
+void GetVoxelRangeAVX2(const VoxelType type, const uint8_t* data, const size_t count, float& lo, float& hi);
+void BinVoxelsAVX2(const VoxelType type, const uint8_t* data, const size_t count, const float lo, const float scale, const int bins,
+	uint32_t* counts, double& sum, double& sumSquares);
+
+#endif // VolumeStats_h__
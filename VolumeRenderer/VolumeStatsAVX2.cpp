@@ -0,0 +1,158 @@
+// AVX2 passes of the float voxel statistics, 8 voxels per iteration.
+// Compiled with /arch:AVX2 and only called when GetCpuFeatures() reports
+// AVX2 (which includes the F16C half conversion).
+#include "VolumeStats.h"
+#include <algorithm>
+#include <cmath>
+#include <immintrin.h>
+#include <limits>
+
+namespace
+{
+	// 8 voxels widened to float, one specialisation per float voxel type
+	template <typename T> struct Load8;
+
+	template <> struct Load8<Half>
+	{
+		static __m256 Load(const Half* data) { return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data))); }
+	};
+
+	template <> struct Load8<float>
+	{
+		static __m256 Load(const float* data) { return _mm256_loadu_ps(data); }
+	};
+
+	// all ones in the lanes that are neither NaN nor infinite
+	inline __m256 IsFinite(const __m256 value)
+	{
+		const __m256 magnitude = _mm256_andnot_ps(_mm256_set1_ps(-0.f), value);
+		return _mm256_cmp_ps(magnitude, _mm256_set1_ps(std::numeric_limits<float>::max()), _CMP_LE_OQ);
+	}
+
+	inline bool IsFinite(const float value)
+	{
+		return std::fabs(value) <= std::numeric_limits<float>::max();
+	}
+
+	template <typename T>
+	void GetRange(const T* data, const size_t count, float& lo, float& hi)
+	{
+		__m256 low = _mm256_set1_ps(lo);
+		__m256 high = _mm256_set1_ps(hi);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			// lanes that aren't finite keep what they had
+			const __m256 value = Load8<T>::Load(data + i);
+			const __m256 finite = IsFinite(value);
+			low = _mm256_min_ps(low, _mm256_blendv_ps(low, value, finite));
+			high = _mm256_max_ps(high, _mm256_blendv_ps(high, value, finite));
+		}
+
+		float lows[8], highs[8];
+		_mm256_storeu_ps(lows, low);
+		_mm256_storeu_ps(highs, high);
+		lo = *std::min_element(lows, lows + 8);
+		hi = *std::max_element(highs, highs + 8);
+		for (; i < count; ++i)
+		{
+			float value = VoxelTraits<T>::ToFloat(data[i]);
+			if (IsFinite(value))
+			{
+				lo = std::min(lo, value);
+				hi = std::max(hi, value);
+			}
+		}
+	}
+
+	template <typename T>
+	void Bin(const T* data, const size_t count, const float lo, const float scale, const int bins, uint32_t* counts, double& sum, double& sumSquares)
+	{
+		const __m256 low = _mm256_set1_ps(lo);
+		const __m256 scales = _mm256_set1_ps(scale);
+		const __m256 last = _mm256_set1_ps(static_cast<float>(bins - 1));
+		const __m256i discard = _mm256_set1_epi32(bins);
+		// lane k counts in table k % kVolumeStatsTables (4)
+		const int table = bins + 1;
+		const __m256i tables = _mm256_setr_epi32(0, table, 2 * table, 3 * table, 0, table, 2 * table, 3 * table);
+		__m256d sums[2] = { _mm256_setzero_pd(), _mm256_setzero_pd() };
+		__m256d squares[2] = { _mm256_setzero_pd(), _mm256_setzero_pd() };
+		alignas(32) int32_t index[8];
+
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m256 value = Load8<T>::Load(data + i);
+			const __m256 finite = IsFinite(value);
+
+			// the same float arithmetic as the scalar pass, so the bins match
+			const __m256 bin = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(value, low), scales), _mm256_setzero_ps()), last);
+			const __m256i bin32 = _mm256_blendv_epi8(discard, _mm256_cvttps_epi32(bin), _mm256_castps_si256(finite));
+			_mm256_store_si256(reinterpret_cast<__m256i*>(index), _mm256_add_epi32(bin32, tables));
+			// scattered increments stay scalar, lanes can hit the same bin
+			++counts[index[0]];
+			++counts[index[1]];
+			++counts[index[2]];
+			++counts[index[3]];
+			++counts[index[4]];
+			++counts[index[5]];
+			++counts[index[6]];
+			++counts[index[7]];
+
+			// summed in double, the lanes that aren't finite as 0
+			const __m256 kept = _mm256_and_ps(value, finite);
+			const __m256d halves[2] = { _mm256_cvtps_pd(_mm256_castps256_ps128(kept)), _mm256_cvtps_pd(_mm256_extractf128_ps(kept, 1)) };
+			for (int h = 0; h < 2; ++h)
+			{
+				sums[h] = _mm256_add_pd(sums[h], halves[h]);
+				squares[h] = _mm256_fmadd_pd(halves[h], halves[h], squares[h]);
+			}
+		}
+
+		double lanes[4];
+		_mm256_storeu_pd(lanes, _mm256_add_pd(sums[0], sums[1]));
+		sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+		_mm256_storeu_pd(lanes, _mm256_add_pd(squares[0], squares[1]));
+		sumSquares += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+
+		const float lastBin = static_cast<float>(bins - 1);
+		for (; i < count; ++i)
+		{
+			uint32_t* tableCounts = counts + i % kVolumeStatsTables * table;
+			float value = VoxelTraits<T>::ToFloat(data[i]);
+			if (!IsFinite(value))
+			{
+				++tableCounts[bins];
+				continue;
+			}
+			++tableCounts[static_cast<int>(std::min(std::max((value - lo) * scale, 0.f), lastBin))];
+			sum += value;
+			sumSquares += static_cast<double>(value) * value;
+		}
+	}
+}
+
+void GetVoxelRangeAVX2(const VoxelType type, const uint8_t* data, const size_t count, float& lo, float& hi)
+{
+	if (type == VoxelType::Float16)
+	{
+		GetRange(reinterpret_cast<const Half*>(data), count, lo, hi);
+	}
+	else
+	{
+		GetRange(reinterpret_cast<const float*>(data), count, lo, hi);
+	}
+}
+
+void BinVoxelsAVX2(const VoxelType type, const uint8_t* data, const size_t count, const float lo, const float scale, const int bins,
+	uint32_t* counts, double& sum, double& sumSquares)
+{
+	if (type == VoxelType::Float16)
+	{
+		Bin(reinterpret_cast<const Half*>(data), count, lo, scale, bins, counts, sum, sumSquares);
+	}
+	else
+	{
+		Bin(reinterpret_cast<const float*>(data), count, lo, scale, bins, counts, sum, sumSquares);
+	}
+}
@@ -0,0 +1,191 @@
+/// <summary>
+/// VoxelTypes.h
+///
+/// About:
+/// The voxel formats a Volume can hold and what the
+/// samplers need to know about each: the C++ type, how a
+/// voxel turns into a float and how mip levels average it.
+/// Kernels are instantiated once per type and picked once
+/// per volume with DispatchVoxelType, so the inner loops
+/// never branch on the format.
+///
+/// VoxelWindow is the window/level mapping applied to the
+/// filtered raw value, the same for every type: voxels in
+/// [level - width/2, level + width/2] map onto [0,1].
+/// </summary>
+#ifndef VoxelTypes_h__
+#define VoxelTypes_h__
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+enum class VoxelType
+{
+	UInt8,
+	UInt16,
+	Float16,
+	Float32
+};
+
+// IEEE 754 binary16, stored as is and only widened to float to be filtered
+struct Half
+{
+	uint16_t bits;
+};
+
+inline float HalfToFloat(const uint16_t bits)
+{
+	const uint32_t sign = static_cast<uint32_t>(bits & 0x8000u) << 16;
+	const uint32_t exponent = (bits >> 10) & 0x1fu;
+	const uint32_t mantissa = bits & 0x3ffu;
+
+	uint32_t result;
+	if (exponent == 0x1f)
+	{
+		// inf/nan
+		result = sign | 0x7f800000u | (mantissa << 13);
+	}
+	else if (exponent != 0)
+	{
+		// rebias 15 -> 127
+		result = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+	else
+	{
+		// zero/subnormal: mantissa * 2^-24, exact in float
+		float value = static_cast<float>(mantissa) * (1.f / 16777216.f);
+		return sign != 0 ? -value : value;
+	}
+
+	float value;
+	memcpy(&value, &result, sizeof(value));
+	return value;
+}
+
+// rounds to nearest even like F16C's vcvtps2ph
+inline uint16_t FloatToHalf(const float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+	const uint32_t magnitude = bits & 0x7fffffffu;
+
+	if (magnitude >= 0x7f800000u)
+	{
+		// inf/nan, nans stay quiet nans
+		return static_cast<uint16_t>(sign | 0x7c00u | (magnitude > 0x7f800000u ? 0x200u : 0u));
+	}
+	if (magnitude >= 0x477ff000u)
+	{
+		// 65520 and up round past the largest half (65504)
+		return static_cast<uint16_t>(sign | 0x7c00u);
+	}
+	if (magnitude < 0x38800000u)
+	{
+		// below 2^-14: subnormal, a multiple of 2^-24
+		float scaled;
+		memcpy(&scaled, &magnitude, sizeof(scaled));
+		return static_cast<uint16_t>(sign | static_cast<uint32_t>(std::nearbyint(scaled * 16777216.f)));
+	}
+
+	// rebias 127 -> 15 and round off the 13 low mantissa bits
+	uint32_t half = (magnitude - 0x38000000u) >> 13;
+	const uint32_t rest = magnitude & 0x1fffu;
+	if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+	{
+		++half;
+	}
+	return static_cast<uint16_t>(sign | half);
+}
+
+// Per type sampling and filtering. Sum is what MipChain accumulates
+// 2^shift weighted voxels in before FromSum divides them back out.
+template <typename T> struct VoxelTraits;
+
+template <> struct VoxelTraits<uint8_t>
+{
+	static const VoxelType kType = VoxelType::UInt8;
+	typedef int Sum;
+	static float ToFloat(const uint8_t v) { return v; }
+	static Sum ToSum(const uint8_t v) { return v; }
+	static uint8_t FromSum(const Sum sum, const int shift) { return static_cast<uint8_t>((sum + (1 << (shift - 1))) >> shift); }
+};
+
+template <> struct VoxelTraits<uint16_t>
+{
+	static const VoxelType kType = VoxelType::UInt16;
+	typedef int Sum;
+	static float ToFloat(const uint16_t v) { return v; }
+	static Sum ToSum(const uint16_t v) { return v; }
+	static uint16_t FromSum(const Sum sum, const int shift) { return static_cast<uint16_t>((sum + (1 << (shift - 1))) >> shift); }
+};
+
+template <> struct VoxelTraits<Half>
+{
+	static const VoxelType kType = VoxelType::Float16;
+	typedef float Sum;
+	static float ToFloat(const Half v) { return HalfToFloat(v.bits); }
+	static Sum ToSum(const Half v) { return HalfToFloat(v.bits); }
+	static Half FromSum(const Sum sum, const int shift) { Half h = { FloatToHalf(std::ldexp(sum, -shift)) }; return h; }
+};
+
+template <> struct VoxelTraits<float>
+{
+	static const VoxelType kType = VoxelType::Float32;
+	typedef float Sum;
+	static float ToFloat(const float v) { return v; }
+	static Sum ToSum(const float v) { return v; }
+	static float FromSum(const Sum sum, const int shift) { return std::ldexp(sum, -shift); }
+};
+
+// Calls f(T()) with T the voxel type of type, e.g.
+// DispatchVoxelType(type, [&](auto voxel) { return Kernel<decltype(voxel)>(...); })
+template <typename Func>
+auto DispatchVoxelType(const VoxelType type, Func&& f) -> decltype(f(uint8_t()))
+{
+	switch (type)
+	{
+	case VoxelType::UInt16:
+		return f(uint16_t());
+	case VoxelType::Float16:
+		return f(Half());
+	case VoxelType::Float32:
+		return f(float());
+	default:
+		return f(uint8_t());
+	}
+}
+
+// Window/level, folded into a scale and bias so the samplers only do
+// clamp(value * scale + bias, 0, 1) on the filtered raw value
+struct VoxelWindow
+{
+	float scale;
+	float bias;
+
+	// the identity, for float voxels already in [0,1]
+	VoxelWindow() : scale(1.f), bias(0.f) {}
+	VoxelWindow(const float level, const float width) : scale(1.f / width), bias(0.5f - level / width) {}
+
+	float Apply(const float value) const { return std::min(std::max(value * scale + bias, 0.f), 1.f); }
+
+	// The whole range of the integer types, [0,1] for the float ones: what a
+	// UNORM/FLOAT texture of the voxels samples to. The 8-bit window is exactly
+	// the 1/255 normalisation.
+	static VoxelWindow GetDefault(const VoxelType type)
+	{
+		switch (type)
+		{
+		case VoxelType::UInt8:
+			return VoxelWindow(127.5f, 255.f);
+		case VoxelType::UInt16:
+			return VoxelWindow(32767.5f, 65535.f);
+		default:
+			return VoxelWindow();
+		}
+	}
+};
+
+#endif // VoxelTypes_h__
@@ -6,17 +6,40 @@
 // Textures and samplers
 Texture3D<float> txVolume : register(t0);
 
+// model positions of the proxy's nearest front and farthest back faces, alpha 0
+// where there's none - EntryExit::Rasterized only
 Texture2D<float4> txPositionFront : register(t1);
 Texture2D<float4> txPositionBack  : register(t2);
 
+// 1 for each macrocell with any visible voxel, see MacrocellGrid
+Texture3D<uint> txOccupancy : register(t3);
+
+// transfer function, see TransferTables: premultiplied RGBA per windowed value,
+// and per (front, back) value pair of a ray segment
+Texture1D<float4> txTransfer : register(t4);
+Texture2D<float4> txPreIntegrated : register(t5);
+
 SamplerState samplerLinear : register(s0);
 
+// Steps saved this frame by early ray termination/exact ray length/empty space skipping (u1, RT is u0),
+// only bound and counted while g_iCountSteps is set
+RWByteAddressBuffer g_stepsSaved : register(u1);
+
 // Constants and constant buffer variables
 static const uint g_iMaxIterations = 128;
 
 // Diagonal of a unit cube has length sqrt(3)
 static const float g_fStepSize = sqrt(3.f)/g_iMaxIterations;
 
+// Early ray termination: stop once the accumulated alpha reaches this
+static const float g_fOpacityThreshold = 0.95f;
+
+// Voxels per macrocell edge - keep in sync with MacrocellGrid::kDefaultCellSize
+static const float g_fCellSize = 16.f;
+
+// Entries of the transfer function tables - keep in sync with TransferFunction::kSize
+static const float g_fTransferSize = 256.f;
+
 // for vertex shader
 cbuffer cbEveryFrame : register(b0)
 {
@@ -29,6 +52,36 @@ cbuffer cbImmutable : register(b0)
 	float2 g_fInvWindowSize;
 }
 
+// for pixel shader, follows the view - see MipChain::SelectLevel
+cbuffer cbLevelOfDetail : register(b1)
+{
+	float g_fLod;			// mip level sampled
+	float g_fStepScale;		// 2^g_fLod, the steps grow with the voxels (and with the transfer function's step scale)
+}
+
+// for pixel shader, window/level of the volume - see VoxelWindow
+cbuffer cbVoxelWindow : register(b2)
+{
+	float g_fWindowScale;	// includes the UNORM normalisation of the texture format
+	float g_fWindowBias;
+}
+
+// for pixel shader, how the windowed value is classified - see Classification
+cbuffer cbTransfer : register(b3)
+{
+	uint g_iClassification;	// 0: identity, 1: post-classified, 2: pre-integrated
+	uint g_iCountSteps;		// 1: add the steps saved to g_stepsSaved
+}
+
+// for pixel shader, where the rays enter and leave the volume - see EntryExit
+cbuffer cbEntryExit : register(b4)
+{
+	matrix mInvWVP;			// clip space to model space
+	float3 g_fBoxMin;		// model space bounds of the occupied macrocells, see ProxyGeometry
+	uint g_iEntryExit;		// 0: analytic, 1: rasterized (txPositionFront/Back)
+	float3 g_fBoxMax;
+}
+
 // Structures
 struct VSInput
 {
@@ -41,6 +94,41 @@ struct PSInput
 };
 
 
+// texture coordinate of the transfer function entry for windowed value(s) s
+float2 TransferCoord(float2 s)
+{
+	return (s * (g_fTransferSize - 1) + 0.5f) / g_fTransferSize;
+}
+
+// Entry and exit of the pixel's ray in texture space, by the slab test against
+// the occupied bounds like ComputeRayEntryExit does against the [-1,1] cube on
+// the CPU. Starts on the near plane when the camera is inside the bounds, false
+// if the ray misses them.
+bool RayEntryExit(float2 tex, out float3 pos_front, out float3 pos_back)
+{
+	// un-project the pixel onto the near and far planes, NDC y points up
+	float2 ndc = float2(tex.x * 2 - 1, 1 - tex.y * 2);
+	float4 n = mul(mInvWVP, float4(ndc, 0, 1));
+	float4 f = mul(mInvWVP, float4(ndc, 1, 1));
+	float3 origin = n.xyz / n.w;
+	float3 dir = f.xyz / f.w - origin;
+
+	// t in [0,1] between the near and far plane, axes the ray is parallel
+	// to are given a tiny direction instead so the slab test stays finite
+	float3 invDir = 1 / (abs(dir) > 1e-8f ? dir : 1e-8f);
+	float3 t0 = (g_fBoxMin - origin) * invDir;
+	float3 t1 = (g_fBoxMax - origin) * invDir;
+	float3 tMin = min(t0, t1);
+	float3 tMax = max(t0, t1);
+	float tNear = max(max(tMin.x, tMin.y), max(tMin.z, 0));
+	float tFar = min(min(tMax.x, tMax.y), min(tMax.z, 1));
+
+	// model position shader: tex = 0.5 * (pos + 1)
+	pos_front = 0.5f * (origin + dir * tNear + 1);
+	pos_back = 0.5f * (origin + dir * tFar + 1);
+	return tNear < tFar;
+}
+
 // Vertex shader
 PSInput RayCastVS(VSInput input)
 {
@@ -60,34 +148,142 @@ float4 RayCastPS(PSInput input) : SV_TARGET
 	float2 tex = input.pos.xy * g_fInvWindowSize;
 
 	// Now read the cube frotn to back - "sample from front to back"	
-	float3 pos_front = txPositionFront.Sample(samplerLinear, tex);
-	float3 pos_back = txPositionBack.Sample(samplerLinear, tex);
+	float3 pos_front, pos_back;
+	if (g_iEntryExit == 0)
+	{
+		// worked out here rather than read from the model position passes
+		if (!RayEntryExit(tex, pos_front, pos_back))
+		{
+			return float4(0, 0, 0, 0);
+		}
+	}
+	else
+	{
+		float4 front = txPositionFront.Sample(samplerLinear, tex);
+		float4 back = txPositionBack.Sample(samplerLinear, tex);
+		if (front.a == 0 && back.a == 0)
+		{
+			return float4(0, 0, 0, 0);
+		}
+
+		// one of them missing is a crack between merged faces, or the front
+		// faces being behind the camera: the bounds stand in for it
+		float3 box_front, box_back;
+		RayEntryExit(tex, box_front, box_back);
+		pos_front = front.a != 0 ? front.xyz : box_front;
+		pos_back = back.a != 0 ? back.xyz : box_back;
+	}
  
 	// Calculate the direction the ray is cast
 	float3 dir = normalize(pos_back - pos_front);
 
+	// Coarser mip levels are marched with proportionally longer steps
+	float stepSize = g_fStepSize * g_fStepScale;
+
+	// Only step as far as the back face - samples past it are outside the volume
+	uint steps = min(g_iMaxIterations, (uint)(length(pos_back - pos_front) / stepSize) + 1);
+
 	// Single step: direction times delta step - g_fStepSize is precaluclated
-	float3 step = g_fStepSize * dir;
+	float3 step = stepSize * dir;
+
+	// Texture space to macrocell space, the occupancy is that of the sampled level
+	float3 volumeSize, cellCount;
+	float levels;
+	txVolume.GetDimensions((uint)g_fLod, volumeSize.x, volumeSize.y, volumeSize.z, levels);
+	txOccupancy.GetDimensions(cellCount.x, cellCount.y, cellCount.z);
+	float3 cellScale = volumeSize / g_fCellSize;
+	float3 cellStep = step * cellScale;
 
-	// The current position - remember we start from the front
-	float3 v = pos_front;
+	// Accumulate result: value and transparency (alpha), or the premultiplied
+	// colour and alpha with a transfer function
+	float4 result = float4(0, 0, 0, 0);
 
-	// Accumulate result: value and transparency (alpha)
-	float2 result = float2(0, 0);
+	// pre-integration: the last sample taken, its value and whether it was in
+	// an occupied macrocell
+	int lastStep = -2;
+	float lastValue = 0;
+	bool lastOccupied = false;
  
 	// iterate for the volume, sampling along the way at equidistant steps 
-	for (uint i = 0; i < g_iMaxIterations; ++i)
+	// until the ray leaves the cube or is (almost) opaque - early ray termination.
+	// Steps that fall in empty macrocells are jumped over.
+	uint i = 0;
+	uint taken = 0;
+	[loop]
+	while (i < steps && result.a < g_fOpacityThreshold)
 	{
+		// The current position - remember we start from the front
+		float3 v = pos_front + i * step;
+
+		float3 c = v * cellScale;
+		int3 cell = clamp((int3)floor(c), 0, (int3)cellCount - 1);
+		bool paired = lastStep == (int)i - 1;
+		bool occupied = txOccupancy.Load(int4(cell, 0)) != 0;
+		// a pre-integrated segment out of an occupied cell can be visible, take the step after it
+		if (!occupied && !(g_iClassification == 2 && paired && lastOccupied))
+		{
+			// jump to the first step past the cell's exit
+			float3 bound = cell + (cellStep > 0 ? 1 : 0);
+			float3 t = cellStep != 0 ? (bound - c) / cellStep : g_iMaxIterations;
+			float tExit = clamp(min(min(t.x, t.y), t.z), 0, g_iMaxIterations);
+			uint skip = (uint)floor(tExit) + 1;
+			if (g_iClassification == 2)
+			{
+				// or a step short of it when landing in an occupied cell, so the
+				// segment into that has its front sample
+				int3 land = clamp((int3)floor((pos_front + (i + skip) * step) * cellScale), 0, (int3)cellCount - 1);
+				skip -= txOccupancy.Load(int4(land, 0)) != 0 ? 1 : 0;
+			}
+			if (skip > 0)
+			{
+				i += skip;
+				continue;
+			}
+		}
+
 		// sample the texture accumlating the result as we step through the texture
-		float2 src = txVolume.Sample(samplerLinear, v).rr;
-		//src.y *= .5f;
+		// (explicit LOD, gradients aren't available in a loop with a varying exit)
+		float src = saturate(txVolume.SampleLevel(samplerLinear, v, g_fLod) * g_fWindowScale + g_fWindowBias);
 
-		// Front to back blending
-		result += (1 - result.y)*src.y * src;
+		if (g_iClassification == 0)
+		{
+			// Front to back blending, the opacity src * src corrected for the step
+			// length: one step stands in for g_fStepScale full resolution ones
+			result += (1 - result.a) * (1 - pow(1 - src * src, g_fStepScale));
+		}
+		else
+		{
+			// the tables are already corrected for the step, pre-integration
+			// looks up the segment from the previous sample if it was taken
+			float4 rgba;
+			if (g_iClassification == 2)
+			{
+				float front = paired ? lastValue : src;
+				rgba = txPreIntegrated.SampleLevel(samplerLinear, TransferCoord(float2(front, src)), 0);
+				lastStep = i;
+				lastValue = src;
+				lastOccupied = occupied;
+			}
+			else
+			{
+				rgba = txTransfer.SampleLevel(samplerLinear, TransferCoord(src).x, 0);
+			}
+			result += (1 - result.a) * rgba;
+		}
 
-		// Advance the current position
-		v += step;
+		++i;
+		++taken;
+	}
+
+	if (g_iCountSteps != 0)
+	{
+		g_stepsSaved.InterlockedAdd(0, g_iMaxIterations - taken);
 	}
  
-	return float4(result.r, result.r, result.r, result.y);
+	if (g_iClassification == 0)
+	{
+		return float4(result.r, result.r, result.r, result.a);
+	}
+	// un-premultiplied for the SRC_ALPHA blend
+	return float4(result.rgb / max(result.a, 1e-6f), result.a);
 }
@@ -0,0 +1,131 @@
+/// <summary>
+/// HeadlessMain is the entry point for the GPU-less renderer
+/// used on the render farm. Renders a number of frames with
+/// CpuVolumeRenderer and writes the last one to a TGA.
+///
+/// usage: VolumeRendererHeadless [volume.raw] [width] [height] [frames] [out.tga] [WxHxD[:type][:sx,sy,sz]] [level,width|auto]
+///        VolumeRendererHeadless volume.bvol [width] [height] [frames] [out.tga] [budget MB]
+///
+/// The volume defaults to 256x256x256 8-bit voxels with unit spacing;
+/// packed volumes (.pvol, see VolumeConverter) carry their own layout.
+/// The window defaults to the full range of the voxel type; auto spans
+/// the 1st to 99th percentile of the volume's voxels (VolumeStats).
+/// Bricked volumes (see VolumeConverter) are streamed in within the
+/// budget, 1024 MB by default.
+/// </summary>
+#include "../VolumeRenderer/CpuVolumeRenderer.h"
+#include "../VolumeRenderer/ImageWriter.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+int main(int argc, char* argv[])
+{
+	std::string volumeFile = argc > 1 ? argv[1] : "../VolumeRenderer/foot.raw";
+	int width = argc > 2 ? atoi(argv[2]) : 800;
+	int height = argc > 3 ? atoi(argv[3]) : 600;
+	int frames = argc > 4 ? atoi(argv[4]) : 1;
+	std::string outFile = argc > 5 ? argv[5] : "frame.tga";
+
+	const bool bricked = volumeFile.size() > 5 && volumeFile.compare(volumeFile.size() - 5, 5, ".bvol") == 0;
+	VolumeDesc desc(256, 256, 256);
+	if (!bricked && argc > 6 && !ParseVolumeDesc(argv[6], desc))
+	{
+		fprintf(stderr, "Invalid volume description %s, expected WxHxD[:type][:sx,sy,sz]\n", argv[6]);
+		return 1;
+	}
+	float windowLevel = 0.f, windowWidth = 0.f;
+	const bool autoWindow = !bricked && argc > 7 && std::string(argv[7]) == "auto";
+	if (!bricked && argc > 7 && !autoWindow && (sscanf(argv[7], "%f,%f", &windowLevel, &windowWidth) != 2 || !(windowWidth > 0.f)))
+	{
+		fprintf(stderr, "Invalid window %s, expected level,width or auto\n", argv[7]);
+		return 1;
+	}
+
+	CpuVolumeRenderer renderer;
+	if (!renderer.Initialize(width, height))
+	{
+		fprintf(stderr, "Invalid frame size %dx%d\n", width, height);
+		return 1;
+	}
+
+	BrickedVolume brickedVolume;
+	if (bricked)
+	{
+		if (!brickedVolume.Open(volumeFile))
+		{
+			fprintf(stderr, "%s\n", brickedVolume.GetError().c_str());
+			return 1;
+		}
+		if (argc > 6)
+		{
+			brickedVolume.SetBudget(static_cast<size_t>(atoi(argv[6])) << 20);
+		}
+		renderer.GetCamera().SetScale(brickedVolume.GetExtent());
+	}
+	else if (!renderer.LoadVolume(volumeFile, desc))
+	{
+		fprintf(stderr, "%s\n", renderer.GetLoadError().c_str());
+		return 1;
+	}
+	if (windowWidth > 0.f)
+	{
+		renderer.SetWindow(VoxelWindow(windowLevel, windowWidth));
+	}
+	else if (autoWindow)
+	{
+		const VolumeStats& stats = renderer.GetVolumeStats();
+		const float low = stats.GetPercentile(0.01), high = stats.GetPercentile(0.99);
+		renderer.SetWindow(stats.GetAutoWindow());
+		printf("auto window %g to %g (of %g to %g, mean %.2f, %.1f%% occupied), %s\n", low, high, stats.min, stats.max, stats.mean,
+			100.0 * stats.GetOccupancy(), renderer.IsVolumeStatsCached() ? "from the sidecar" : "computed");
+	}
+
+	// fixed time step so runs are repeatable
+	const float dt = 1.f / 60.f;
+	double totalMs = 0.0;
+	uint64_t samples = 0;
+	uint64_t saved = 0;
+	uint64_t bytesRead = 0;
+	for (int i = 0; i < frames; ++i)
+	{
+		renderer.Update(dt);
+		if (bricked)
+		{
+			renderer.Render(renderer.GetCamera(), brickedVolume);
+			bytesRead += brickedVolume.GetFrameStats().bytesRead;
+		}
+		else
+		{
+			renderer.Render();
+		}
+		totalMs += renderer.GetFrameStats().renderMs;
+		samples += renderer.GetFrameStats().samples;
+		saved += renderer.GetFrameStats().samplesSaved;
+	}
+
+	if (frames > 0)
+	{
+		printf("%d frame(s) at %dx%d, %.2f ms/frame, %s kernel, mip level %d\n", frames, width, height, totalMs / frames,
+			GetRayCastPathName(renderer.GetFrameStats().path), renderer.GetFrameStats().lod);
+		printf("%llu samples/frame, %llu steps saved/frame\n", static_cast<unsigned long long>(samples / frames),
+			static_cast<unsigned long long>(saved / frames));
+		if (bricked)
+		{
+			const BrickedVolume::FrameStats& stats = brickedVolume.GetFrameStats();
+			printf("%d of %d bricks in view, %d resident (%.1f MB), %d missing; %.1f MB read in total\n", stats.touched,
+				brickedVolume.GetBrickCount(), stats.resident, brickedVolume.GetMemoryUsage() / (1024.0 * 1024.0), stats.missing,
+				bytesRead / (1024.0 * 1024.0));
+		}
+	}
+
+	if (!WriteTGA(outFile, renderer.GetFrame(), renderer.GetWidth(), renderer.GetHeight()))
+	{
+		fprintf(stderr, "Writing %s failed\n", outFile.c_str());
+		renderer.Shutdown();
+		return 1;
+	}
+
+	renderer.Shutdown();
+	return 0;
+}
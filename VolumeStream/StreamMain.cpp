@@ -0,0 +1,343 @@
+/// <summary>
+/// StreamMain is the entry point for the frame streaming server, for
+/// viewing renders from thin clients. Renders with CpuVolumeRenderer,
+/// encodes every frame with FrameEncoder (changed tiles only, XORed and
+/// compressed) and serves the packets over a local socket to a viewer
+/// that decodes them and acknowledges each one. Reports the encode time,
+/// bytes per frame and end-to-end latency, from the frame being rendered
+/// to the viewer having it, while the volume turns and while it stands
+/// still.
+///
+/// usage: VolumeStream volume.raw [--frames n] [--size WxH] [--tile n]
+///            [--port p] [--full] [--external] [--out last.tga]
+///        VolumeStream --viewer [--port p] [--out last.tga]
+///
+/// The server starts a viewer on a thread of its own, talking to it
+/// through the socket all the same, unless --external says one will be
+/// started separately with --viewer. --full sends every tile as it is
+/// every frame, to compare with. --frames is per phase (60 by default).
+/// Frames go out one at a time, each once the last was acknowledged.
+/// </summary>
+#include "../VolumeRenderer/CpuVolumeRenderer.h"
+#include "../VolumeRenderer/FrameStream.h"
+#include "../VolumeRenderer/ImageWriter.h"
+#include "../VolumeRenderer/Profiler.h"
+#include "../VolumeRenderer/Transport.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	const float kTurn = 0.02f;
+
+	// what the viewer answers every frame with
+	struct FrameAck
+	{
+		uint32_t frame;
+		uint32_t ok;
+		double decodeMs;
+	};
+
+	struct Options
+	{
+		std::string file;
+		bool viewer;
+		int frames;
+		int width;
+		int height;
+		int tileSize;
+		int port;
+		bool full;
+		bool external;
+		std::string out;
+	};
+
+	// a phase of frames, averaged
+	struct PhaseStats
+	{
+		double renderMs;
+		double encodeMs;
+		double decodeMs;
+		double latencyMs;
+		double maxLatencyMs;
+		double changedTiles;
+		double packetBytes;
+		double rawBytes;
+	};
+
+	bool ParseSize(const std::string& text, int& width, int& height)
+	{
+		size_t x = text.find('x');
+		if (x == std::string::npos)
+		{
+			return false;
+		}
+		width = atoi(text.substr(0, x).c_str());
+		height = atoi(text.substr(x + 1).c_str());
+		return width > 0 && height > 0 && width < 65536 && height < 65536;
+	}
+
+	bool ParseOptions(int argc, char* argv[], Options& options)
+	{
+		options.viewer = std::string(argv[1]) == "--viewer";
+		options.file = options.viewer ? "" : argv[1];
+		options.frames = 60;
+		options.width = 800;
+		options.height = 600;
+		options.tileSize = kDefaultStreamTileSize;
+		options.port = 47400;
+		options.full = false;
+		options.external = false;
+
+		for (int i = 2; i < argc; ++i)
+		{
+			std::string arg = argv[i];
+			bool valid = true;
+			if (arg == "--full")
+			{
+				options.full = true;
+				continue;
+			}
+			else if (arg == "--external")
+			{
+				options.external = true;
+				continue;
+			}
+			if (i + 1 >= argc)
+			{
+				fprintf(stderr, "Missing value for %s\n", arg.c_str());
+				return false;
+			}
+			std::string value = argv[++i];
+			if (arg == "--frames")
+			{
+				options.frames = atoi(value.c_str());
+				valid = options.frames > 0;
+			}
+			else if (arg == "--size")
+			{
+				valid = ParseSize(value, options.width, options.height);
+			}
+			else if (arg == "--tile")
+			{
+				options.tileSize = atoi(value.c_str());
+				valid = options.tileSize > 0 && options.tileSize < 65536;
+			}
+			else if (arg == "--port")
+			{
+				options.port = atoi(value.c_str());
+				valid = options.port > 0 && options.port < 65535;
+			}
+			else if (arg == "--out")
+			{
+				options.out = value;
+			}
+			else
+			{
+				fprintf(stderr, "Unknown option %s\n", arg.c_str());
+				return false;
+			}
+			if (!valid)
+			{
+				fprintf(stderr, "Invalid %s %s\n", arg.c_str(), value.c_str());
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Packets are sent as their size, then the packet. Acknowledges every frame
+	// until the end of the stream, writes the last one to out if given.
+	bool RunViewer(const int port, const std::string& out)
+	{
+		SocketTransport transport;
+		if (!transport.Connect(1, 2, port))
+		{
+			fprintf(stderr, "viewer: %s\n", transport.GetError().c_str());
+			return false;
+		}
+
+		FrameDecoder decoder;
+		std::vector<uint8_t> packet;
+		for (;;)
+		{
+			uint32_t size = 0;
+			if (!transport.Receive(0, &size, sizeof(size)))
+			{
+				fprintf(stderr, "viewer: %s\n", transport.GetError().c_str());
+				return false;
+			}
+			packet.resize(size);
+			if (!transport.Receive(0, packet.data(), size))
+			{
+				fprintf(stderr, "viewer: %s\n", transport.GetError().c_str());
+				return false;
+			}
+
+			const uint64_t start = GetClockNs();
+			FrameAck ack = FrameAck();
+			ack.ok = decoder.Decode(packet.data(), packet.size()) ? 1 : 0;
+			ack.decodeMs = NsToMs(GetClockNs() - start);
+			ack.frame = decoder.GetFrameNumber();
+			if (!ack.ok)
+			{
+				fprintf(stderr, "viewer: %s\n", decoder.GetError().c_str());
+			}
+			if (decoder.IsEnd())
+			{
+				break;
+			}
+			if (!transport.Send(0, &ack, sizeof(ack)))
+			{
+				fprintf(stderr, "viewer: %s\n", transport.GetError().c_str());
+				return false;
+			}
+		}
+
+		if (!out.empty() && decoder.GetWidth() > 0 && !WriteTGA(out, decoder.GetFrame(), decoder.GetWidth(), decoder.GetHeight()))
+		{
+			fprintf(stderr, "viewer: can't write %s\n", out.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	bool SendPacket(Transport& transport, const std::vector<uint8_t>& packet)
+	{
+		uint32_t size = static_cast<uint32_t>(packet.size());
+		return transport.Send(1, &size, sizeof(size)) && transport.Send(1, packet.data(), packet.size());
+	}
+
+	// renders, encodes and sends options.frames frames, turning the camera
+	// turn per frame, and waits for each to be acknowledged
+	bool RunPhase(const Options& options, CpuVolumeRenderer& renderer, FrameEncoder& encoder, Transport& transport, const float turn, PhaseStats& stats)
+	{
+		stats = PhaseStats();
+		std::vector<uint8_t> packet;
+		for (int i = 0; i < options.frames; ++i)
+		{
+			renderer.GetCamera().SetRotation(renderer.GetCamera().GetRotation() + turn);
+			renderer.Render();
+
+			// latency counts from here, the frame is ready
+			const uint64_t ready = GetClockNs();
+			encoder.Encode(renderer.GetFrame(), renderer.GetWidth(), renderer.GetHeight(), packet);
+			FrameAck ack;
+			if (!SendPacket(transport, packet) || !transport.Receive(1, &ack, sizeof(ack)))
+			{
+				fprintf(stderr, "%s\n", transport.GetError().c_str());
+				return false;
+			}
+			const double latencyMs = NsToMs(GetClockNs() - ready);
+			if (!ack.ok)
+			{
+				fprintf(stderr, "The viewer couldn't decode frame %u\n", ack.frame);
+				return false;
+			}
+
+			const FrameEncoder::Stats& encoded = encoder.GetStats();
+			stats.renderMs += renderer.GetFrameStats().renderMs / options.frames;
+			stats.encodeMs += encoded.encodeMs / options.frames;
+			stats.decodeMs += ack.decodeMs / options.frames;
+			stats.latencyMs += latencyMs / options.frames;
+			stats.maxLatencyMs = std::max(stats.maxLatencyMs, latencyMs);
+			stats.changedTiles += static_cast<double>(encoded.changedTiles) / encoded.tiles / options.frames;
+			stats.packetBytes += static_cast<double>(encoded.packetBytes) / options.frames;
+			stats.rawBytes += static_cast<double>(encoded.rawBytes) / options.frames;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		printf("usage: VolumeStream volume.raw [--frames n] [--size WxH] [--tile n] [--port p] [--full] [--external] [--out last.tga]\n"
+			"       VolumeStream --viewer [--port p] [--out last.tga]\n");
+		return 1;
+	}
+
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		return 1;
+	}
+	if (options.viewer)
+	{
+		return RunViewer(options.port, options.out) ? 0 : 1;
+	}
+
+	CpuVolumeRenderer renderer;
+	if (!renderer.Initialize(options.width, options.height))
+	{
+		fprintf(stderr, "Invalid frame size\n");
+		return 1;
+	}
+	if (!renderer.LoadVolume(options.file))
+	{
+		fprintf(stderr, "%s\n", renderer.GetLoadError().c_str());
+		return 1;
+	}
+
+	// the viewer connects to the server's port, whichever starts first
+	std::thread viewer;
+	bool viewerOk = true;
+	if (!options.external)
+	{
+		viewer = std::thread([&]() { viewerOk = RunViewer(options.port, options.out); });
+	}
+	SocketTransport transport;
+	if (!transport.Connect(0, 2, options.port, options.external ? 60000 : 10000))
+	{
+		fprintf(stderr, "%s\n", transport.GetError().c_str());
+		if (viewer.joinable())
+		{
+			viewer.join();
+		}
+		return 1;
+	}
+
+	FrameEncoder encoder;
+	encoder.SetTileSize(options.tileSize);
+	encoder.SetDelta(!options.full);
+
+	printf("%s, %dx%d, tiles of %d, %s, %d frames per phase\n", options.file.c_str(), options.width, options.height, options.tileSize,
+		options.full ? "every tile" : "changed tiles", options.frames);
+	printf("%-10s %10s %10s %10s %10s %10s %10s %12s %10s %10s\n", "phase", "render ms", "encode ms", "decode ms", "latency", "max", "changed",
+		"KB/frame", "ratio", "MB/s@30");
+
+	const struct
+	{
+		const char* name;
+		float turn;
+	} phases[] = { { "turning", kTurn }, { "still", 0.f } };
+	bool ok = true;
+	for (const auto& phase : phases)
+	{
+		PhaseStats stats;
+		if (!RunPhase(options, renderer, encoder, transport, phase.turn, stats))
+		{
+			ok = false;
+			break;
+		}
+		printf("%-10s %10.2f %10.3f %10.3f %10.3f %10.3f %9.1f%% %12.1f %9.1fx %10.2f\n", phase.name, stats.renderMs, stats.encodeMs, stats.decodeMs,
+			stats.latencyMs, stats.maxLatencyMs, 100.0 * stats.changedTiles, stats.packetBytes / 1024.0, stats.rawBytes / stats.packetBytes,
+			stats.packetBytes * 30.0 / (1 << 20));
+	}
+
+	std::vector<uint8_t> end;
+	encoder.EncodeEnd(end);
+	ok = SendPacket(transport, end) && ok;
+	if (viewer.joinable())
+	{
+		viewer.join();
+	}
+	transport.Close();
+	renderer.Shutdown();
+	return ok && viewerOk ? 0 : 1;
+}